@@ -6,6 +6,8 @@
 #include <Python.h>
 #include <seccomp.h>
 #include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
 #include "inc/arch.h"
 #include "inc/seccomplite.h"
 
@@ -18,6 +20,7 @@ static PyMemberDef Arch_members[] = {
 };
 
 static PyMethodDef Arch_methods[] = {
+  { "__reduce__", (PyCFunction)Arch_reduce, METH_NOARGS, "Pickle support" },
   {NULL} /* Sentinel */
 };
 
@@ -45,6 +48,45 @@ PyType_Spec seccomplite_ArchTypeSpec = {
   seccomplite_ArchTypeSlots
 };
 
+/**
+ * All architectures known to this build of libseccomp
+ */
+static const seccomplite_ArchEntry arch_table[] = {
+  { "native", "NATIVE", SCMP_ARCH_NATIVE },
+  { "x86", "X86", SCMP_ARCH_X86 },
+  { "x86_64", "X86_64", SCMP_ARCH_X86_64 },
+  { "x32", "X32", SCMP_ARCH_X32 },
+  { "arm", "ARM", SCMP_ARCH_ARM },
+#ifdef SCMP_ARCH_AARCH64
+  { "aarch64", "AARCH64", SCMP_ARCH_AARCH64 },
+#endif
+#ifdef SCMP_ARCH_MIPS
+  { "mips", "MIPS", SCMP_ARCH_MIPS },
+  { "mips64", "MIPS64", SCMP_ARCH_MIPS64 },
+  { "mips64n32", "MIPS64N32", SCMP_ARCH_MIPS64N32 },
+  { "mipsel", "MIPSEL", SCMP_ARCH_MIPSEL },
+  { "mipsel64", "MIPSEL64", SCMP_ARCH_MIPSEL64 },
+  { "mipsel64n32", "MIPSEL64N32", SCMP_ARCH_MIPSEL64N32 },
+#endif
+#ifdef SCMP_ARCH_PARISC
+  { "parisc", "PARISC", SCMP_ARCH_PARISC },
+  { "parisc64", "PARISC64", SCMP_ARCH_PARISC64 },
+#endif
+#ifdef SCMP_ARCH_PPC
+  { "ppc", "PPC", SCMP_ARCH_PPC },
+  { "ppc64", "PPC64", SCMP_ARCH_PPC64 },
+  { "ppc64le", "PPC64LE", SCMP_ARCH_PPC64LE },
+#endif
+#ifdef SCMP_ARCH_S390
+  { "s390", "S390", SCMP_ARCH_S390 },
+  { "s390x", "S390X", SCMP_ARCH_S390X },
+#endif
+#ifdef SCMP_ARCH_RISCV64
+  { "riscv64", "RISCV64", SCMP_ARCH_RISCV64 },
+#endif
+  { NULL, NULL, 0 } /* Sentinel */
+};
+
 /// Arch type methods
 
 void Arch_dealloc(seccomplite_ArchObject *self) {
@@ -62,132 +104,359 @@ PyObject * Arch_new(PyTypeObject *type, PyObject *args, PyObject *kwds) {
   return (PyObject *) self;
 }
 
-int Arch_init(seccomplite_ArchObject *self, PyObject *args, PyObject *kwds) {
-  static char *kwlist[] = {"arch", NULL};
+/**
+ * Constructor parameters
+ */
+static char *Arch_kwlist[] = {"arch", NULL};
 
-  // We accept a arch name or int
-  PyObject *arch = NULL;
-  if (!PyArg_ParseTupleAndKeywords(args, kwds, "|O", kwlist, &arch)) {
-    return -1;
-  }
-  
+/**
+ * Set the architecture token
+ * @param self Type self reference
+ * @param arch Architecture name or number, NULL for native
+ * @return 0 on success, -1 with exception set
+ */
+static int Arch_setup(seccomplite_ArchObject *self, PyObject *arch) {
   uint32_t arch_token = SCMP_ARCH_NATIVE;
   if (arch) {
     arch_token = PyObject_AsArchToken(arch);
   }
   
-  switch (arch_token) {
-    case SCMP_ARCH_NATIVE:
-      self->_token = seccomp_arch_native();
-      break;
-    case SCMP_ARCH_X86:
-    case SCMP_ARCH_X86_64:
-    case SCMP_ARCH_X32:
-    case SCMP_ARCH_ARM:
-      self->_token = arch_token;
-      break;
-    case UINT32_MAX:
-      self->_token = 0;
-      break;
+  if (arch_token == SCMP_ARCH_NATIVE) {
+    self->_token = seccomp_arch_native();
   }
-  
-  if (self->_token == 0) {
+  else if (arch_token == UINT32_MAX) {
+    self->_token = 0;
     PyErr_SetString(PyExc_AttributeError, "Given architecture is invalid.");
+    return -1;
+  }
+  else {
+    self->_token = arch_token;
   }
 
   return 0;
 }
 
+int Arch_init(seccomplite_ArchObject *self, PyObject *args, PyObject *kwds) {
+  // We accept a arch name or int
+  PyObject *arch = NULL;
+  if (!PyArg_ParseTupleAndKeywords(args, kwds, "|O", Arch_kwlist, &arch)) {
+    return -1;
+  }
+
+  return Arch_setup(self, arch);
+}
+
+PyObject * Arch_vectorcall(PyObject *type, PyObject *const *args, size_t nargsf, PyObject *kwnames) {
+  PyObject *arch = NULL;
+  if (!seccomplite_parse_vector(args, PyVectorcall_NARGS(nargsf), kwnames, "|O:" ARCH_TYPE_NAME, Arch_kwlist, &arch)) {
+    return NULL;
+  }
+
+  PyObject *self = Arch_new((PyTypeObject *) type, NULL, NULL);
+  if (self && Arch_setup((seccomplite_ArchObject *) self, arch) != 0) {
+    Py_CLEAR(self);
+  }
+  return self;
+}
+
 PyObject * Arch_int(seccomplite_ArchObject *self) {
   return Py_BuildValue("I", self->_token);
 }
 
+PyObject * Arch_reduce(seccomplite_ArchObject *self) {
+  return Py_BuildValue("O(I)", Py_TYPE(self), self->_token);
+}
+
 PyTypeObject * Arch_build(void) {
   // Ready the type
   PyObject *type = PyType_FromSpec(&seccomplite_ArchTypeSpec);
   PyTypeObject *result = (PyTypeObject *) type;
 
-  if (PyType_Ready(result) < 0) {
+  if (!type || PyType_Ready(result) < 0) {
+    Py_XDECREF(type);
     return NULL;
   }
 
   // Assign static type properties
-  PyObject_SetAttrString(type, "NATIVE", PyLong_FromLong(SCMP_ARCH_NATIVE));
-  PyObject_SetAttrString(type, "X86", PyLong_FromLong(SCMP_ARCH_X86));
-  PyObject_SetAttrString(type, "X86_64", PyLong_FromLong(SCMP_ARCH_X86_64));
-  PyObject_SetAttrString(type, "X32", PyLong_FromLong(SCMP_ARCH_X32));
-  PyObject_SetAttrString(type, "ARM", PyLong_FromLong(SCMP_ARCH_ARM));
-
-  /*
-  // TODO: Support later
-  PyObject_SetAttrString(type, "AARCH64", PyLong_FromLong(SCMP_ARCH_AARCH64));
-  PyObject_SetAttrString(type, "MIPS", PyLong_FromLong(SCMP_ARCH_MIPS));
-  PyObject_SetAttrString(type, "MIPS64", PyLong_FromLong(SCMP_ARCH_MIPS64));
-  PyObject_SetAttrString(type, "MIPS64N32", PyLong_FromLong(SCMP_ARCH_MIPS64N32));
-  PyObject_SetAttrString(type, "MIPSEL", PyLong_FromLong(SCMP_ARCH_MIPSEL));
-  PyObject_SetAttrString(type, "MIPSEL64", PyLong_FromLong(SCMP_ARCH_MIPSEL64));
-  PyObject_SetAttrString(type, "MIPSEL64N32", PyLong_FromLong(SCMP_ARCH_MIPSEL64N32));
-  PyObject_SetAttrString(type, "PARISC", PyLong_FromLong(SCMP_ARCH_PARISC));
-  PyObject_SetAttrString(type, "PARISC64", PyLong_FromLong(SCMP_ARCH_PARISC64));
-  PyObject_SetAttrString(type, "PPC", PyLong_FromLong(SCMP_ARCH_PPC));
-  PyObject_SetAttrString(type, "PPC64", PyLong_FromLong(SCMP_ARCH_PPC64));
-  PyObject_SetAttrString(type, "PPC64LE", PyLong_FromLong(SCMP_ARCH_PPC64LE));
-  PyObject_SetAttrString(type, "S390", PyLong_FromLong(SCMP_ARCH_S390));
-  PyObject_SetAttrString(type, "S390X", PyLong_FromLong(SCMP_ARCH_S390X));
-   */
+  const seccomplite_ArchEntry *entry = NULL;
+  for (entry = arch_table; entry->name; entry++) {
+    PyObject *token = PyLong_FromUnsignedLong(entry->token);
+    if (!token || PyObject_SetAttrString(type, entry->constant, token) != 0) {
+      Py_XDECREF(token);
+      Py_DECREF(type);
+      return NULL;
+    }
+    Py_DECREF(token);
+  }
 
   return result;
 }
 
+const seccomplite_ArchEntry * seccomplite_arch_by_token(uint32_t token) {
+  const seccomplite_ArchEntry *entry = NULL;
+  for (entry = arch_table; entry->name; entry++) {
+    if (entry->token == token) {
+      return entry;
+    }
+  }
+
+  return NULL;
+}
+
+const seccomplite_ArchEntry * seccomplite_arch_by_name(const char *name) {
+  const seccomplite_ArchEntry *entry = NULL;
+  for (entry = arch_table; entry->name; entry++) {
+    if (strcmp(entry->name, name) == 0) {
+      return entry;
+    }
+  }
+
+  return NULL;
+}
+
+uint32_t seccomplite_arch_kernel_token(uint32_t token) {
+  if (token == SCMP_ARCH_NATIVE) {
+    token = seccomp_arch_native();
+  }
+
+  return token == SCMP_ARCH_X32 ? SCMP_ARCH_X86_64 : token;
+}
+
+/// Syscall number translation
+
+/**
+ * Every ABI numbers its syscalls in at most two windows, the one holding
+ * read and, on arm, the private syscalls around cacheflush.  A window is
+ * aligned to and scanned over TRANSLATE_SPAN numbers, which also covers
+ * the offsets of the mips ABIs and the x32 syscall bit.
+ */
+#define TRANSLATE_SPAN 0x2000
+#define TRANSLATE_WINDOWS 2
+
+/**
+ * Inputs with at least this many numbers are translated without the GIL
+ */
+#define TRANSLATE_NOGIL 4096
+
+typedef struct {
+  int64_t base;
+  uint32_t len;
+  int32_t *map;
+} translate_window;
+
+/**
+ * Dense mapping from one architecture to another, -1 where the target has
+ * no such syscall.  Tables are built on first use and kept for the life
+ * of the process, they are only created and looked up with the GIL held.
+ */
+typedef struct translate_table {
+  uint32_t from;
+  uint32_t to;
+  unsigned int num_windows;
+  translate_window windows[TRANSLATE_WINDOWS];
+  struct translate_table *next;
+} translate_table;
+
+static translate_table *translate_tables = NULL;
+
+static void translate_free(translate_table *table) {
+  unsigned int index = 0;
+  for (index = 0; index < table->num_windows; index++) {
+    free(table->windows[index].map);
+  }
+  free(table);
+}
+
+/**
+ * Scan one window of the source architecture into the table
+ * @return 0 on success, -1 if out of memory
+ */
+static int translate_scan(translate_table *table, int64_t start) {
+  int32_t *map = malloc(TRANSLATE_SPAN * sizeof(int32_t));
+  if (!map) {
+    return -1;
+  }
+
+  int64_t first = -1;
+  int64_t last = -1;
+  int64_t offset = 0;
+  for (offset = 0; offset < TRANSLATE_SPAN; offset++) {
+    map[offset] = -1;
+    char *name = seccomp_syscall_resolve_num_arch(table->from, (int) (start + offset));
+    if (!name) {
+      continue;
+    }
+
+    // Pseudo syscall numbers of libseccomp are negative
+    int nr = seccomp_syscall_resolve_name_arch(table->to, name);
+    free(name);
+    map[offset] = nr >= 0 ? nr : -1;
+    first = first < 0 ? offset : first;
+    last = offset;
+  }
+
+  if (first < 0) {
+    free(map);
+    return 0;
+  }
+
+  // Only the used part of the window is kept
+  translate_window *window = &table->windows[table->num_windows++];
+  window->base = start + first;
+  window->len = (uint32_t) (last - first + 1);
+  window->map = malloc(window->len * sizeof(int32_t));
+  if (!window->map) {
+    free(map);
+    return -1;
+  }
+  memcpy(window->map, map + first, window->len * sizeof(int32_t));
+  free(map);
+  return 0;
+}
+
+/**
+ * Find or build the table of an architecture pair
+ * @return The table, NULL with exception set
+ */
+static const translate_table * translate_lookup(uint32_t from, uint32_t to) {
+  translate_table *table = NULL;
+  for (table = translate_tables; table; table = table->next) {
+    if (table->from == from && table->to == to) {
+      return table;
+    }
+  }
+
+  table = calloc(1, sizeof(translate_table));
+  if (!table) {
+    PyErr_NoMemory();
+    return NULL;
+  }
+  table->from = from;
+  table->to = to;
+
+  const char *anchors[TRANSLATE_WINDOWS] = { "read", "cacheflush" };
+  int64_t starts[TRANSLATE_WINDOWS];
+  unsigned int num_starts = 0;
+  unsigned int index = 0;
+  for (index = 0; index < TRANSLATE_WINDOWS; index++) {
+    int nr = seccomp_syscall_resolve_name_arch(from, anchors[index]);
+    int64_t start = nr >= 0 ? (int64_t) nr - nr % TRANSLATE_SPAN : -1;
+    unsigned int seen = 0;
+    while (seen < num_starts && starts[seen] != start) {
+      seen++;
+    }
+    if (start < 0 || seen < num_starts) {
+      continue;
+    }
+
+    starts[num_starts++] = start;
+    if (translate_scan(table, start) != 0) {
+      translate_free(table);
+      PyErr_NoMemory();
+      return NULL;
+    }
+  }
+
+  table->next = translate_tables;
+  translate_tables = table;
+  return table;
+}
+
+static void translate_run(const translate_table *table, const int32_t *numbers, int32_t *result, Py_ssize_t count, int32_t missing) {
+  Py_ssize_t index = 0;
+  for (index = 0; index < count; index++) {
+    int64_t nr = numbers[index];
+    int32_t translated = -1;
+    unsigned int window = 0;
+    for (window = 0; window < table->num_windows; window++) {
+      uint64_t offset = (uint64_t) (nr - table->windows[window].base);
+      if (offset < table->windows[window].len) {
+        translated = table->windows[window].map[offset];
+        break;
+      }
+    }
+    result[index] = translated >= 0 ? translated : missing;
+  }
+}
+
+PyObject * seccomplite_translate_syscalls(PyObject *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames) {
+  PyObject *numbers = NULL;
+  PyObject *from_arch = NULL;
+  PyObject *to_arch = NULL;
+  int missing = -1;
+  static char *kwlist[] = {"numbers", "from_arch", "to_arch", "missing", NULL};
+  if (!seccomplite_parse_vector(args, nargs, kwnames, "OOO|i:translate_syscalls", kwlist, &numbers, &from_arch, &to_arch, &missing)) {
+    return NULL;
+  }
+
+  uint32_t from = PyObject_AsArchToken(from_arch);
+  uint32_t to = PyObject_AsArchToken(to_arch);
+  if (from == UINT32_MAX || to == UINT32_MAX) {
+    PyErr_SetString(PyExc_AttributeError, "Given architecture is invalid.");
+    return NULL;
+  }
+  from = from == SCMP_ARCH_NATIVE ? seccomp_arch_native() : from;
+  to = to == SCMP_ARCH_NATIVE ? seccomp_arch_native() : to;
+
+  Py_buffer view;
+  if (PyObject_GetBuffer(numbers, &view, PyBUF_C_CONTIGUOUS) != 0) {
+    return NULL;
+  }
+  if ((view.itemsize != 1 && view.itemsize != sizeof(int32_t)) || view.len % sizeof(int32_t) != 0) {
+    PyBuffer_Release(&view);
+    PyErr_SetString(PyExc_ValueError, "Numbers must be a buffer of 4 byte items");
+    return NULL;
+  }
+  if ((uintptr_t) view.buf % sizeof(int32_t) != 0) {
+    PyBuffer_Release(&view);
+    PyErr_SetString(PyExc_ValueError, "Numbers buffer is not aligned");
+    return NULL;
+  }
+
+  const translate_table *table = translate_lookup(from, to);
+  PyObject *result = table ? PyBytes_FromStringAndSize(NULL, view.len) : NULL;
+  if (!result) {
+    PyBuffer_Release(&view);
+    return NULL;
+  }
+
+  // The result is not shared yet and the buffer export pins the input
+  Py_ssize_t count = view.len / sizeof(int32_t);
+  int32_t *translated = (int32_t *) PyBytes_AS_STRING(result);
+  if (count >= TRANSLATE_NOGIL) {
+    Py_BEGIN_ALLOW_THREADS
+    translate_run(table, view.buf, translated, count, missing);
+    Py_END_ALLOW_THREADS
+  }
+  else {
+    translate_run(table, view.buf, translated, count, missing);
+  }
+
+  PyBuffer_Release(&view);
+  return result;
+}
+
 uint32_t PyObject_AsArchToken(PyObject *o) {
   // Get the module and type of Arch type
   PyObject *seccomplite = PyState_FindModule(&SeccompLiteModule);
   PyObject *type = PyDict_GetItemString(PyModule_GetDict(seccomplite), ARCH_TYPE_NAME);
   
   // Check if this object is a number
+  const seccomplite_ArchEntry *entry = NULL;
   if (o == NULL || o == Py_None) {
     return SCMP_ARCH_NATIVE;
   }
   else if (PyLong_Check(o)) {
     uint32_t result = 0;
     PyArg_Parse(o, "I", &result);
-    switch (result) {
-      case SCMP_ARCH_NATIVE:
-      case SCMP_ARCH_X86:
-      case SCMP_ARCH_X86_64:
-      case SCMP_ARCH_X32:
-      case SCMP_ARCH_ARM:
-        return result;
-      default:
-        return UINT32_MAX;
-    }
+    entry = seccomplite_arch_by_token(result);
   }
   else if (PyUnicode_Check(o)) {
-    // Extract the string
-    const char *arch_name = PyUnicode_AsString(o);
-    if (strcmp(arch_name, "native") == 0) {
-      return SCMP_ARCH_NATIVE;
-    }
-    else if (strcmp(arch_name, "x86") == 0) {
-      return SCMP_ARCH_X86;
-    }
-    else if (strcmp(arch_name, "x86_64") == 0) {
-      return SCMP_ARCH_X86_64;
-    }
-    else if (strcmp(arch_name, "x32") == 0) {
-      return SCMP_ARCH_X32;
-    }
-    else if (strcmp(arch_name, "arm") == 0) {
-      return SCMP_ARCH_ARM;
-    }
-    else {
-      return UINT32_MAX;
-    }
+    entry = seccomplite_arch_by_name(PyUnicode_AsString(o));
   }
   else if (PyObject_IsInstance(o, type)) {
     return ((seccomplite_ArchObject*)o)->_token;
   }
-  else {
-    return UINT32_MAX;
-  }
+
+  return entry ? entry->token : UINT32_MAX;
 }
\ No newline at end of file
@@ -8,6 +8,7 @@
 #include <stdint.h>
 #include "inc/config.h"
 #include "inc/arg.h"
+#include "inc/placeholder.h"
 #include "inc/seccomplite.h"
 
 /**
@@ -16,12 +17,26 @@
 static PyMemberDef Arg_members[] = {
   {"arg", T_UINT, offsetof(seccomplite_ArgObject, _arg.arg), 0, "Attribute argument"},
   {"op", T_INT, offsetof(seccomplite_ArgObject, _arg.op), 0, "Attribute operation"},
-  {"datum_a", T_ULONGLONG, offsetof(seccomplite_ArgObject, _arg.datum_a), 0, "Attribute first datum"},
-  {"datum_b", T_ULONGLONG, offsetof(seccomplite_ArgObject, _arg.datum_b), 0, "Attribute second datum"},
+  {"placeholder_a", T_OBJECT, offsetof(seccomplite_ArgObject, _placeholder_a), READONLY, "Placeholder name of the first datum"},
+  {"placeholder_b", T_OBJECT, offsetof(seccomplite_ArgObject, _placeholder_b), READONLY, "Placeholder name of the second datum"},
+  { NULL } /* Sentinel */
+};
+
+static PyObject * Arg_get_datum(seccomplite_ArgObject *self, void *closure);
+static int Arg_set_datum(seccomplite_ArgObject *self, PyObject *value, void *closure);
+
+/**
+ * The datums go through a setter, an int replaces the placeholder
+ */
+static PyGetSetDef Arg_getset[] = {
+  {"datum_a", (getter)Arg_get_datum, (setter)Arg_set_datum, "Attribute first datum, an int or a Placeholder", (void *) 0},
+  {"datum_b", (getter)Arg_get_datum, (setter)Arg_set_datum, "Attribute second datum, an int or a Placeholder", (void *) 1},
   { NULL } /* Sentinel */
 };
 
 static PyMethodDef Arg_methods[] = {
+  { "__reduce__", (PyCFunction)Arg_reduce, METH_NOARGS, "Pickle support" },
+  { "flags_subset", (PyCFunction)Arg_flags_subset, METH_FASTCALL | METH_KEYWORDS | METH_CLASS, "Match any combination of the allowed flags \nArguments:\n arg the argument number allowed the mask of allowed flag bits \nDescription:\n Return an Arg which matches if no bit outside of allowed is set in the argument i.e value & ~allowed == 0 This replaces one EQ rule per flag combination with a single MASKED_EQ comparison" },
   {NULL} /* Sentinel */
 };
 
@@ -31,6 +46,7 @@ static PyMethodDef Arg_methods[] = {
 static PyType_Slot seccomplite_ArgTypeSlots[] = {
   { Py_tp_methods, Arg_methods },
   { Py_tp_members, Arg_members },
+  { Py_tp_getset, Arg_getset },
   { Py_tp_init, Arg_init },
   { Py_tp_new, Arg_new },
   { Py_tp_dealloc, Arg_dealloc },
@@ -50,7 +66,72 @@ PyType_Spec seccomplite_ArgTypeSpec = {
 
 /// Arg type methods
 
+/**
+ * Convert a datum argument which is either an int or a Placeholder
+ * @param o Object to convert
+ * @param datum Receives the integer value
+ * @param placeholder Receives the placeholder name (new reference) or NULL
+ * @return 0 on success, -1 with exception set
+ */
+static int Arg_parse_datum(PyObject *o, scmp_datum_t *datum, PyObject **placeholder) {
+  Py_CLEAR(*placeholder);
+  *datum = 0;
+
+  if (o == NULL) {
+    return 0;
+  }
+  else if (PyLong_Check(o)) {
+    *datum = PyLong_AsUnsignedLongLongMask(o);
+    return PyErr_Occurred() ? -1 : 0;
+  }
+  else if (PyObject_IsPlaceholder(o)) {
+    *placeholder = ((seccomplite_PlaceholderObject *) o)->_name;
+    Py_XINCREF(*placeholder);
+    return 0;
+  }
+  else {
+    PyErr_SetString(PyExc_TypeError, "datum must be an int or a " PLACEHOLDER_TYPE_NAME);
+    return -1;
+  }
+}
+
+/**
+ * Datum getter, a placeholder reads as 0 until the filter is instantiated
+ */
+static PyObject * Arg_get_datum(seccomplite_ArgObject *self, void *closure) {
+  return PyLong_FromUnsignedLongLong(closure ? self->_arg.datum_b : self->_arg.datum_a);
+}
+
+/**
+ * Datum setter, takes the same values as the constructor
+ */
+static int Arg_set_datum(seccomplite_ArgObject *self, PyObject *value, void *closure) {
+  if (!value) {
+    PyErr_SetString(PyExc_AttributeError, "Datum can not be deleted");
+    return -1;
+  }
+
+  // Nothing changes if the value is rejected
+  scmp_datum_t datum = 0;
+  PyObject *placeholder = NULL;
+  if (Arg_parse_datum(value, &datum, &placeholder) != 0) {
+    return -1;
+  }
+
+  if (closure) {
+    self->_arg.datum_b = datum;
+    Py_XSETREF(self->_placeholder_b, placeholder);
+  }
+  else {
+    self->_arg.datum_a = datum;
+    Py_XSETREF(self->_placeholder_a, placeholder);
+  }
+  return 0;
+}
+
 void Arg_dealloc(seccomplite_ArgObject *self) {
+  Py_XDECREF(self->_placeholder_a);
+  Py_XDECREF(self->_placeholder_b);
   Py_TYPE(self)->tp_free((PyObject*) self);
 }
 
@@ -65,26 +146,96 @@ PyObject * Arg_new(PyTypeObject *type, PyObject *args, PyObject *kwds) {
   return (PyObject *) self;
 }
 
+/**
+ * Constructor parameters
+ */
+static char *Arg_kwlist[] = {"arg", "op", "datum_a", "datum_b", NULL};
+
 int Arg_init(seccomplite_ArgObject *self, PyObject *args, PyObject *kwds) {
-  static char *kwlist[] = {"arg", "op", "datum_a", "datum_b", NULL};
+  // Both datums may either be an int or a Placeholder
+  PyObject *datum_a = NULL;
+  PyObject *datum_b = NULL;
+  if (!PyArg_ParseTupleAndKeywords(args, kwds, "IiO|O", Arg_kwlist, &self->_arg.arg, &self->_arg.op, &datum_a, &datum_b)) {
+    return -1;
+  }
 
-  // We accept a arch name or int
-  if (!PyArg_ParseTupleAndKeywords(args, kwds, "IiK|K", kwlist, &self->_arg.arg, &self->_arg.op, &self->_arg.datum_a, &self->_arg.datum_b)) {
+  if (Arg_parse_datum(datum_a, &self->_arg.datum_a, &self->_placeholder_a) != 0 ||
+      Arg_parse_datum(datum_b, &self->_arg.datum_b, &self->_placeholder_b) != 0) {
     return -1;
   }
   
   return 0;
 }
 
+PyObject * Arg_vectorcall(PyObject *type, PyObject *const *args, size_t nargsf, PyObject *kwnames) {
+  seccomplite_ArgObject *self = (seccomplite_ArgObject *) Arg_new((PyTypeObject *) type, NULL, NULL);
+  if (!self) {
+    return NULL;
+  }
+
+  PyObject *datum_a = NULL;
+  PyObject *datum_b = NULL;
+  if (!seccomplite_parse_vector(args, PyVectorcall_NARGS(nargsf), kwnames, "IiO|O:" ARG_TYPE_NAME, Arg_kwlist, &self->_arg.arg, &self->_arg.op, &datum_a, &datum_b) ||
+      Arg_parse_datum(datum_a, &self->_arg.datum_a, &self->_placeholder_a) != 0 ||
+      Arg_parse_datum(datum_b, &self->_arg.datum_b, &self->_placeholder_b) != 0) {
+    Py_DECREF(self);
+    return NULL;
+  }
+
+  return (PyObject *) self;
+}
+
+/**
+ * Build the pickled form of a datum
+ * @return New reference to an int or Placeholder
+ */
+static PyObject * Arg_datum_object(scmp_datum_t datum, PyObject *placeholder) {
+  if (!placeholder) {
+    return PyLong_FromUnsignedLongLong(datum);
+  }
+
+  PyObject *seccomplite = PyState_FindModule(&SeccompLiteModule);
+  PyObject *type = PyDict_GetItemString(PyModule_GetDict(seccomplite), PLACEHOLDER_TYPE_NAME);
+  return PyObject_CallFunctionObjArgs(type, placeholder, NULL);
+}
+
+PyObject * Arg_reduce(seccomplite_ArgObject *self) {
+  PyObject *datum_a = Arg_datum_object(self->_arg.datum_a, self->_placeholder_a);
+  PyObject *datum_b = Arg_datum_object(self->_arg.datum_b, self->_placeholder_b);
+  PyObject *result = NULL;
+  if (datum_a && datum_b) {
+    result = Py_BuildValue("O(IiOO)", Py_TYPE(self), self->_arg.arg, self->_arg.op, datum_a, datum_b);
+  }
+
+  Py_XDECREF(datum_a);
+  Py_XDECREF(datum_b);
+  return result;
+}
+
+PyObject * Arg_flags_subset(PyTypeObject *type, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames) {
+  unsigned int arg = 0;
+  unsigned long long allowed = 0;
+  static char *kwlist[] = {"arg", "allowed", NULL};
+  if (!seccomplite_parse_vector(args, nargs, kwnames, "IK:flags_subset", kwlist, &arg, &allowed)) {
+    return NULL;
+  }
+
+  return PyObject_CallFunction((PyObject *) type, "IiKK", arg, (int) SCMP_CMP_MASKED_EQ, ~allowed, 0ULL);
+}
+
 PyTypeObject * Arg_build(void) {
   // Ready the type
   PyObject *type = PyType_FromSpec(&seccomplite_ArgTypeSpec);
   PyTypeObject *result = (PyTypeObject *) type;
 
-  if (PyType_Ready(result) < 0) {
+  if (!type || PyType_Ready(result) < 0) {
+    Py_XDECREF(type);
     return NULL;
   }
-  else {
-    return result;
-  }
+
+#if PY_VERSION_HEX >= 0x03090000
+  // Calling the type skips the argument tuple of tp_new and tp_init
+  result->tp_vectorcall = (vectorcallfunc) Arg_vectorcall;
+#endif
+  return result;
 }
\ No newline at end of file
@@ -30,22 +30,41 @@ PyType_Spec seccomplite_AttrTypeSpec = {
 
 /// Attr type methods
 
+/**
+ * Assign an integer class constant
+ * @return 0 on success, -1 with exception set
+ */
+static int Attr_set_constant(PyObject *type, const char *name, long value) {
+  PyObject *constant = PyLong_FromLong(value);
+  if (!constant) {
+    return -1;
+  }
+
+  int rc = PyObject_SetAttrString(type, name, constant);
+  Py_DECREF(constant);
+  return rc;
+}
+
 PyTypeObject * Attr_build(void) {
   // Ready the type
   PyObject *type = PyType_FromSpec(&seccomplite_AttrTypeSpec);
   PyTypeObject *result = (PyTypeObject *) type;
 
-  if (PyType_Ready(result) < 0) {
+  if (!type || PyType_Ready(result) < 0) {
+    Py_XDECREF(type);
     return NULL;
   }
 
   // Assign static type properties
-  PyObject_SetAttrString(type, "ACT_DEFAULT", PyLong_FromLong(SCMP_FLTATR_ACT_DEFAULT));
-  PyObject_SetAttrString(type, "ACT_BADARCH", PyLong_FromLong(SCMP_FLTATR_ACT_BADARCH));
-  PyObject_SetAttrString(type, "CTL_NNP", PyLong_FromLong(SCMP_FLTATR_CTL_NNP));
-#ifdef SCMP_FLTATR_CTL_TSYNC
-  PyObject_SetAttrString(type, "CTL_TSYNC", PyLong_FromLong(SCMP_FLTATR_CTL_TSYNC));
+  if (Attr_set_constant(type, "ACT_DEFAULT", SCMP_FLTATR_ACT_DEFAULT) != 0 ||
+      Attr_set_constant(type, "ACT_BADARCH", SCMP_FLTATR_ACT_BADARCH) != 0 ||
+#if SCMP_VER_MAJOR > 2 || (SCMP_VER_MAJOR == 2 && SCMP_VER_MINOR >= 2)
+      Attr_set_constant(type, "CTL_TSYNC", SCMP_FLTATR_CTL_TSYNC) != 0 ||
 #endif
+      Attr_set_constant(type, "CTL_NNP", SCMP_FLTATR_CTL_NNP) != 0) {
+    Py_DECREF(type);
+    return NULL;
+  }
 
   return result;
 }
\ No newline at end of file
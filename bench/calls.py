@@ -0,0 +1,57 @@
+#!/usr/bin/env python3
+#
+# Per-call overhead benchmark for seccomplite
+# Author: Michael Witt <m.witt@htw-berlin.de>
+#
+# Times the small calls tooling makes in bulk, positional and with
+# keywords, and prints nanoseconds per call.  Run it against two builds
+# to compare calling conventions.
+#
+# Usage: python3 bench/calls.py [--number N] [--repeat N]
+#
+
+import argparse
+import sys
+import timeit
+
+import seccomplite
+
+CASES = [
+  ("resolve_syscall", "resolve_syscall(native, 'openat')"),
+  ("resolve_syscall kw", "resolve_syscall(arch=native, syscall='openat')"),
+  ("ERRNO", "ERRNO(1)"),
+  ("Arg()", "Arg(0, EQ, 1)"),
+  ("Arg() kw", "Arg(arg=0, op=EQ, datum_a=1)"),
+  ("Arch()", "Arch('x86_64')"),
+  ("Filter()", "Filter(KILL)"),
+  ("add_rule", "f.add_rule(ALLOW, 1, arg)"),
+  ("exist_arch", "f.exist_arch(native)"),
+  ("get_attr", "f.get_attr(Attr.CTL_NNP)"),
+  ("evaluate", "p.evaluate('read', args=(0,))"),
+]
+
+
+def main():
+  parser = argparse.ArgumentParser(description="seccomplite call overhead benchmark")
+  parser.add_argument("--number", type=int, default=200000, help="calls per measurement")
+  parser.add_argument("--repeat", type=int, default=5, help="measurements, the best is reported")
+  options = parser.parse_args()
+
+  namespace = {name: getattr(seccomplite, name) for name in dir(seccomplite) if not name.startswith("_")}
+  namespace["native"] = seccomplite.Arch.NATIVE
+  namespace["arg"] = seccomplite.Arg(0, seccomplite.EQ, 1)
+  namespace["p"] = seccomplite.Filter(seccomplite.ALLOW).compile()
+
+  print("{:20s} {:>10s}".format("call", "ns/call"))
+  for name, statement in CASES:
+    # add_rule grows the filter, start from an empty one for every run
+    setup = "f = Filter(KILL)"
+    number = options.number if name != "add_rule" else options.number // 10
+    best = min(timeit.repeat(statement, setup, number=number, repeat=options.repeat, globals=namespace))
+    print("{:20s} {:10.1f}".format(name, best / number * 1e9))
+
+  return 0
+
+
+if __name__ == "__main__":
+  sys.exit(main())
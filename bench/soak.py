@@ -0,0 +1,98 @@
+#!/usr/bin/env python3
+#
+# Soak benchmark for seccomplite
+# Author: Michael Witt <m.witt@htw-berlin.de>
+#
+# Creates, merges, compiles and releases filters in a loop and reports the
+# resident set size and the reference counts of the shared singletons after
+# every round.  A leak shows up as RSS or refcounts growing from round to
+# round, a missing INCREF on None eventually aborts interpreters that do
+# not make None immortal (before 3.12).
+#
+# Usage: python3 bench/soak.py [--filters N] [--rounds N]
+#
+
+import argparse
+import errno
+import gc
+import sys
+import time
+
+import seccomplite
+
+
+def rss_kib():
+  with open("/proc/self/status") as status:
+    for line in status:
+      if line.startswith("VmRSS:"):
+        return int(line.split()[1])
+  return 0
+
+
+def singletons():
+  return (sys.getrefcount(None), sys.getrefcount(True), sys.getrefcount(False))
+
+
+def churn(count):
+  sink = open("/dev/null", "w")
+  for index in range(count):
+    first = seccomplite.Filter(seccomplite.KILL)
+    first.add_rule(seccomplite.ALLOW, "read", seccomplite.Arg(0, seccomplite.EQ, index & 0xff))
+    first.add_rule(seccomplite.ERRNO(errno.EPERM), "getpid")
+    first.exist_arch(seccomplite.Arch.NATIVE)
+
+    # Merged filters must not share an architecture
+    second = seccomplite.Filter(seccomplite.KILL)
+    second.add_arch(seccomplite.Arch.AARCH64)
+    second.remove_arch(seccomplite.Arch.NATIVE)
+    second.add_rule(seccomplite.ALLOW, "write", seccomplite.Arg(0, seccomplite.LT, 3))
+    first.merge(second)
+    second.add_rule(seccomplite.ALLOW, "close")
+    second.reset()
+
+    rules = seccomplite.RuleSet()
+    rules.append(seccomplite.ALLOW, "close")
+    first.add_rules(rules)
+    first.set_attr(seccomplite.Attr.CTL_NNP, 0)
+
+    if index % 16 == 0:
+      program = first.compile()
+      program.evaluate("read", args=(index & 0xff,))
+      program.optimize()
+      first.export_pfc(sink)
+      first.simplify()
+
+    first.reset(seccomplite.ALLOW)
+  sink.close()
+
+
+def main():
+  parser = argparse.ArgumentParser(description="seccomplite soak benchmark")
+  parser.add_argument("--filters", type=int, default=100000, help="filters per round")
+  parser.add_argument("--rounds", type=int, default=20, help="number of rounds")
+  options = parser.parse_args()
+
+  # Warm up caches and allocator pools before taking the baseline
+  churn(1000)
+  gc.collect()
+  base_rss = rss_kib()
+  base_refs = singletons()
+  print("round  filters/s     rss KiB   delta  None/True/False refs")
+
+  for round in range(options.rounds):
+    start = time.perf_counter()
+    churn(options.filters)
+    elapsed = time.perf_counter() - start
+    gc.collect()
+
+    rss = rss_kib()
+    refs = singletons()
+    print("{:5d} {:10.0f} {:11d} {:+7d}  {}".format(
+      round, options.filters / elapsed, rss, rss - base_rss,
+      "/".join("{:+d}".format(now - then) for now, then in zip(refs, base_refs))))
+
+  return 0
+
+
+if __name__ == "__main__":
+  sys.exit(main())
@@ -0,0 +1,1113 @@
+/*
+ * Classic BPF helpers in seccomplite library
+ * Author: Michael Witt <m.witt@htw-berlin.de>
+ *
+ * Only the subset of classic BPF the kernel accepts for seccomp is
+ * supported, loads are restricted to struct seccomp_data.
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include "inc/bpf.h"
+
+/**
+ * Upper bounds for the optimiser and the witness generator
+ */
+#define BPF_OPT_ROUNDS 8
+#define BPF_THREAD_STEPS 64
+#define BPF_WITNESS_LIMIT 65536
+#define BPF_WITNESS_STEPS (1 << 22)
+#define BPF_WORDS (sizeof(struct seccomp_data) / sizeof(uint32_t))
+#define BPF_MAX_NEQ 4
+
+int seccomplite_bpf_run(const struct sock_filter *insns, unsigned int len, const struct seccomp_data *data, uint32_t *action, unsigned int *executed) {
+  return seccomplite_bpf_profile(insns, len, data, action, executed, NULL);
+}
+
+int seccomplite_bpf_profile(const struct sock_filter *insns, unsigned int len, const struct seccomp_data *data, uint32_t *action, unsigned int *executed, unsigned long *hits) {
+  uint32_t mem[BPF_MEMWORDS] = { 0 };
+  uint32_t a = 0;
+  uint32_t x = 0;
+  unsigned int pc = 0;
+  unsigned int count = 0;
+
+  while (pc < len) {
+    const struct sock_filter *insn = &insns[pc++];
+    uint32_t operand = BPF_SRC(insn->code) == BPF_X ? x : insn->k;
+    count++;
+    if (hits) {
+      hits[pc - 1]++;
+    }
+
+    switch (BPF_CLASS(insn->code)) {
+      case BPF_LD:
+        if (BPF_MODE(insn->code) == BPF_ABS && BPF_SIZE(insn->code) == BPF_W) {
+          if (insn->k > sizeof(struct seccomp_data) - sizeof(uint32_t) || insn->k & 3) {
+            return -1;
+          }
+          memcpy(&a, (const char *) data + insn->k, sizeof(uint32_t));
+        }
+        else if (BPF_MODE(insn->code) == BPF_IMM) {
+          a = insn->k;
+        }
+        else if (BPF_MODE(insn->code) == BPF_MEM && insn->k < BPF_MEMWORDS) {
+          a = mem[insn->k];
+        }
+        else if (BPF_MODE(insn->code) == BPF_LEN) {
+          a = sizeof(struct seccomp_data);
+        }
+        else {
+          return -1;
+        }
+        break;
+
+      case BPF_LDX:
+        if (BPF_MODE(insn->code) == BPF_IMM) {
+          x = insn->k;
+        }
+        else if (BPF_MODE(insn->code) == BPF_MEM && insn->k < BPF_MEMWORDS) {
+          x = mem[insn->k];
+        }
+        else if (BPF_MODE(insn->code) == BPF_LEN) {
+          x = sizeof(struct seccomp_data);
+        }
+        else {
+          return -1;
+        }
+        break;
+
+      case BPF_ST:
+      case BPF_STX:
+        if (insn->k >= BPF_MEMWORDS) {
+          return -1;
+        }
+        mem[insn->k] = BPF_CLASS(insn->code) == BPF_ST ? a : x;
+        break;
+
+      case BPF_ALU:
+        switch (BPF_OP(insn->code)) {
+          case BPF_ADD: a += operand; break;
+          case BPF_SUB: a -= operand; break;
+          case BPF_MUL: a *= operand; break;
+          case BPF_DIV:
+            if (operand == 0) {
+              // Division by zero terminates the program with 0
+              a = 0;
+              goto done;
+            }
+            a /= operand;
+            break;
+          case BPF_MOD:
+            if (operand == 0) {
+              a = 0;
+              goto done;
+            }
+            a %= operand;
+            break;
+          case BPF_AND: a &= operand; break;
+          case BPF_OR: a |= operand; break;
+          case BPF_XOR: a ^= operand; break;
+          case BPF_LSH: a = operand < 32 ? a << operand : 0; break;
+          case BPF_RSH: a = operand < 32 ? a >> operand : 0; break;
+          case BPF_NEG: a = -a; break;
+          default: return -1;
+        }
+        break;
+
+      case BPF_JMP:
+        if (BPF_OP(insn->code) == BPF_JA) {
+          if (insn->k >= len - pc) {
+            return -1;
+          }
+          pc += insn->k;
+          break;
+        }
+
+        int taken = 0;
+        switch (BPF_OP(insn->code)) {
+          case BPF_JEQ: taken = a == operand; break;
+          case BPF_JGT: taken = a > operand; break;
+          case BPF_JGE: taken = a >= operand; break;
+          case BPF_JSET: taken = (a & operand) != 0; break;
+          default: return -1;
+        }
+        pc += taken ? insn->jt : insn->jf;
+        break;
+
+      case BPF_RET:
+        *action = BPF_RVAL(insn->code) == BPF_A ? a : insn->k;
+        if (executed) {
+          *executed = count;
+        }
+        return 0;
+
+      case BPF_MISC:
+        if (BPF_MISCOP(insn->code) == BPF_TAX) {
+          x = a;
+        }
+        else {
+          a = x;
+        }
+        break;
+    }
+  }
+
+  // Falling off the end is rejected by the kernel checker
+  return -1;
+
+done:
+  *action = a;
+  if (executed) {
+    *executed = count;
+  }
+  return 0;
+}
+
+int seccomplite_bpf_check(const struct sock_filter *insns, unsigned int len) {
+  if (len == 0 || len > 0xFFFF || BPF_CLASS(insns[len - 1].code) != BPF_RET) {
+    return -1;
+  }
+
+  unsigned int index = 0;
+  for (index = 0; index < len; index++) {
+    const struct sock_filter *insn = &insns[index];
+    unsigned int remaining = len - index - 1;
+    switch (BPF_CLASS(insn->code)) {
+      case BPF_LD:
+        if (insn->code == (BPF_LD | BPF_W | BPF_ABS)) {
+          if (insn->k > sizeof(struct seccomp_data) - sizeof(uint32_t) || insn->k & 3) {
+            return -1;
+          }
+        }
+        else if (insn->code == (BPF_LD | BPF_MEM) && insn->k >= BPF_MEMWORDS) {
+          return -1;
+        }
+        else if (insn->code != (BPF_LD | BPF_IMM) && insn->code != (BPF_LD | BPF_MEM) && insn->code != (BPF_LD | BPF_W | BPF_LEN)) {
+          return -1;
+        }
+        break;
+      case BPF_LDX:
+        if (insn->code == (BPF_LDX | BPF_MEM) && insn->k >= BPF_MEMWORDS) {
+          return -1;
+        }
+        else if (insn->code != (BPF_LDX | BPF_IMM) && insn->code != (BPF_LDX | BPF_MEM) && insn->code != (BPF_LDX | BPF_W | BPF_LEN)) {
+          return -1;
+        }
+        break;
+      case BPF_ST:
+      case BPF_STX:
+        if (insn->k >= BPF_MEMWORDS) {
+          return -1;
+        }
+        break;
+      case BPF_ALU:
+        if ((BPF_OP(insn->code) == BPF_DIV || BPF_OP(insn->code) == BPF_MOD) && BPF_SRC(insn->code) == BPF_K && insn->k == 0) {
+          return -1;
+        }
+        break;
+      case BPF_JMP:
+        if (BPF_OP(insn->code) == BPF_JA) {
+          if (insn->k >= remaining) {
+            return -1;
+          }
+        }
+        else if (insn->jt >= remaining || insn->jf >= remaining) {
+          return -1;
+        }
+        break;
+    }
+  }
+
+  return 0;
+}
+
+/// Optimiser
+
+/**
+ * Program graph node, every edge is an absolute index
+ */
+typedef struct {
+  uint16_t code;
+  uint32_t k;
+  unsigned int jt;
+  unsigned int jf;
+  unsigned int next;
+  unsigned int alias;
+  int alive;
+} bpf_node;
+
+static int bpf_is_cond(uint16_t code) {
+  return BPF_CLASS(code) == BPF_JMP && BPF_OP(code) != BPF_JA;
+}
+
+/**
+ * Follow removed nodes to the node taking their place
+ */
+static unsigned int bpf_resolve(bpf_node *nodes, unsigned int index) {
+  unsigned int target = index;
+  while (!nodes[target].alive) {
+    target = nodes[target].alias;
+  }
+
+  while (!nodes[index].alive) {
+    unsigned int next = nodes[index].alias;
+    nodes[index].alias = target;
+    index = next;
+  }
+
+  return target;
+}
+
+/**
+ * Outcome of a comparison on A given the outcome of an earlier one
+ * @return 1 or 0 if the outcome is known, -1 otherwise
+ */
+static int bpf_implied(uint16_t op, uint32_t k, int taken, uint16_t op2, uint32_t k2) {
+  uint64_t lo = 0;
+  uint64_t hi = UINT32_MAX;
+  int has_neq = 0;
+
+  switch (op) {
+    case BPF_JEQ:
+      if (taken) {
+        lo = hi = k;
+      }
+      else {
+        has_neq = 1;
+      }
+      break;
+    case BPF_JGT:
+      if (taken) {
+        lo = (uint64_t) k + 1;
+      }
+      else {
+        hi = k;
+      }
+      break;
+    case BPF_JGE:
+      if (taken) {
+        lo = k;
+      }
+      else if (k == 0) {
+        return -1;
+      }
+      else {
+        hi = (uint64_t) k - 1;
+      }
+      break;
+    case BPF_JSET:
+      if (op2 == BPF_JSET && k2 == k) {
+        return taken;
+      }
+      else if (op2 == BPF_JSET && !taken && (k2 & ~k) == 0) {
+        return 0;
+      }
+      return -1;
+    default:
+      return -1;
+  }
+
+  switch (op2) {
+    case BPF_JEQ:
+      if (lo == hi) {
+        return lo == k2;
+      }
+      else if (k2 < lo || k2 > hi || (has_neq && k2 == k)) {
+        return 0;
+      }
+      return -1;
+    case BPF_JGT:
+      if (lo > k2) {
+        return 1;
+      }
+      else if (hi <= k2) {
+        return 0;
+      }
+      return -1;
+    case BPF_JGE:
+      if (lo >= k2) {
+        return 1;
+      }
+      else if (hi < k2) {
+        return 0;
+      }
+      return -1;
+    case BPF_JSET:
+      if (lo == hi) {
+        return (lo & k2) != 0;
+      }
+      return -1;
+    default:
+      return -1;
+  }
+}
+
+/**
+ * Skip comparisons whose outcome follows from the branch just taken
+ */
+static unsigned int bpf_thread(bpf_node *nodes, unsigned int from, unsigned int target, int taken) {
+  const bpf_node *jump = &nodes[from];
+  unsigned int steps = 0;
+  if (BPF_SRC(jump->code) != BPF_K) {
+    return target;
+  }
+
+  while (steps++ < BPF_THREAD_STEPS) {
+    const bpf_node *node = &nodes[target];
+    if (!bpf_is_cond(node->code) || BPF_SRC(node->code) != BPF_K) {
+      break;
+    }
+
+    int known = bpf_implied(BPF_OP(jump->code), jump->k, taken, BPF_OP(node->code), node->k);
+    if (known < 0) {
+      break;
+    }
+    target = bpf_resolve(nodes, known ? node->jt : node->jf);
+  }
+
+  return target;
+}
+
+/**
+ * Jump threading, unconditional jumps are dropped and recreated by the
+ * layout only where needed
+ */
+static unsigned int bpf_pass_thread(bpf_node *nodes, unsigned int len) {
+  unsigned int changes = 0;
+  unsigned int index = 0;
+  for (index = 0; index < len; index++) {
+    bpf_node *node = &nodes[index];
+    if (!node->alive) {
+      continue;
+    }
+    else if (BPF_CLASS(node->code) == BPF_JMP && BPF_OP(node->code) == BPF_JA) {
+      node->alive = 0;
+      node->alias = node->jt;
+      changes++;
+    }
+    else if (bpf_is_cond(node->code)) {
+      unsigned int jt = bpf_resolve(nodes, node->jt);
+      unsigned int jf = bpf_resolve(nodes, node->jf);
+      unsigned int threaded_jt = bpf_thread(nodes, index, jt, 1);
+      unsigned int threaded_jf = bpf_thread(nodes, index, jf, 0);
+      changes += (threaded_jt != jt) + (threaded_jf != jf);
+      node->jt = threaded_jt;
+      node->jf = threaded_jf;
+      if (node->jt == node->jf) {
+        node->alive = 0;
+        node->alias = node->jt;
+        changes++;
+      }
+    }
+  }
+
+  return changes;
+}
+
+/**
+ * Content of A, only loads from seccomp_data and immediates are tracked
+ */
+enum bpf_acc {
+  BPF_ACC_UNSET = 0,
+  BPF_ACC_UNKNOWN,
+  BPF_ACC_ABS,
+  BPF_ACC_IMM
+};
+
+typedef struct {
+  uint8_t kind;
+  uint32_t value;
+} bpf_acc_state;
+
+static void bpf_acc_merge(bpf_acc_state *state, bpf_acc_state value) {
+  if (state->kind == BPF_ACC_UNSET) {
+    *state = value;
+  }
+  else if (state->kind != value.kind || state->value != value.value) {
+    state->kind = BPF_ACC_UNKNOWN;
+  }
+}
+
+/**
+ * Redundant load elimination
+ */
+static int bpf_pass_loads(bpf_node *nodes, unsigned int len, unsigned int *removed) {
+  bpf_acc_state *states = calloc(len, sizeof(bpf_acc_state));
+  if (!states) {
+    return -ENOMEM;
+  }
+
+  // The kernel starts with A cleared
+  states[bpf_resolve(nodes, 0)] = (bpf_acc_state) { BPF_ACC_IMM, 0 };
+
+  unsigned int index = 0;
+  for (index = 0; index < len; index++) {
+    bpf_node *node = &nodes[index];
+    if (!node->alive) {
+      continue;
+    }
+
+    bpf_acc_state in = states[index];
+    bpf_acc_state out = { BPF_ACC_UNKNOWN, 0 };
+    if (in.kind == BPF_ACC_UNSET) {
+      in.kind = BPF_ACC_UNKNOWN;
+    }
+
+    if (node->code == (BPF_LD | BPF_W | BPF_ABS) || node->code == (BPF_LD | BPF_IMM)) {
+      out.kind = node->code == (BPF_LD | BPF_IMM) ? BPF_ACC_IMM : BPF_ACC_ABS;
+      out.value = node->k;
+      if (in.kind == out.kind && in.value == out.value) {
+        node->alive = 0;
+        node->alias = node->next;
+        (*removed)++;
+      }
+    }
+    else if (BPF_CLASS(node->code) == BPF_JMP || BPF_CLASS(node->code) == BPF_ST ||
+             BPF_CLASS(node->code) == BPF_STX || BPF_CLASS(node->code) == BPF_LDX ||
+             (BPF_CLASS(node->code) == BPF_MISC && BPF_MISCOP(node->code) == BPF_TAX)) {
+      out = in;
+    }
+
+    if (bpf_is_cond(node->code)) {
+      bpf_acc_merge(&states[bpf_resolve(nodes, node->jt)], out);
+      bpf_acc_merge(&states[bpf_resolve(nodes, node->jf)], out);
+    }
+    else if (BPF_CLASS(node->code) != BPF_RET) {
+      bpf_acc_merge(&states[bpf_resolve(nodes, node->next)], out);
+    }
+  }
+
+  free(states);
+  return 0;
+}
+
+/**
+ * Merge identical returns into the last one, returns reached by falling
+ * through are kept since they would need an extra jump
+ */
+static int bpf_pass_returns(bpf_node *nodes, unsigned int len, unsigned int *merged) {
+  uint8_t *falls = calloc(len, 1);
+  unsigned int *canonical = malloc(len * sizeof(unsigned int));
+  unsigned int count = 0;
+  if (!falls || !canonical) {
+    free(falls);
+    free(canonical);
+    return -ENOMEM;
+  }
+
+  unsigned int index = 0;
+  for (index = 0; index < len; index++) {
+    const bpf_node *node = &nodes[index];
+    if (node->alive && BPF_CLASS(node->code) != BPF_JMP && BPF_CLASS(node->code) != BPF_RET) {
+      falls[bpf_resolve(nodes, node->next)] = 1;
+    }
+  }
+
+  index = len;
+  while (index-- > 0) {
+    bpf_node *node = &nodes[index];
+    if (!node->alive || BPF_CLASS(node->code) != BPF_RET) {
+      continue;
+    }
+
+    unsigned int other = 0;
+    for (other = 0; other < count; other++) {
+      const bpf_node *last = &nodes[canonical[other]];
+      if (last->code == node->code && last->k == node->k) {
+        break;
+      }
+    }
+
+    if (other == count) {
+      canonical[count++] = index;
+    }
+    else if (!falls[index]) {
+      node->alive = 0;
+      node->alias = canonical[other];
+      (*merged)++;
+    }
+  }
+
+  free(falls);
+  free(canonical);
+  return 0;
+}
+
+/**
+ * Hash key of a node, its successors are already canonical
+ */
+static uint64_t bpf_node_hash(bpf_node *nodes, unsigned int index) {
+  const bpf_node *node = &nodes[index];
+  uint64_t hash = ((uint64_t) node->code << 32) ^ node->k;
+  if (bpf_is_cond(node->code)) {
+    hash = hash * 0x100000001B3ULL ^ bpf_resolve(nodes, node->jt);
+    hash = hash * 0x100000001B3ULL ^ bpf_resolve(nodes, node->jf);
+  }
+  else if (BPF_CLASS(node->code) != BPF_RET) {
+    hash = hash * 0x100000001B3ULL ^ bpf_resolve(nodes, node->next);
+  }
+  return hash * 0x9E3779B97F4A7C15ULL;
+}
+
+static int bpf_node_equal(bpf_node *nodes, unsigned int a, unsigned int b) {
+  const bpf_node *left = &nodes[a];
+  const bpf_node *right = &nodes[b];
+  if (left->code != right->code || left->k != right->k) {
+    return 0;
+  }
+  else if (bpf_is_cond(left->code)) {
+    return bpf_resolve(nodes, left->jt) == bpf_resolve(nodes, right->jt) &&
+           bpf_resolve(nodes, left->jf) == bpf_resolve(nodes, right->jf);
+  }
+  else if (BPF_CLASS(left->code) != BPF_RET) {
+    return bpf_resolve(nodes, left->next) == bpf_resolve(nodes, right->next);
+  }
+  return 1;
+}
+
+/**
+ * Block sharing, identical instruction tails are kept once.  Walking
+ * backwards makes the successors of a node canonical before the node
+ * itself is looked up, so whole argument check blocks collapse.
+ */
+static int bpf_pass_share(bpf_node *nodes, unsigned int len, unsigned int *shared) {
+  unsigned int size = 16;
+  while (size < 2 * len) {
+    size *= 2;
+  }
+
+  unsigned int *table = malloc(size * sizeof(unsigned int));
+  if (!table) {
+    return -ENOMEM;
+  }
+  memset(table, 0xFF, size * sizeof(unsigned int));
+
+  unsigned int index = len;
+  while (index-- > 0) {
+    bpf_node *node = &nodes[index];
+    if (!node->alive) {
+      continue;
+    }
+
+    unsigned int slot = bpf_node_hash(nodes, index) & (size - 1);
+    while (table[slot] != UINT32_MAX && !bpf_node_equal(nodes, table[slot], index)) {
+      slot = (slot + 1) & (size - 1);
+    }
+
+    if (table[slot] == UINT32_MAX) {
+      table[slot] = index;
+    }
+    else {
+      node->alive = 0;
+      node->alias = table[slot];
+      (*shared)++;
+    }
+  }
+
+  free(table);
+  return 0;
+}
+
+/**
+ * Dead code removal
+ */
+static int bpf_pass_dead(bpf_node *nodes, unsigned int len, unsigned int *removed) {
+  uint8_t *reached = calloc(len, 1);
+  if (!reached) {
+    return -ENOMEM;
+  }
+
+  // Edges only point forward, one sweep in program order is enough
+  reached[bpf_resolve(nodes, 0)] = 1;
+  unsigned int index = 0;
+  for (index = 0; index < len; index++) {
+    bpf_node *node = &nodes[index];
+    if (!node->alive) {
+      continue;
+    }
+    else if (!reached[index]) {
+      node->alive = 0;
+      node->alias = index + 1 < len ? index + 1 : index;
+      (*removed)++;
+    }
+    else if (bpf_is_cond(node->code)) {
+      reached[bpf_resolve(nodes, node->jt)] = 1;
+      reached[bpf_resolve(nodes, node->jf)] = 1;
+    }
+    else if (BPF_CLASS(node->code) != BPF_RET) {
+      reached[bpf_resolve(nodes, node->next)] = 1;
+    }
+  }
+
+  free(reached);
+  return 0;
+}
+
+/**
+ * Lay the graph out again, conditional jumps only reach 255 instructions
+ * so far targets get an unconditional trampoline
+ */
+static int bpf_layout(bpf_node *nodes, unsigned int len, struct sock_filter **out, unsigned int *out_len) {
+  unsigned int *pos = calloc(len, sizeof(unsigned int));
+  uint8_t *extra = calloc(len, 1);
+  if (!pos || !extra) {
+    free(pos);
+    free(extra);
+    return -ENOMEM;
+  }
+
+  // Bit 0: trampoline for jt, bit 1: trampoline for jf, bit 2: jump to next
+  unsigned int index = 0;
+  unsigned int following = len;
+  index = len;
+  while (index-- > 0) {
+    bpf_node *node = &nodes[index];
+    if (!node->alive) {
+      continue;
+    }
+    if (BPF_CLASS(node->code) != BPF_JMP && BPF_CLASS(node->code) != BPF_RET &&
+        bpf_resolve(nodes, node->next) != following) {
+      extra[index] |= 4;
+    }
+    following = index;
+  }
+
+  unsigned int total = 0;
+  int changed = 1;
+  while (changed) {
+    changed = 0;
+    total = 0;
+    for (index = 0; index < len; index++) {
+      if (nodes[index].alive) {
+        pos[index] = total;
+        total += 1 + (extra[index] & 1) + ((extra[index] >> 1) & 1) + ((extra[index] >> 2) & 1);
+      }
+    }
+
+    for (index = 0; index < len; index++) {
+      bpf_node *node = &nodes[index];
+      if (!node->alive || !bpf_is_cond(node->code)) {
+        continue;
+      }
+      if (!(extra[index] & 1) && pos[bpf_resolve(nodes, node->jt)] - (pos[index] + 1) > 255) {
+        extra[index] |= 1;
+        changed = 1;
+      }
+      if (!(extra[index] & 2) && pos[bpf_resolve(nodes, node->jf)] - (pos[index] + 1) > 255) {
+        extra[index] |= 2;
+        changed = 1;
+      }
+    }
+  }
+
+  struct sock_filter *result = malloc((total ? total : 1) * sizeof(struct sock_filter));
+  if (!result) {
+    free(pos);
+    free(extra);
+    return -ENOMEM;
+  }
+
+  unsigned int at = 0;
+  for (index = 0; index < len; index++) {
+    bpf_node *node = &nodes[index];
+    if (!node->alive) {
+      continue;
+    }
+
+    if (bpf_is_cond(node->code)) {
+      unsigned int jt = pos[bpf_resolve(nodes, node->jt)];
+      unsigned int jf = pos[bpf_resolve(nodes, node->jf)];
+      unsigned int tramp_t = extra[index] & 1;
+      unsigned int tramp_f = (extra[index] >> 1) & 1;
+      result[at].code = node->code;
+      result[at].k = node->k;
+      result[at].jt = tramp_t ? 0 : jt - (at + 1);
+      result[at].jf = tramp_f ? tramp_t : jf - (at + 1);
+      at++;
+      if (tramp_t) {
+        result[at] = (struct sock_filter) BPF_STMT(BPF_JMP | BPF_JA, jt - (at + 1));
+        at++;
+      }
+      if (tramp_f) {
+        result[at] = (struct sock_filter) BPF_STMT(BPF_JMP | BPF_JA, jf - (at + 1));
+        at++;
+      }
+    }
+    else {
+      result[at] = (struct sock_filter) BPF_STMT(node->code, node->k);
+      at++;
+      if (extra[index] & 4) {
+        result[at] = (struct sock_filter) BPF_STMT(BPF_JMP | BPF_JA, pos[bpf_resolve(nodes, node->next)] - (at + 1));
+        at++;
+      }
+    }
+  }
+
+  free(pos);
+  free(extra);
+  *out = result;
+  *out_len = at;
+  return 0;
+}
+
+/// Verifier
+
+/**
+ * Constraints collected on one path
+ */
+typedef struct {
+  uint32_t lo[BPF_WORDS];
+  uint32_t hi[BPF_WORDS];
+  uint32_t eq[BPF_WORDS];
+  uint32_t must[BPF_WORDS];
+  uint32_t mustnot[BPF_WORDS];
+  uint32_t neq[BPF_WORDS][BPF_MAX_NEQ];
+  uint8_t num_neq[BPF_WORDS];
+  uint32_t has_eq;
+  int acc;
+  uint32_t mask;
+  unsigned int pc;
+} bpf_path;
+
+/**
+ * Apply the outcome of a comparison to the path
+ * @return 0 if the path is still feasible, -1 otherwise
+ */
+static int bpf_path_constrain(bpf_path *path, uint16_t op, uint32_t k, int taken) {
+  if (path->acc < 0) {
+    return 0;
+  }
+
+  unsigned int word = path->acc;
+  uint32_t bit = 1U << word;
+  if (path->mask != UINT32_MAX) {
+    // Masked comparisons, only equality is tracked
+    if (op == BPF_JEQ && taken) {
+      path->must[word] |= k & path->mask;
+      path->mustnot[word] |= path->mask & ~k;
+    }
+  }
+  else {
+    switch (op) {
+      case BPF_JEQ:
+        if (taken) {
+          if ((path->has_eq & bit) && path->eq[word] != k) {
+            return -1;
+          }
+          path->eq[word] = k;
+          path->has_eq |= bit;
+        }
+        else if (path->num_neq[word] < BPF_MAX_NEQ) {
+          path->neq[word][path->num_neq[word]++] = k;
+        }
+        break;
+      case BPF_JGT:
+        if (taken) {
+          if (k == UINT32_MAX) {
+            return -1;
+          }
+          path->lo[word] = k + 1 > path->lo[word] ? k + 1 : path->lo[word];
+        }
+        else {
+          path->hi[word] = k < path->hi[word] ? k : path->hi[word];
+        }
+        break;
+      case BPF_JGE:
+        if (taken) {
+          path->lo[word] = k > path->lo[word] ? k : path->lo[word];
+        }
+        else {
+          if (k == 0) {
+            return -1;
+          }
+          path->hi[word] = k - 1 < path->hi[word] ? k - 1 : path->hi[word];
+        }
+        break;
+      case BPF_JSET:
+        if (taken) {
+          uint32_t candidates = k & ~path->mustnot[word];
+          if (!candidates) {
+            return -1;
+          }
+          if (!(path->must[word] & k)) {
+            path->must[word] |= candidates & -candidates;
+          }
+        }
+        else {
+          if (path->must[word] & k) {
+            return -1;
+          }
+          path->mustnot[word] |= k;
+        }
+        break;
+    }
+  }
+
+  if (path->lo[word] > path->hi[word] || (path->must[word] & path->mustnot[word])) {
+    return -1;
+  }
+  if (path->has_eq & bit) {
+    uint32_t value = path->eq[word];
+    unsigned int index = 0;
+    if (value < path->lo[word] || value > path->hi[word] || (value & path->must[word]) != path->must[word] ||
+        (value & path->mustnot[word])) {
+      return -1;
+    }
+    for (index = 0; index < path->num_neq[word]; index++) {
+      if (path->neq[word][index] == value) {
+        return -1;
+      }
+    }
+  }
+
+  return 0;
+}
+
+/**
+ * Pick concrete values satisfying the path constraints where possible
+ */
+static void bpf_path_witness(const bpf_path *path, struct seccomp_data *data) {
+  uint32_t words[BPF_WORDS];
+  unsigned int word = 0;
+  for (word = 0; word < BPF_WORDS; word++) {
+    uint32_t value = (path->has_eq & (1U << word)) ? path->eq[word] : path->lo[word];
+    unsigned int tries = 0;
+    for (tries = 0; tries <= BPF_MAX_NEQ; tries++) {
+      value = (value | path->must[word]) & ~path->mustnot[word];
+      unsigned int index = 0;
+      for (index = 0; index < path->num_neq[word] && path->neq[word][index] != value; index++);
+      if (index == path->num_neq[word]) {
+        break;
+      }
+      value++;
+    }
+    words[word] = value;
+  }
+
+  memcpy(data, words, sizeof(struct seccomp_data));
+}
+
+unsigned long seccomplite_bpf_witnesses(const struct sock_filter *insns, unsigned int len, void (*callback)(const struct seccomp_data *data, void *arg), void *arg) {
+  unsigned long count = 0;
+  unsigned long steps = 0;
+  unsigned int cap = 64;
+  unsigned int depth = 0;
+  bpf_path *stack = malloc(cap * sizeof(bpf_path));
+  if (!stack) {
+    return 0;
+  }
+
+  memset(&stack[0], 0, sizeof(bpf_path));
+  memset(stack[0].hi, 0xFF, sizeof(stack[0].hi));
+  stack[0].acc = -1;
+  stack[0].mask = UINT32_MAX;
+  depth = 1;
+
+  while (depth > 0 && count < BPF_WITNESS_LIMIT && steps < BPF_WITNESS_STEPS) {
+    bpf_path *path = &stack[depth - 1];
+    if (path->pc >= len) {
+      depth--;
+      continue;
+    }
+
+    const struct sock_filter *insn = &insns[path->pc++];
+    steps++;
+    switch (BPF_CLASS(insn->code)) {
+      case BPF_LD:
+        path->acc = insn->code == (BPF_LD | BPF_W | BPF_ABS) ? (int) (insn->k / 4) : -1;
+        path->mask = UINT32_MAX;
+        break;
+
+      case BPF_ALU:
+        if (path->acc >= 0 && BPF_OP(insn->code) == BPF_AND && BPF_SRC(insn->code) == BPF_K) {
+          path->mask &= insn->k;
+        }
+        else {
+          path->acc = -1;
+        }
+        break;
+
+      case BPF_MISC:
+        if (BPF_MISCOP(insn->code) == BPF_TXA) {
+          path->acc = -1;
+        }
+        break;
+
+      case BPF_RET: {
+        struct seccomp_data data;
+        bpf_path_witness(path, &data);
+        callback(&data, arg);
+        count++;
+        depth--;
+        break;
+      }
+
+      case BPF_JMP:
+        if (BPF_OP(insn->code) == BPF_JA) {
+          path->pc += insn->k;
+          break;
+        }
+
+        if (depth == cap) {
+          bpf_path *grown = realloc(stack, 2 * cap * sizeof(bpf_path));
+          if (!grown) {
+            free(stack);
+            return count;
+          }
+          stack = grown;
+          cap *= 2;
+          path = &stack[depth - 1];
+        }
+
+        // Explore the false branch later, continue with the true branch
+        bpf_path *other = &stack[depth];
+        *other = *path;
+        other->pc += insn->jf;
+        path->pc += insn->jt;
+        int keep_other = BPF_SRC(insn->code) != BPF_K || bpf_path_constrain(other, BPF_OP(insn->code), insn->k, 0) == 0;
+        int keep_path = BPF_SRC(insn->code) != BPF_K || bpf_path_constrain(path, BPF_OP(insn->code), insn->k, 1) == 0;
+        if (keep_path && keep_other) {
+          depth++;
+        }
+        else if (!keep_path && keep_other) {
+          *path = *other;
+        }
+        else if (!keep_path) {
+          depth--;
+        }
+        break;
+    }
+  }
+
+  free(stack);
+  return count;
+}
+
+/**
+ * Differential check of two programs
+ */
+typedef struct {
+  const struct sock_filter *a;
+  unsigned int a_len;
+  const struct sock_filter *b;
+  unsigned int b_len;
+  unsigned long mismatches;
+  unsigned long executed_a;
+  unsigned long executed_b;
+} bpf_compare;
+
+static void bpf_compare_witness(const struct seccomp_data *data, void *arg) {
+  bpf_compare *compare = arg;
+  uint32_t action_a = 0;
+  uint32_t action_b = 0;
+  unsigned int executed_a = 0;
+  unsigned int executed_b = 0;
+  int rc_a = seccomplite_bpf_run(compare->a, compare->a_len, data, &action_a, &executed_a);
+  int rc_b = seccomplite_bpf_run(compare->b, compare->b_len, data, &action_b, &executed_b);
+  if (rc_a != rc_b || action_a != action_b) {
+    compare->mismatches++;
+  }
+  compare->executed_a += executed_a;
+  compare->executed_b += executed_b;
+}
+
+unsigned long seccomplite_bpf_compare(const struct sock_filter *a, unsigned int a_len, const struct sock_filter *b, unsigned int b_len, seccomplite_BpfReport *report) {
+  bpf_compare compare = { a, a_len, b, b_len, 0, 0, 0 };
+  unsigned long witnesses = seccomplite_bpf_witnesses(a, a_len, bpf_compare_witness, &compare);
+  witnesses += seccomplite_bpf_witnesses(b, b_len, bpf_compare_witness, &compare);
+  if (report) {
+    report->witnesses = witnesses;
+    report->executed_before = compare.executed_a;
+    report->executed_after = compare.executed_b;
+  }
+
+  return compare.mismatches;
+}
+
+int seccomplite_bpf_optimize(const struct sock_filter *insns, unsigned int len, int flags, struct sock_filter **out, unsigned int *out_len, seccomplite_BpfReport *report) {
+  memset(report, 0, sizeof(seccomplite_BpfReport));
+  report->before = len;
+  if (seccomplite_bpf_check(insns, len) != 0) {
+    return -EINVAL;
+  }
+
+  bpf_node *nodes = calloc(len, sizeof(bpf_node));
+  if (!nodes) {
+    return -ENOMEM;
+  }
+
+  unsigned int index = 0;
+  for (index = 0; index < len; index++) {
+    nodes[index].code = insns[index].code;
+    nodes[index].k = insns[index].k;
+    nodes[index].alive = 1;
+    if (bpf_is_cond(insns[index].code)) {
+      nodes[index].jt = index + 1 + insns[index].jt;
+      nodes[index].jf = index + 1 + insns[index].jf;
+    }
+    else if (BPF_CLASS(insns[index].code) == BPF_JMP) {
+      nodes[index].jt = index + 1 + insns[index].k;
+    }
+    else {
+      nodes[index].next = index + 1;
+    }
+  }
+
+  int rc = 0;
+  unsigned int round = 0;
+  for (round = 0; rc == 0 && round < BPF_OPT_ROUNDS; round++) {
+    unsigned int threaded = bpf_pass_thread(nodes, len);
+    unsigned int loads = 0;
+    unsigned int returns = 0;
+    unsigned int dead = 0;
+    unsigned int shared = 0;
+    rc = bpf_pass_loads(nodes, len, &loads);
+    rc = rc ? rc : bpf_pass_returns(nodes, len, &returns);
+    if (rc == 0 && (flags & SECCOMPLITE_BPF_SHARE_BLOCKS)) {
+      rc = bpf_pass_share(nodes, len, &shared);
+    }
+    rc = rc ? rc : bpf_pass_dead(nodes, len, &dead);
+
+    report->threaded += threaded;
+    report->loads += loads;
+    report->returns += returns;
+    report->dead += dead;
+    report->shared += shared;
+    if (!threaded && !loads && !returns && !dead && !shared) {
+      break;
+    }
+  }
+
+  struct sock_filter *result = NULL;
+  unsigned int result_len = 0;
+  rc = rc ? rc : bpf_layout(nodes, len, &result, &result_len);
+  free(nodes);
+  if (rc != 0) {
+    return rc;
+  }
+
+  if (seccomplite_bpf_check(result, result_len) != 0) {
+    report->verified = -1;
+  }
+  else if (flags & SECCOMPLITE_BPF_VERIFY) {
+    unsigned long mismatches = seccomplite_bpf_compare(insns, len, result, result_len, report);
+    report->verified = mismatches ? -1 : 1;
+  }
+
+  // Never hand out a program that failed verification
+  if (report->verified < 0) {
+    free(result);
+    result = malloc(len * sizeof(struct sock_filter));
+    if (!result) {
+      return -ENOMEM;
+    }
+    memcpy(result, insns, len * sizeof(struct sock_filter));
+    result_len = len;
+  }
+
+  report->after = result_len;
+  *out = result;
+  *out_len = result_len;
+  return 0;
+}
@@ -0,0 +1,838 @@
+/*
+ * Broker submodule in seccomplite library
+ * Author: Michael Witt <m.witt@htw-berlin.de>
+ *
+ * The supervisor thread answers the open requests of a notifying filter
+ * without the GIL.  It copies the path out of the target, checks the copy
+ * and opens it itself, so the target can not swap the path after the
+ * check.  The prefix tree is only modified while the thread is stopped.
+ */
+
+#include <Python.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <seccomp.h>
+#include <linux/openat2.h>
+#include <linux/seccomp.h>
+#include "inc/config.h"
+#include "inc/broker.h"
+#include "inc/seccomplite.h"
+
+#ifndef SECCOMP_ADDFD_FLAG_SEND
+#define SECCOMP_ADDFD_FLAG_SEND (1UL << 1)
+#endif
+
+/**
+ * Maximum number of components of a requested path
+ */
+#define BROKER_MAX_DEPTH 512
+
+/**
+ * Absolute request paths are the base directory and the requested path
+ */
+#define BROKER_PATH_SIZE (2 * PATH_MAX)
+
+static PyObject * Broker_get_paths(seccomplite_BrokerObject *self, void *closure);
+static PyObject * Broker_get_running(seccomplite_BrokerObject *self, void *closure);
+static PyObject * Broker_get_counter(seccomplite_BrokerObject *self, void *closure);
+
+/**
+ * Broker type member and methods definitions
+ */
+static PyGetSetDef Broker_getset[] = {
+  {"paths", (getter) Broker_get_paths, NULL, "Dict of the allowed prefixes and their modes", NULL},
+  {"running", (getter) Broker_get_running, NULL, "True between start and stop", NULL},
+  {"served", (getter) Broker_get_counter, NULL, "Requests answered with a descriptor", (void *) offsetof(seccomplite_BrokerObject, _served)},
+  {"denied", (getter) Broker_get_counter, NULL, "Requests refused by the prefix tree", (void *) offsetof(seccomplite_BrokerObject, _denied)},
+  {"errors", (getter) Broker_get_counter, NULL, "Allowed requests that failed, including failed opens passed on to the target", (void *) offsetof(seccomplite_BrokerObject, _errors)},
+  { NULL } /* Sentinel */
+};
+
+static PyMethodDef Broker_methods[] = {
+  { "add", (PyCFunction)Broker_add, METH_FASTCALL | METH_KEYWORDS, "Allow a path prefix \nArguments:\n prefix absolute path mode r to open read-only rw to also write and create files default r \nDescription:\n The prefix is normalised lexically the longest matching prefix of a request decides Prefixes can only be added while the broker is stopped" },
+  { "start", (PyCFunction)Broker_start, METH_FASTCALL | METH_KEYWORDS, "Start serving a listener \nArguments:\n fd listener descriptor returned by Filter.load or Program.load \nDescription:\n Duplicate the listener and start the supervisor thread open openat and openat2 requests below an allowed prefix are opened by the supervisor relative to an O_PATH descriptor of the prefix taken now and with RESOLVE_BENEATH the descriptor is injected into the target Other paths fail with EACCES other syscalls with EPERM Files are created with the umask of the supervisor" },
+  { "stop", (PyCFunction)Broker_stop, METH_NOARGS, "Stop the supervisor thread and close the listener \nDescription:\n Targets waiting for an answer fail with ENOSYS once no listener is left" },
+  { NULL } /* Sentinel */
+};
+
+/**
+ * Broker type slots definitions
+ */
+static PyType_Slot seccomplite_BrokerTypeSlots[] = {
+  { Py_tp_methods, Broker_methods },
+  { Py_tp_getset, Broker_getset },
+  { Py_tp_init, Broker_init },
+  { Py_tp_new, Broker_new },
+  { Py_tp_dealloc, Broker_dealloc },
+  { Py_tp_repr, Broker_repr },
+  { 0, NULL }
+};
+
+/**
+ * Broker type specs
+ */
+PyType_Spec seccomplite_BrokerTypeSpec = {
+  MODULE_NAME "." BROKER_TYPE_NAME,
+  sizeof (seccomplite_BrokerObject),
+  0,
+  Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE,
+  seccomplite_BrokerTypeSlots
+};
+
+/// Prefix tree
+
+static void broker_free(seccomplite_BrokerNode *node) {
+  while (node) {
+    seccomplite_BrokerNode *next = node->next;
+    broker_free(node->child);
+    free(node->name);
+    free(node);
+    node = next;
+  }
+}
+
+/**
+ * Split an absolute path into its components in place, "." is dropped and
+ * ".." removes the previous component
+ * @return Number of components, -1 if there are more than max
+ */
+static int broker_split(char *path, char **components, int max) {
+  int count = 0;
+  char *save = NULL;
+  char *part = NULL;
+  for (part = strtok_r(path, "/", &save); part; part = strtok_r(NULL, "/", &save)) {
+    if (strcmp(part, ".") == 0) {
+      continue;
+    }
+    else if (strcmp(part, "..") == 0) {
+      count -= count > 0;
+    }
+    else if (count == max) {
+      return -1;
+    }
+    else {
+      components[count++] = part;
+    }
+  }
+  return count;
+}
+
+/**
+ * Add a prefix to the tree, an existing prefix gets the new mode
+ * @return 0 on success, -1 if out of memory
+ */
+static int broker_insert(seccomplite_BrokerNode *root, char **components, int count, int mode) {
+  seccomplite_BrokerNode *node = root;
+  int index = 0;
+  for (index = 0; index < count; index++) {
+    seccomplite_BrokerNode *child = node->child;
+    while (child && strcmp(child->name, components[index]) != 0) {
+      child = child->next;
+    }
+
+    if (!child) {
+      child = calloc(1, sizeof(seccomplite_BrokerNode));
+      if (!child || !(child->name = strdup(components[index]))) {
+        free(child);
+        return -1;
+      }
+      child->fd = -1;
+      child->next = node->child;
+      node->child = child;
+    }
+    node = child;
+  }
+
+  node->mode = mode;
+  return 0;
+}
+
+/**
+ * Find the longest prefix of a path
+ * @param depth Receives the number of components covered by the prefix
+ * @return The prefix node, NULL if no prefix matches
+ */
+static const seccomplite_BrokerNode * broker_match(const seccomplite_BrokerNode *root, char **components, int count, int *depth) {
+  const seccomplite_BrokerNode *match = root->mode ? root : NULL;
+  const seccomplite_BrokerNode *node = root;
+  int index = 0;
+  *depth = 0;
+  for (index = 0; index < count; index++) {
+    for (node = node->child; node && strcmp(node->name, components[index]) != 0; node = node->next);
+    if (!node) {
+      break;
+    }
+    else if (node->mode) {
+      match = node;
+      *depth = index + 1;
+    }
+  }
+  return match;
+}
+
+/**
+ * Open the O_PATH descriptors of all prefixes below a node, prefixes that
+ * do not exist keep -1
+ * @param path Path of the parent node, len bytes without trailing slash
+ */
+static void broker_open(seccomplite_BrokerNode *node, char *path, size_t len) {
+  for (; node; node = node->next) {
+    int written = snprintf(path + len, PATH_MAX - len, "/%s", node->name);
+    if (written < 0 || (size_t) written >= PATH_MAX - len) {
+      continue;
+    }
+
+    if (node->mode) {
+      node->fd = open(path, O_PATH | O_CLOEXEC);
+    }
+    broker_open(node->child, path, len + written);
+  }
+}
+
+static void broker_close(seccomplite_BrokerNode *node) {
+  for (; node; node = node->next) {
+    if (node->fd >= 0) {
+      close(node->fd);
+      node->fd = -1;
+    }
+    broker_close(node->child);
+  }
+}
+
+/**
+ * Add all prefixes below a node to a dict
+ * @return 0 on success, -1 with exception set
+ */
+static int broker_collect(const seccomplite_BrokerNode *node, char *path, size_t len, PyObject *paths) {
+  for (; node; node = node->next) {
+    int written = snprintf(path + len, PATH_MAX - len, "/%s", node->name);
+    if (written < 0 || (size_t) written >= PATH_MAX - len) {
+      continue;
+    }
+
+    if (node->mode) {
+      PyObject *key = PyUnicode_DecodeFSDefault(path);
+      PyObject *mode = PyUnicode_FromString(node->mode & SECCOMPLITE_BROKER_WRITE ? "rw" : "r");
+      int rc = key && mode ? PyDict_SetItem(paths, key, mode) : -1;
+      Py_XDECREF(key);
+      Py_XDECREF(mode);
+      if (rc != 0) {
+        return -1;
+      }
+    }
+
+    if (broker_collect(node->child, path, len + written, paths) != 0) {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+/// Supervisor
+
+/**
+ * One open request of the target
+ */
+typedef struct {
+  int dirfd;
+  uint64_t path;
+  int flags;
+  mode_t mode;
+  uint64_t resolve;
+} broker_request;
+
+/**
+ * Copy memory of the target, strings are read page by page up to the
+ * terminating NUL since the next page may not be mapped
+ * @return 0 on success, an errno value otherwise
+ */
+static int broker_read(int mem, uint64_t address, char *buffer, size_t size, int string) {
+  size_t done = 0;
+  while (done < size) {
+    size_t chunk = size - done;
+    if (string) {
+      size_t page = 4096 - ((address + done) & 4095);
+      chunk = chunk < page ? chunk : page;
+    }
+
+    ssize_t got = pread(mem, buffer + done, chunk, (off_t) (address + done));
+    if (got <= 0) {
+      return got < 0 ? errno : EFAULT;
+    }
+    else if (string && memchr(buffer + done, '\0', got)) {
+      return 0;
+    }
+    done += got;
+  }
+
+  return string ? ENAMETOOLONG : 0;
+}
+
+/**
+ * Decode the arguments of an open syscall
+ * @return 0 on success, an errno value to answer with otherwise
+ */
+static int broker_decode(const struct seccomp_notif *req, int mem, broker_request *request) {
+  const __u64 *args = req->data.args;
+  if (req->data.arch != seccomp_arch_native()) {
+    return EPERM;
+  }
+#ifdef __NR_open
+  else if (req->data.nr == __NR_open) {
+    request->dirfd = AT_FDCWD;
+    request->path = args[0];
+    request->flags = (int) args[1];
+    request->mode = (mode_t) args[2];
+    return 0;
+  }
+#endif
+  else if (req->data.nr == __NR_openat) {
+    request->dirfd = (int) args[0];
+    request->path = args[1];
+    request->flags = (int) args[2];
+    request->mode = (mode_t) args[3];
+    return 0;
+  }
+#ifdef __NR_openat2
+  else if (req->data.nr == __NR_openat2) {
+    struct open_how how;
+    if (args[3] < sizeof(how)) {
+      return EINVAL;
+    }
+
+    int rc = broker_read(mem, args[2], (char *) &how, sizeof(how), 0);
+    if (rc != 0) {
+      return rc;
+    }
+
+    // RESOLVE_IN_ROOT can not be combined with RESOLVE_BENEATH
+    request->dirfd = (int) args[0];
+    request->path = args[1];
+    request->flags = (int) how.flags;
+    request->mode = (mode_t) how.mode;
+    request->resolve = how.resolve & ~(uint64_t) RESOLVE_IN_ROOT;
+    return 0;
+  }
+#endif
+
+  return EPERM;
+}
+
+/**
+ * Build the normalised absolute path of a request
+ * @return 0 on success, an errno value otherwise
+ */
+static int broker_resolve(const struct seccomp_notif *req, int mem, const broker_request *request, char *path) {
+  size_t len = 0;
+  char target[PATH_MAX];
+  int rc = broker_read(mem, request->path, target, sizeof(target), 1);
+  if (rc != 0) {
+    return rc;
+  }
+  else if (target[0] == '\0') {
+    return ENOENT;
+  }
+
+  // Relative paths start at the working directory or the given descriptor
+  if (target[0] != '/') {
+    char link[64];
+    if (request->dirfd == AT_FDCWD) {
+      snprintf(link, sizeof(link), "/proc/%u/cwd", req->pid);
+    }
+    else {
+      snprintf(link, sizeof(link), "/proc/%u/fd/%d", req->pid, request->dirfd);
+    }
+
+    ssize_t got = readlink(link, path, PATH_MAX - 1);
+    if (got < 0) {
+      return errno == ENOENT ? EBADF : errno;
+    }
+    else if (path[0] != '/') {
+      // Sockets, pipes and anonymous inodes
+      return ENOTDIR;
+    }
+    len = got;
+    path[len++] = '/';
+  }
+
+  memcpy(path + len, target, strlen(target) + 1);
+  return 0;
+}
+
+/**
+ * Open a request below its prefix
+ * @return The descriptor, -1 with errno set
+ */
+static int broker_open_below(const seccomplite_BrokerNode *prefix, char **components, int count, int depth, const broker_request *request) {
+  if (prefix->fd < 0) {
+    errno = ENOENT;
+    return -1;
+  }
+
+  // The prefix itself is reopened through its descriptor
+  char path[BROKER_PATH_SIZE];
+  if (depth == count) {
+    snprintf(path, sizeof(path), "/proc/self/fd/%d", prefix->fd);
+    return open(path, (request->flags & ~O_NOFOLLOW) | O_CLOEXEC, request->mode);
+  }
+
+  size_t len = 0;
+  int index = 0;
+  for (index = depth; index < count; index++) {
+    len += snprintf(path + len, sizeof(path) - len, index > depth ? "/%s" : "%s", components[index]);
+  }
+
+  struct open_how how;
+  memset(&how, 0, sizeof(how));
+  how.flags = (unsigned int) request->flags | O_CLOEXEC;
+  how.resolve = request->resolve | RESOLVE_BENEATH;
+  if ((request->flags & O_CREAT) || (request->flags & O_TMPFILE) == O_TMPFILE) {
+    how.mode = request->mode & 07777;
+  }
+  return (int) syscall(__NR_openat2, prefix->fd, path, &how, sizeof(how));
+}
+
+/**
+ * Inject a descriptor into the target and answer the request with it
+ * @return 0 on success, an errno value to answer with otherwise
+ */
+static int broker_inject(int listener, const struct seccomp_notif *req, struct seccomp_notif_resp *resp, int fd, int flags) {
+  struct seccomp_notif_addfd addfd;
+  memset(&addfd, 0, sizeof(addfd));
+  addfd.id = req->id;
+  addfd.flags = SECCOMP_ADDFD_FLAG_SEND;
+  addfd.srcfd = fd;
+  addfd.newfd_flags = flags & O_CLOEXEC;
+
+  // Injecting and answering atomically needs Linux 5.14
+  if (ioctl(listener, SECCOMP_IOCTL_NOTIF_ADDFD, &addfd) >= 0) {
+    return 0;
+  }
+  else if (errno != EINVAL) {
+    return errno;
+  }
+
+  addfd.flags = 0;
+  int newfd = ioctl(listener, SECCOMP_IOCTL_NOTIF_ADDFD, &addfd);
+  if (newfd < 0) {
+    return errno;
+  }
+
+  resp->id = req->id;
+  resp->val = newfd;
+  resp->error = 0;
+  resp->flags = 0;
+  seccomp_notify_respond(listener, resp);
+  return 0;
+}
+
+static void broker_respond(int listener, const struct seccomp_notif *req, struct seccomp_notif_resp *resp, int error) {
+  resp->id = req->id;
+  resp->val = 0;
+  resp->error = -error;
+  resp->flags = 0;
+  seccomp_notify_respond(listener, resp);
+}
+
+/**
+ * Answer one request
+ */
+static void broker_serve(seccomplite_BrokerObject *self, const struct seccomp_notif *req, struct seccomp_notif_resp *resp) {
+  char mempath[64];
+  snprintf(mempath, sizeof(mempath), "/proc/%u/mem", req->pid);
+  int mem = open(mempath, O_RDONLY | O_CLOEXEC);
+
+  broker_request request = { 0 };
+  char path[BROKER_PATH_SIZE];
+  int rc = mem < 0 ? errno : broker_decode(req, mem, &request);
+  if (rc == 0) {
+    rc = broker_resolve(req, mem, &request, path);
+  }
+  if (mem >= 0) {
+    close(mem);
+  }
+
+  // The pid could have been reused while the target memory was read
+  if (seccomp_notify_id_valid(self->_listener, req->id) != 0) {
+    return;
+  }
+  else if (rc != 0) {
+    __atomic_fetch_add(rc == EPERM ? &self->_denied : &self->_errors, 1, __ATOMIC_RELAXED);
+    broker_respond(self->_listener, req, resp, rc);
+    return;
+  }
+
+  char *components[BROKER_MAX_DEPTH];
+  int depth = 0;
+  int count = broker_split(path, components, BROKER_MAX_DEPTH);
+  const seccomplite_BrokerNode *prefix = count < 0 ? NULL : broker_match(self->_root, components, count, &depth);
+  int writing = (request.flags & O_ACCMODE) != O_RDONLY || (request.flags & (O_CREAT | O_TRUNC));
+  if (count < 0) {
+    __atomic_fetch_add(&self->_errors, 1, __ATOMIC_RELAXED);
+    broker_respond(self->_listener, req, resp, ENAMETOOLONG);
+    return;
+  }
+  else if (!prefix || (writing && !(prefix->mode & SECCOMPLITE_BROKER_WRITE))) {
+    __atomic_fetch_add(&self->_denied, 1, __ATOMIC_RELAXED);
+    broker_respond(self->_listener, req, resp, EACCES);
+    return;
+  }
+
+  int fd = broker_open_below(prefix, components, count, depth, &request);
+  rc = fd < 0 ? errno : broker_inject(self->_listener, req, resp, fd, request.flags);
+  if (fd >= 0) {
+    close(fd);
+  }
+
+  if (rc == 0) {
+    __atomic_fetch_add(&self->_served, 1, __ATOMIC_RELAXED);
+  }
+  else {
+    __atomic_fetch_add(&self->_errors, 1, __ATOMIC_RELAXED);
+    broker_respond(self->_listener, req, resp, rc);
+  }
+}
+
+static void * broker_supervisor(void *arg) {
+  seccomplite_BrokerObject *self = arg;
+  struct seccomp_notif *req = NULL;
+  struct seccomp_notif_resp *resp = NULL;
+  if (seccomp_notify_alloc(&req, &resp) != 0) {
+    __atomic_fetch_add(&self->_errors, 1, __ATOMIC_RELAXED);
+    return NULL;
+  }
+
+  struct pollfd fds[2] = {
+    { .fd = self->_listener, .events = POLLIN },
+    { .fd = self->_wakeup, .events = POLLIN }
+  };
+  for (;;) {
+    if (poll(fds, 2, -1) < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      break;
+    }
+    else if (fds[1].revents || !(fds[0].revents & POLLIN)) {
+      // Stopped, or every filter using the listener is gone
+      break;
+    }
+
+    // Fails when the target was interrupted before the request was read
+    memset(req, 0, sizeof(*req));
+    if (seccomp_notify_receive(self->_listener, req) == 0) {
+      broker_serve(self, req, resp);
+    }
+  }
+
+  seccomp_notify_free(req, resp);
+  return NULL;
+}
+
+/// Broker type methods
+
+/**
+ * Stop the supervisor and close all descriptors
+ */
+static void broker_shutdown(seccomplite_BrokerObject *self) {
+  if (!self->_running) {
+    return;
+  }
+
+  uint64_t one = 1;
+  if (write(self->_wakeup, &one, sizeof(one)) != sizeof(one)) {
+    // The eventfd can only overflow, the thread is woken up anyway
+  }
+  Py_BEGIN_ALLOW_THREADS
+  pthread_join(self->_thread, NULL);
+  Py_END_ALLOW_THREADS
+
+  close(self->_listener);
+  close(self->_wakeup);
+  self->_listener = -1;
+  self->_wakeup = -1;
+  broker_close(self->_root);
+  self->_running = 0;
+}
+
+void Broker_dealloc(seccomplite_BrokerObject *self) {
+  if (self->_root) {
+    broker_shutdown(self);
+    broker_free(self->_root);
+  }
+  Py_TYPE(self)->tp_free((PyObject*) self);
+}
+
+PyObject * Broker_new(PyTypeObject *type, PyObject *args, PyObject *kwds) {
+  seccomplite_BrokerObject *self;
+
+  self = (seccomplite_BrokerObject *) type->tp_alloc(type, 0);
+  if (self != NULL) {
+    self->_root = calloc(1, sizeof(seccomplite_BrokerNode));
+    if (!self->_root) {
+      Py_DECREF(self);
+      return PyErr_NoMemory();
+    }
+    self->_root->fd = -1;
+    self->_listener = -1;
+    self->_wakeup = -1;
+    self->_running = 0;
+    self->_served = 0;
+    self->_denied = 0;
+    self->_errors = 0;
+  }
+
+  return (PyObject *) self;
+}
+
+/**
+ * Add one prefix
+ * @return 0 on success, -1 with exception set
+ */
+static int Broker_insert(seccomplite_BrokerObject *self, PyObject *prefix, PyObject *mode) {
+  const char *value = PyUnicode_Check(mode) ? PyUnicode_AsUTF8(mode) : NULL;
+  int bits = 0;
+  if (value && strcmp(value, "r") == 0) {
+    bits = SECCOMPLITE_BROKER_READ;
+  }
+  else if (value && strcmp(value, "rw") == 0) {
+    bits = SECCOMPLITE_BROKER_READ | SECCOMPLITE_BROKER_WRITE;
+  }
+  else {
+    PyErr_SetString(PyExc_ValueError, "Mode must be 'r' or 'rw'");
+    return -1;
+  }
+
+  PyObject *encoded = NULL;
+  if (!PyUnicode_FSConverter(prefix, &encoded)) {
+    return -1;
+  }
+
+  char path[PATH_MAX];
+  char *components[BROKER_MAX_DEPTH];
+  const char *bytes = PyBytes_AS_STRING(encoded);
+  int count = -1;
+  if (bytes[0] == '/' && strlen(bytes) < sizeof(path)) {
+    strcpy(path, bytes);
+    count = broker_split(path, components, BROKER_MAX_DEPTH);
+  }
+  Py_DECREF(encoded);
+
+  if (count < 0) {
+    PyErr_SetString(PyExc_ValueError, "Prefixes must be absolute paths");
+    return -1;
+  }
+  else if (broker_insert(self->_root, components, count, bits) != 0) {
+    PyErr_NoMemory();
+    return -1;
+  }
+  return 0;
+}
+
+/**
+ * Add all prefixes of a dict
+ * @return 0 on success, -1 with exception set
+ */
+static int Broker_setup(seccomplite_BrokerObject *self, PyObject *paths) {
+  if (!paths || paths == Py_None) {
+    return 0;
+  }
+  else if (!PyDict_Check(paths)) {
+    PyErr_SetString(PyExc_TypeError, "Paths must be a dict of prefixes and modes");
+    return -1;
+  }
+
+  Py_ssize_t position = 0;
+  PyObject *prefix = NULL;
+  PyObject *mode = NULL;
+  while (PyDict_Next(paths, &position, &prefix, &mode)) {
+    if (Broker_insert(self, prefix, mode) != 0) {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+/**
+ * Constructor parameters
+ */
+static char *Broker_kwlist[] = {"paths", NULL};
+
+int Broker_init(seccomplite_BrokerObject *self, PyObject *args, PyObject *kwds) {
+  PyObject *paths = NULL;
+  if (!PyArg_ParseTupleAndKeywords(args, kwds, "|O", Broker_kwlist, &paths)) {
+    return -1;
+  }
+
+  if (self->_running) {
+    PyErr_SetString(PyExc_ValueError, "Prefixes can not be changed while the broker is running");
+    return -1;
+  }
+
+  broker_free(self->_root->child);
+  self->_root->child = NULL;
+  self->_root->mode = 0;
+  return Broker_setup(self, paths);
+}
+
+PyObject * Broker_vectorcall(PyObject *type, PyObject *const *args, size_t nargsf, PyObject *kwnames) {
+  PyObject *paths = NULL;
+  if (!seccomplite_parse_vector(args, PyVectorcall_NARGS(nargsf), kwnames, "|O:" BROKER_TYPE_NAME, Broker_kwlist, &paths)) {
+    return NULL;
+  }
+
+  seccomplite_BrokerObject *self = (seccomplite_BrokerObject *) Broker_new((PyTypeObject *) type, NULL, NULL);
+  if (self && Broker_setup(self, paths) != 0) {
+    Py_CLEAR(self);
+  }
+  return (PyObject *) self;
+}
+
+PyObject * Broker_add(seccomplite_BrokerObject *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames) {
+  PyObject *prefix = NULL;
+  PyObject *mode = NULL;
+  static char *kwlist[] = {"prefix", "mode", NULL};
+  if (!seccomplite_parse_vector(args, nargs, kwnames, "O|U:add", kwlist, &prefix, &mode)) {
+    return NULL;
+  }
+
+  if (self->_running) {
+    PyErr_SetString(PyExc_ValueError, "Prefixes can not be changed while the broker is running");
+    return NULL;
+  }
+
+  PyObject *read_only = mode ? NULL : PyUnicode_FromString("r");
+  int rc = Broker_insert(self, prefix, mode ? mode : read_only);
+  Py_XDECREF(read_only);
+  if (rc != 0) {
+    return NULL;
+  }
+
+  Py_RETURN_NONE;
+}
+
+PyObject * Broker_start(seccomplite_BrokerObject *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames) {
+  PyObject *file = NULL;
+  static char *kwlist[] = {"fd", NULL};
+  if (!seccomplite_parse_vector(args, nargs, kwnames, "O:start", kwlist, &file)) {
+    return NULL;
+  }
+
+  if (self->_running) {
+    PyErr_SetString(PyExc_ValueError, "Broker is already running");
+    return NULL;
+  }
+
+  int fd = PyObject_AsFileDescriptor(file);
+  if (fd < 0) {
+    PyErr_SetString(PyExc_AttributeError, "Given file descriptor appears to be invalid");
+    return NULL;
+  }
+
+  self->_listener = fcntl(fd, F_DUPFD_CLOEXEC, 0);
+  self->_wakeup = self->_listener < 0 ? -1 : eventfd(0, EFD_CLOEXEC);
+  if (self->_wakeup < 0) {
+    PyErr_SetFromErrno(PyExc_OSError);
+    if (self->_listener >= 0) {
+      close(self->_listener);
+    }
+    self->_listener = -1;
+    return NULL;
+  }
+
+  // Prefixes are pinned now, later renames do not move them
+  char path[PATH_MAX];
+  if (self->_root->mode) {
+    self->_root->fd = open("/", O_PATH | O_CLOEXEC);
+  }
+  broker_open(self->_root->child, path, 0);
+
+  int rc = pthread_create(&self->_thread, NULL, broker_supervisor, self);
+  if (rc != 0) {
+    close(self->_listener);
+    close(self->_wakeup);
+    self->_listener = -1;
+    self->_wakeup = -1;
+    broker_close(self->_root);
+    errno = rc;
+    return PyErr_SetFromErrno(PyExc_OSError);
+  }
+
+  self->_running = 1;
+  Py_RETURN_NONE;
+}
+
+PyObject * Broker_stop(seccomplite_BrokerObject *self) {
+  broker_shutdown(self);
+  Py_RETURN_NONE;
+}
+
+static PyObject * Broker_get_paths(seccomplite_BrokerObject *self, void *closure) {
+  PyObject *paths = PyDict_New();
+  if (paths && self->_root->mode) {
+    PyObject *mode = PyUnicode_FromString(self->_root->mode & SECCOMPLITE_BROKER_WRITE ? "rw" : "r");
+    if (!mode || PyDict_SetItemString(paths, "/", mode) != 0) {
+      Py_CLEAR(paths);
+    }
+    Py_XDECREF(mode);
+  }
+
+  char path[PATH_MAX];
+  if (paths && broker_collect(self->_root->child, path, 0, paths) != 0) {
+    Py_CLEAR(paths);
+  }
+  return paths;
+}
+
+static PyObject * Broker_get_running(seccomplite_BrokerObject *self, void *closure) {
+  return PyBool_FromLong(self->_running);
+}
+
+static PyObject * Broker_get_counter(seccomplite_BrokerObject *self, void *closure) {
+  unsigned long long *counter = (unsigned long long *) ((char *) self + (size_t) closure);
+  return PyLong_FromUnsignedLongLong(__atomic_load_n(counter, __ATOMIC_RELAXED));
+}
+
+PyObject * Broker_repr(seccomplite_BrokerObject *self) {
+  PyObject *paths = Broker_get_paths(self, NULL);
+  if (!paths) {
+    return NULL;
+  }
+
+  PyObject *result = PyUnicode_FromFormat("%s(%R)", BROKER_TYPE_NAME, paths);
+  Py_DECREF(paths);
+  return result;
+}
+
+PyTypeObject * Broker_build(void) {
+  // Ready the type
+  PyObject *type = PyType_FromSpec(&seccomplite_BrokerTypeSpec);
+  PyTypeObject *result = (PyTypeObject *) type;
+
+  if (!type || PyType_Ready(result) < 0) {
+    Py_XDECREF(type);
+    return NULL;
+  }
+
+#if PY_VERSION_HEX >= 0x03090000
+  // Calling the type skips the argument tuple of tp_new and tp_init
+  result->tp_vectorcall = (vectorcallfunc) Broker_vectorcall;
+#endif
+  return result;
+}
+
+int PyObject_IsBroker(PyObject *o) {
+  PyObject *seccomplite = PyState_FindModule(&SeccompLiteModule);
+  PyObject *type = PyDict_GetItemString(PyModule_GetDict(seccomplite), BROKER_TYPE_NAME);
+  return PyObject_IsInstance(o, type) == 1;
+}
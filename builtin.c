@@ -0,0 +1,58 @@
+/*
+ * Builtin policies of the seccomplite library
+ * Author: Michael Witt <m.witt@htw-berlin.de>
+ */
+
+#include <Python.h>
+#include <string.h>
+#include "inc/config.h"
+#include "inc/builtin.h"
+#include "inc/program.h"
+
+/**
+ * The generated table is only present if policies were given at build
+ * time, see build_ext --policies in setup.py
+ */
+#ifdef SECCOMPLITE_BUILTIN_POLICIES
+#include SECCOMPLITE_BUILTIN_POLICIES
+#else
+static const seccomplite_BuiltinPolicy builtin_policies[] = {
+  { NULL, NULL, 0, 0, 0 }
+};
+#endif
+
+PyObject * seccomplite_builtin_policies(PyTypeObject *program_type) {
+  PyObject *policies = PyDict_New();
+  if (!policies) {
+    return NULL;
+  }
+
+  const seccomplite_BuiltinPolicy *policy = NULL;
+  for (policy = builtin_policies; policy->name; policy++) {
+    seccomplite_ProgramObject *program = (seccomplite_ProgramObject *) Program_new(program_type, NULL, NULL);
+    if (!program) {
+      Py_DECREF(policies);
+      return NULL;
+    }
+
+    program->_insns = PyMem_Malloc(policy->len * sizeof (struct sock_filter));
+    if (!program->_insns) {
+      Py_DECREF(program);
+      Py_DECREF(policies);
+      return PyErr_NoMemory();
+    }
+    memcpy(program->_insns, policy->insns, policy->len * sizeof (struct sock_filter));
+    program->_len = policy->len;
+    program->_flags = policy->flags;
+    program->_nnp = policy->nnp;
+
+    int rc = PyDict_SetItemString(policies, policy->name, (PyObject *) program);
+    Py_DECREF(program);
+    if (rc != 0) {
+      Py_DECREF(policies);
+      return NULL;
+    }
+  }
+
+  return policies;
+}
@@ -0,0 +1,519 @@
+/*
+ * Semantic filter difference in seccomplite library
+ * Author: Michael Witt <m.witt@htw-berlin.de>
+ *
+ * A seccomp program only looks at an argument through the comparisons of
+ * the rules, so the verdict of a syscall is constant on every product of
+ * argument atoms.  An atom is an interval between the cut points of the
+ * ordered and equality comparisons, restricted to one assignment of the
+ * bits tested by MASKED_EQ comparisons.  Both programs are evaluated once
+ * per cell on a representative value, libseccomp's precedence rules are
+ * the programs' business and need not be modelled here.
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <seccomp.h>
+#include "inc/arch.h"
+#include "inc/bpf.h"
+#include "inc/diff.h"
+
+/**
+ * One atom of an argument, rep is the smallest value in it
+ */
+typedef struct {
+  uint64_t lo;
+  uint64_t hi;
+  uint64_t bits;
+  uint64_t rep;
+} diff_atom;
+
+/**
+ * Atoms of one argument of the current syscall
+ */
+typedef struct {
+  uint64_t *cuts;
+  unsigned int num_cuts;
+  unsigned int cap;
+  uint64_t mask;
+  int overflow;
+  diff_atom *atoms;
+  unsigned int count;
+} diff_axis;
+
+/**
+ * Rule of one syscall and architecture with sorted comparisons
+ */
+typedef struct {
+  uint32_t action;
+  unsigned int argc;
+  struct scmp_arg_cmp args[6];
+} diff_rule;
+
+/**
+ * Result buffer
+ */
+typedef struct {
+  seccomplite_DiffRegion *regions;
+  unsigned int count;
+  unsigned int cap;
+} diff_result;
+
+static int diff_by_cmp(const void *a, const void *b) {
+  return memcmp(a, b, sizeof(struct scmp_arg_cmp));
+}
+
+static int diff_by_rule(const void *a, const void *b) {
+  return memcmp(a, b, sizeof(diff_rule));
+}
+
+static int diff_by_int(const void *a, const void *b) {
+  int left = *(const int *) a;
+  int right = *(const int *) b;
+  return left < right ? -1 : left > right;
+}
+
+static seccomplite_DiffRegion * diff_append(diff_result *result) {
+  if (result->count == result->cap) {
+    unsigned int cap = result->cap ? 2 * result->cap : 16;
+    seccomplite_DiffRegion *regions = realloc(result->regions, cap * sizeof(seccomplite_DiffRegion));
+    if (!regions) {
+      return NULL;
+    }
+    result->regions = regions;
+    result->cap = cap;
+  }
+
+  seccomplite_DiffRegion *region = &result->regions[result->count++];
+  memset(region, 0, sizeof(seccomplite_DiffRegion));
+  region->exact = 1;
+  return region;
+}
+
+/**
+ * Smallest value not below lo whose bits in mask equal bits
+ * @return 1 if there is one, 0 otherwise
+ */
+static int diff_next(uint64_t lo, uint64_t mask, uint64_t bits, uint64_t *value) {
+  uint64_t mismatch = (lo ^ bits) & mask;
+  if (!mismatch) {
+    *value = lo;
+    return 1;
+  }
+
+  // Keep lo above the highest mismatch and raise the lowest possible bit
+  int bit = 0;
+  for (bit = 63 - __builtin_clzll(mismatch); bit < 64; bit++) {
+    uint64_t one = 1ULL << bit;
+    if ((lo & one) || ((mask & one) && !(bits & one))) {
+      continue;
+    }
+
+    uint64_t below = one - 1;
+    *value = (lo & ~(below | one)) | one | (bits & below);
+    return 1;
+  }
+
+  return 0;
+}
+
+/**
+ * Insert a cut point into the sorted cuts of an argument unless present
+ * @return 0 on success, -ENOMEM
+ */
+static int diff_insert(diff_axis *axis, uint64_t cut) {
+  unsigned int lo = 0;
+  unsigned int hi = axis->num_cuts;
+  while (lo < hi) {
+    unsigned int mid = lo + (hi - lo) / 2;
+    if (axis->cuts[mid] < cut) {
+      lo = mid + 1;
+    }
+    else {
+      hi = mid;
+    }
+  }
+
+  if (lo < axis->num_cuts && axis->cuts[lo] == cut) {
+    return 0;
+  }
+  else if (axis->num_cuts >= SECCOMPLITE_DIFF_MAX_CELLS) {
+    // More cuts than cells, diff_atoms() gives up anyway
+    axis->overflow = 1;
+    return 0;
+  }
+
+  if (axis->num_cuts == axis->cap) {
+    unsigned int cap = axis->cap ? 2 * axis->cap : 16;
+    uint64_t *cuts = realloc(axis->cuts, cap * sizeof(uint64_t));
+    if (!cuts) {
+      return -ENOMEM;
+    }
+    axis->cuts = cuts;
+    axis->cap = cap;
+  }
+
+  memmove(&axis->cuts[lo + 1], &axis->cuts[lo], (axis->num_cuts - lo) * sizeof(uint64_t));
+  axis->cuts[lo] = cut;
+  axis->num_cuts++;
+  return 0;
+}
+
+/**
+ * Add the cut points of a comparison to its argument
+ * @return 0 on success, -ENOMEM
+ */
+static int diff_cut(diff_axis *axes, const struct scmp_arg_cmp *cmp, uint64_t width) {
+  if (cmp->arg >= 6) {
+    return 0;
+  }
+
+  diff_axis *axis = &axes[cmp->arg];
+  uint64_t datum = cmp->datum_a & width;
+  uint64_t cuts[2];
+  unsigned int count = 0;
+  switch (cmp->op) {
+    case SCMP_CMP_NE:
+    case SCMP_CMP_EQ:
+      cuts[count++] = datum;
+      cuts[count++] = datum + 1;
+      break;
+    case SCMP_CMP_LT:
+    case SCMP_CMP_GE:
+      cuts[count++] = datum;
+      break;
+    case SCMP_CMP_LE:
+    case SCMP_CMP_GT:
+      cuts[count++] = datum + 1;
+      break;
+    case SCMP_CMP_MASKED_EQ:
+      axis->mask |= datum;
+      break;
+    default:
+      break;
+  }
+
+  unsigned int index = 0;
+  for (index = 0; index < count; index++) {
+    // Cuts at 0 and past the end of the domain split nothing
+    if (cuts[index] != 0 && cuts[index] <= width && diff_insert(axis, cuts[index]) != 0) {
+      return -ENOMEM;
+    }
+  }
+
+  return 0;
+}
+
+/**
+ * Split an argument into atoms
+ * @return 0 on success, 1 if there are too many, -ENOMEM
+ */
+static int diff_atoms(diff_axis *axis, uint64_t width) {
+  if (axis->overflow || __builtin_popcountll(axis->mask) > SECCOMPLITE_DIFF_MAX_MASK_BITS) {
+    return 1;
+  }
+
+  // The cuts are sorted and unique, none of them is 0
+  size_t count = (size_t) (axis->num_cuts + 1) << __builtin_popcountll(axis->mask);
+  if (count > SECCOMPLITE_DIFF_MAX_CELLS) {
+    return 1;
+  }
+
+  axis->atoms = malloc(count * sizeof(diff_atom));
+  if (!axis->atoms) {
+    return -ENOMEM;
+  }
+
+  uint64_t lo = 0;
+  unsigned int index = 0;
+  for (index = 0; index <= axis->num_cuts; index++) {
+    uint64_t hi = index < axis->num_cuts ? axis->cuts[index] - 1 : width;
+    uint64_t bits = 0;
+    do {
+      uint64_t rep = 0;
+      if (diff_next(lo, axis->mask, bits, &rep) && rep <= hi) {
+        diff_atom *atom = &axis->atoms[axis->count++];
+        atom->lo = lo;
+        atom->hi = hi;
+        atom->bits = bits;
+        atom->rep = rep;
+      }
+      bits = (bits - axis->mask) & axis->mask;
+    } while (bits != 0);
+
+    lo = hi + 1;
+  }
+
+  return 0;
+}
+
+static int diff_has_arch(const seccomplite_DiffSide *side, uint32_t arch) {
+  unsigned int index = 0;
+  for (index = 0; index < SECCOMPLITE_SIMPLIFY_MAX_INSTANCES; index++) {
+    if (side->tokens[index] == arch) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/**
+ * Collect the rules of a syscall on an architecture in canonical form,
+ * sorted and without duplicates
+ * @return Number of rules, -ENOMEM
+ */
+static int diff_rules(const seccomplite_DiffSide *side, uint32_t arch, int syscall, diff_rule **rules) {
+  uint64_t instances = 0;
+  unsigned int index = 0;
+  for (index = 0; index < SECCOMPLITE_SIMPLIFY_MAX_INSTANCES; index++) {
+    instances |= side->tokens[index] == arch ? 1ULL << index : 0;
+  }
+
+  *rules = calloc(side->num_rules + 1, sizeof(diff_rule));
+  if (!*rules) {
+    return -ENOMEM;
+  }
+
+  unsigned int count = 0;
+  for (index = 0; index < side->num_rules; index++) {
+    const seccomplite_SimplifyRule *rule = &side->rules[index];
+    if (rule->syscall != syscall || !(rule->instances & instances)) {
+      continue;
+    }
+
+    // Only MASKED_EQ looks at the second datum
+    diff_rule *copy = &(*rules)[count++];
+    copy->action = rule->action;
+    copy->argc = rule->argc;
+    unsigned int arg = 0;
+    for (arg = 0; arg < rule->argc; arg++) {
+      copy->args[arg].arg = rule->args[arg].arg;
+      copy->args[arg].op = rule->args[arg].op;
+      copy->args[arg].datum_a = rule->args[arg].datum_a;
+      copy->args[arg].datum_b = rule->args[arg].op == SCMP_CMP_MASKED_EQ ? rule->args[arg].datum_b : 0;
+    }
+    qsort(copy->args, copy->argc, sizeof(struct scmp_arg_cmp), diff_by_cmp);
+  }
+
+  qsort(*rules, count, sizeof(diff_rule), diff_by_rule);
+  unsigned int unique = 0;
+  for (index = 0; index < count; index++) {
+    if (unique == 0 || diff_by_rule(&(*rules)[unique - 1], &(*rules)[index]) != 0) {
+      (*rules)[unique++] = (*rules)[index];
+    }
+  }
+  return (int) unique;
+}
+
+/**
+ * Check if both filters decide a syscall of an architecture with the same
+ * rules and default action, the order rules were added in does not matter
+ * to libseccomp, see seccomplite_policy_canonical()
+ * @return 1 if they do, 0 if not, -ENOMEM
+ */
+static int diff_same_rules(const seccomplite_DiffSide *a, const seccomplite_DiffSide *b, uint32_t arch, int syscall) {
+  if (!diff_has_arch(a, arch) || !diff_has_arch(b, arch) || a->def_action != b->def_action) {
+    return 0;
+  }
+
+  diff_rule *rules_a = NULL;
+  diff_rule *rules_b = NULL;
+  int count_a = diff_rules(a, arch, syscall, &rules_a);
+  int count_b = count_a < 0 ? 0 : diff_rules(b, arch, syscall, &rules_b);
+  int rc = count_a < 0 || count_b < 0 ? -ENOMEM :
+           count_a == count_b && memcmp(rules_a, rules_b, count_a * sizeof(diff_rule)) == 0;
+  free(rules_a);
+  free(rules_b);
+  return rc;
+}
+
+/**
+ * Compare one syscall of an architecture cell by cell
+ * @return 0 on success, negative errno on failure
+ */
+static int diff_syscall(const seccomplite_DiffSide *a, const seccomplite_DiffSide *b, uint32_t arch, int syscall, int nr, diff_result *result) {
+  uint64_t width = arch & __AUDIT_ARCH_64BIT ? UINT64_MAX : UINT32_MAX;
+  diff_axis *axes = calloc(6, sizeof(diff_axis));
+  if (!axes) {
+    return -ENOMEM;
+  }
+
+  const seccomplite_DiffSide *sides[2] = { a, b };
+  unsigned int side = 0;
+  unsigned int index = 0;
+  int rc = 0;
+  for (side = 0; side < 2 && rc == 0; side++) {
+    for (index = 0; index < sides[side]->num_rules && rc == 0; index++) {
+      const seccomplite_SimplifyRule *rule = &sides[side]->rules[index];
+      unsigned int arg = 0;
+      for (arg = 0; rule->syscall == syscall && arg < rule->argc && rc == 0; arg++) {
+        rc = diff_cut(axes, &rule->args[arg], width);
+      }
+    }
+  }
+
+  size_t cells = 1;
+  for (index = 0; index < 6 && rc == 0; index++) {
+    rc = diff_atoms(&axes[index], width);
+    cells *= axes[index].count ? axes[index].count : 1;
+    if (cells > SECCOMPLITE_DIFF_MAX_CELLS) {
+      rc = 1;
+    }
+  }
+
+  struct seccomp_data data;
+  memset(&data, 0, sizeof(data));
+  data.nr = nr;
+  data.arch = seccomplite_arch_kernel_token(arch);
+
+  // Too many cells, report the whole syscall unless both have the same rules
+  int inexact = rc == 1;
+  if (inexact) {
+    rc = diff_same_rules(a, b, arch, syscall);
+  }
+  if (inexact && rc == 0) {
+    seccomplite_DiffRegion *region = diff_append(result);
+    rc = region ? 0 : -ENOMEM;
+    if (region) {
+      region->arch = arch;
+      region->syscall = syscall;
+      region->exact = 0;
+    }
+  }
+
+  unsigned int odometer[6] = { 0 };
+  while (rc == 0 && !inexact) {
+    for (index = 0; index < 6; index++) {
+      data.args[index] = axes[index].count ? axes[index].atoms[odometer[index]].rep : 0;
+    }
+
+    uint32_t action_a = 0;
+    uint32_t action_b = 0;
+    if (seccomplite_bpf_run(a->insns, a->len, &data, &action_a, NULL) != 0 ||
+        seccomplite_bpf_run(b->insns, b->len, &data, &action_b, NULL) != 0) {
+      rc = -EINVAL;
+      break;
+    }
+
+    if (action_a != action_b) {
+      seccomplite_DiffRegion *region = diff_append(result);
+      if (!region) {
+        rc = -ENOMEM;
+        break;
+      }
+
+      region->arch = arch;
+      region->syscall = syscall;
+      region->action_a = action_a;
+      region->action_b = action_b;
+      for (index = 0; index < 6; index++) {
+        if (axes[index].num_cuts == 0 && axes[index].mask == 0) {
+          continue;
+        }
+
+        const diff_atom *atom = &axes[index].atoms[odometer[index]];
+        seccomplite_DiffRange *range = &region->args[region->argc++];
+        range->arg = index;
+        range->lo = atom->lo;
+        range->hi = atom->hi;
+        range->mask = axes[index].mask;
+        range->bits = atom->bits;
+      }
+    }
+
+    // Next cell, the last argument moves fastest
+    for (index = 6; index-- > 0;) {
+      if (axes[index].count && ++odometer[index] < axes[index].count) {
+        break;
+      }
+      odometer[index] = 0;
+    }
+    if (index == (unsigned int) -1) {
+      break;
+    }
+  }
+
+  for (index = 0; index < 6; index++) {
+    free(axes[index].cuts);
+    free(axes[index].atoms);
+  }
+  free(axes);
+  return rc < 0 ? rc : 0;
+}
+
+int seccomplite_diff(const seccomplite_DiffSide *a, const seccomplite_DiffSide *b, seccomplite_DiffRegion **regions) {
+  diff_result result = { NULL, 0, 0 };
+  uint32_t arches[2 * SECCOMPLITE_SIMPLIFY_MAX_INSTANCES];
+  unsigned int num_arches = 0;
+  unsigned int index = 0;
+  unsigned int other = 0;
+  for (index = 0; index < 2 * SECCOMPLITE_SIMPLIFY_MAX_INSTANCES; index++) {
+    uint32_t token = index < SECCOMPLITE_SIMPLIFY_MAX_INSTANCES ? a->tokens[index] : b->tokens[index - SECCOMPLITE_SIMPLIFY_MAX_INSTANCES];
+    for (other = 0; token && other < num_arches && arches[other] != token; other++);
+    if (token && other == num_arches) {
+      arches[num_arches++] = token;
+    }
+  }
+
+  int *syscalls = malloc((a->num_rules + b->num_rules + 1) * sizeof(int));
+  if (!syscalls) {
+    return -ENOMEM;
+  }
+
+  unsigned int num_syscalls = 0;
+  for (index = 0; index < a->num_rules; index++) {
+    syscalls[num_syscalls++] = a->rules[index].syscall;
+  }
+  for (index = 0; index < b->num_rules; index++) {
+    syscalls[num_syscalls++] = b->rules[index].syscall;
+  }
+  qsort(syscalls, num_syscalls, sizeof(int), diff_by_int);
+
+  int rc = 0;
+  unsigned int arch = 0;
+  for (arch = 0; arch < num_arches && rc == 0; arch++) {
+    // Syscalls without rules take the default action of the architecture
+    uint32_t other_a = diff_has_arch(a, arches[arch]) ? a->def_action : a->badarch;
+    uint32_t other_b = diff_has_arch(b, arches[arch]) ? b->def_action : b->badarch;
+    if (other_a != other_b) {
+      seccomplite_DiffRegion *region = diff_append(&result);
+      if (!region) {
+        rc = -ENOMEM;
+        break;
+      }
+      region->arch = arches[arch];
+      region->syscall = __NR_SCMP_ERROR;
+      region->action_a = other_a;
+      region->action_b = other_b;
+    }
+
+    for (index = 0; index < num_syscalls && rc == 0; index++) {
+      if (index > 0 && syscalls[index] == syscalls[index - 1]) {
+        continue;
+      }
+
+      int nr = syscalls[index];
+      if (arches[arch] != seccomp_arch_native()) {
+        char *name = seccomp_syscall_resolve_num_arch(SCMP_ARCH_NATIVE, nr);
+        nr = name ? seccomp_syscall_resolve_name_arch(arches[arch], name) : __NR_SCMP_ERROR;
+        free(name);
+      }
+
+      // Multiplexed pseudo syscalls never reach the filter as such
+      if (nr < 0) {
+        continue;
+      }
+      rc = diff_syscall(a, b, arches[arch], syscalls[index], nr, &result);
+    }
+  }
+
+  free(syscalls);
+  if (rc != 0) {
+    free(result.regions);
+    return rc;
+  }
+
+  *regions = result.regions;
+  return result.count;
+}
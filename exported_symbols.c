@@ -6,12 +6,14 @@
 
 #include <seccomp.h>
 #include "inc/exported_symbols.h"
+#include "inc/profile.h"
 
 void seccomplite_export_constants(PyObject *module) {
   // Actions
   PyModule_AddIntConstant(module, "KILL", SCMP_ACT_KILL);
   PyModule_AddIntConstant(module, "TRAP", SCMP_ACT_TRAP);
   PyModule_AddIntConstant(module, "ALLOW", SCMP_ACT_ALLOW);
+  PyModule_AddIntConstant(module, "NOTIFY", SCMP_ACT_NOTIFY);
   
   // Comparators
   PyModule_AddIntConstant(module, "NE", SCMP_CMP_NE);
@@ -21,4 +23,9 @@ void seccomplite_export_constants(PyObject *module) {
   PyModule_AddIntConstant(module, "GE", SCMP_CMP_GE);
   PyModule_AddIntConstant(module, "GT", SCMP_CMP_GT);
   PyModule_AddIntConstant(module, "MASKED_EQ", SCMP_CMP_MASKED_EQ); 
+
+  // Trace format
+  PyModule_AddIntConstant(module, "TRACE_RECORD_SIZE", SECCOMPLITE_TRACE_RECORD_SIZE);
+  PyModule_AddIntConstant(module, "TRACE_HEADER", SECCOMPLITE_TRACE_HEADER);
+  PyModule_AddIntConstant(module, "TRACE_INDEX", SECCOMPLITE_TRACE_INDEX);
 }
\ No newline at end of file
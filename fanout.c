@@ -0,0 +1,162 @@
+/*
+ * Multi-architecture fan-out in seccomplite library
+ * Author: Michael Witt <m.witt@htw-berlin.de>
+ *
+ * libseccomp generates the code of all architectures of a context one
+ * after another.  Fan-out filters hold every rule on every architecture,
+ * so each architecture group can be replayed into its own context and
+ * compiled on a worker thread.  The resulting programs are joined behind
+ * a short dispatch on seccomp_data.arch:
+ *
+ *   ld [arch]
+ *   jeq #group0, 0, 1
+ *   ja group0
+ *   ...
+ *   ret badarch
+ *   group0: <program of group 0>
+ *   ...
+ */
+
+#include <Python.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <seccomp.h>
+#include <linux/seccomp.h>
+#include "inc/arch.h"
+#include "inc/fanout.h"
+#include "inc/policy.h"
+#include "inc/program.h"
+
+/**
+ * One architecture group compiled by a worker
+ */
+typedef struct {
+  const uint8_t *data;
+  size_t len;
+  uint32_t kernel;
+  uint32_t arches[SECCOMPLITE_POLICY_MAX_ARCHES];
+  unsigned int num_arches;
+  struct sock_filter *insns;
+  unsigned int num_insns;
+  int rc;
+  pthread_t thread;
+  int started;
+} fanout_job;
+
+/**
+ * Split the architectures of the record into groups
+ * @return Number of groups, negative errno on failure
+ */
+static int fanout_plan(const uint8_t *data, size_t len, fanout_job *jobs) {
+  uint32_t arches[SECCOMPLITE_POLICY_MAX_ARCHES];
+  int count = seccomplite_policy_arches(data, len, arches);
+  if (count <= 0) {
+    return count < 0 ? count : -EINVAL;
+  }
+
+  int groups = 0;
+  int index = 0;
+  for (index = 0; index < count; index++) {
+    uint32_t kernel = seccomplite_arch_kernel_token(arches[index]);
+    int group = 0;
+    for (group = 0; group < groups && jobs[group].kernel != kernel; group++);
+    if (group == groups) {
+      memset(&jobs[group], 0, sizeof(fanout_job));
+      jobs[group].data = data;
+      jobs[group].len = len;
+      jobs[group].kernel = kernel;
+      groups++;
+    }
+    jobs[group].arches[jobs[group].num_arches++] = arches[index];
+  }
+
+  return groups;
+}
+
+/**
+ * Worker thread, compile one architecture group
+ */
+static void * fanout_worker(void *arg) {
+  fanout_job *job = arg;
+  scmp_filter_ctx ctx = NULL;
+
+  job->rc = seccomplite_policy_replay_arches(job->data, job->len, job->arches, job->num_arches, &ctx);
+  if (job->rc == 0) {
+    job->rc = seccomplite_ctx_export(ctx, &job->insns, &job->num_insns);
+    seccomp_release(ctx);
+  }
+
+  return NULL;
+}
+
+int seccomplite_fanout_groups(const uint8_t *data, size_t len) {
+  fanout_job jobs[SECCOMPLITE_POLICY_MAX_ARCHES];
+  return fanout_plan(data, len, jobs);
+}
+
+int seccomplite_fanout_compile(const uint8_t *data, size_t len, uint32_t badarch, struct sock_filter **insns, unsigned int *num_insns) {
+  fanout_job jobs[SECCOMPLITE_POLICY_MAX_ARCHES];
+  int groups = fanout_plan(data, len, jobs);
+  if (groups < 0) {
+    return groups;
+  }
+
+  // The calling thread compiles the first group itself
+  int index = 0;
+  for (index = 1; index < groups; index++) {
+    jobs[index].started = pthread_create(&jobs[index].thread, NULL, fanout_worker, &jobs[index]) == 0;
+  }
+  fanout_worker(&jobs[0]);
+
+  int rc = 0;
+  size_t total = 2 + 2 * (size_t) groups;
+  for (index = 0; index < groups; index++) {
+    if (jobs[index].started) {
+      pthread_join(jobs[index].thread, NULL);
+    }
+    else if (index > 0) {
+      fanout_worker(&jobs[index]);
+    }
+
+    if (jobs[index].rc != 0 && rc == 0) {
+      rc = jobs[index].rc;
+    }
+    total += jobs[index].num_insns;
+  }
+
+  struct sock_filter *result = rc == 0 ? malloc(total * sizeof(struct sock_filter)) : NULL;
+  if (rc == 0 && !result) {
+    rc = -ENOMEM;
+  }
+
+  if (rc == 0) {
+    // Architecture dispatch, every group jumps to its own program
+    unsigned int pos = 0;
+    unsigned int block = 2 + 2 * groups;
+    result[pos++] = (struct sock_filter) BPF_STMT(BPF_LD | BPF_W | BPF_ABS, offsetof(struct seccomp_data, arch));
+    for (index = 0; index < groups; index++) {
+      result[pos] = (struct sock_filter) BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, jobs[index].kernel, 0, 1);
+      result[pos + 1] = (struct sock_filter) BPF_STMT(BPF_JMP | BPF_JA, block - (pos + 2));
+      pos += 2;
+      block += jobs[index].num_insns;
+    }
+    result[pos++] = (struct sock_filter) BPF_STMT(BPF_RET | BPF_K, badarch);
+
+    for (index = 0; index < groups; index++) {
+      memcpy(&result[pos], jobs[index].insns, jobs[index].num_insns * sizeof(struct sock_filter));
+      pos += jobs[index].num_insns;
+    }
+
+    *insns = result;
+    *num_insns = pos;
+  }
+
+  for (index = 0; index < groups; index++) {
+    free(jobs[index].insns);
+  }
+
+  return rc;
+}
@@ -6,34 +6,153 @@
 #include <Python.h>
 #include <seccomp.h>
 #include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
 #include "inc/config.h"
 #include "inc/filter.h"
 #include "inc/seccomplite.h"
 #include "inc/arch.h"
 #include "inc/arg.h"
+#include "inc/program.h"
+#include "inc/registry.h"
+#include "inc/fanout.h"
+#include "inc/split.h"
+#include "inc/bpf.h"
+#include "inc/simplify.h"
+#include "inc/ruleset.h"
+#include "inc/profile.h"
+#include "inc/stats.h"
+#include "inc/diff.h"
+#include "inc/server.h"
+
+/**
+ * Marker values used for placeholders while compiling a template.  The
+ * upper 16 bits tag the 32-bit half, the lower 16 bits hold the slot or,
+ * for MASKED_EQ comparisons, the pair.
+ */
+#define PLACEHOLDER_MARK_MASK 0xFFFF0000U
+#define PLACEHOLDER_MARK_LO 0x5ECC0000U
+#define PLACEHOLDER_MARK_HI 0xA5EC0000U
+#define PLACEHOLDER_MARK_PAIR_LO 0x5ECD0000U
+#define PLACEHOLDER_MARK_PAIR_HI 0xA5ED0000U
+#define PLACEHOLDER_MAX_SLOTS 0x10000
+
+static int Filter_bind_placeholder(seccomplite_FilterObject *self, PyObject *name, scmp_datum_t *datum);
+static void Filter_save_bindings(seccomplite_FilterObject *self, seccomplite_TemplateBindings *bindings);
+static void Filter_restore_bindings(seccomplite_FilterObject *self, const seccomplite_TemplateBindings *bindings);
+static int Filter_bind_pair(seccomplite_FilterObject *self, const seccomplite_ArgObject *arg, struct scmp_arg_cmp *cmp);
 
 /**
  * Filter type member and methods definitions
  */
 static PyMemberDef Filter_members[] = {
   {"defaction", T_INT, offsetof(seccomplite_FilterObject, _def_action), 0, "Filter defaction state"},
+  {"frozen", T_BOOL, offsetof(seccomplite_FilterObject, _frozen), READONLY, "Filter was frozen and can not be modified"},
+  {"fanout", T_BOOL, offsetof(seccomplite_FilterObject, _fanout), READONLY, "Rules apply to every architecture of the filter"},
+  {"optimize", T_BOOL, offsetof(seccomplite_FilterObject, _optimize), 0, "Run the peephole optimiser on compiled programs"},
+  {"share_blocks", T_BOOL, offsetof(seccomplite_FilterObject, _share_blocks), 0, "Emit identical argument checks of different syscalls only once"},
+  {"pickle_program", T_BOOL, offsetof(seccomplite_FilterObject, _pickle_program), 0, "Include the compiled program when pickling"},
+  {"generation", T_ULONGLONG, offsetof(seccomplite_FilterObject, _generation), READONLY, "Number of modifications, compiled output is cached until the next one"},
   { NULL } /* Sentinel */
 };
 
 static PyMethodDef Filter_methods[] = {
-  { "reset", (PyCFunction)Filter_reset, METH_KEYWORDS | METH_VARARGS, "Reset the given filter \nArguments:\n defaction the default filter action \nDescription:\n Resets the seccomp filter state to an initial default state if a default filter action is not specified in the reset call the original action will be reused This function does not affect any seccomp filters alread loaded into the kernel" },
-  { "merge", (PyCFunction)Filter_merge, METH_KEYWORDS | METH_VARARGS, "Merge two existing SyscallFilter objects \nArguments:\n filter a valid SyscallFilter object \nDescription:\n Merges a valid SyscallFilter object with the current SyscallFilter object the passed filter object will be reset on success In order to successfully merge two seccomp filters they must have the same attribute values and not share any of the same architectures" },
-  { "exist_arch", (PyCFunction)Filter_exist_arch, METH_KEYWORDS | METH_VARARGS, "Check if the seccomp filter contains a given architecture \nArguments:\n arch the architecture value e.g Arch \nDescription:\n Test to see if a given architecture is included in the filter Return True is the architecture exists False if it does not exist" },
-  { "add_arch", (PyCFunction)Filter_add_arch, METH_KEYWORDS | METH_VARARGS, "Add an architecture to the filter \nArguments:\n arch the architecture value e.g Arch \nDescription:\n Add the given architecture to the filter Any new rules added after this method returns successfully will be added to this new architecture but any existing rules will not be added to the new architecture" },
-  { "remove_arch", (PyCFunction)Filter_remove_arch, METH_KEYWORDS | METH_VARARGS, "Remove an architecture from the filter \nArguments:\n arch the architecture value e.g Arch \nDescription:\n Remove the given architecture from the filter The filter must always contain at least one architecture so if only one architecture exists in the filter this method will fail" },
-  { "load", (PyCFunction)Filter_load, METH_NOARGS, "Load the filter into the Linux Kernel \nDescription:\n Load the current filter into the Linux Kernel As soon as the method returns the filter will be active and enforcing" },
-  { "get_attr", (PyCFunction)Filter_get_attr, METH_KEYWORDS | METH_VARARGS, "Get an attribute value from the filter \nArguments:\n attr the attribute e.g Attr \nDescription:\n Lookup the given attribute in the filter and return the attribute's value to the caller" },
-  { "set_attr", (PyCFunction)Filter_set_attr, METH_KEYWORDS | METH_VARARGS, "Set a filter attribute \nArguments:\n attr the attribute e.g Attr value the attribute value \nDescription:\n Lookup the given attribute in the filter and assign it the given value" },
-  { "syscall_priority", (PyCFunction)Filter_syscall_priority, METH_KEYWORDS | METH_VARARGS, "Set the filter priority of a syscall \nArguments:\n syscall the syscall name or number priority the priority of the syscall \nDescription:\n Set the filter priority of the given syscall A syscall with a higher priority will have less overhead in the generated filter code which is loaded into the system Priority values can range from 0 to 255 inclusive" },
-  { "add_rule", (PyCFunction)Filter_add_rule, METH_VARARGS, "Add a new rule to filter \nArguments:\n action the rule action KILL TRAP ERRNO TRACE or ALLOW syscall the syscall name or number args variable number of Arg objects \nDescription:\n Add a new rule to the filter matching on the given syscall and an optional list of argument comparisons If the rule is triggered the given action will be taken by the kernel In order for the rule to trigger the syscall as well as each argument comparison must be true In the case where the specific rule is not valid on a specific architecture e.g socket on 32-bit x86 this method rewrites the rule to the best possible match If you don't want this fule rewriting to take place use add_rule_exactly" },
-  { "add_rule_exactly", (PyCFunction)Filter_add_rule_exactly, METH_VARARGS, "Add a new rule to filter \nArguments:\n action the rule action KILL TRAP ERRNO TRACE or ALLOW syscall the syscall name or number args variable number of Arg objects \nDescription:\n Add a new rule to the filter matching on the given syscall and an optional list of argument comparisons If the rule is triggered the given action will be taken by the kernel In order for the rule to trigger the syscall as well as each argument comparison must be true This method attempts to add the filter rule exactly as specified which can cause problems on certain architectures e.g socket on 32-bit x86 For a architecture independent version of this method use add_rule" },
-  { "export_pfc", (PyCFunction)Filter_export_pfc, METH_KEYWORDS | METH_VARARGS, "Export the filter in PFC format \nArguments:\n file the output file \nDescription:\n Output the filter in Pseudo Filter Code PFC to the given file The output is functionally equivalent to the BPF based filter which is loaded into the Linux Kernel" },
-  { "export_bpf", (PyCFunction)Filter_export_bpf, METH_KEYWORDS | METH_VARARGS, "Export the filter in BPF format \nArguments:\n file the output file \nDescription:\n Output the filter in Berkley Packet Filter BPF to the given file The output is identical to what is loaded into the Linux Kernel" },
+  { "reset", (PyCFunction)Filter_reset, METH_FASTCALL | METH_KEYWORDS, "Reset the given filter \nArguments:\n defaction the default filter action \nDescription:\n Resets the seccomp filter state to an initial default state if a default filter action is not specified in the reset call the original action will be reused This function does not affect any seccomp filters alread loaded into the kernel" },
+  { "merge", (PyCFunction)Filter_merge, METH_FASTCALL | METH_KEYWORDS, "Merge two existing SyscallFilter objects \nArguments:\n filter a valid SyscallFilter object \nDescription:\n Merges a valid SyscallFilter object with the current SyscallFilter object the passed filter object will be reset on success In order to successfully merge two seccomp filters they must have the same attribute values and not share any of the same architectures" },
+  { "exist_arch", (PyCFunction)Filter_exist_arch, METH_FASTCALL | METH_KEYWORDS, "Check if the seccomp filter contains a given architecture \nArguments:\n arch the architecture value e.g Arch \nDescription:\n Test to see if a given architecture is included in the filter Return True is the architecture exists False if it does not exist" },
+  { "add_arch", (PyCFunction)Filter_add_arch, METH_FASTCALL | METH_KEYWORDS, "Add an architecture to the filter \nArguments:\n arch the architecture value e.g Arch \nDescription:\n Add the given architecture to the filter Any new rules added after this method returns successfully will be added to this new architecture but any existing rules will not be added to the new architecture unless the filter was created with fanout=True" },
+  { "remove_arch", (PyCFunction)Filter_remove_arch, METH_FASTCALL | METH_KEYWORDS, "Remove an architecture from the filter \nArguments:\n arch the architecture value e.g Arch \nDescription:\n Remove the given architecture from the filter The filter must always contain at least one architecture so if only one architecture exists in the filter this method will fail" },
+  { "load", (PyCFunction)Filter_load, METH_FASTCALL | METH_KEYWORDS, "Load the filter into the Linux Kernel \nArguments:\n split load oversized filters as a stack of filters see split \nDescription:\n Load the current filter into the Linux Kernel As soon as the method returns the filter will be active and enforcing Filters with NOTIFY actions return the descriptor of their listener otherwise None With shadow True every action but ALLOW and LOG is replaced by NOTIFY served by a listener thread that lets the syscall continue and counts it see shadow_report with shadow log it is replaced by LOG Shadow loads ignore TSYNC since the listener thread must not be filtered itself A failed install raises OSError with the errno of seccomp ESRCH when TSYNC could not synchronize a thread" },
+  { "get_attr", (PyCFunction)Filter_get_attr, METH_FASTCALL | METH_KEYWORDS, "Get an attribute value from the filter \nArguments:\n attr the attribute e.g Attr \nDescription:\n Lookup the given attribute in the filter and return the attribute's value to the caller" },
+  { "set_attr", (PyCFunction)Filter_set_attr, METH_FASTCALL | METH_KEYWORDS, "Set a filter attribute \nArguments:\n attr the attribute e.g Attr value the attribute value \nDescription:\n Lookup the given attribute in the filter and assign it the given value" },
+  { "syscall_priority", (PyCFunction)Filter_syscall_priority, METH_FASTCALL | METH_KEYWORDS, "Set the filter priority of a syscall \nArguments:\n syscall the syscall name or number priority the priority of the syscall \nDescription:\n Set the filter priority of the given syscall A syscall with a higher priority will have less overhead in the generated filter code which is loaded into the system Priority values can range from 0 to 255 inclusive" },
+  { "add_rule", (PyCFunction)Filter_add_rule, METH_FASTCALL, "Add a new rule to filter \nArguments:\n action the rule action KILL TRAP ERRNO TRACE or ALLOW syscall the syscall name or number args variable number of Arg objects \nDescription:\n Add a new rule to the filter matching on the given syscall and an optional list of argument comparisons If the rule is triggered the given action will be taken by the kernel In order for the rule to trigger the syscall as well as each argument comparison must be true In the case where the specific rule is not valid on a specific architecture e.g socket on 32-bit x86 this method rewrites the rule to the best possible match If you don't want this fule rewriting to take place use add_rule_exactly" },
+  { "add_rule_exactly", (PyCFunction)Filter_add_rule_exactly, METH_FASTCALL, "Add a new rule to filter \nArguments:\n action the rule action KILL TRAP ERRNO TRACE or ALLOW syscall the syscall name or number args variable number of Arg objects \nDescription:\n Add a new rule to the filter matching on the given syscall and an optional list of argument comparisons If the rule is triggered the given action will be taken by the kernel In order for the rule to trigger the syscall as well as each argument comparison must be true This method attempts to add the filter rule exactly as specified which can cause problems on certain architectures e.g socket on 32-bit x86 For a architecture independent version of this method use add_rule" },
+  { "add_rules", (PyCFunction)Filter_add_rules, METH_FASTCALL | METH_KEYWORDS, "Add all rules of a RuleSet to the filter \nArguments:\n rules the RuleSet holding the rules exact add the rules as add_rule_exactly does default False \nDescription:\n Insert the rules in order with one call instead of one add_rule call per rule Every rule is validated when it is inserted on an invalid rule or a library error the exception names the rule index and the rules before it stay in the filter" },
+  { "export_pfc", (PyCFunction)Filter_export_pfc, METH_FASTCALL | METH_KEYWORDS, "Export the filter in PFC format \nArguments:\n file the output file \nDescription:\n Output the filter in Pseudo Filter Code PFC to the given file The output is functionally equivalent to the BPF based filter which is loaded into the Linux Kernel" },
+  { "export_bpf", (PyCFunction)Filter_export_bpf, METH_FASTCALL | METH_KEYWORDS, "Export the filter in BPF format \nArguments:\n file the output file \nDescription:\n Output the filter in Berkley Packet Filter BPF to the given file The output is identical to what is loaded into the Linux Kernel" },
+  { "compile", (PyCFunction)Filter_compile, METH_NOARGS, "Compile the filter into a program \nDescription:\n Generate the BPF program of the current filter and return it as a Program object which can be loaded or exported without any further libseccomp work Filters containing placeholders must be compiled with instantiate With the optimize or share_blocks member set the program goes through Program optimize first With the compile_server member set the program is fetched from that CompileServer instead The reply must echo the digest of the record and the options come with the load flags the filter would use and pass the structural checks of the kernel the filter compiles locally otherwise or if the server can not be reached" },
+  { "split", (PyCFunction)Filter_split, METH_FASTCALL | METH_KEYWORDS, "Split the filter into a stack of programs \nArguments:\n limit maximum number of instructions per program default 4096 report also return the expected cost of every syscall \nDescription:\n Compile the filter and if the program exceeds the limit partition the rules by syscall into several programs Every program keeps the default action and allows the syscalls decided by the others The programs are returned in load order the last one is evaluated first and decides the syscalls with the highest priority With report a tuple of the programs and a dict mapping every syscall of the policy to the number of instructions the stack executes for it is returned" },
+  { "simplify", (PyCFunction)Filter_simplify, METH_FASTCALL | METH_KEYWORDS, "Find rules that can never decide a syscall \nArguments:\n rewrite remove the reported rules from the filter \nDescription:\n Report duplicate rules rules subsumed by a rule with the same action matching a superset of the arguments and rules shadowed by an unconditional rule for the same syscall Rules enumerating every combination of some flag bits with EQ are collapsed into the first one which is widened to one MASKED_EQ comparison given as arg Every finding is a dict with the kind the index of the rule in the order rules were added the index of the rule that makes it redundant the syscall the action and whether dropping it leaves the compiled program unchanged libseccomp builds one decision tree per syscall so a redundant rule can still change where a later rule ends up With rewrite the filter is rebuilt without the verified findings" },
+  { "profile", (PyCFunction)Filter_profile, METH_FASTCALL | METH_KEYWORDS, "Replay a syscall trace through the filter \nArguments:\n trace buffer of recorded syscalls TRACE_RECORD_SIZE bytes each a struct seccomp_data followed by the uint32 pid uint32 flags and uint64 timestamp of the call e.g a file written by record_trace \nDescription:\n Run every record through the compiled program and the rules of the filter header and index records are skipped Return a dict with the number of records the hit count of every instruction of compile the reached matched and decided counts of every rule in the order rules were added the number of records no rule decided and the indices of the rules that never matched Return instructions count the verdicts they decided a rule decided a record if it is the first matching rule with the resulting action" },
+  { "shadow_report", (PyCFunction)Filter_shadow_report, METH_FASTCALL | METH_KEYWORDS, "Get the would-be violations of a shadow load \nArguments:\n reset clear the counters afterwards \nDescription:\n Return a dict with the number of violations the number dropped because too many distinct syscalls violated and a list of dicts ordered by count with the architecture the syscall the action the filter would have taken the count and a tuple with a dict of the most frequent values of every argument less frequent values are counted under None" },
+  { "diff", (PyCFunction)Filter_diff, METH_FASTCALL | METH_KEYWORDS, "Find where two filters decide differently \nArguments:\n filter the Filter to compare with \nDescription:\n Cut the arguments of every syscall with rules in either filter into the intervals bounded by the rule comparisons and the bit patterns tested by MASKED_EQ and compare both programs once per cell Every difference is a dict with the architecture the syscall None for all syscalls without rules the ranges of the constrained arguments as tuples of arg lo hi mask and bits the actions of both filters and whether the region is exact Syscalls with too many cells are reported as one inexact region without actions unless both filters have the same rules for them Equivalent filters give an empty list" },
+  { "intern", (PyCFunction)Filter_intern, METH_NOARGS, "Get the shared compiled program of the filter \nDescription:\n Look up the filter in the process wide interning registry and return the program shared by all filters with an identical policy Policies are identical if they end up with the same rules on the same architectures the order of the rules and whether they were merged in does not matter see digest The filter is only compiled on a registry miss" },
+  { "freeze", (PyCFunction)Filter_freeze, METH_FASTCALL | METH_KEYWORDS, "Freeze the filter \nArguments:\n intern share the program through the interning registry \nDescription:\n Compile the filter keep only the BPF program and the digest of its rules and release the libseccomp context Frozen filters can still be loaded compiled and exported in BPF format every other method raises an error" },
+  { "__reduce__", (PyCFunction)Filter_reduce, METH_NOARGS, "Pickle support" },
+  { "__setstate__", (PyCFunction)Filter_setstate, METH_O, "Pickle support" },
+  { "instantiate", (PyCFunction)Filter_instantiate, METH_FASTCALL | METH_KEYWORDS, "Instantiate a filter template \nArguments:\n values one integer value for every Placeholder of the filter \nDescription:\n Filters with Placeholder arguments are compiled once with marker values Every instantiation copies that program and patches the immediate fields of the affected instructions no code generation takes place libseccomp orders the rules of a syscall by their values so if a syscall with placeholders has several rules and any comparison other than EQ the filter is compiled again with the values instead" },
+  { NULL } /* Sentinel */
+};
+
+/**
+ * Filter placeholders getter
+ */
+static PyObject * Filter_get_placeholders(seccomplite_FilterObject *self, void *closure) {
+  if (!self->_placeholders) {
+    return PyTuple_New(0);
+  }
+
+  return PyList_AsTuple(self->_placeholders);
+}
+
+/**
+ * Digest of the canonical form of the record, see seccomplite_policy_canonical()
+ */
+static int Filter_digest(seccomplite_FilterObject *self, uint64_t *digest) {
+  seccomplite_Policy canonical = { NULL, 0, 0 };
+  if (seccomplite_policy_canonical(self->_policy.data, self->_policy.len, &canonical) != 0) {
+    seccomplite_policy_free(&canonical);
+    PyErr_NoMemory();
+    return -1;
+  }
+
+  *digest = seccomplite_policy_digest(canonical.data, canonical.len);
+  seccomplite_policy_free(&canonical);
+  return 0;
+}
+
+/**
+ * Filter digest getter
+ */
+static PyObject * Filter_get_digest(seccomplite_FilterObject *self, void *closure) {
+  uint64_t digest = self->_digest;
+  if (!self->_frozen && Filter_digest(self, &digest) != 0) {
+    return NULL;
+  }
+
+  return PyLong_FromUnsignedLongLong(digest);
+}
+
+/**
+ * Filter compile server getter
+ */
+static PyObject * Filter_get_compile_server(seccomplite_FilterObject *self, void *closure) {
+  PyObject *path = self->_compile_server ? self->_compile_server : Py_None;
+  Py_INCREF(path);
+  return path;
+}
+
+/**
+ * Filter compile server setter, only valid socket paths are taken
+ */
+static int Filter_set_compile_server(seccomplite_FilterObject *self, PyObject *value, void *closure) {
+  struct sockaddr_un address;
+  if (value && value != Py_None && seccomplite_server_address(value, &address) != 0) {
+    return -1;
+  }
+
+  PyObject *path = value && value != Py_None ? value : NULL;
+  Py_XINCREF(path);
+  Py_XSETREF(self->_compile_server, path);
+  return 0;
+}
+
+static PyGetSetDef Filter_getset[] = {
+  {"placeholders", (getter)Filter_get_placeholders, NULL, "Names of all placeholders used by the filter", NULL},
+  {"digest", (getter)Filter_get_digest, NULL, "Digest of the policy, independent of the order of its rules", NULL},
+  {"compile_server", (getter)Filter_get_compile_server, (setter)Filter_set_compile_server, "Socket of a CompileServer to fetch compiled programs from, None to compile locally", NULL},
   { NULL } /* Sentinel */
 };
 
@@ -43,6 +162,7 @@ static PyMethodDef Filter_methods[] = {
 static PyType_Slot seccomplite_FilterTypeSlots[] = {
   { Py_tp_methods, Filter_methods },
   { Py_tp_members, Filter_members },
+  { Py_tp_getset, Filter_getset },
   { Py_tp_init,Filter_init },
   { Py_tp_new, Filter_new },
   { Py_tp_dealloc, Filter_dealloc },
@@ -65,19 +185,96 @@ PyType_Spec seccomplite_FilterTypeSpec = {
 /**
  * Extract add_rule and add_rule_exact parameters from the arguments
  * @param self Type self reference
- * @param args Arguments to parse 
+ * @param args Arguments to parse
+ * @param nargs Number of arguments
  * @param action Extracted action identifier
  * @param syscall Extracted action identifier
  * @param arguments seccomplite.Arg array that will hold the extracted arguments
  * @return number of arguments extracted and stored in  arguments
  */
-int Filter_extract_add_rule_parameters(seccomplite_FilterObject *self, PyObject *args, int *action, int *syscall, struct scmp_arg_cmp* arguments);
+int Filter_extract_add_rule_parameters(seccomplite_FilterObject *self, PyObject *const *args, Py_ssize_t nargs, int *action, int *syscall, struct scmp_arg_cmp* arguments);
+
+/**
+ * Drop everything derived from the current filter state, must be called
+ * by every method modifying the filter
+ * @param self Type self reference
+ */
+static void Filter_invalidate(seccomplite_FilterObject *self) {
+  self->_generation++;
+  if (!self->_frozen) {
+    Py_CLEAR(self->_program);
+  }
+  Py_CLEAR(self->_pfc);
+  Py_CLEAR(self->_template);
+  PyMem_Free(self->_sites);
+  self->_sites = NULL;
+  self->_num_sites = 0;
+}
+
+int Filter_program_options(seccomplite_FilterObject *self) {
+  return (self->_optimize ? SECCOMPLITE_BPF_VERIFY : 0) | (self->_share_blocks ? SECCOMPLITE_BPF_SHARE_BLOCKS : 0);
+}
+
+/**
+ * Drop all placeholders together with the derived template
+ * @param self Type self reference
+ */
+static void Filter_clear_placeholders(seccomplite_FilterObject *self) {
+  Filter_invalidate(self);
+  Py_CLEAR(self->_placeholders);
+  PyMem_Free(self->_pairs);
+  self->_pairs = NULL;
+  self->_num_pairs = 0;
+  self->_marker_clash = 0;
+}
+
+/**
+ * Make sure the filter still owns a libseccomp context
+ * @param self Type self reference
+ * @return 0 if the context can be used, -1 with exception set
+ */
+static int Filter_check_context(seccomplite_FilterObject *self) {
+  if (self->_frozen) {
+    PyErr_SetString(PyExc_RuntimeError, "Filter is frozen");
+    return -1;
+  }
+  else if (!self->_ctx) {
+    PyErr_SetString(PyExc_RuntimeError, "Filter is not initialized");
+    return -1;
+  }
+
+  return 0;
+}
+
+/**
+ * Finish a successful filter modification
+ * @param self Type self reference
+ * @param rc Result of appending the operation to the policy record
+ * @return None or NULL with exception set
+ */
+static PyObject * Filter_modified(seccomplite_FilterObject *self, int rc) {
+  Filter_invalidate(self);
+  if (rc != 0) {
+    return PyErr_NoMemory();
+  }
+
+  Py_RETURN_NONE;
+}
 
 void Filter_dealloc(seccomplite_FilterObject *self) {
   if (self->_ctx) {
     seccomp_release(self->_ctx);
   }
   
+  Filter_clear_placeholders(self);
+  Py_CLEAR(self->_program);
+  Py_CLEAR(self->_pfc);
+  Py_CLEAR(self->_compile_server);
+  seccomplite_policy_free(&self->_policy);
+  if (self->_shadow) {
+    seccomplite_shadow_release(self->_shadow);
+  }
+
   Py_TYPE(self)->tp_free((PyObject*) self);
 }
 
@@ -88,48 +285,105 @@ PyObject * Filter_new(PyTypeObject *type, PyObject *args, PyObject *kwds) {
   return (PyObject *) self;
 }
 
-int Filter_init(seccomplite_FilterObject *self, PyObject *args, PyObject *kwds) {
-  static char *kwlist[] = {"def_action", NULL};
+/**
+ * Constructor parameters
+ */
+static char *Filter_kwlist[] = {"def_action", "fanout", NULL};
 
-  // We accept a defaction int
-  if (!PyArg_ParseTupleAndKeywords(args, kwds, "i", kwlist, &self->_def_action)) {
-    return -1;
-  }
-  
+/**
+ * Create a fresh libseccomp context and policy record
+ * @param self Type self reference
+ * @param def_action Default action
+ * @param fanout Replay rules onto every architecture
+ * @return 0 on success, -1 with exception set
+ */
+static int Filter_setup(seccomplite_FilterObject *self, int def_action, int fanout) {
   // Try to load the filter
+  self->_def_action = def_action;
+  Filter_clear_placeholders(self);
+  Py_CLEAR(self->_program);
+  Py_CLEAR(self->_pfc);
+  self->_generation++;
+  self->_frozen = 0;
+  self->_fanout = fanout;
+
+  // __init__ may run again on a live object
+  if (self->_ctx) {
+    seccomp_release(self->_ctx);
+  }
+  uint64_t started = seccomplite_stats_begin(SECCOMPLITE_STATS_INIT);
   self->_ctx = seccomp_init(self->_def_action);
+  seccomplite_stats_end(SECCOMPLITE_STATS_INIT, started, self->_ctx ? 0 : -EINVAL);
   if (!self->_ctx) {
     PyErr_SetString(PyExc_RuntimeError, "Library error");
     return -1;
   }
+  else if (seccomplite_policy_reset(&self->_policy, self->_def_action) != 0 ||
+           (fanout && seccomplite_policy_fanout(&self->_policy) != 0)) {
+    PyErr_NoMemory();
+    return -1;
+  }
   else {
     return 0;
   }
 }
 
+int Filter_init(seccomplite_FilterObject *self, PyObject *args, PyObject *kwds) {
+  // We accept a defaction int
+  int def_action = 0;
+  int fanout = 0;
+  if (!PyArg_ParseTupleAndKeywords(args, kwds, "i|p", Filter_kwlist, &def_action, &fanout)) {
+    return -1;
+  }
+
+  return Filter_setup(self, def_action, fanout);
+}
+
+PyObject * Filter_vectorcall(PyObject *type, PyObject *const *args, size_t nargsf, PyObject *kwnames) {
+  int def_action = 0;
+  int fanout = 0;
+  if (!seccomplite_parse_vector(args, PyVectorcall_NARGS(nargsf), kwnames, "i|p:" FILTER_TYPE_NAME, Filter_kwlist, &def_action, &fanout)) {
+    return NULL;
+  }
+
+  PyObject *self = Filter_new((PyTypeObject *) type, NULL, NULL);
+  if (self && Filter_setup((seccomplite_FilterObject *) self, def_action, fanout) != 0) {
+    Py_CLEAR(self);
+  }
+  return self;
+}
+
 PyTypeObject * Filter_build(void) {
   // Ready the type
   PyObject *type = PyType_FromSpec(&seccomplite_FilterTypeSpec);
   PyTypeObject *result = (PyTypeObject *) type;
 
-  if (PyType_Ready(result) < 0) {
+  if (!type || PyType_Ready(result) < 0) {
+    Py_XDECREF(type);
     return NULL;
   }
-  else {
-    return result;
-  }
+
+#if PY_VERSION_HEX >= 0x03090000
+  // Calling the type skips the argument tuple of tp_new and tp_init
+  result->tp_vectorcall = (vectorcallfunc) Filter_vectorcall;
+#endif
+  return result;
 }
 
-PyObject * Filter_reset(seccomplite_FilterObject *self, PyObject *args, PyObject *kwds) {
+PyObject * Filter_reset(seccomplite_FilterObject *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames) {
   int def_action = -1;
   static char *kwlist[] = {"def_action", NULL};
-  if (!PyArg_ParseTupleAndKeywords(args, kwds, "i", kwlist, &def_action)) {
+  if (!seccomplite_parse_vector(args, nargs, kwnames, "|i:reset", kwlist, &def_action)) {
     return NULL;
   }
   
   if (def_action == -1) {
     def_action = self->_def_action;
   }
+
+  if (Filter_check_context(self) != 0) {
+    return NULL;
+  }
   
   int rc = seccomp_reset(self->_ctx, def_action);
   if (rc == -EINVAL) {
@@ -142,14 +396,19 @@ PyObject * Filter_reset(seccomplite_FilterObject *self, PyObject *args, PyObject
   }
   else {
     self->_def_action = def_action;
-    return Py_None;
+    Filter_clear_placeholders(self);
+    rc = seccomplite_policy_reset(&self->_policy, def_action);
+    if (rc == 0 && self->_fanout) {
+      rc = seccomplite_policy_fanout(&self->_policy);
+    }
+    return Filter_modified(self, rc);
   }
 }
   
-PyObject * Filter_merge(seccomplite_FilterObject *self, PyObject *args, PyObject *kwds) {
+PyObject * Filter_merge(seccomplite_FilterObject *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames) {
   seccomplite_FilterObject *filter;
   static char *kwlist[] = {"filter", NULL};
-  if (!PyArg_ParseTupleAndKeywords(args, kwds, "O", kwlist, &filter)) {
+  if (!seccomplite_parse_vector(args, nargs, kwnames, "O:merge", kwlist, &filter)) {
     return NULL;
   }
   
@@ -160,26 +419,50 @@ PyObject * Filter_merge(seccomplite_FilterObject *self, PyObject *args, PyObject
     PyErr_SetString(PyExc_AttributeError, "Specified object must be a valid " FILTER_TYPE_NAME " instance");
     return NULL;
   }
+
+  if (Filter_check_context(self) != 0 || Filter_check_context(filter) != 0) {
+    return NULL;
+  }
+
+  // Marker slots are local to each template
+  if (filter->_placeholders && PyList_GET_SIZE(filter->_placeholders) > 0) {
+    PyErr_SetString(PyExc_ValueError, "Filters containing placeholders can not be merged");
+    return NULL;
+  }
+
+  // Fan-out filters replay their rules onto every architecture
+  if (self->_fanout || filter->_fanout) {
+    PyErr_SetString(PyExc_ValueError, "Fan-out filters can not be merged, use add_arch instead");
+    return NULL;
+  }
   
+  uint64_t started = seccomplite_stats_begin(SECCOMPLITE_STATS_MERGE);
   int rc = seccomp_merge(self->_ctx, filter->_ctx);
+  seccomplite_stats_end(SECCOMPLITE_STATS_MERGE, started, rc);
   if (rc != 0) {
     PyErr_SetString(PyExc_RuntimeError, "Library error (errno != 0)");
     return NULL;
   }
   
-  // Reset the old filter
-  if (filter->_ctx) {
-    seccomp_release(filter->_ctx);
+  if (seccomplite_policy_merge(&self->_policy, &filter->_policy) != 0) {
+    Filter_invalidate(self);
+    return PyErr_NoMemory();
   }
-  Filter_init(filter, Py_BuildValue("(i)", filter->_def_action), NULL);
-  
-  return Py_None;
+  Filter_invalidate(self);
+
+  // Reset the old filter, seccomp_merge() already released its context
+  filter->_ctx = NULL;
+  if (Filter_setup(filter, filter->_def_action, 0) != 0) {
+    return NULL;
+  }
+
+  Py_RETURN_NONE;
 }
 
-PyObject * Filter_exist_arch(seccomplite_FilterObject *self, PyObject *args, PyObject *kwds) {
+PyObject * Filter_exist_arch(seccomplite_FilterObject *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames) {
   PyObject *arch;
   static char *kwlist[] = {"arch", NULL};
-  if (!PyArg_ParseTupleAndKeywords(args, kwds, "O", kwlist, &arch)) {
+  if (!seccomplite_parse_vector(args, nargs, kwnames, "O:exist_arch", kwlist, &arch)) {
     return NULL;
   }
   
@@ -189,17 +472,21 @@ PyObject * Filter_exist_arch(seccomplite_FilterObject *self, PyObject *args, PyO
     PyErr_SetString(PyExc_AttributeError, "Given architecture is invalid.");
     return NULL;
   }
+
+  if (Filter_check_context(self) != 0) {
+    return NULL;
+  }
   
   int rc = seccomp_arch_exist(self->_ctx, arch_token);
   if (rc == 0) {
-    return Py_True;
+    Py_RETURN_TRUE;
   }
   else if (rc == -EINVAL) {
     PyErr_SetString(PyExc_ValueError, "Invalid architecture");
     return NULL;
   }
   else if (rc == -EEXIST) {
-    return Py_False;
+    Py_RETURN_FALSE;
   }
   else {
     PyErr_SetString(PyExc_RuntimeError, "Library error (errno != 0)");
@@ -207,10 +494,52 @@ PyObject * Filter_exist_arch(seccomplite_FilterObject *self, PyObject *args, PyO
   }
 }
   
-PyObject * Filter_add_arch(seccomplite_FilterObject *self, PyObject *args, PyObject *kwds) {
+/**
+ * Add an architecture to a fan-out filter, all recorded rules are replayed
+ * into a context of the new architecture which is merged into the filter
+ * @param self Type self reference
+ * @param arch_token Architecture to add
+ * @return None or NULL with exception set
+ */
+static PyObject * Filter_fanout_arch(seccomplite_FilterObject *self, uint32_t arch_token) {
+  uint32_t arch = arch_token == SCMP_ARCH_NATIVE ? seccomp_arch_native() : arch_token;
+  int rc = seccomp_arch_exist(self->_ctx, arch);
+  if (rc == 0) {
+    PyErr_SetString(PyExc_RuntimeError, "Library error (errno != 0)");
+    return NULL;
+  }
+  else if (rc != -EEXIST) {
+    PyErr_SetString(PyExc_ValueError, "Invalid architecture");
+    return NULL;
+  }
+
+  scmp_filter_ctx other = NULL;
+  rc = seccomplite_policy_replay_arches(self->_policy.data, self->_policy.len, &arch, 1, &other);
+  if (rc == 0) {
+    uint64_t started = seccomplite_stats_begin(SECCOMPLITE_STATS_MERGE);
+    rc = seccomp_merge(self->_ctx, other);
+    seccomplite_stats_end(SECCOMPLITE_STATS_MERGE, started, rc);
+    if (rc != 0) {
+      seccomp_release(other);
+    }
+  }
+
+  if (rc == -EINVAL) {
+    PyErr_SetString(PyExc_ValueError, "Invalid architecture");
+    return NULL;
+  }
+  else if (rc != 0) {
+    PyErr_SetString(PyExc_RuntimeError, "Library error (errno != 0)");
+    return NULL;
+  }
+
+  return Filter_modified(self, seccomplite_policy_arch(&self->_policy, SECCOMPLITE_POLICY_ARCH_ADD, arch));
+}
+
+PyObject * Filter_add_arch(seccomplite_FilterObject *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames) {
   PyObject *arch;
   static char *kwlist[] = {"arch", NULL};
-  if (!PyArg_ParseTupleAndKeywords(args, kwds, "O", kwlist, &arch)) {
+  if (!seccomplite_parse_vector(args, nargs, kwnames, "O:add_arch", kwlist, &arch)) {
     return NULL;
   }
   
@@ -220,6 +549,13 @@ PyObject * Filter_add_arch(seccomplite_FilterObject *self, PyObject *args, PyObj
     PyErr_SetString(PyExc_AttributeError, "Given architecture is invalid.");
     return NULL;
   }
+
+  if (Filter_check_context(self) != 0) {
+    return NULL;
+  }
+  else if (self->_fanout) {
+    return Filter_fanout_arch(self, arch_token);
+  }
   
   int rc = seccomp_arch_add(self->_ctx, arch_token);
   if (rc == -EINVAL) {
@@ -231,14 +567,14 @@ PyObject * Filter_add_arch(seccomplite_FilterObject *self, PyObject *args, PyObj
     return NULL;
   }
   else {
-    return Py_None;
+    return Filter_modified(self, seccomplite_policy_arch(&self->_policy, SECCOMPLITE_POLICY_ARCH_ADD, arch_token));
   }
 }
   
-PyObject * Filter_remove_arch(seccomplite_FilterObject *self, PyObject *args, PyObject *kwds) {
+PyObject * Filter_remove_arch(seccomplite_FilterObject *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames) {
   PyObject *arch;
   static char *kwlist[] = {"arch", NULL};
-  if (!PyArg_ParseTupleAndKeywords(args, kwds, "O", kwlist, &arch)) {
+  if (!seccomplite_parse_vector(args, nargs, kwnames, "O:remove_arch", kwlist, &arch)) {
     return NULL;
   }
   
@@ -248,6 +584,10 @@ PyObject * Filter_remove_arch(seccomplite_FilterObject *self, PyObject *args, Py
     PyErr_SetString(PyExc_AttributeError, "Given architecture is invalid.");
     return NULL;
   }
+
+  if (Filter_check_context(self) != 0) {
+    return NULL;
+  }
   
   int rc = seccomp_arch_remove(self->_ctx, arch_token);
   if (rc == -EINVAL) {
@@ -259,28 +599,174 @@ PyObject * Filter_remove_arch(seccomplite_FilterObject *self, PyObject *args, Py
     return NULL;
   }
   else {
-    return Py_None;
+    return Filter_modified(self, seccomplite_policy_arch(&self->_policy, SECCOMPLITE_POLICY_ARCH_REMOVE, arch_token));
   }
 }
 
-PyObject * Filter_load(seccomplite_FilterObject *self) {
-  int rc = seccomp_load(self->_ctx);
+/**
+ * Load the filter with every action but ALLOW and LOG rewritten
+ * @param self Type self reference
+ * @param mode SECCOMP_RET_USER_NOTIF to count the violations in a
+ *             listener thread, SECCOMP_RET_LOG to only log them
+ * @return None, NULL with exception set
+ */
+static PyObject * Filter_load_shadow(seccomplite_FilterObject *self, uint32_t mode) {
+  if (mode == SECCOMP_RET_USER_NOTIF && self->_shadow) {
+    PyErr_SetString(PyExc_ValueError, "Filter is already loaded in shadow mode");
+    return NULL;
+  }
+
+  seccomplite_ProgramObject *program = (seccomplite_ProgramObject *) Filter_compile(self);
+  if (!program) {
+    return NULL;
+  }
+
+  struct sock_filter *insns = seccomplite_shadow_rewrite(program->_insns, program->_len, mode);
+  if (!insns) {
+    Py_DECREF(program);
+    return PyErr_NoMemory();
+  }
+
+  // The thread has to exist before the filter, it would be filtered otherwise
+  seccomplite_Shadow *shadow = NULL;
+  if (mode == SECCOMP_RET_USER_NOTIF && !(shadow = seccomplite_shadow_start(program->_insns, program->_len))) {
+    free(insns);
+    Py_DECREF(program);
+    return PyErr_SetFromErrno(PyExc_OSError);
+  }
+
+  int listener = -1;
+  uint32_t flags = program->_flags & ~SECCOMP_FILTER_FLAG_TSYNC;
+  uint64_t started = seccomplite_stats_begin(SECCOMPLITE_STATS_LOAD);
+  int rc = seccomplite_program_install(insns, program->_len, flags, program->_nnp, shadow ? &listener : NULL);
+  seccomplite_stats_end(SECCOMPLITE_STATS_LOAD, started, rc);
+  free(insns);
+  Py_DECREF(program);
+
+  if (shadow) {
+    seccomplite_shadow_attach(shadow, rc == 0 ? listener : -1);
+    if (rc == 0) {
+      self->_shadow = shadow;
+    }
+    else {
+      seccomplite_shadow_release(shadow);
+    }
+  }
+
   if (rc != 0) {
-    PyErr_SetString(PyExc_RuntimeError, "Library error (errno != 0)");
+    PyErr_SetFromErrno(PyExc_OSError);
+    return NULL;
+  }
+  Py_RETURN_NONE;
+}
+
+PyObject * Filter_load(seccomplite_FilterObject *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames) {
+  int split = 0;
+  PyObject *shadow = NULL;
+  static char *kwlist[] = {"split", "shadow", NULL};
+  if (!seccomplite_parse_vector(args, nargs, kwnames, "|pO:load", kwlist, &split, &shadow)) {
+    return NULL;
+  }
+
+  if (shadow && shadow != Py_False && shadow != Py_None) {
+    uint32_t mode = 0;
+    if (shadow == Py_True || (PyUnicode_Check(shadow) && PyUnicode_CompareWithASCIIString(shadow, "notify") == 0)) {
+      mode = SECCOMP_RET_USER_NOTIF;
+    }
+    else if (PyUnicode_Check(shadow) && PyUnicode_CompareWithASCIIString(shadow, "log") == 0) {
+      mode = SECCOMP_RET_LOG;
+    }
+    else {
+      PyErr_SetString(PyExc_ValueError, "Shadow mode must be True, 'notify' or 'log'");
+      return NULL;
+    }
+
+    if (split) {
+      PyErr_SetString(PyExc_ValueError, "Shadow loads can not be split");
+      return NULL;
+    }
+    return Filter_load_shadow(self, mode);
+  }
+
+  if (split && !self->_frozen) {
+    PyObject *programs = Filter_split(self, NULL, 0, NULL);
+    if (!programs) {
+      return NULL;
+    }
+
+    // Only one listener can be returned, check before anything is loaded
+    Py_ssize_t index = 0;
+    int notifying = 0;
+    for (index = 0; index < PyTuple_GET_SIZE(programs); index++) {
+      seccomplite_ProgramObject *program = (seccomplite_ProgramObject *) PyTuple_GET_ITEM(programs, index);
+      notifying += seccomplite_program_notifies(program->_insns, program->_len);
+    }
+    if (notifying > 1) {
+      Py_DECREF(programs);
+      PyErr_SetString(PyExc_ValueError, "NOTIFY actions are spread over several programs");
+      return NULL;
+    }
+
+    // The kernel can not take back filters, stop at the first failure
+    PyObject *listener = Py_None;
+    Py_INCREF(listener);
+    for (index = 0; index < PyTuple_GET_SIZE(programs); index++) {
+      PyObject *result = Program_load((seccomplite_ProgramObject *) PyTuple_GET_ITEM(programs, index));
+      if (!result) {
+        Py_DECREF(listener);
+        Py_DECREF(programs);
+        return NULL;
+      }
+      else if (result != Py_None) {
+        Py_SETREF(listener, result);
+      }
+      else {
+        Py_DECREF(result);
+      }
+    }
+
+    Py_DECREF(programs);
+    return listener;
+  }
+
+  if (self->_frozen) {
+    return Program_load((seccomplite_ProgramObject *) self->_program);
+  }
+
+  // Loads the cached program, which is what seccomp_load() would generate
+  seccomplite_ProgramObject *program = (seccomplite_ProgramObject *) Filter_compile(self);
+  if (!program) {
+    return NULL;
+  }
+
+  int listener = -1;
+  uint64_t started = seccomplite_stats_begin(SECCOMPLITE_STATS_LOAD);
+  int rc = seccomplite_program_install(program->_insns, program->_len, program->_flags, program->_nnp, &listener);
+  seccomplite_stats_end(SECCOMPLITE_STATS_LOAD, started, rc);
+  Py_DECREF(program);
+  if (rc != 0) {
+    PyErr_SetFromErrno(PyExc_OSError);
     return NULL;
   }
+  else if (listener >= 0) {
+    return PyLong_FromLong(listener);
+  }
   else {
-    return Py_None;
+    Py_RETURN_NONE;
   }
 }
   
-PyObject * Filter_get_attr(seccomplite_FilterObject *self, PyObject *args, PyObject *kwds) {
+PyObject * Filter_get_attr(seccomplite_FilterObject *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames) {
   int attr = 0;
   static char *kwlist[] = {"attr", NULL};
-  if (!PyArg_ParseTupleAndKeywords(args, kwds, "i", kwlist, &attr)) {
+  if (!seccomplite_parse_vector(args, nargs, kwnames, "i:get_attr", kwlist, &attr)) {
     return NULL;
   }
   
+  if (Filter_check_context(self) != 0) {
+    return NULL;
+  }
+
   uint32_t value = 0;
   int rc = seccomp_attr_get(self->_ctx, attr, &value);
   if (rc == -EINVAL) {
@@ -296,14 +782,18 @@ PyObject * Filter_get_attr(seccomplite_FilterObject *self, PyObject *args, PyObj
   }
 }
   
-PyObject * Filter_set_attr(seccomplite_FilterObject *self, PyObject *args, PyObject *kwds) {
+PyObject * Filter_set_attr(seccomplite_FilterObject *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames) {
   int attr = 0;
   uint32_t value = 0;
   static char *kwlist[] = {"attr", "value", NULL};
-  if (!PyArg_ParseTupleAndKeywords(args, kwds, "iI", kwlist, &attr, &value)) {
+  if (!seccomplite_parse_vector(args, nargs, kwnames, "iI:set_attr", kwlist, &attr, &value)) {
     return NULL;
   }
   
+  if (Filter_check_context(self) != 0) {
+    return NULL;
+  }
+
   int rc = seccomp_attr_set(self->_ctx, attr, value);
   if (rc == -EINVAL) {
     PyErr_SetString(PyExc_ValueError, "Invalid attribute");
@@ -314,15 +804,15 @@ PyObject * Filter_set_attr(seccomplite_FilterObject *self, PyObject *args, PyObj
     return NULL;
   }
   else {
-    return Py_None;
+    return Filter_modified(self, seccomplite_policy_attr(&self->_policy, attr, value));
   }
 }
 
-PyObject * Filter_syscall_priority(seccomplite_FilterObject *self, PyObject *args, PyObject *kwds) {
+PyObject * Filter_syscall_priority(seccomplite_FilterObject *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames) {
   int priority = 0;
   PyObject *syscall = NULL;
   static char *kwlist[] = {"syscall", "priority", NULL};
-  if (!PyArg_ParseTupleAndKeywords(args, kwds, "Oi", kwlist, &syscall, &priority)) {
+  if (!seccomplite_parse_vector(args, nargs, kwnames, "Oi:syscall_priority", kwlist, &syscall, &priority)) {
     return NULL;
   }
   
@@ -335,6 +825,10 @@ PyObject * Filter_syscall_priority(seccomplite_FilterObject *self, PyObject *arg
   if (syscall_num == -1) {
     return NULL;
   }
+
+  if (Filter_check_context(self) != 0) {
+    return NULL;
+  }
   
   int rc = seccomp_syscall_priority(self->_ctx, syscall_num, priority);
   if (rc != 0) {
@@ -342,96 +836,1507 @@ PyObject * Filter_syscall_priority(seccomplite_FilterObject *self, PyObject *arg
     return NULL;
   }
   else {
-    return Py_None;
+    return Filter_modified(self, seccomplite_policy_priority(&self->_policy, syscall_num, priority));
   }
 }
   
-PyObject * Filter_add_rule(seccomplite_FilterObject *self, PyObject *args) {
+PyObject * Filter_add_rule(seccomplite_FilterObject *self, PyObject *const *args, Py_ssize_t nargs) {
   // Extract and validate arguments
   int action = 0; 
   int syscall = 0;
   struct scmp_arg_cmp arguments[6];
-  int num_args = Filter_extract_add_rule_parameters(self, args, &action, &syscall, arguments);
+  if (Filter_check_context(self) != 0) {
+    return NULL;
+  }
+
+  // Placeholders are only bound once the rule is accepted
+  seccomplite_TemplateBindings bindings;
+  Filter_save_bindings(self, &bindings);
+  int num_args = Filter_extract_add_rule_parameters(self, args, nargs, &action, &syscall, arguments);
   if (num_args == -1) {
+    Filter_restore_bindings(self, &bindings);
     return NULL;
   }
   
   // Pass to method
+  uint64_t started = seccomplite_stats_begin(SECCOMPLITE_STATS_RULE_ADD);
   int rc = seccomp_rule_add_array(self->_ctx, action, syscall, num_args, arguments);
+  seccomplite_stats_end(SECCOMPLITE_STATS_RULE_ADD, started, rc);
   if (rc != 0) {
+    Filter_restore_bindings(self, &bindings);
     PyErr_SetString(PyExc_RuntimeError, "Library error (errno != 0)");
     return NULL;
   }
   else {
-    return Py_None;
+    return Filter_modified(self, seccomplite_policy_rule(&self->_policy, 0, action, syscall, num_args, arguments));
   }
 }
   
-PyObject * Filter_add_rule_exactly(seccomplite_FilterObject *self, PyObject *args) {
+PyObject * Filter_add_rule_exactly(seccomplite_FilterObject *self, PyObject *const *args, Py_ssize_t nargs) {
   // Extract and validate arguments
   int action = 0; 
   int syscall = 0;
   struct scmp_arg_cmp arguments[6];
-  int num_args = Filter_extract_add_rule_parameters(self, args, &action, &syscall, arguments);
+  if (Filter_check_context(self) != 0) {
+    return NULL;
+  }
+
+  // Placeholders are only bound once the rule is accepted
+  seccomplite_TemplateBindings bindings;
+  Filter_save_bindings(self, &bindings);
+  int num_args = Filter_extract_add_rule_parameters(self, args, nargs, &action, &syscall, arguments);
   if (num_args == -1) {
+    Filter_restore_bindings(self, &bindings);
     return NULL;
   }
   
   // Pass to method
+  uint64_t started = seccomplite_stats_begin(SECCOMPLITE_STATS_RULE_ADD);
   int rc = seccomp_rule_add_exact_array(self->_ctx, action, syscall, num_args, arguments);
+  seccomplite_stats_end(SECCOMPLITE_STATS_RULE_ADD, started, rc);
   if (rc != 0) {
+    Filter_restore_bindings(self, &bindings);
     PyErr_SetString(PyExc_RuntimeError, "Library error (errno != 0)");
     return NULL;
   }
   else {
-    return Py_None;
+    return Filter_modified(self, seccomplite_policy_rule(&self->_policy, 1, action, syscall, num_args, arguments));
   }
 }
-  
-PyObject * Filter_export_pfc(seccomplite_FilterObject *self, PyObject *args, PyObject *kwds) {
-  PyObject *file;
-  static char *kwlist[] = {"file", NULL};
-  if (!PyArg_ParseTupleAndKeywords(args, kwds, "O", kwlist, &file)) {
+
+PyObject * Filter_add_rules(seccomplite_FilterObject *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames) {
+  PyObject *rules = NULL;
+  int exact = 0;
+  static char *kwlist[] = {"rules", "exact", NULL};
+  if (!seccomplite_parse_vector(args, nargs, kwnames, "O|p:add_rules", kwlist, &rules, &exact)) {
     return NULL;
   }
-  
-  int fd = PyObject_AsFileDescriptor(file);
-  if (fd < 0) {
-    PyErr_SetString(PyExc_AttributeError, "Given file descriptor appears to be invalid");
+
+  if (Filter_check_context(self) != 0) {
     return NULL;
   }
 
-  int rc = seccomp_export_pfc(self->_ctx, fd);
-  if (rc != 0) {
-    PyErr_SetString(PyExc_RuntimeError, "Library error (errno != 0)");
+  if (!PyObject_IsRuleSet(rules)) {
+    PyErr_SetString(PyExc_AttributeError, "Specified object must be a valid " RULESET_TYPE_NAME " instance");
     return NULL;
   }
-  else {
-    return Py_None;
+
+  seccomplite_RuleSetObject *set = (seccomplite_RuleSetObject *) rules;
+  struct scmp_arg_cmp arguments[6];
+  uint32_t action = 0;
+  int syscall = 0;
+  Py_ssize_t index;
+  for (index = 0; index < set->_len; index++) {
+    int num_args = seccomplite_ruleset_get(set, index, &action, &syscall, arguments);
+    if (num_args < 0) {
+      break;
+    }
+
+    seccomplite_TemplateBindings bindings;
+    Filter_save_bindings(self, &bindings);
+    int arg;
+    for (arg = 0; arg < num_args; arg++) {
+      Filter_bind_placeholder(self, NULL, &arguments[arg].datum_a);
+      Filter_bind_placeholder(self, NULL, &arguments[arg].datum_b);
+    }
+
+    uint64_t started = seccomplite_stats_begin(SECCOMPLITE_STATS_RULE_ADD);
+    int rc = exact ? seccomp_rule_add_exact_array(self->_ctx, action, syscall, num_args, arguments)
+                   : seccomp_rule_add_array(self->_ctx, action, syscall, num_args, arguments);
+    seccomplite_stats_end(SECCOMPLITE_STATS_RULE_ADD, started, rc);
+    if (rc != 0) {
+      Filter_restore_bindings(self, &bindings);
+      PyErr_Format(PyExc_RuntimeError, "Library error (errno != 0) in rule %zd", index);
+      break;
+    }
+    if (seccomplite_policy_rule(&self->_policy, exact, action, syscall, num_args, arguments) != 0) {
+      PyErr_NoMemory();
+      break;
+    }
   }
-}
-  
-PyObject * Filter_export_bpf(seccomplite_FilterObject *self, PyObject *args, PyObject *kwds) {
-  PyObject *file;
-  static char *kwlist[] = {"file", NULL};
-  if (!PyArg_ParseTupleAndKeywords(args, kwds, "O", kwlist, &file)) {
+
+  if (index < set->_len) {
+    Filter_invalidate(self);
     return NULL;
   }
+
+  return Filter_modified(self, 0);
+}
   
-  int fd = PyObject_AsFileDescriptor(file);
+/**
+ * Generate the PFC text of the filter into the cache
+ * @param self Type self reference
+ * @return 0 on success, -1 with exception set
+ */
+static int Filter_export_pfc_cache(seccomplite_FilterObject *self) {
+  // libseccomp can only export into a file descriptor, use an anonymous one
+  int fd = memfd_create("seccomplite-pfc", MFD_CLOEXEC);
   if (fd < 0) {
-    PyErr_SetString(PyExc_AttributeError, "Given file descriptor appears to be invalid");
+    PyErr_SetFromErrno(PyExc_OSError);
+    return -1;
+  }
+
+  uint64_t started = seccomplite_stats_begin(SECCOMPLITE_STATS_EXPORT_PFC);
+  int rc = seccomp_export_pfc(self->_ctx, fd);
+  seccomplite_stats_end(SECCOMPLITE_STATS_EXPORT_PFC, started, rc);
+  off_t size = rc == 0 ? lseek(fd, 0, SEEK_END) : -1;
+  if (size < 0) {
+    close(fd);
+    PyErr_SetString(PyExc_RuntimeError, "Library error (errno != 0)");
+    return -1;
+  }
+
+  PyObject *text = PyBytes_FromStringAndSize(NULL, size);
+  if (!text) {
+    close(fd);
+    return -1;
+  }
+
+  off_t offset = 0;
+  while (offset < size) {
+    ssize_t count = pread(fd, PyBytes_AS_STRING(text) + offset, size - offset, offset);
+    if (count <= 0) {
+      if (count < 0 && errno == EINTR) {
+        continue;
+      }
+      close(fd);
+      Py_DECREF(text);
+      PyErr_SetString(PyExc_RuntimeError, "Library error (errno != 0)");
+      return -1;
+    }
+    offset += count;
+  }
+
+  close(fd);
+  self->_pfc = text;
+  return 0;
+}
+
+PyObject * Filter_export_pfc(seccomplite_FilterObject *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames) {
+  PyObject *file;
+  static char *kwlist[] = {"file", NULL};
+  if (!seccomplite_parse_vector(args, nargs, kwnames, "O:export_pfc", kwlist, &file)) {
+    return NULL;
+  }
+  
+  int fd = PyObject_AsFileDescriptor(file);
+  if (fd < 0) {
+    PyErr_SetString(PyExc_AttributeError, "Given file descriptor appears to be invalid");
+    return NULL;
+  }
+
+  if (Filter_check_context(self) != 0) {
+    return NULL;
+  }
+  else if (!self->_pfc && Filter_export_pfc_cache(self) != 0) {
+    return NULL;
+  }
+
+  if (seccomplite_write_all(fd, PyBytes_AS_STRING(self->_pfc), PyBytes_GET_SIZE(self->_pfc)) != 0) {
+    return PyErr_SetFromErrno(PyExc_OSError);
+  }
+
+  Py_RETURN_NONE;
+}
+  
+PyObject * Filter_export_bpf(seccomplite_FilterObject *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames) {
+  PyObject *file;
+  static char *kwlist[] = {"file", NULL};
+  if (!seccomplite_parse_vector(args, nargs, kwnames, "O:export_bpf", kwlist, &file)) {
+    return NULL;
+  }
+  
+  int fd = PyObject_AsFileDescriptor(file);
+  if (fd < 0) {
+    PyErr_SetString(PyExc_AttributeError, "Given file descriptor appears to be invalid");
+    return NULL;
+  }
+
+  // The compiled program is cached, exporting it is the same output
+  PyObject *program = Filter_compile(self);
+  if (!program) {
     return NULL;
   }
 
-  int rc = seccomp_export_bpf(self->_ctx, fd);
+  PyObject *result = Program_export_bpf((seccomplite_ProgramObject *) program, args, nargs, kwnames);
+  Py_DECREF(program);
+  return result;
+}
+
+/**
+ * Shape of one rule of a template
+ */
+typedef struct {
+  int syscall;
+  uint8_t placeholder;
+  uint8_t ordered;
+} template_rule;
+
+static int template_rule_compare(const void *a, const void *b) {
+  int left = ((const template_rule *) a)->syscall;
+  int right = ((const template_rule *) b)->syscall;
+  return (left > right) - (left < right);
+}
+
+/**
+ * Collect the shapes of all rules of a record, merged records included
+ * @return 0 on success, -ENOMEM or -EINVAL
+ */
+static int template_collect_rules(const uint8_t *data, size_t len, template_rule **rules, size_t *count, size_t *cap) {
+  seccomplite_PolicyEntry entry;
+  size_t offset = 0;
+  int rc = 0;
+  while ((rc = seccomplite_policy_next(data, len, &offset, &entry)) == 1) {
+    if (entry.op == SECCOMPLITE_POLICY_MERGE) {
+      rc = template_collect_rules(entry.nested, entry.nested_len, rules, count, cap);
+      if (rc != 0) {
+        return rc;
+      }
+      continue;
+    }
+    else if (entry.op != SECCOMPLITE_POLICY_RULE && entry.op != SECCOMPLITE_POLICY_RULE_EXACT) {
+      continue;
+    }
+
+    if (*count == *cap) {
+      size_t size = *cap ? *cap * 2 : 64;
+      template_rule *grown = PyMem_Realloc(*rules, sizeof(template_rule) * size);
+      if (!grown) {
+        return -ENOMEM;
+      }
+      *rules = grown;
+      *cap = size;
+    }
+
+    // Constants never carry a marker, see Filter_bind_placeholder()
+    template_rule *rule = &(*rules)[(*count)++];
+    rule->syscall = entry.syscall;
+    rule->placeholder = 0;
+    rule->ordered = 0;
+    unsigned int index = 0;
+    for (index = 0; index < entry.argc; index++) {
+      uint32_t mark_a = (uint32_t) entry.args[index].datum_a & PLACEHOLDER_MARK_MASK;
+      uint32_t mark_b = (uint32_t) entry.args[index].datum_b & PLACEHOLDER_MARK_MASK;
+      rule->placeholder |= mark_a == PLACEHOLDER_MARK_LO || mark_a == PLACEHOLDER_MARK_PAIR_LO ||
+                           mark_b == PLACEHOLDER_MARK_LO || mark_b == PLACEHOLDER_MARK_PAIR_LO;
+      rule->ordered |= entry.args[index].op != SCMP_CMP_EQ;
+    }
+  }
+
+  return rc == 0 ? 0 : -EINVAL;
+}
+
+/**
+ * Check if patching the template can change the verdicts.  libseccomp
+ * sorts the comparisons of a syscall by their values, only EQ checks are
+ * disjoint whatever order they end up in.
+ * @param self Type self reference
+ * @return 1 if the filter must be compiled with the values, 0 if the
+ *         template can be patched, -1 with exception set
+ */
+static int Filter_template_ordered(seccomplite_FilterObject *self) {
+  template_rule *rules = NULL;
+  size_t count = 0;
+  size_t cap = 0;
+  int rc = template_collect_rules(self->_policy.data, self->_policy.len, &rules, &count, &cap);
   if (rc != 0) {
+    PyMem_Free(rules);
+    if (rc == -ENOMEM) {
+      PyErr_NoMemory();
+    }
+    else {
+      PyErr_SetString(PyExc_RuntimeError, "Filter record is corrupt");
+    }
+    return -1;
+  }
+
+  qsort(rules, count, sizeof(template_rule), template_rule_compare);
+  int ordered = 0;
+  size_t first = 0;
+  while (!ordered && first < count) {
+    size_t last = first;
+    int placeholder = 0;
+    int compared = 0;
+    for (last = first; last < count && rules[last].syscall == rules[first].syscall; last++) {
+      placeholder |= rules[last].placeholder;
+      compared |= rules[last].ordered;
+    }
+    ordered = placeholder && compared && last - first > 1;
+    first = last;
+  }
+
+  PyMem_Free(rules);
+  return ordered;
+}
+
+/**
+ * Compile the template program and locate all placeholder immediates,
+ * templates that can not be patched only get the recompile flag
+ * @param self Type self reference
+ * @return 0 on success, -1 with exception set
+ */
+static int Filter_compile_template(seccomplite_FilterObject *self) {
+  if (self->_template) {
+    return 0;
+  }
+
+  if (self->_marker_clash) {
+    PyErr_SetString(PyExc_ValueError, "Filter constants collide with the placeholder markers");
+    return -1;
+  }
+
+  int ordered = Filter_template_ordered(self);
+  if (ordered < 0) {
+    return -1;
+  }
+  else if (ordered) {
+    Py_INCREF(Py_None);
+    self->_template = Py_None;
+    self->_recompile = 1;
+    return 0;
+  }
+
+  PyObject *program = Program_from_ctx(self->_ctx);
+  if (!program) {
+    return -1;
+  }
+
+  // Every ALU or JMP instruction with an immediate operand may carry a marker
+  seccomplite_ProgramObject *template = (seccomplite_ProgramObject *) program;
+  seccomplite_TemplateSite *sites = PyMem_Malloc(sizeof(seccomplite_TemplateSite) * template->_len);
+  if (!sites) {
+    Py_DECREF(program);
+    PyErr_NoMemory();
+    return -1;
+  }
+
+  unsigned int num_sites = 0;
+  unsigned int slots = PyList_GET_SIZE(self->_placeholders);
+  unsigned int index = 0;
+  for (index = 0; index < template->_len; index++) {
+    struct sock_filter *insn = &template->_insns[index];
+    uint16_t class = BPF_CLASS(insn->code);
+    if ((class != BPF_JMP && class != BPF_ALU) || BPF_SRC(insn->code) != BPF_K) {
+      continue;
+    }
+
+    uint32_t mark = insn->k & PLACEHOLDER_MARK_MASK;
+    uint32_t slot = insn->k & ~PLACEHOLDER_MARK_MASK;
+    int pair = mark == PLACEHOLDER_MARK_PAIR_LO || mark == PLACEHOLDER_MARK_PAIR_HI;
+    if (pair ? slot >= self->_num_pairs : ((mark != PLACEHOLDER_MARK_LO && mark != PLACEHOLDER_MARK_HI) || slot >= slots)) {
+      continue;
+    }
+
+    sites[num_sites].insn = index;
+    sites[num_sites].slot = slot;
+    sites[num_sites].high = mark == PLACEHOLDER_MARK_HI || mark == PLACEHOLDER_MARK_PAIR_HI;
+    sites[num_sites].pair = pair;
+    num_sites++;
+  }
+
+  self->_template = program;
+  self->_sites = sites;
+  self->_num_sites = num_sites;
+  self->_recompile = 0;
+  return 0;
+}
+
+/**
+ * Datum rewrite of Filter_recompile(), the values are in slot order
+ */
+static uint64_t Filter_substitute(const struct scmp_arg_cmp *cmp, int second, void *arg) {
+  seccomplite_FilterObject *self = ((void **) arg)[0];
+  const uint64_t *values = ((void **) arg)[1];
+  uint64_t datum = second ? cmp->datum_b : cmp->datum_a;
+  uint32_t mark = (uint32_t) datum & PLACEHOLDER_MARK_MASK;
+  uint32_t slot = (uint32_t) datum & ~PLACEHOLDER_MARK_MASK;
+  if (mark == PLACEHOLDER_MARK_LO) {
+    return values[slot];
+  }
+  else if (mark == PLACEHOLDER_MARK_PAIR_LO) {
+    const seccomplite_TemplatePair *pair = &self->_pairs[slot];
+    if (second) {
+      return pair->value_slot >= 0 ? values[pair->value_slot] : pair->value;
+    }
+    return pair->mask_slot >= 0 ? values[pair->mask_slot] : pair->mask;
+  }
+
+  return datum;
+}
+
+/**
+ * Compile the filter with the placeholders replaced by their values
+ * @param self Type self reference
+ * @param values Placeholder values in slot order
+ * @return New program or NULL with exception set
+ */
+static PyObject * Filter_recompile(seccomplite_FilterObject *self, const uint64_t *values) {
+  seccomplite_Policy record = { NULL, 0, 0 };
+  void *arg[2] = { self, (void *) values };
+  scmp_filter_ctx ctx = NULL;
+  int rc = seccomplite_policy_map_datums(self->_policy.data, self->_policy.len, Filter_substitute, arg, &record);
+  if (rc == 0) {
+    rc = seccomplite_policy_replay(record.data, record.len, &ctx);
+  }
+  seccomplite_policy_free(&record);
+  if (rc == -ENOMEM) {
+    return PyErr_NoMemory();
+  }
+  else if (rc != 0) {
+    PyErr_SetString(PyExc_RuntimeError, "Library error (errno != 0)");
+    return NULL;
+  }
+
+  PyObject *program = Program_from_ctx(ctx);
+  seccomp_release(ctx);
+  return program;
+}
+
+/**
+ * Compile a fan-out filter with one worker thread per architecture group
+ * @param self Type self reference
+ * @return New program or NULL with exception set
+ */
+static PyObject * Filter_fanout_compile(seccomplite_FilterObject *self) {
+  uint32_t badarch = SCMP_ACT_KILL;
+  uint32_t flags = 0;
+  int nnp = 1;
+  seccomp_attr_get(self->_ctx, SCMP_FLTATR_ACT_BADARCH, &badarch);
+  seccomplite_ctx_load_flags(self->_ctx, &flags, &nnp);
+
+  // The record may change while the GIL is released
+  uint8_t *data = malloc(self->_policy.len);
+  if (!data) {
+    return PyErr_NoMemory();
+  }
+  memcpy(data, self->_policy.data, self->_policy.len);
+  size_t len = self->_policy.len;
+
+  struct sock_filter *insns = NULL;
+  unsigned int num_insns = 0;
+  int rc = 0;
+  Py_BEGIN_ALLOW_THREADS
+  rc = seccomplite_fanout_compile(data, len, badarch, &insns, &num_insns);
+  Py_END_ALLOW_THREADS
+  free(data);
+
+  if (rc == -ENOMEM) {
+    return PyErr_NoMemory();
+  }
+  else if (rc != 0) {
+    PyErr_SetString(PyExc_RuntimeError, "Library error (errno != 0)");
+    return NULL;
+  }
+
+  PyObject *result = Program_create(insns, num_insns, flags, nnp);
+  free(insns);
+  return result;
+}
+
+/**
+ * Fetch the program from the compile server of the filter, if it has one.
+ * Whoever serves the socket decides what gets installed, so the program
+ * must carry the load flags of the filter and be well formed.
+ * @param self Type self reference
+ * @param options SECCOMPLITE_BPF_* options to compile with
+ * @return New reference, NULL without exception to compile locally
+ */
+static PyObject * Filter_fetch(seccomplite_FilterObject *self, int options) {
+  struct sockaddr_un address;
+  if (!self->_compile_server || self->_policy.len > SECCOMPLITE_SERVER_MAX_RECORD) {
+    return NULL;
+  }
+  else if (seccomplite_server_address(self->_compile_server, &address) != 0) {
+    PyErr_Clear();
+    return NULL;
+  }
+
+  uint32_t expected_flags = 0;
+  int expected_nnp = 1;
+  seccomplite_ctx_load_flags(self->_ctx, &expected_flags, &expected_nnp);
+
+  // The record may change while the GIL is released
+  size_t len = self->_policy.len;
+  uint8_t *data = malloc(len ? len : 1);
+  if (!data) {
+    return NULL;
+  }
+  memcpy(data, self->_policy.data, len);
+
+  int fd = -1;
+  uint32_t flags = 0;
+  int nnp = 1;
+  int rc = 0;
+  Py_BEGIN_ALLOW_THREADS
+  rc = seccomplite_server_fetch(&address, data, len, options, &fd, &flags, &nnp);
+  Py_END_ALLOW_THREADS
+  free(data);
+  if (rc != 0) {
+    return NULL;
+  }
+  else if (flags != expected_flags || nnp != expected_nnp) {
+    close(fd);
+    return NULL;
+  }
+
+  seccomplite_ProgramObject *program = (seccomplite_ProgramObject *) Program_from_memfd(fd, flags, nnp);
+  close(fd);
+  if (!program) {
+    PyErr_Clear();
+  }
+  else if (seccomplite_bpf_check(program->_insns, program->_len) != 0) {
+    Py_CLEAR(program);
+  }
+  return (PyObject *) program;
+}
+
+PyObject * Filter_compile(seccomplite_FilterObject *self) {
+  int options = Filter_program_options(self);
+  if (self->_program && (self->_frozen || self->_program_options == options)) {
+    Py_INCREF(self->_program);
+    return self->_program;
+  }
+  else if (Filter_check_context(self) != 0) {
+    return NULL;
+  }
+  else if (self->_placeholders && PyList_GET_SIZE(self->_placeholders) > 0) {
+    PyErr_SetString(PyExc_ValueError, "Filter contains placeholders, use instantiate()");
+    return NULL;
+  }
+
+  // A compile server hands out the program it compiled for the same record
+  PyObject *program = Filter_fetch(self, options);
+  if (!program) {
+    if (self->_fanout && seccomplite_fanout_groups(self->_policy.data, self->_policy.len) > 1) {
+      program = Filter_fanout_compile(self);
+    }
+    else {
+      program = Program_from_ctx(self->_ctx);
+    }
+
+    if (program && (self->_optimize || self->_share_blocks)) {
+      seccomplite_BpfReport report;
+      int flags = SECCOMPLITE_BPF_VERIFY | (self->_share_blocks ? SECCOMPLITE_BPF_SHARE_BLOCKS : 0);
+      Py_SETREF(program, Program_optimized((seccomplite_ProgramObject *) program, flags, &report));
+    }
+  }
+
+  // Programs are immutable, every caller gets the cached one until the next modification
+  if (program) {
+    Py_INCREF(program);
+    Py_XSETREF(self->_program, program);
+    self->_program_options = options;
+  }
+
+  return program;
+}
+
+/**
+ * Gather one side of a comparison, the filter must have a live context
+ * @param self Filter
+ * @param side Receives the filter data, rules and program are new
+ * @param tokens Receives the architecture instances
+ * @return 0 on success, -1 with an exception set
+ */
+static int Filter_diff_side(seccomplite_FilterObject *self, seccomplite_DiffSide *side, uint32_t *tokens) {
+  memset(side, 0, sizeof(seccomplite_DiffSide));
+  seccomplite_SimplifyRule *rules = NULL;
+  int count = seccomplite_simplify_rules(self->_policy.data, self->_policy.len, &rules, tokens);
+  if (count == -ENOMEM) {
+    PyErr_NoMemory();
+    return -1;
+  }
+  else if (count == -E2BIG) {
+    PyErr_SetString(PyExc_ValueError, "Too many architectures to analyse");
+    return -1;
+  }
+  else if (count < 0 ||
+           seccomp_attr_get(self->_ctx, SCMP_FLTATR_ACT_DEFAULT, &side->def_action) != 0 ||
+           seccomp_attr_get(self->_ctx, SCMP_FLTATR_ACT_BADARCH, &side->badarch) != 0) {
+    free(rules);
+    PyErr_SetString(PyExc_RuntimeError, "Library error (errno != 0)");
+    return -1;
+  }
+
+  side->rules = rules;
+  side->num_rules = count;
+  side->tokens = tokens;
+  return 0;
+}
+
+PyObject * Filter_diff(seccomplite_FilterObject *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames) {
+  seccomplite_FilterObject *filter;
+  static char *kwlist[] = {"filter", NULL};
+  if (!seccomplite_parse_vector(args, nargs, kwnames, "O:diff", kwlist, &filter)) {
+    return NULL;
+  }
+
+  PyObject *seccomplite = PyState_FindModule(&SeccompLiteModule);
+  PyObject *type = PyDict_GetItemString(PyModule_GetDict(seccomplite), FILTER_TYPE_NAME);
+  if (!PyObject_IsInstance((PyObject *)filter, type)) {
+    PyErr_SetString(PyExc_AttributeError, "Specified object must be a valid " FILTER_TYPE_NAME " instance");
+    return NULL;
+  }
+  else if (Filter_check_context(self) != 0 || Filter_check_context(filter) != 0) {
+    return NULL;
+  }
+
+  // Compiling also rejects placeholders
+  seccomplite_ProgramObject *programs[2] = { NULL, NULL };
+  seccomplite_DiffSide sides[2];
+  uint32_t tokens[2][SECCOMPLITE_SIMPLIFY_MAX_INSTANCES];
+  seccomplite_FilterObject *filters[2] = { self, filter };
+  seccomplite_DiffRegion *regions = NULL;
+  PyObject *result = NULL;
+  int count = 0;
+  int index = 0;
+  memset(sides, 0, sizeof(sides));
+  for (index = 0; index < 2; index++) {
+    programs[index] = (seccomplite_ProgramObject *) Filter_compile(filters[index]);
+    if (!programs[index] || Filter_diff_side(filters[index], &sides[index], tokens[index]) != 0) {
+      goto done;
+    }
+    sides[index].insns = programs[index]->_insns;
+    sides[index].len = programs[index]->_len;
+  }
+
+  Py_BEGIN_ALLOW_THREADS
+  count = seccomplite_diff(&sides[0], &sides[1], &regions);
+  Py_END_ALLOW_THREADS
+  if (count == -ENOMEM) {
+    PyErr_NoMemory();
+    goto done;
+  }
+  else if (count < 0) {
+    PyErr_SetString(PyExc_ValueError, "Program is malformed");
+    goto done;
+  }
+
+  result = PyList_New(count);
+  for (index = 0; result && index < count; index++) {
+    const seccomplite_DiffRegion *region = &regions[index];
+    PyObject *syscall = NULL;
+    if (region->syscall == __NR_SCMP_ERROR) {
+      syscall = Py_None;
+      Py_INCREF(syscall);
+    }
+    else {
+      char *name = seccomp_syscall_resolve_num_arch(SCMP_ARCH_NATIVE, region->syscall);
+      syscall = name ? PyUnicode_FromString(name) : PyLong_FromLong(region->syscall);
+      free(name);
+    }
+
+    PyObject *ranges = PyTuple_New(region->argc);
+    unsigned int arg = 0;
+    for (arg = 0; ranges && arg < region->argc; arg++) {
+      const seccomplite_DiffRange *range = &region->args[arg];
+      PyObject *item = Py_BuildValue("(IKKKK)", range->arg, (unsigned long long) range->lo, (unsigned long long) range->hi,
+                                     (unsigned long long) range->mask, (unsigned long long) range->bits);
+      if (!item) {
+        Py_CLEAR(ranges);
+        break;
+      }
+      PyTuple_SET_ITEM(ranges, arg, item);
+    }
+
+    // Inexact regions were not compared, there is no pair of actions
+    PyObject *actions = region->exact ? Py_BuildValue("(kk)", (unsigned long) region->action_a, (unsigned long) region->action_b) : Py_None;
+    if (!region->exact) {
+      Py_INCREF(actions);
+    }
+
+    PyObject *item = !syscall || !ranges || !actions ? NULL :
+      Py_BuildValue("{sIsNsNsNsO}", "arch", region->arch, "syscall", syscall, "args", ranges,
+                    "actions", actions, "exact", region->exact ? Py_True : Py_False);
+    if (!item) {
+      // Py_BuildValue consumes N references even when it fails
+      if (!syscall || !ranges || !actions) {
+        Py_XDECREF(syscall);
+        Py_XDECREF(ranges);
+        Py_XDECREF(actions);
+      }
+      Py_CLEAR(result);
+      break;
+    }
+    PyList_SET_ITEM(result, index, item);
+  }
+
+done:
+  free(regions);
+  for (index = 0; index < 2; index++) {
+    free((void *) sides[index].rules);
+    Py_XDECREF(programs[index]);
+  }
+  return result;
+}
+
+PyObject * Filter_shadow_report(seccomplite_FilterObject *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames) {
+  int reset = 0;
+  static char *kwlist[] = {"reset", NULL};
+  if (!seccomplite_parse_vector(args, nargs, kwnames, "|p:shadow_report", kwlist, &reset)) {
+    return NULL;
+  }
+
+  if (!self->_shadow) {
+    PyErr_SetString(PyExc_ValueError, "Filter was not loaded in shadow mode");
+    return NULL;
+  }
+
+  return seccomplite_shadow_report(self->_shadow, reset);
+}
+
+PyObject * Filter_profile(seccomplite_FilterObject *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames) {
+  PyObject *trace = NULL;
+  static char *kwlist[] = {"trace", NULL};
+  if (!seccomplite_parse_vector(args, nargs, kwnames, "O:profile", kwlist, &trace)) {
+    return NULL;
+  }
+
+  Py_buffer view;
+  if (PyObject_GetBuffer(trace, &view, PyBUF_SIMPLE) != 0) {
+    return NULL;
+  }
+  else if (view.len % SECCOMPLITE_TRACE_RECORD_SIZE != 0) {
+    PyBuffer_Release(&view);
+    PyErr_Format(PyExc_ValueError, "Trace length is not a multiple of the record size %d", SECCOMPLITE_TRACE_RECORD_SIZE);
+    return NULL;
+  }
+
+  // Compiling checks the context and placeholders
+  seccomplite_ProgramObject *program = (seccomplite_ProgramObject *) Filter_compile(self);
+  if (!program) {
+    PyBuffer_Release(&view);
+    return NULL;
+  }
+
+  uint32_t tokens[SECCOMPLITE_SIMPLIFY_MAX_INSTANCES];
+  seccomplite_SimplifyRule *rules = NULL;
+  seccomplite_Profile profile = { 0, 0, NULL, NULL, NULL, NULL };
+  int count = seccomplite_simplify_rules(self->_policy.data, self->_policy.len, &rules, tokens);
+  if (count == -ENOMEM) {
+    PyErr_NoMemory();
+    goto error;
+  }
+  else if (count == -E2BIG) {
+    PyErr_SetString(PyExc_ValueError, "Too many architectures to analyse");
+    goto error;
+  }
+  else if (count < 0) {
+    PyErr_SetString(PyExc_RuntimeError, "Library error (errno != 0)");
+    goto error;
+  }
+
+  profile.hits = PyMem_Calloc(program->_len ? program->_len : 1, sizeof(unsigned long));
+  profile.reached = PyMem_Calloc(3 * (count ? count : 1), sizeof(unsigned long));
+  if (!profile.hits || !profile.reached) {
+    PyErr_NoMemory();
+    goto error;
+  }
+  profile.matched = profile.reached + count;
+  profile.decided = profile.matched + count;
+
+  // The program and the rule copy stay untouched, the view is locked
+  int rc = 0;
+  Py_BEGIN_ALLOW_THREADS
+  rc = seccomplite_profile_run(program->_insns, program->_len, rules, count, tokens, view.buf,
+                               view.len / SECCOMPLITE_TRACE_RECORD_SIZE, &profile);
+  Py_END_ALLOW_THREADS
+  if (rc != 0) {
+    PyErr_NoMemory();
+    goto error;
+  }
+
+  PyObject *hits = PyList_New(program->_len);
+  PyObject *entries = PyList_New(count);
+  PyObject *unused = PyList_New(0);
+  unsigned int index = 0;
+  for (index = 0; hits && index < program->_len; index++) {
+    PyObject *value = PyLong_FromUnsignedLong(profile.hits[index]);
+    if (!value) {
+      Py_CLEAR(hits);
+      break;
+    }
+    PyList_SET_ITEM(hits, index, value);
+  }
+  for (index = 0; entries && unused && index < (unsigned int) count; index++) {
+    char *name = seccomp_syscall_resolve_num_arch(SCMP_ARCH_NATIVE, rules[index].syscall);
+    PyObject *syscall = name ? PyUnicode_FromString(name) : PyLong_FromLong(rules[index].syscall);
+    PyObject *entry = !syscall ? NULL :
+      Py_BuildValue("{sNsksksksk}", "syscall", syscall, "action", (unsigned long) rules[index].action,
+                    "reached", profile.reached[index], "matched", profile.matched[index], "decided", profile.decided[index]);
+    free(name);
+    if (!entry) {
+      Py_CLEAR(entries);
+      break;
+    }
+    PyList_SET_ITEM(entries, index, entry);
+
+    if (profile.matched[index] == 0) {
+      PyObject *rule = PyLong_FromUnsignedLong(index);
+      if (!rule || PyList_Append(unused, rule) != 0) {
+        Py_CLEAR(unused);
+      }
+      Py_XDECREF(rule);
+    }
+  }
+
+  PyObject *result = NULL;
+  if (hits && entries && unused) {
+    result = Py_BuildValue("{sksksOsOsO}", "records", profile.records, "undecided", profile.undecided,
+                           "instructions", hits, "rules", entries, "unused", unused);
+  }
+  Py_XDECREF(hits);
+  Py_XDECREF(entries);
+  Py_XDECREF(unused);
+  PyMem_Free(profile.hits);
+  PyMem_Free(profile.reached);
+  free(rules);
+  Py_DECREF(program);
+  PyBuffer_Release(&view);
+  return result;
+
+error:
+  PyMem_Free(profile.hits);
+  PyMem_Free(profile.reached);
+  free(rules);
+  Py_DECREF(program);
+  PyBuffer_Release(&view);
+  return NULL;
+}
+
+/**
+ * Expected cost of every syscall of the policy when running a stack
+ * @param self Type self reference
+ * @param programs Tuple of programs in load order
+ * @return New dict mapping syscall names to instruction counts
+ */
+static PyObject * Filter_split_cost(seccomplite_FilterObject *self, PyObject *programs) {
+  PyObject *cost = PyDict_New();
+  if (!cost) {
+    return NULL;
+  }
+
+  seccomplite_PolicyEntry entry;
+  size_t offset = 0;
+  while (seccomplite_policy_next(self->_policy.data, self->_policy.len, &offset, &entry) == 1) {
+    if (entry.op != SECCOMPLITE_POLICY_RULE && entry.op != SECCOMPLITE_POLICY_RULE_EXACT) {
+      continue;
+    }
+
+    char *name = seccomp_syscall_resolve_num_arch(SCMP_ARCH_NATIVE, entry.syscall);
+    PyObject *key = name ? PyUnicode_FromString(name) : PyLong_FromLong(entry.syscall);
+    free(name);
+    if (!key) {
+      Py_DECREF(cost);
+      return NULL;
+    }
+    else if (PyDict_Contains(cost, key)) {
+      Py_DECREF(key);
+      continue;
+    }
+
+    // The kernel runs every filter of the stack, all arguments zero
+    struct seccomp_data data;
+    memset(&data, 0, sizeof(data));
+    data.nr = entry.syscall;
+    data.arch = seccomp_arch_native();
+
+    unsigned long total = 0;
+    Py_ssize_t index = 0;
+    for (index = 0; index < PyTuple_GET_SIZE(programs); index++) {
+      seccomplite_ProgramObject *program = (seccomplite_ProgramObject *) PyTuple_GET_ITEM(programs, index);
+      uint32_t action = 0;
+      unsigned int executed = 0;
+      if (seccomplite_bpf_run(program->_insns, program->_len, &data, &action, &executed) == 0) {
+        total += executed;
+      }
+    }
+
+    PyObject *value = PyLong_FromUnsignedLong(total);
+    if (!value || PyDict_SetItem(cost, key, value) != 0) {
+      Py_XDECREF(value);
+      Py_DECREF(key);
+      Py_DECREF(cost);
+      return NULL;
+    }
+    Py_DECREF(value);
+    Py_DECREF(key);
+  }
+
+  return cost;
+}
+
+PyObject * Filter_simplify(seccomplite_FilterObject *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames) {
+  int rewrite = 0;
+  static char *kwlist[] = {"rewrite", NULL};
+  if (!seccomplite_parse_vector(args, nargs, kwnames, "|p:simplify", kwlist, &rewrite)) {
+    return NULL;
+  }
+
+  if (Filter_check_context(self) != 0) {
+    return NULL;
+  }
+  else if (self->_placeholders && PyList_GET_SIZE(self->_placeholders) > 0) {
+    PyErr_SetString(PyExc_ValueError, "Filter contains placeholders, use instantiate()");
+    return NULL;
+  }
+
+  // The record may change while the GIL is released
+  seccomplite_Policy record = { NULL, 0, 0 };
+  if (seccomplite_policy_put_bytes(&record, self->_policy.data, self->_policy.len) != 0) {
+    return PyErr_NoMemory();
+  }
+
+  seccomplite_SimplifyFinding *findings = NULL;
+  seccomplite_Policy simplified = { NULL, 0, 0 };
+  int count = 0;
+  int rc = 0;
+  Py_BEGIN_ALLOW_THREADS
+  count = seccomplite_simplify_analyze(record.data, record.len, &findings);
+  if (count > 0) {
+    rc = seccomplite_simplify_verify(record.data, record.len, findings, count, &simplified);
+  }
+  Py_END_ALLOW_THREADS
+  seccomplite_policy_free(&record);
+
+  if (count == -ENOMEM || rc == -ENOMEM) {
+    PyErr_NoMemory();
+    goto error;
+  }
+  else if (count == -E2BIG) {
+    PyErr_SetString(PyExc_ValueError, "Too many architectures to analyse");
+    goto error;
+  }
+  else if (count < 0 || rc < 0) {
     PyErr_SetString(PyExc_RuntimeError, "Library error (errno != 0)");
+    goto error;
+  }
+
+  static const char *kinds[] = { NULL, "duplicate", "subsumed", "shadowed", "collapsed", "widened" };
+  PyObject *seccomplite = PyState_FindModule(&SeccompLiteModule);
+  PyObject *arg_type = PyDict_GetItemString(PyModule_GetDict(seccomplite), ARG_TYPE_NAME);
+  PyObject *result = PyList_New(count);
+  int verified = 0;
+  int index = 0;
+  for (index = 0; result && index < count; index++) {
+    const seccomplite_SimplifyFinding *finding = &findings[index];
+    char *name = seccomp_syscall_resolve_num_arch(SCMP_ARCH_NATIVE, finding->syscall);
+    PyObject *syscall = name ? PyUnicode_FromString(name) : PyLong_FromLong(finding->syscall);
+    PyObject *item = !syscall ? NULL :
+      Py_BuildValue("{sssIsIsNsksO}", "kind", kinds[finding->kind], "rule", finding->rule, "cause", finding->cause,
+                    "syscall", syscall, "action", (unsigned long) finding->action,
+                    "verified", finding->verified ? Py_True : Py_False);
+    verified += finding->verified;
+    free(name);
+
+    // Widened rules also report their new comparison
+    if (item && finding->kind == SECCOMPLITE_SIMPLIFY_WIDENED) {
+      PyObject *arg = PyObject_CallFunction(arg_type, "IiKK", finding->cmp.arg, (int) finding->cmp.op,
+                                            (unsigned long long) finding->cmp.datum_a, (unsigned long long) finding->cmp.datum_b);
+      if (!arg || PyDict_SetItemString(item, "arg", arg) != 0) {
+        Py_CLEAR(item);
+      }
+      Py_XDECREF(arg);
+    }
+    if (!item) {
+      Py_CLEAR(result);
+      break;
+    }
+    PyList_SET_ITEM(result, index, item);
+  }
+  free(findings);
+
+  if (result && verified > 0 && rewrite) {
+    scmp_filter_ctx ctx = NULL;
+    if (seccomplite_policy_replay(simplified.data, simplified.len, &ctx) != 0) {
+      PyErr_SetString(PyExc_RuntimeError, "Library error (errno != 0)");
+      Py_CLEAR(result);
+    }
+    else {
+      seccomp_release(self->_ctx);
+      seccomplite_policy_free(&self->_policy);
+      self->_ctx = ctx;
+      self->_policy = simplified;
+      simplified.data = NULL;
+      Filter_invalidate(self);
+    }
+  }
+
+  seccomplite_policy_free(&simplified);
+  return result;
+
+error:
+  free(findings);
+  seccomplite_policy_free(&simplified);
+  return NULL;
+}
+
+PyObject * Filter_split(seccomplite_FilterObject *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames) {
+  unsigned int limit = BPF_MAXINSNS;
+  int report = 0;
+  static char *kwlist[] = {"limit", "report", NULL};
+  if (!seccomplite_parse_vector(args, nargs, kwnames, "|Ip:split", kwlist, &limit, &report)) {
+    return NULL;
+  }
+
+  if (self->_frozen && report) {
+    PyErr_SetString(PyExc_RuntimeError, "Filter is frozen");
+    return NULL;
+  }
+
+  PyObject *program = Filter_compile(self);
+  if (!program) {
+    return NULL;
+  }
+
+  PyObject *programs = NULL;
+  if (((seccomplite_ProgramObject *) program)->_len <= limit) {
+    programs = PyTuple_Pack(1, program);
+    Py_DECREF(program);
+  }
+  else if (self->_frozen) {
+    // Only the compiled program is left
+    Py_DECREF(program);
+    PyErr_SetString(PyExc_RuntimeError, "Filter is frozen");
     return NULL;
   }
   else {
-    return Py_None;
+    seccomplite_ProgramObject *compiled = (seccomplite_ProgramObject *) program;
+    uint32_t flags = compiled->_flags;
+    int nnp = compiled->_nnp;
+    Py_DECREF(program);
+
+    // The record may change while the GIL is released
+    uint8_t *data = malloc(self->_policy.len);
+    if (!data) {
+      return PyErr_NoMemory();
+    }
+    memcpy(data, self->_policy.data, self->_policy.len);
+    size_t len = self->_policy.len;
+
+    seccomplite_SplitProgram *split = NULL;
+    int count = 0;
+    Py_BEGIN_ALLOW_THREADS
+    count = seccomplite_split_compile(data, len, limit, &split);
+    Py_END_ALLOW_THREADS
+    free(data);
+
+    if (count == -E2BIG) {
+      PyErr_SetString(PyExc_ValueError, "The rules of a single syscall exceed the limit");
+      return NULL;
+    }
+    else if (count == -EINVAL) {
+      PyErr_SetString(PyExc_ValueError, "Merged filters can not be split");
+      return NULL;
+    }
+    else if (count == -ENOMEM) {
+      return PyErr_NoMemory();
+    }
+    else if (count < 0) {
+      PyErr_SetString(PyExc_RuntimeError, "Library error (errno != 0)");
+      return NULL;
+    }
+
+    // The kernel runs the most recently loaded filter first
+    programs = PyTuple_New(count);
+    int index = 0;
+    for (index = 0; programs && index < count; index++) {
+      PyObject *item = Program_create(split[index].insns, split[index].len, flags, nnp);
+      if (!item) {
+        Py_CLEAR(programs);
+        break;
+      }
+      PyTuple_SET_ITEM(programs, count - 1 - index, item);
+    }
+    seccomplite_split_free(split, count);
+  }
+
+  if (!programs || !report) {
+    return programs;
+  }
+
+  PyObject *cost = Filter_split_cost(self, programs);
+  if (!cost) {
+    Py_DECREF(programs);
+    return NULL;
   }
+
+  return Py_BuildValue("(NN)", programs, cost);
+}
+
+PyObject * Filter_instantiate(seccomplite_FilterObject *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames) {
+  if (nargs != 0) {
+    PyErr_SetString(PyExc_TypeError, "instantiate() only accepts keyword arguments");
+    return NULL;
+  }
+
+  Py_ssize_t keywords = kwnames ? PyTuple_GET_SIZE(kwnames) : 0;
+  if (!self->_placeholders || PyList_GET_SIZE(self->_placeholders) == 0) {
+    if (keywords > 0) {
+      PyErr_SetString(PyExc_TypeError, "Filter does not contain any placeholders");
+      return NULL;
+    }
+    return Filter_compile(self);
+  }
+
+  Py_ssize_t slots = PyList_GET_SIZE(self->_placeholders);
+  if (keywords != slots) {
+    PyErr_Format(PyExc_TypeError, "instantiate() requires a value for each of the %zd placeholders", slots);
+    return NULL;
+  }
+
+  // Collect the values in slot order
+  uint64_t *values = PyMem_Malloc(sizeof(uint64_t) * slots);
+  if (!values) {
+    return PyErr_NoMemory();
+  }
+
+  Py_ssize_t slot = 0;
+  for (slot = 0; slot < slots; slot++) {
+    PyObject *name = PyList_GET_ITEM(self->_placeholders, slot);
+    PyObject *value = NULL;
+    Py_ssize_t index = 0;
+    for (index = 0; index < keywords && !value; index++) {
+      if (PyUnicode_Compare(PyTuple_GET_ITEM(kwnames, index), name) == 0) {
+        value = args[index];
+      }
+    }
+    if (!value) {
+      PyErr_Format(PyExc_TypeError, "Missing value for placeholder %R", name);
+      PyMem_Free(values);
+      return NULL;
+    }
+
+    if (!PyLong_Check(value)) {
+      PyErr_Format(PyExc_TypeError, "Value of placeholder %R must be an int", name);
+      PyMem_Free(values);
+      return NULL;
+    }
+
+    values[slot] = PyLong_AsUnsignedLongLongMask(value);
+    if (PyErr_Occurred()) {
+      PyMem_Free(values);
+      return NULL;
+    }
+  }
+
+  if (Filter_check_context(self) != 0 || Filter_compile_template(self) != 0) {
+    PyMem_Free(values);
+    return NULL;
+  }
+
+  if (self->_recompile) {
+    PyObject *result = Filter_recompile(self, values);
+    PyMem_Free(values);
+    return result;
+  }
+
+  // Copy the template and patch the immediates in place
+  seccomplite_ProgramObject *template = (seccomplite_ProgramObject *) self->_template;
+  PyObject *result = Program_create(template->_insns, template->_len, template->_flags, template->_nnp);
+  if (result) {
+    struct sock_filter *insns = ((seccomplite_ProgramObject *) result)->_insns;
+    unsigned int index = 0;
+    for (index = 0; index < self->_num_sites; index++) {
+      seccomplite_TemplateSite *site = &self->_sites[index];
+      uint64_t value = values[site->slot];
+      if (site->pair) {
+        // The AND takes the mask, the comparison the masked value
+        const seccomplite_TemplatePair *pair = &self->_pairs[site->slot];
+        uint64_t mask = pair->mask_slot >= 0 ? values[pair->mask_slot] : pair->mask;
+        value = pair->value_slot >= 0 ? values[pair->value_slot] : pair->value;
+        value = BPF_CLASS(insns[site->insn].code) == BPF_ALU ? mask : value & mask;
+      }
+      insns[site->insn].k = site->high ? (uint32_t) (value >> 32) : (uint32_t) value;
+    }
+  }
+
+  PyMem_Free(values);
+  return result;
+}
+
+PyObject * Filter_freeze(seccomplite_FilterObject *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames) {
+  int intern = 0;
+  static char *kwlist[] = {"intern", NULL};
+  if (!seccomplite_parse_vector(args, nargs, kwnames, "|p:freeze", kwlist, &intern)) {
+    return NULL;
+  }
+
+  if (self->_frozen) {
+    Py_RETURN_NONE;
+  }
+
+  uint64_t digest = 0;
+  if (Filter_digest(self, &digest) != 0) {
+    return NULL;
+  }
+
+  PyObject *program = intern ? Filter_intern(self) : Filter_compile(self);
+  if (!program) {
+    return NULL;
+  }
+
+  // Only the program and the digest survive
+  self->_digest = digest;
+  seccomplite_policy_free(&self->_policy);
+  seccomp_release(self->_ctx);
+  self->_ctx = NULL;
+  Filter_clear_placeholders(self);
+  Py_XSETREF(self->_program, program);
+  self->_frozen = 1;
+
+  Py_RETURN_NONE;
+}
+
+PyObject * Filter_intern(seccomplite_FilterObject *self) {
+  if (!self->_frozen && Filter_check_context(self) != 0) {
+    return NULL;
+  }
+
+  return seccomplite_registry_intern(self);
+}
+
+/**
+ * Pickle state layout, all integers are varints
+ */
+#define FILTER_STATE_VERSION 2
+#define FILTER_STATE_FROZEN 0x01
+#define FILTER_STATE_PROGRAM 0x02
+#define FILTER_STATE_MARKER_CLASH 0x04
+
+PyObject * Filter_reduce(seccomplite_FilterObject *self) {
+  if (!self->_frozen && Filter_check_context(self) != 0) {
+    return NULL;
+  }
+
+  PyObject *program = NULL;
+  if (self->_frozen) {
+    program = self->_program;
+    Py_INCREF(program);
+  }
+  else if (self->_pickle_program && !(self->_placeholders && PyList_GET_SIZE(self->_placeholders) > 0)) {
+    program = Filter_compile(self);
+    if (!program) {
+      return NULL;
+    }
+  }
+
+  uint8_t flags = (self->_frozen ? FILTER_STATE_FROZEN : 0) | (program ? FILTER_STATE_PROGRAM : 0) | (self->_marker_clash ? FILTER_STATE_MARKER_CLASH : 0);
+  uint8_t header[2] = { FILTER_STATE_VERSION, flags };
+  seccomplite_Policy state = { NULL, 0, 0 };
+  int rc = seccomplite_policy_put_bytes(&state, header, sizeof(header));
+
+  if (self->_frozen) {
+    rc = rc || seccomplite_policy_put_varint(&state, self->_digest);
+  }
+  else {
+    rc = rc || seccomplite_policy_put_varint(&state, self->_policy.len);
+    rc = rc || seccomplite_policy_put_bytes(&state, self->_policy.data, self->_policy.len);
+
+    Py_ssize_t count = self->_placeholders ? PyList_GET_SIZE(self->_placeholders) : 0;
+    Py_ssize_t index = 0;
+    rc = rc || seccomplite_policy_put_varint(&state, count);
+    for (index = 0; !rc && index < count; index++) {
+      Py_ssize_t size = 0;
+      const char *name = PyUnicode_AsUTF8AndSize(PyList_GET_ITEM(self->_placeholders, index), &size);
+      if (!name) {
+        seccomplite_policy_free(&state);
+        Py_XDECREF(program);
+        return NULL;
+      }
+      rc = rc || seccomplite_policy_put_varint(&state, size);
+      rc = rc || seccomplite_policy_put_bytes(&state, name, size);
+    }
+
+    // Slots are stored off by one, 0 marks a constant datum
+    rc = rc || seccomplite_policy_put_varint(&state, self->_num_pairs);
+    for (index = 0; !rc && index < (Py_ssize_t) self->_num_pairs; index++) {
+      const seccomplite_TemplatePair *pair = &self->_pairs[index];
+      rc = rc || seccomplite_policy_put_varint(&state, (uint64_t) (pair->mask_slot + 1));
+      rc = rc || seccomplite_policy_put_varint(&state, pair->mask);
+      rc = rc || seccomplite_policy_put_varint(&state, (uint64_t) (pair->value_slot + 1));
+      rc = rc || seccomplite_policy_put_varint(&state, pair->value);
+    }
+  }
+
+  if (program) {
+    seccomplite_ProgramObject *compiled = (seccomplite_ProgramObject *) program;
+    uint8_t nnp = compiled->_nnp ? 1 : 0;
+    rc = rc || seccomplite_policy_put_varint(&state, compiled->_flags);
+    rc = rc || seccomplite_policy_put_bytes(&state, &nnp, 1);
+    rc = rc || seccomplite_policy_put_varint(&state, compiled->_len);
+    rc = rc || seccomplite_policy_put_bytes(&state, compiled->_insns, compiled->_len * sizeof(struct sock_filter));
+    Py_DECREF(program);
+  }
+
+  if (rc) {
+    seccomplite_policy_free(&state);
+    return PyErr_NoMemory();
+  }
+
+  PyObject *encoded = PyBytes_FromStringAndSize((const char *) state.data, state.len);
+  seccomplite_policy_free(&state);
+  if (!encoded) {
+    return NULL;
+  }
+
+  return Py_BuildValue("O(i)N", Py_TYPE(self), self->_def_action, encoded);
+}
+
+PyObject * Filter_setstate(seccomplite_FilterObject *self, PyObject *state) {
+  if (!PyBytes_Check(state)) {
+    PyErr_SetString(PyExc_TypeError, "Filter state must be bytes");
+    return NULL;
+  }
+
+  const uint8_t *data = (const uint8_t *) PyBytes_AS_STRING(state);
+  size_t len = PyBytes_GET_SIZE(state);
+  size_t offset = 2;
+  if (len < 2 || data[0] < 1 || data[0] > FILTER_STATE_VERSION) {
+    PyErr_SetString(PyExc_ValueError, "Unsupported filter state");
+    return NULL;
+  }
+
+  uint8_t flags = data[1];
+  uint64_t digest = 0;
+  uint64_t record_len = 0;
+  const uint8_t *record = NULL;
+  PyObject *placeholders = NULL;
+  seccomplite_TemplatePair *pairs = NULL;
+  uint64_t num_pairs = 0;
+  PyObject *program = NULL;
+  scmp_filter_ctx ctx = NULL;
+
+  if (flags & FILTER_STATE_FROZEN) {
+    if (seccomplite_policy_get_varint(data, len, &offset, &digest) != 0) {
+      goto corrupt;
+    }
+  }
+  else {
+    uint64_t count = 0;
+    if (seccomplite_policy_get_varint(data, len, &offset, &record_len) != 0 || record_len > len - offset) {
+      goto corrupt;
+    }
+    record = data + offset;
+    offset += record_len;
+
+    if (seccomplite_policy_get_varint(data, len, &offset, &count) != 0 || count > len - offset) {
+      goto corrupt;
+    }
+
+    placeholders = count ? PyList_New(0) : NULL;
+    while (count-- > 0) {
+      uint64_t size = 0;
+      if (seccomplite_policy_get_varint(data, len, &offset, &size) != 0 || size > len - offset) {
+        goto corrupt;
+      }
+
+      PyObject *name = PyUnicode_DecodeUTF8((const char *) data + offset, size, NULL);
+      if (!name || PyList_Append(placeholders, name) != 0) {
+        Py_XDECREF(name);
+        goto error;
+      }
+      Py_DECREF(name);
+      offset += size;
+    }
+
+    // Version 1 had no MASKED_EQ pairs
+    uint64_t slots = placeholders ? PyList_GET_SIZE(placeholders) : 0;
+    if (data[0] >= 2 && (seccomplite_policy_get_varint(data, len, &offset, &num_pairs) != 0 || num_pairs > len - offset)) {
+      goto corrupt;
+    }
+    pairs = num_pairs ? PyMem_Malloc(sizeof(seccomplite_TemplatePair) * num_pairs) : NULL;
+    if (num_pairs && !pairs) {
+      PyErr_NoMemory();
+      goto error;
+    }
+
+    uint64_t index = 0;
+    for (index = 0; index < num_pairs; index++) {
+      uint64_t fields[4];
+      unsigned int field = 0;
+      for (field = 0; field < 4; field++) {
+        if (seccomplite_policy_get_varint(data, len, &offset, &fields[field]) != 0) {
+          goto corrupt;
+        }
+      }
+      if (fields[0] > slots || fields[2] > slots) {
+        goto corrupt;
+      }
+      pairs[index].mask_slot = (int32_t) fields[0] - 1;
+      pairs[index].mask = fields[1];
+      pairs[index].value_slot = (int32_t) fields[2] - 1;
+      pairs[index].value = fields[3];
+    }
+  }
+
+  if (flags & FILTER_STATE_PROGRAM) {
+    uint64_t load_flags = 0;
+    uint64_t count = 0;
+    if (seccomplite_policy_get_varint(data, len, &offset, &load_flags) != 0 || offset >= len) {
+      goto corrupt;
+    }
+
+    uint8_t nnp = data[offset++];
+    if (seccomplite_policy_get_varint(data, len, &offset, &count) != 0 || count == 0 ||
+        count > (len - offset) / sizeof(struct sock_filter)) {
+      goto corrupt;
+    }
+
+    program = Program_create((const struct sock_filter *) (data + offset), count, load_flags, nnp);
+    if (!program) {
+      goto error;
+    }
+    offset += count * sizeof(struct sock_filter);
+  }
+  else if (flags & FILTER_STATE_FROZEN) {
+    goto corrupt;
+  }
+
+  if (!(flags & FILTER_STATE_FROZEN)) {
+    int rc = seccomplite_policy_replay(record, record_len, &ctx);
+    if (rc != 0) {
+      PyErr_SetString(PyExc_ValueError, "Filter state can not be replayed");
+      goto error;
+    }
+  }
+
+  // Everything is decoded, swap the new state in
+  if (self->_ctx) {
+    seccomp_release(self->_ctx);
+  }
+  Filter_clear_placeholders(self);
+  Py_CLEAR(self->_program);
+  Py_CLEAR(self->_pfc);
+  seccomplite_policy_free(&self->_policy);
+
+  // A shadow load stays installed in the kernel, its counters stay attached
+  self->_ctx = ctx;
+  self->_frozen = (flags & FILTER_STATE_FROZEN) != 0;
+  self->_digest = digest;
+  self->_program = program;
+  self->_program_options = Filter_program_options(self);
+  self->_placeholders = placeholders;
+  self->_pairs = pairs;
+  self->_num_pairs = (unsigned int) num_pairs;
+  self->_marker_clash = (flags & FILTER_STATE_MARKER_CLASH) != 0;
+  self->_fanout = record && seccomplite_policy_is_fanout(record, record_len);
+  if (record && seccomplite_policy_put_bytes(&self->_policy, record, record_len) != 0) {
+    return PyErr_NoMemory();
+  }
+
+  Py_RETURN_NONE;
+
+corrupt:
+  PyErr_SetString(PyExc_ValueError, "Corrupt filter state");
+error:
+  Py_XDECREF(placeholders);
+  PyMem_Free(pairs);
+  Py_XDECREF(program);
+  if (ctx) {
+    seccomp_release(ctx);
+  }
+  return NULL;
 }
 
 int PyObject_AsSyscallNumber(PyObject *syscall) {
@@ -452,33 +2357,151 @@ int PyObject_AsSyscallNumber(PyObject *syscall) {
 
 // Private methods
 
-int Filter_extract_add_rule_parameters(seccomplite_FilterObject *self, PyObject *args, int *action, int *syscall, struct scmp_arg_cmp* arguments) {
+/**
+ * Replace a placeholder by its marker value or check a plain datum
+ * @param self Type self reference
+ * @param name Placeholder name or NULL for a plain datum
+ * @param datum Datum to update
+ * @return 0 on success, -1 with exception set
+ */
+static int Filter_bind_placeholder(seccomplite_FilterObject *self, PyObject *name, scmp_datum_t *datum) {
+  if (!name) {
+    // Plain constants must not be mistaken for markers later on
+    uint32_t halves[2] = { (uint32_t) (*datum >> 32) & PLACEHOLDER_MARK_MASK, (uint32_t) *datum & PLACEHOLDER_MARK_MASK };
+    unsigned int index = 0;
+    for (index = 0; index < 2; index++) {
+      if (halves[index] == PLACEHOLDER_MARK_LO || halves[index] == PLACEHOLDER_MARK_HI ||
+          halves[index] == PLACEHOLDER_MARK_PAIR_LO || halves[index] == PLACEHOLDER_MARK_PAIR_HI) {
+        self->_marker_clash = 1;
+      }
+    }
+    return 0;
+  }
+
+  if (!self->_placeholders) {
+    self->_placeholders = PyList_New(0);
+    if (!self->_placeholders) {
+      return -1;
+    }
+  }
+
+  Py_ssize_t slot = PySequence_Index(self->_placeholders, name);
+  if (slot < 0) {
+    PyErr_Clear();
+    slot = PyList_GET_SIZE(self->_placeholders);
+    if (slot >= PLACEHOLDER_MAX_SLOTS) {
+      PyErr_SetString(PyExc_ValueError, "Maximum number of placeholders exceeded");
+      return -1;
+    }
+    if (PyList_Append(self->_placeholders, name) != 0) {
+      return -1;
+    }
+  }
+
+  *datum = ((uint64_t) (PLACEHOLDER_MARK_HI | slot) << 32) | (PLACEHOLDER_MARK_LO | slot);
+  return 0;
+}
+
+/**
+ * Remember the placeholder bindings before a rule is added
+ * @param self Type self reference
+ * @param bindings Receives the current state
+ */
+static void Filter_save_bindings(seccomplite_FilterObject *self, seccomplite_TemplateBindings *bindings) {
+  bindings->slots = self->_placeholders ? PyList_GET_SIZE(self->_placeholders) : 0;
+  bindings->pairs = self->_num_pairs;
+  bindings->marker_clash = self->_marker_clash;
+}
+
+/**
+ * Drop the bindings of a rule that was not added, keeps a pending exception
+ * @param self Type self reference
+ * @param bindings State saved by Filter_save_bindings()
+ */
+static void Filter_restore_bindings(seccomplite_FilterObject *self, const seccomplite_TemplateBindings *bindings) {
+  if (self->_placeholders && PyList_GET_SIZE(self->_placeholders) > bindings->slots) {
+    // Shrinking a list does not allocate
+    PyList_SetSlice(self->_placeholders, bindings->slots, PyList_GET_SIZE(self->_placeholders), NULL);
+  }
+  self->_num_pairs = bindings->pairs;
+  self->_marker_clash = bindings->marker_clash;
+}
+
+/**
+ * Replace the datums of a MASKED_EQ comparison with placeholders by the
+ * marker of its pair, the datums must already be bound
+ * @param self Type self reference
+ * @param arg Argument the comparison was taken from
+ * @param cmp Comparison to update
+ * @return 0 on success, -1 with exception set
+ */
+static int Filter_bind_pair(seccomplite_FilterObject *self, const seccomplite_ArgObject *arg, struct scmp_arg_cmp *cmp) {
+  if (cmp->op != SCMP_CMP_MASKED_EQ || (!arg->_placeholder_a && !arg->_placeholder_b)) {
+    return 0;
+  }
+
+  seccomplite_TemplatePair pair = {
+    arg->_placeholder_a ? (int32_t) (cmp->datum_a & ~PLACEHOLDER_MARK_MASK) : -1,
+    arg->_placeholder_b ? (int32_t) (cmp->datum_b & ~PLACEHOLDER_MARK_MASK) : -1,
+    arg->_placeholder_a ? 0 : cmp->datum_a,
+    arg->_placeholder_b ? 0 : cmp->datum_b
+  };
+
+  unsigned int index = 0;
+  for (index = 0; index < self->_num_pairs; index++) {
+    const seccomplite_TemplatePair *other = &self->_pairs[index];
+    if (other->mask_slot == pair.mask_slot && other->value_slot == pair.value_slot &&
+        other->mask == pair.mask && other->value == pair.value) {
+      break;
+    }
+  }
+
+  if (index == self->_num_pairs) {
+    if (index >= PLACEHOLDER_MAX_SLOTS) {
+      PyErr_SetString(PyExc_ValueError, "Maximum number of placeholders exceeded");
+      return -1;
+    }
+
+    seccomplite_TemplatePair *pairs = PyMem_Realloc(self->_pairs, sizeof(seccomplite_TemplatePair) * (index + 1));
+    if (!pairs) {
+      PyErr_NoMemory();
+      return -1;
+    }
+    pairs[index] = pair;
+    self->_pairs = pairs;
+    self->_num_pairs++;
+  }
+
+  cmp->datum_a = ((uint64_t) (PLACEHOLDER_MARK_PAIR_HI | index) << 32) | (PLACEHOLDER_MARK_PAIR_LO | index);
+  cmp->datum_b = cmp->datum_a;
+  return 0;
+}
+
+int Filter_extract_add_rule_parameters(seccomplite_FilterObject *self, PyObject *const *args, Py_ssize_t nargs, int *action, int *syscall, struct scmp_arg_cmp* arguments) {
   // validate presence of action and syscall
-  if (PyTuple_Size(args) < 2) {
+  if (nargs < 2) {
     PyErr_SetString(PyExc_AttributeError, "add_rule requires at least 2 arguments");
     return -1;
   }  
   
   // Extract action
-  PyObject *action_object = PyTuple_GetItem(args, 0);
-  if (PyArg_Parse(action_object, "i", action) == 0) {
+  if (PyArg_Parse(args[0], "i", action) == 0) {
     PyErr_SetString(PyExc_AttributeError, "action must be an integer");
     return -1;
   }
   
   // Extract syscall number
-  *syscall = PyObject_AsSyscallNumber(PyTuple_GetItem(args, 1));
+  *syscall = PyObject_AsSyscallNumber(args[1]);
   if (*syscall == -1) {
     return -1;
   }
   
-  // Extract remaining arguments
-  uint8_t offset = 2;
-  uint8_t num_args = PyTuple_Size(args) - offset;
-  if (num_args == 1 && PyTuple_Check(PyTuple_GetItem(args, offset))) {
-    args = PyTuple_GetItem(args, offset);
-    num_args = PyTuple_Size(args);
-    offset = 0;
+  // Extract remaining arguments, they may also be passed as one tuple
+  args += 2;
+  Py_ssize_t num_args = nargs - 2;
+  if (num_args == 1 && PyTuple_Check(args[0])) {
+    num_args = PyTuple_GET_SIZE(args[0]);
+    args = &PyTuple_GET_ITEM(args[0], 0);
   }
   
   // 6 is the maximum number of arguments
@@ -488,13 +2511,13 @@ int Filter_extract_add_rule_parameters(seccomplite_FilterObject *self, PyObject
   }
   
   // Extract and validate arguments
-  uint8_t index = 0;
-  uint8_t arg_index = 0;
+  Py_ssize_t index = 0;
+  int arg_index = 0;
   PyObject *seccomplite = PyState_FindModule(&SeccompLiteModule);
   PyObject *type = PyDict_GetItemString(PyModule_GetDict(seccomplite), ARG_TYPE_NAME);
   for (index = 0; index < num_args; index++) {
     // Fetch object and validate type
-    PyObject *o = PyTuple_GetItem(args, offset + index);
+    PyObject *o = args[index];
     if (o == Py_None) {
         continue;
     }
@@ -506,8 +2529,14 @@ int Filter_extract_add_rule_parameters(seccomplite_FilterObject *self, PyObject
     
     seccomplite_ArgObject *arg = (seccomplite_ArgObject *)o;
     arguments[arg_index] = arg->_arg;
+    if (Filter_bind_placeholder(self, arg->_placeholder_a, &arguments[arg_index].datum_a) != 0 ||
+        Filter_bind_placeholder(self, arg->_placeholder_b, &arguments[arg_index].datum_b) != 0 ||
+        Filter_bind_pair(self, arg, &arguments[arg_index]) != 0) {
+      return -1;
+    }
     arg_index++;
   }
   
   return arg_index;
-}
\ No newline at end of file
+}
+
@@ -20,6 +20,15 @@
 extern "C" {
 #endif
 
+  /**
+   * Architecture table entry
+   */
+  typedef struct {
+    const char *name;
+    const char *constant;
+    uint32_t token;
+  } seccomplite_ArchEntry;
+
   /**
    * Arch type internals
    */
@@ -49,11 +58,41 @@ extern "C" {
    */
   extern int Arch_init(seccomplite_ArchObject *self, PyObject *args, PyObject *kwds);
 
+  /**
+   * Vectorcall constructor, takes the arguments of the initializer without
+   * packing them into a tuple and dict
+   */
+  extern PyObject * Arch_vectorcall(PyObject *type, PyObject *const *args, size_t nargsf, PyObject *kwnames);
+
   /**
    * __int__ method
    */
   extern PyObject * Arch_int(seccomplite_ArchObject *self);
 
+  /**
+   * Pickle support, __reduce__ method
+   */
+  extern PyObject * Arch_reduce(seccomplite_ArchObject *self);
+
+  /**
+   * Look up an architecture by its token
+   * @param token Architecture token, SCMP_ARCH_NATIVE is not resolved
+   * @return Table entry or NULL if unsupported
+   */
+  extern const seccomplite_ArchEntry * seccomplite_arch_by_token(uint32_t token);
+
+  /**
+   * Look up an architecture by its libseccomp name, e.g. "x86_64"
+   * @return Table entry or NULL if unsupported
+   */
+  extern const seccomplite_ArchEntry * seccomplite_arch_by_name(const char *name);
+
+  /**
+   * Token the kernel reports in seccomp_data.arch for the given token
+   * (x32 shares AUDIT_ARCH_X86_64 with x86_64)
+   */
+  extern uint32_t seccomplite_arch_kernel_token(uint32_t token);
+
   /**
    * Convert the given object into an architecture token
    * @param o Object to convert (string or number)
@@ -61,6 +100,23 @@ extern "C" {
    */
   extern uint32_t PyObject_AsArchToken(PyObject *o);
 
+  /**
+   * Translate syscall numbers between architectures
+   * @arguments
+        numbers - buffer of 4 byte syscall numbers, e.g. array('i')
+        from_arch - architecture the numbers belong to
+        to_arch - architecture to translate to
+        missing - number for syscalls the target does not have, or the
+                  source does not know, default -1
+   *
+   * Description:
+        Map every number to the number of the syscall with the same name
+        on the target and return the result as bytes of the same layout.
+        The mapping tables are built from libseccomp once per pair of
+        architectures, large inputs are translated without the GIL.
+   */
+  extern PyObject * seccomplite_translate_syscalls(PyObject *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames);
+
   /**
    * Type export
    */
@@ -22,6 +22,8 @@ extern "C" {
   typedef struct {
     PyObject_HEAD
     struct scmp_arg_cmp _arg;
+    PyObject *_placeholder_a;
+    PyObject *_placeholder_b;
   } seccomplite_ArgObject;
 
   /**
@@ -45,6 +47,30 @@ extern "C" {
    */
   extern int Arg_init(seccomplite_ArgObject *self, PyObject *args, PyObject *kwds);
 
+  /**
+   * Vectorcall constructor, takes the arguments of the initializer without
+   * packing them into a tuple and dict
+   */
+  extern PyObject * Arg_vectorcall(PyObject *type, PyObject *const *args, size_t nargsf, PyObject *kwnames);
+
+  /**
+   * Pickle support, __reduce__ method
+   */
+  extern PyObject * Arg_reduce(seccomplite_ArgObject *self);
+
+  /**
+   * Match any combination of the allowed flags.
+   * @arguments
+        arg - the argument number
+        allowed - the mask of allowed flag bits
+   *
+   * Description:
+        Return an Arg which matches if no bit outside of allowed is set in
+        the argument, i.e. (value & ~allowed) == 0.  This replaces one EQ
+        rule per flag combination with a single MASKED_EQ comparison.
+   */
+  extern PyObject * Arg_flags_subset(PyTypeObject *type, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames);
+
   /**
    * Type export
    */
@@ -0,0 +1,119 @@
+/*
+ * Author: Michael Witt <m.witt@htw-berlin.de>
+ */
+
+/*
+ * File:   bpf.h
+ * Author: michael
+ *
+ * Classic BPF helpers working on compiled seccomp programs
+ */
+
+#ifndef SECCOMPLITE_BPF_H
+#define SECCOMPLITE_BPF_H
+
+#include <stdint.h>
+#include <linux/filter.h>
+#include <linux/seccomp.h>
+
+/**
+ * Classic BPF extensions the kernel accepts, only defined in linux/bpf.h
+ */
+#ifndef BPF_MOD
+#define BPF_MOD 0x90
+#endif
+#ifndef BPF_XOR
+#define BPF_XOR 0xa0
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+  /**
+   * Optimiser flags
+   */
+#define SECCOMPLITE_BPF_VERIFY 0x01
+#define SECCOMPLITE_BPF_SHARE_BLOCKS 0x02
+
+  /**
+   * Result of an optimiser run
+   */
+  typedef struct {
+    unsigned int before;
+    unsigned int after;
+    unsigned int threaded;
+    unsigned int loads;
+    unsigned int returns;
+    unsigned int dead;
+    unsigned int shared;
+    unsigned long witnesses;
+    unsigned long executed_before;
+    unsigned long executed_after;
+    int verified;
+  } seccomplite_BpfReport;
+
+  /**
+   * Run a seccomp program the way the kernel does
+   * @param insns Program instructions
+   * @param len Number of instructions
+   * @param data Syscall to evaluate
+   * @param action Receives the SECCOMP_RET_* value of the program
+   * @param executed Receives the number of executed instructions, may be NULL
+   * @return 0 on success, -1 if the program is malformed
+   */
+  extern int seccomplite_bpf_run(const struct sock_filter *insns, unsigned int len, const struct seccomp_data *data, uint32_t *action, unsigned int *executed);
+
+  /**
+   * Run a seccomp program and count the executed instructions, the last
+   * one counted decided the verdict
+   * @param hits Array of len counters, every executed instruction
+   *             increments its own
+   * @return 0 on success, -1 if the program is malformed
+   */
+  extern int seccomplite_bpf_profile(const struct sock_filter *insns, unsigned int len, const struct seccomp_data *data, uint32_t *action, unsigned int *executed, unsigned long *hits);
+
+  /**
+   * Structural checks the kernel applies before accepting a program
+   * @return 0 if the program is well formed, -1 otherwise
+   */
+  extern int seccomplite_bpf_check(const struct sock_filter *insns, unsigned int len);
+
+  /**
+   * Call the given function with one seccomp_data for every path through
+   * the program (up to a limit), each chosen to follow that path
+   * @return Number of generated inputs
+   */
+  extern unsigned long seccomplite_bpf_witnesses(const struct sock_filter *insns, unsigned int len, void (*callback)(const struct seccomp_data *data, void *arg), void *arg);
+
+  /**
+   * Run two programs on the path witnesses of both
+   * @param report If not NULL receives the number of witnesses and the
+   *               executed instructions of a (before) and b (after)
+   * @return Number of witnesses the programs disagree on
+   */
+  extern unsigned long seccomplite_bpf_compare(const struct sock_filter *a, unsigned int a_len, const struct sock_filter *b, unsigned int b_len, seccomplite_BpfReport *report);
+
+  /**
+   * Peephole optimiser: jump threading, redundant load elimination, shared
+   * return merging and dead code removal.  Does not need the GIL.
+   * @param insns Program to optimise
+   * @param len Number of instructions
+   * @param flags SECCOMPLITE_BPF_VERIFY compares both programs on the path
+   *              witnesses of each, the input is returned unchanged if they
+   *              ever disagree.  SECCOMPLITE_BPF_SHARE_BLOCKS merges all
+   *              identical instruction tails, e.g. the same argument checks
+   *              emitted for several syscalls
+   * @param out Receives a malloc'ed instruction array
+   * @param out_len Receives the number of instructions
+   * @param report Receives the statistics of the run
+   * @return 0 on success, negative errno on failure
+   */
+  extern int seccomplite_bpf_optimize(const struct sock_filter *insns, unsigned int len, int flags, struct sock_filter **out, unsigned int *out_len, seccomplite_BpfReport *report);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SECCOMPLITE_BPF_H */
+
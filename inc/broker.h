@@ -0,0 +1,140 @@
+/*
+ * Author: Michael Witt <m.witt@htw-berlin.de>
+ */
+
+/*
+ * File:   broker.h
+ * Author: michael
+ *
+ * File-open broker for filters with NOTIFY actions.  A supervisor thread
+ * receives the open requests from the listener, checks the path against
+ * a prefix tree, performs the open and injects the descriptor into the
+ * target with SECCOMP_IOCTL_NOTIF_ADDFD.
+ */
+
+#ifndef BROKER_H
+#define BROKER_H
+
+#include <Python.h>
+#include "structmember.h"
+#include <pthread.h>
+#include "config.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+  /**
+   * Access granted below a prefix
+   */
+#define SECCOMPLITE_BROKER_READ 1
+#define SECCOMPLITE_BROKER_WRITE 2
+
+  /**
+   * Node of the prefix tree, one per path component.  Nodes with a mode
+   * are prefixes, their O_PATH descriptor is opened when the broker starts.
+   */
+  typedef struct seccomplite_BrokerNode {
+    char *name;
+    int mode;
+    int fd;
+    struct seccomplite_BrokerNode *child;
+    struct seccomplite_BrokerNode *next;
+  } seccomplite_BrokerNode;
+
+  /**
+   * Broker type internals, the counters are written by the supervisor
+   * thread without the GIL
+   */
+  typedef struct {
+    PyObject_HEAD
+    seccomplite_BrokerNode *_root;
+    int _listener;
+    int _wakeup;
+    int _running;
+    pthread_t _thread;
+    unsigned long long _served;
+    unsigned long long _denied;
+    unsigned long long _errors;
+  } seccomplite_BrokerObject;
+
+  /**
+   * Type object builder
+   * @return Set up new python type
+   */
+  extern PyTypeObject * Broker_build(void);
+
+  /**
+   * Object destructor, stops the supervisor
+   */
+  extern void Broker_dealloc(seccomplite_BrokerObject *self);
+
+  /**
+   * Object allocator
+   */
+  extern PyObject * Broker_new(PyTypeObject *type, PyObject *args, PyObject *kwds);
+
+  /**
+   * Object constructor
+   * @arguments
+        paths - dict mapping absolute path prefixes to "r" or "rw"
+   */
+  extern int Broker_init(seccomplite_BrokerObject *self, PyObject *args, PyObject *kwds);
+
+  /**
+   * Vectorcall constructor, builds the object without an argument tuple
+   */
+  extern PyObject * Broker_vectorcall(PyObject *type, PyObject *const *args, size_t nargsf, PyObject *kwnames);
+
+  /**
+   * Allow a path prefix.
+   * @arguments
+        prefix - absolute path
+        mode - "r" to open read-only, "rw" to also write and create files
+   *
+   * Description:
+        The prefix is normalised lexically, the longest matching prefix of
+        a request decides.  Prefixes can only be added while the broker is
+        stopped.
+   */
+  extern PyObject * Broker_add(seccomplite_BrokerObject *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames);
+
+  /**
+   * Start serving a listener.
+   * @arguments
+        fd - listener descriptor returned by Filter.load() or Program.load()
+   *
+   * Description:
+        Duplicate the listener and start the supervisor thread.  open,
+        openat and openat2 requests below an allowed prefix are opened by
+        the supervisor, relative to an O_PATH descriptor of the prefix
+        taken now and with RESOLVE_BENEATH, and the descriptor is injected
+        into the target.  Other paths fail with EACCES, other syscalls with
+        EPERM.  Files are created with the umask of the supervisor.
+   */
+  extern PyObject * Broker_start(seccomplite_BrokerObject *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames);
+
+  /**
+   * Stop the supervisor thread and close the listener.
+   *
+   * Description:
+        Targets waiting for an answer fail with ENOSYS once no listener is
+        left.
+   */
+  extern PyObject * Broker_stop(seccomplite_BrokerObject *self);
+
+  /**
+   * __repr__ method
+   */
+  extern PyObject * Broker_repr(seccomplite_BrokerObject *self);
+
+  /**
+   * Check if the given object is a seccomplite.Broker instance
+   */
+  extern int PyObject_IsBroker(PyObject *o);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* BROKER_H */
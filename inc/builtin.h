@@ -0,0 +1,47 @@
+/*
+ * Author: Michael Witt <m.witt@htw-berlin.de>
+ */
+
+/*
+ * File:   builtin.h
+ * Author: michael
+ *
+ * Policies compiled into the extension at build time
+ */
+
+#ifndef BUILTIN_H
+#define BUILTIN_H
+
+#include <Python.h>
+#include <stdint.h>
+#include <linux/filter.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+  /**
+   * One embedded policy, setup.py generates a NULL terminated table of
+   * them from the policy files given with --policies
+   */
+  typedef struct {
+    const char *name;
+    const struct sock_filter *insns;
+    unsigned int len;
+    uint32_t flags;
+    int nnp;
+  } seccomplite_BuiltinPolicy;
+
+  /**
+   * Create the builtin_policies dict mapping every embedded policy name to
+   * a Program object.  Loading one of them is a single seccomp(2) call.
+   * @param program_type The Program type, the module is not registered yet
+   * @return New reference or NULL with exception set
+   */
+  extern PyObject * seccomplite_builtin_policies(PyTypeObject *program_type);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* BUILTIN_H */
@@ -40,6 +40,26 @@ extern "C" {
 #ifndef FILTER_TYPE_NAME
 #define FILTER_TYPE_NAME "Filter"
 #endif
+
+#ifndef PROGRAM_TYPE_NAME
+#define PROGRAM_TYPE_NAME "Program"
+#endif
+
+#ifndef PLACEHOLDER_TYPE_NAME
+#define PLACEHOLDER_TYPE_NAME "Placeholder"
+#endif
+
+#ifndef RULESET_TYPE_NAME
+#define RULESET_TYPE_NAME "RuleSet"
+#endif
+
+#ifndef BROKER_TYPE_NAME
+#define BROKER_TYPE_NAME "Broker"
+#endif
+
+#ifndef COMPILE_SERVER_TYPE_NAME
+#define COMPILE_SERVER_TYPE_NAME "CompileServer"
+#endif
   
 #if PY_MAJOR_VERSION > 3 || (PY_MAJOR_VERSION == 3 && PY_MINOR_VERSION >= 3)
 #define PyUnicode_AsString(o) (const char*)PyUnicode_1BYTE_DATA(o)
@@ -0,0 +1,94 @@
+/*
+ * Author: Michael Witt <m.witt@htw-berlin.de>
+ */
+
+/*
+ * File:   diff.h
+ * Author: michael
+ *
+ * Semantic difference of two filters over the argument space of every
+ * syscall they have rules for
+ */
+
+#ifndef DIFF_H
+#define DIFF_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <linux/filter.h>
+#include "simplify.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+  /**
+   * Upper bounds of the analysis, syscalls exceeding them are reported as
+   * one inexact region covering all arguments unless both filters have
+   * the same rules for them
+   */
+#define SECCOMPLITE_DIFF_MAX_CELLS 65536
+#define SECCOMPLITE_DIFF_MAX_MASK_BITS 8
+
+  /**
+   * One filter of the comparison
+   */
+  typedef struct {
+    const struct sock_filter *insns;
+    unsigned int len;
+    const seccomplite_SimplifyRule *rules;
+    unsigned int num_rules;
+    const uint32_t *tokens;
+    uint32_t def_action;
+    uint32_t badarch;
+  } seccomplite_DiffSide;
+
+  /**
+   * Argument range of a region, the values from lo to hi whose bits in
+   * mask equal bits
+   */
+  typedef struct {
+    unsigned int arg;
+    uint64_t lo;
+    uint64_t hi;
+    uint64_t mask;
+    uint64_t bits;
+  } seccomplite_DiffRange;
+
+  /**
+   * Part of the syscall space where the verdicts differ.  The syscall is
+   * native, __NR_SCMP_ERROR stands for every syscall without rules.
+   * Arguments without a range are not constrained.  Inexact regions were
+   * not compared and may cover arguments where the filters agree, their
+   * actions are not set.
+   */
+  typedef struct {
+    uint32_t arch;
+    int syscall;
+    unsigned int argc;
+    seccomplite_DiffRange args[6];
+    uint32_t action_a;
+    uint32_t action_b;
+    int exact;
+  } seccomplite_DiffRegion;
+
+  /**
+   * Compare two filters.  The comparisons of the rules of a syscall cut
+   * every argument into intervals, MASKED_EQ comparisons further split
+   * them by the masked bits.  Every verdict of both programs is constant
+   * on a product of such atoms, so one representative per cell decides
+   * whether the filters differ there.  Does not need the GIL.
+   * @param a First filter
+   * @param b Second filter
+   * @param regions Receives a malloc'ed array ordered by architecture
+   *                and syscall
+   * @return Number of regions, 0 for equivalent filters, negative errno
+   *         on failure
+   */
+  extern int seccomplite_diff(const seccomplite_DiffSide *a, const seccomplite_DiffSide *b, seccomplite_DiffRegion **regions);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* DIFF_H */
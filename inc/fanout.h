@@ -0,0 +1,50 @@
+/*
+ * Author: Michael Witt <m.witt@htw-berlin.de>
+ */
+
+/*
+ * File:   fanout.h
+ * Author: michael
+ *
+ * Parallel compilation of multi-architecture filters
+ */
+
+#ifndef FANOUT_H
+#define FANOUT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <linux/filter.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+  /**
+   * Count the architecture groups of a fan-out record, architectures the
+   * kernel reports with the same AUDIT_ARCH value form one group
+   * @param data Record data
+   * @param len Record length
+   * @return Number of groups, negative errno on failure
+   */
+  extern int seccomplite_fanout_groups(const uint8_t *data, size_t len);
+
+  /**
+   * Compile every architecture group of a fan-out record on its own
+   * thread and join the programs behind an architecture dispatch.  Must be
+   * called without holding the GIL.
+   * @param data Record data
+   * @param len Record length
+   * @param badarch Action taken for architectures not in the filter
+   * @param insns Receives a malloc'ed instruction array
+   * @param num_insns Receives the number of instructions
+   * @return 0 on success, negative errno on failure
+   */
+  extern int seccomplite_fanout_compile(const uint8_t *data, size_t len, uint32_t badarch, struct sock_filter **insns, unsigned int *num_insns);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* FANOUT_H */
+
@@ -17,11 +17,46 @@
 #include <Python.h>
 #include "structmember.h"
 #include <seccomp.h>  
+#include "policy.h"
+#include "shadow.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+  /**
+   * Location of a placeholder immediate inside a compiled template, the
+   * slot indexes the pairs for pair sites
+   */
+  typedef struct {
+    uint32_t insn;
+    uint16_t slot;
+    uint8_t high;
+    uint8_t pair;
+  } seccomplite_TemplateSite;
+
+  /**
+   * MASKED_EQ comparison of a template.  libseccomp compares the value
+   * after masking it, so both datums carry one pair marker and the site
+   * is patched with the mask or the masked value.  Slots are -1 for
+   * constant datums.
+   */
+  typedef struct {
+    int32_t mask_slot;
+    int32_t value_slot;
+    uint64_t mask;
+    uint64_t value;
+  } seccomplite_TemplatePair;
+
+  /**
+   * Placeholder bindings of a filter, restored if a rule is rejected
+   */
+  typedef struct {
+    Py_ssize_t slots;
+    unsigned int pairs;
+    int marker_clash;
+  } seccomplite_TemplateBindings;
+
   /**
    * Filter type internals
    */
@@ -29,6 +64,27 @@ extern "C" {
     PyObject_HEAD
     int _def_action;
     scmp_filter_ctx _ctx;
+    PyObject *_placeholders;
+    PyObject *_template;
+    seccomplite_TemplateSite *_sites;
+    unsigned int _num_sites;
+    seccomplite_TemplatePair *_pairs;
+    unsigned int _num_pairs;
+    int _recompile;
+    int _marker_clash;
+    seccomplite_Policy _policy;
+    PyObject *_program;
+    uint64_t _digest;
+    int _frozen;
+    int _pickle_program;
+    int _fanout;
+    int _optimize;
+    int _share_blocks;
+    uint64_t _generation;
+    int _program_options;
+    PyObject *_pfc;
+    seccomplite_Shadow *_shadow;
+    PyObject *_compile_server;
   } seccomplite_FilterObject;
 
   /**
@@ -49,8 +105,23 @@ extern "C" {
 
   /**
    * Object initializer
+   * @arguments
+        def_action - the default filter action
+        fanout - rules apply to every architecture of the filter, including
+                 architectures added later (default False)
+   *
+   * Description:
+        Fan-out filters record every rule once and replay it onto each
+        architecture when it is added.  Filters holding architectures of
+        different kernel ABIs are compiled with one thread per ABI.
    */
   extern int Filter_init(seccomplite_FilterObject *self, PyObject *args, PyObject *kwds);
+
+  /**
+   * Vectorcall constructor, takes the arguments of the initializer without
+   * packing them into a tuple and dict
+   */
+  extern PyObject * Filter_vectorcall(PyObject *type, PyObject *const *args, size_t nargsf, PyObject *kwnames);
   
   /**
    * Reset the given filter
@@ -62,7 +133,7 @@ extern "C" {
         original action will be reused.  This function does not affect any
         seccomp filters alread loaded into the kernel.
    */
-  extern PyObject * Filter_reset(seccomplite_FilterObject *self, PyObject *args, PyObject *kwds);
+  extern PyObject * Filter_reset(seccomplite_FilterObject *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames);
   
   /**
    * Merge two existing SyscallFilter objects
@@ -74,7 +145,7 @@ extern "C" {
         order to successfully merge two seccomp filters they must have the
         same attribute values and not share any of the same architectures.
    */
-  extern PyObject * Filter_merge(seccomplite_FilterObject *self, PyObject *args, PyObject *kwds);
+  extern PyObject * Filter_merge(seccomplite_FilterObject *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames);
 
   /**
    * Check if the seccomp filter contains a given architecture
@@ -85,7 +156,7 @@ extern "C" {
         Return True is the architecture exists, False if it does not
         exist.
    */
-  extern PyObject * Filter_exist_arch(seccomplite_FilterObject *self, PyObject *args, PyObject *kwds);
+  extern PyObject * Filter_exist_arch(seccomplite_FilterObject *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames);
   
   /**
    * Add an architecture to the filter.
@@ -95,9 +166,10 @@ extern "C" {
         Add the given architecture to the filter.  Any new rules added
         after this method returns successfully will be added to this new
         architecture, but any existing rules will not be added to the new
-        architecture.
+        architecture.  Fan-out filters replay all existing rules onto the
+        new architecture.
    */
-  extern PyObject * Filter_add_arch(seccomplite_FilterObject *self, PyObject *args, PyObject *kwds);
+  extern PyObject * Filter_add_arch(seccomplite_FilterObject *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames);
   
   /**
    * Remove an architecture from the filter.
@@ -108,16 +180,117 @@ extern "C" {
         always contain at least one architecture, so if only one
         architecture exists in the filter this method will fail.
    */
-  extern PyObject * Filter_remove_arch(seccomplite_FilterObject *self, PyObject *args, PyObject *kwds);
+  extern PyObject * Filter_remove_arch(seccomplite_FilterObject *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames);
   
   /**
    * Load the filter into the Linux Kernel.
+   * @arguments split - load oversized filters as a stack, see split()
+                shadow - True to count would-be violations instead of
+                         enforcing them, "log" to only log them
    * 
    * Description:
         Load the current filter into the Linux Kernel.  As soon as the
-        method returns the filter will be active and enforcing.
+        method returns the filter will be active and enforcing.  Filters
+        with NOTIFY actions return the descriptor of their listener, see
+        Broker, otherwise None.  Shadow loads replace every action but
+        ALLOW and LOG with NOTIFY, served by a listener thread that lets
+        the syscall continue and counts it, see shadow_report(), or with
+        LOG.  They ignore TSYNC since the listener thread must not be
+        filtered itself.  A failed install raises OSError with the errno
+        of seccomp(2), ESRCH when TSYNC could not synchronize a thread.
+   */
+  extern PyObject * Filter_load(seccomplite_FilterObject *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames);
+
+  /**
+   * Get the would-be violations of a shadow load.
+   * @arguments reset - clear the counters afterwards
+   *
+   * Description:
+        Return a dict with the number of violations, the number dropped
+        because too many distinct syscalls violated, and a list of dicts
+        ordered by count with the architecture, the syscall, the action
+        the filter would have taken, the count and a tuple with a dict
+        of the most frequent values of every argument, less frequent
+        values are counted under None.
+   */
+  extern PyObject * Filter_shadow_report(seccomplite_FilterObject *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames);
+
+  /**
+   * Split the filter into a stack of programs.
+   * @arguments
+        limit - maximum number of instructions per program (default 4096)
+        report - also return the expected cost of every syscall
+   *
+   * Description:
+        Compile the filter and, if the program exceeds the limit, partition
+        the rules by syscall into several programs.  Every program keeps
+        the default action and allows the syscalls decided by the others,
+        the most restrictive result of the stack is the result of the
+        original filter.  The programs are returned in load order, the
+        last one is evaluated first and decides the syscalls with the
+        highest priority.  With report a tuple of the programs and a dict
+        mapping every syscall to the number of instructions the whole
+        stack executes for it is returned.
+   */
+  extern PyObject * Filter_split(seccomplite_FilterObject *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames);
+
+  /**
+   * Find rules that can never decide a syscall.
+   * @arguments
+        rewrite - remove the reported rules from the filter (default False)
+   *
+   * Description:
+        Report duplicate rules, rules subsumed by a rule with the same
+        action matching a superset of the arguments and rules shadowed by
+        an unconditional rule for the same syscall.  Rules enumerating
+        every combination of some flag bits with EQ are collapsed into the
+        first one, which is widened to one MASKED_EQ comparison given as
+        arg, see Arg.flags_subset().  Every finding is a
+        dict with the kind, the index of the rule in the order rules were
+        added, the index of the rule that makes it redundant, the syscall,
+        the action and whether dropping it leaves the compiled program
+        unchanged.  libseccomp builds one decision tree per syscall, so a
+        redundant rule can still change where a later rule ends up.  With
+        rewrite the filter is rebuilt without the verified findings.
+   */
+  extern PyObject * Filter_simplify(seccomplite_FilterObject *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames);
+  
+  /**
+   * Find where two filters decide differently.
+   * @arguments filter - the Filter to compare with
+   *
+   * Description:
+        Cut the arguments of every syscall with rules in either filter
+        into the intervals bounded by the rule comparisons and the bit
+        patterns tested by MASKED_EQ, then compare both programs once per
+        cell.  Every difference is a dict with the architecture, the
+        syscall (None for all syscalls without rules), the ranges of the
+        constrained arguments as (arg, lo, hi, mask, bits) tuples, the
+        actions of both filters and whether the region is exact.
+        Syscalls with too many cells are reported as one inexact region
+        whose actions are None unless both filters have the same rules for
+        them.  Equivalent filters give an empty list.
+   */
+  extern PyObject * Filter_diff(seccomplite_FilterObject *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames);
+  
+  /**
+   * Replay a syscall trace through the filter.
+   * @arguments trace - buffer of TRACE_RECORD_SIZE byte records, a struct
+                        seccomp_data followed by the uint32 pid, uint32
+                        flags and uint64 timestamp of the call, e.g.
+                        a file written by record_trace()
+   *
+   * Description:
+        Run every record through the compiled program and the rules of
+        the filter, header and index records are skipped.  The result is a dict with the number of records, the
+        hit count of every instruction of compile(), the reached, matched
+        and decided counts of every rule in the order rules were added,
+        the number of records no rule decided and the indices of the
+        rules that never matched.  Return instructions count the verdicts
+        they decided, a rule decided a record if it is the first matching
+        rule with the resulting action.
    */
-  extern PyObject * Filter_load(seccomplite_FilterObject *self);
+  extern PyObject * Filter_profile(seccomplite_FilterObject *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames);
   
   /**
    * Get an attribute value from the filter.
@@ -127,7 +300,7 @@ extern "C" {
         Lookup the given attribute in the filter and return the
         attribute's value to the caller.
    */
-  extern PyObject * Filter_get_attr(seccomplite_FilterObject *self, PyObject *args, PyObject *kwds);
+  extern PyObject * Filter_get_attr(seccomplite_FilterObject *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames);
   
   /**
    * Set a filter attribute.
@@ -139,7 +312,7 @@ extern "C" {
         Lookup the given attribute in the filter and assign it the given
         value.
    */
-  extern PyObject * Filter_set_attr(seccomplite_FilterObject *self, PyObject *args, PyObject *kwds);
+  extern PyObject * Filter_set_attr(seccomplite_FilterObject *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames);
   
   /**
    * Set the filter priority of a syscall.
@@ -153,7 +326,7 @@ extern "C" {
         code which is loaded into the system.  Priority values can range
         from 0 to 255 inclusive.
    */
-  extern PyObject * Filter_syscall_priority(seccomplite_FilterObject *self, PyObject *args, PyObject *kwds);
+  extern PyObject * Filter_syscall_priority(seccomplite_FilterObject *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames);
   
   /**
    * Add a new rule to filter.
@@ -173,7 +346,7 @@ extern "C" {
         the rule to the best possible match.  If you don't want this fule
         rewriting to take place use add_rule_exactly().
    */
-  extern PyObject * Filter_add_rule(seccomplite_FilterObject *self, PyObject *args);
+  extern PyObject * Filter_add_rule(seccomplite_FilterObject *self, PyObject *const *args, Py_ssize_t nargs);
   
   /**
    * Add a new rule to filter.
@@ -193,7 +366,21 @@ extern "C" {
         on 32-bit x86.  For a architecture independent version of this
         method use add_rule().
    */
-  extern PyObject * Filter_add_rule_exactly(seccomplite_FilterObject *self, PyObject *args);
+  extern PyObject * Filter_add_rule_exactly(seccomplite_FilterObject *self, PyObject *const *args, Py_ssize_t nargs);
+  
+  /**
+   * Add all rules of a RuleSet to the filter.
+   * @arguments
+        rules - the RuleSet holding the rules
+        exact - add the rules as add_rule_exactly() does (default False)
+   * 
+   * Description:
+        Insert the rules in order with one call instead of one add_rule()
+        call per rule.  Every rule is validated when it is inserted, on an
+        invalid rule or a library error the exception names the rule index
+        and the rules before it stay in the filter.
+   */
+  extern PyObject * Filter_add_rules(seccomplite_FilterObject *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames);
   
   /**
    * Export the filter in PFC format.
@@ -205,7 +392,7 @@ extern "C" {
         The output is functionally equivalent to the BPF based filter
         which is loaded into the Linux Kernel.
    */
-  extern PyObject * Filter_export_pfc(seccomplite_FilterObject *self, PyObject *args, PyObject *kwds);
+  extern PyObject * Filter_export_pfc(seccomplite_FilterObject *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames);
   
   /**
    * Export the filter in BPF format.
@@ -218,7 +405,87 @@ extern "C" {
         Linux Kernel.
    * 
    */
-  extern PyObject * Filter_export_bpf(seccomplite_FilterObject *self, PyObject *args, PyObject *kwds);
+  extern PyObject * Filter_export_bpf(seccomplite_FilterObject *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames);
+
+  /**
+   * Compile the filter into a program.
+   * 
+   * Description:
+        Generate the BPF program of the current filter and return it as
+        a Program object which can be loaded or exported without any
+        further libseccomp work.  Filters containing placeholders must
+        be compiled with instantiate().  With the optimize or share_blocks
+        member set the program goes through Program.optimize() first.
+        With the compile_server member set the program is fetched from
+        that CompileServer instead.  The reply must echo the digest of the
+        record and the options, come with the load flags the filter would
+        use and pass the structural checks of the kernel, the filter
+        compiles locally otherwise or if the server can not be reached.
+   */
+  extern PyObject * Filter_compile(seccomplite_FilterObject *self);
+
+  /**
+   * SECCOMPLITE_BPF_* options the program is compiled with, optimize and
+   * share_blocks are plain members that can change without a modification
+   */
+  extern int Filter_program_options(seccomplite_FilterObject *self);
+
+  /**
+   * Instantiate a filter template.
+   * @arguments
+        **values - one integer value for every Placeholder of the filter
+   * 
+   * Description:
+        Filters with Placeholder arguments are compiled once with marker
+        values.  Every instantiation copies that program and patches the
+        immediate fields of the affected instructions, no code generation
+        takes place.  libseccomp orders the rules of a syscall by their
+        values, so if a syscall with placeholders has several rules and
+        any comparison other than EQ the filter is compiled again with the
+        values instead.
+   */
+  extern PyObject * Filter_instantiate(seccomplite_FilterObject *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames);
+
+  /**
+   * Freeze the filter.
+   * @arguments
+        intern - share the program through the interning registry
+   * 
+   * Description:
+        Compile the filter, keep only the BPF program and the digest of
+        its rules and release the libseccomp context.  Frozen filters can
+        still be loaded, compiled and exported in BPF format, every other
+        method raises an error.
+   */
+  extern PyObject * Filter_freeze(seccomplite_FilterObject *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames);
+
+  /**
+   * Get the shared compiled program of the filter.
+   * 
+   * Description:
+        Look up the filter in the process wide interning registry and
+        return the program shared by all filters with an identical
+        policy.  Policies are identical if they end up with the same
+        rules on the same architectures, the order of the rules and
+        whether they were merged in does not matter, see digest.  The
+        filter is only compiled on a registry miss.
+   */
+  extern PyObject * Filter_intern(seccomplite_FilterObject *self);
+
+  /**
+   * Pickle support, __reduce__ method
+   * 
+   * Description:
+        The state is a compact binary encoding of the policy record, the
+        placeholder names and, if pickle_program is set or the filter is
+        frozen, the compiled program.
+   */
+  extern PyObject * Filter_reduce(seccomplite_FilterObject *self);
+
+  /**
+   * Pickle support, __setstate__ method
+   */
+  extern PyObject * Filter_setstate(seccomplite_FilterObject *self, PyObject *state);
 
   /**
    * Extract the syscall number from the given object
@@ -0,0 +1,85 @@
+/*
+ * Author: Michael Witt <m.witt@htw-berlin.de>
+ */
+
+/*
+ * File:   placeholder.h
+ * Author: michael
+ *
+ * Named immediate values of filter templates
+ */
+
+#ifndef PLACEHOLDER_H
+#define PLACEHOLDER_H
+
+#include <Python.h>
+#include "structmember.h"
+#include "config.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+  /**
+   * Placeholder type internals
+   */
+  typedef struct {
+    PyObject_HEAD
+    PyObject *_name;
+  } seccomplite_PlaceholderObject;
+
+  /**
+   * Type object builder
+   * @return Set up new python type
+   */
+  extern PyTypeObject * Placeholder_build(void);
+
+  /**
+   * Object destructor
+   */
+  extern void Placeholder_dealloc(seccomplite_PlaceholderObject *self);
+
+  /**
+   * Object allocator
+   */
+  extern PyObject * Placeholder_new(PyTypeObject *type, PyObject *args, PyObject *kwds);
+
+  /**
+   * Object initializer
+   * @arguments
+        name - the keyword used to bind the value in Filter.instantiate()
+   */
+  extern int Placeholder_init(seccomplite_PlaceholderObject *self, PyObject *args, PyObject *kwds);
+
+  /**
+   * Vectorcall constructor, takes the arguments of the initializer without
+   * packing them into a tuple and dict
+   */
+  extern PyObject * Placeholder_vectorcall(PyObject *type, PyObject *const *args, size_t nargsf, PyObject *kwnames);
+
+  /**
+   * __repr__ method
+   */
+  extern PyObject * Placeholder_repr(seccomplite_PlaceholderObject *self);
+
+  /**
+   * Pickle support, __reduce__ method
+   */
+  extern PyObject * Placeholder_reduce(seccomplite_PlaceholderObject *self);
+
+  /**
+   * Check if the given object is a seccomplite.Placeholder instance
+   */
+  extern int PyObject_IsPlaceholder(PyObject *o);
+
+  /**
+   * Type export
+   */
+  extern PyType_Spec seccomplite_PlaceholderTypeSpec;
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PLACEHOLDER_H */
+
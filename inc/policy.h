@@ -0,0 +1,192 @@
+/*
+ * Author: Michael Witt <m.witt@htw-berlin.de>
+ */
+
+/*
+ * File:   policy.h
+ * Author: michael
+ *
+ * Compact binary record of all operations applied to a filter.  libseccomp
+ * can not enumerate the rules of a context, so every successful filter
+ * mutation is appended here.
+ */
+
+#ifndef POLICY_H
+#define POLICY_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <seccomp.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+  /**
+   * Record operation codes
+   */
+  enum seccomplite_policy_op {
+    SECCOMPLITE_POLICY_INIT = 1,
+    SECCOMPLITE_POLICY_ATTR = 2,
+    SECCOMPLITE_POLICY_ARCH_ADD = 3,
+    SECCOMPLITE_POLICY_ARCH_REMOVE = 4,
+    SECCOMPLITE_POLICY_PRIORITY = 5,
+    SECCOMPLITE_POLICY_RULE = 6,
+    SECCOMPLITE_POLICY_RULE_EXACT = 7,
+    SECCOMPLITE_POLICY_MERGE = 8,
+    SECCOMPLITE_POLICY_FANOUT = 9
+  };
+
+  /**
+   * Maximum number of architectures tracked for fan-out filters
+   */
+#define SECCOMPLITE_POLICY_MAX_ARCHES 32
+
+  /**
+   * Growable record buffer
+   */
+  typedef struct {
+    uint8_t *data;
+    size_t len;
+    size_t cap;
+  } seccomplite_Policy;
+
+  /**
+   * One decoded record entry
+   */
+  typedef struct {
+    uint8_t op;
+    uint32_t action;
+    uint32_t attr;
+    uint32_t value;
+    uint32_t arch;
+    int syscall;
+    uint8_t priority;
+    unsigned int argc;
+    struct scmp_arg_cmp args[6];
+    const uint8_t *nested;
+    size_t nested_len;
+  } seccomplite_PolicyEntry;
+
+  /**
+   * Release the record memory
+   */
+  extern void seccomplite_policy_free(seccomplite_Policy *policy);
+
+  /**
+   * Drop all entries and start over with the given default action
+   * @return 0 on success, -1 if out of memory
+   */
+  extern int seccomplite_policy_reset(seccomplite_Policy *policy, uint32_t def_action);
+
+  /**
+   * Append operations, all return 0 on success and -1 if out of memory
+   */
+  extern int seccomplite_policy_attr(seccomplite_Policy *policy, uint32_t attr, uint32_t value);
+  extern int seccomplite_policy_arch(seccomplite_Policy *policy, uint8_t op, uint32_t arch);
+  extern int seccomplite_policy_priority(seccomplite_Policy *policy, int syscall, uint8_t priority);
+  extern int seccomplite_policy_rule(seccomplite_Policy *policy, int exact, uint32_t action, int syscall, unsigned int argc, const struct scmp_arg_cmp *args);
+  extern int seccomplite_policy_merge(seccomplite_Policy *policy, const seccomplite_Policy *other);
+  extern int seccomplite_policy_fanout(seccomplite_Policy *policy);
+
+  /**
+   * Check if the record belongs to a fan-out filter, i.e. every rule
+   * applies to every architecture regardless of when it was added
+   */
+  extern int seccomplite_policy_is_fanout(const uint8_t *data, size_t len);
+
+  /**
+   * Collect the architectures the record ends up with
+   * @param data Record data
+   * @param len Record length
+   * @param arches Receives at most SECCOMPLITE_POLICY_MAX_ARCHES tokens,
+   *               SCMP_ARCH_NATIVE is resolved
+   * @return Number of architectures, negative errno on failure
+   */
+  extern int seccomplite_policy_arches(const uint8_t *data, size_t len, uint32_t *arches);
+
+  /**
+   * Raw buffer helpers, also used for other compact encodings
+   */
+  extern int seccomplite_policy_put_varint(seccomplite_Policy *buffer, uint64_t value);
+  extern int seccomplite_policy_put_bytes(seccomplite_Policy *buffer, const void *data, size_t len);
+  extern int seccomplite_policy_get_varint(const uint8_t *data, size_t len, size_t *offset, uint64_t *value);
+
+  /**
+   * Decode the entry at the given offset
+   * @param data Record data
+   * @param len Record length
+   * @param offset Read position, advanced past the entry
+   * @param entry Receives the decoded entry
+   * @return 1 if an entry was decoded, 0 at the end, -1 on corrupt data
+   */
+  extern int seccomplite_policy_next(const uint8_t *data, size_t len, size_t *offset, seccomplite_PolicyEntry *entry);
+
+  /**
+   * Build a new libseccomp context from a record
+   * @param data Record data
+   * @param len Record length
+   * @param ctx Receives the new context
+   * @return 0 on success, negative errno on failure
+   */
+  extern int seccomplite_policy_replay(const uint8_t *data, size_t len, scmp_filter_ctx *ctx);
+
+  /**
+   * Build a new libseccomp context holding every rule of the record on
+   * the given architectures, the arch operations of the record are ignored.
+   * Does not need the GIL.
+   * @param data Record data
+   * @param len Record length
+   * @param arches Architecture tokens of the new context
+   * @param num_arches Number of architectures, at least one
+   * @param ctx Receives the new context
+   * @return 0 on success, negative errno on failure
+   */
+  extern int seccomplite_policy_replay_arches(const uint8_t *data, size_t len, const uint32_t *arches, unsigned int num_arches, scmp_filter_ctx *ctx);
+
+  /**
+   * Rewrites one datum of a rule comparison
+   * @param cmp Comparison as stored in the record
+   * @param second 0 for datum_a, 1 for datum_b
+   * @param arg Caller data
+   * @return New datum
+   */
+  typedef uint64_t (*seccomplite_PolicyDatumMap)(const struct scmp_arg_cmp *cmp, int second, void *arg);
+
+  /**
+   * Copy a record with every rule datum passed through the given function,
+   * merged records are copied unchanged.  Does not need the GIL.
+   * @param data Record data
+   * @param len Record length
+   * @param map Datum rewrite function
+   * @param arg Passed to map
+   * @param out Receives the new record
+   * @return 0 on success, -ENOMEM if out of memory, -EINVAL on corrupt data
+   */
+  extern int seccomplite_policy_map_datums(const uint8_t *data, size_t len, seccomplite_PolicyDatumMap map, void *arg, seccomplite_Policy *out);
+
+  /**
+   * Canonical form of a record, equal for records that build the same
+   * filter regardless of the order of their operations.  Holds the
+   * default action, the final attributes and, for every architecture in
+   * token order, its sorted rules and final priorities without duplicates.
+   * Merged records are resolved.  It is only meant to be compared and
+   * digested, not replayed.  Does not need the GIL.
+   * @param data Record data
+   * @param len Record length
+   * @param out Receives the canonical form
+   * @return 0 on success, -ENOMEM if out of memory
+   */
+  extern int seccomplite_policy_canonical(const uint8_t *data, size_t len, seccomplite_Policy *out);
+
+  /**
+   * 64-bit FNV-1a digest of the record
+   */
+  extern uint64_t seccomplite_policy_digest(const uint8_t *data, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* POLICY_H */
+
@@ -0,0 +1,85 @@
+/*
+ * Author: Michael Witt <m.witt@htw-berlin.de>
+ */
+
+/*
+ * File:   profile.h
+ * Author: michael
+ *
+ * Replay of recorded syscalls through a compiled filter, counting which
+ * instructions and rules a workload exercises
+ */
+
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <linux/filter.h>
+#include <linux/seccomp.h>
+#include "simplify.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+  /**
+   * One recorded syscall, the kernel's struct seccomp_data followed by the
+   * calling thread and a CLOCK_MONOTONIC timestamp in nanoseconds.  Traces
+   * are plain arrays of these records in native byte order.
+   */
+  typedef struct {
+    struct seccomp_data data;
+    uint32_t pid;
+    uint32_t flags;
+    uint64_t timestamp;
+  } seccomplite_TraceRecord;
+
+#define SECCOMPLITE_TRACE_RECORD_SIZE 80
+
+  /**
+   * Record flags of the meta records trace files interleave with the
+   * calls, see recorder.h.  Replays skip them.
+   */
+#define SECCOMPLITE_TRACE_HEADER 0x1
+#define SECCOMPLITE_TRACE_INDEX 0x2
+#define SECCOMPLITE_TRACE_META (SECCOMPLITE_TRACE_HEADER | SECCOMPLITE_TRACE_INDEX)
+
+  /**
+   * Counters of a replay, the arrays are provided by the caller and
+   * zeroed before the first run
+   */
+  typedef struct {
+    unsigned long records;
+    unsigned long undecided;
+    unsigned long *hits;
+    unsigned long *reached;
+    unsigned long *matched;
+    unsigned long *decided;
+  } seccomplite_Profile;
+
+  /**
+   * Replay records through a program and its rules.  A rule is reached if
+   * the record's syscall and architecture are the rule's, it matched if all
+   * of its comparisons hold as well.  The verdict is attributed to the
+   * first matching rule with the program's action, unconditional rules
+   * first since they take precedence in libseccomp.  Records no rule
+   * decided, e.g. the default action or a foreign architecture, count as
+   * undecided.  Meta records are not counted.  Does not need the GIL.
+   * @param insns Program instructions
+   * @param len Number of instructions, the size of profile->hits
+   * @param rules Rules of the filter, see seccomplite_simplify_rules()
+   * @param num_rules Number of rules, the size of the rule counters
+   * @param tokens Architecture token of every rule instance
+   * @param records Trace records, need not be aligned
+   * @param count Number of records
+   * @param profile Counters to add to
+   * @return 0 on success, -ENOMEM if out of memory
+   */
+  extern int seccomplite_profile_run(const struct sock_filter *insns, unsigned int len, const seccomplite_SimplifyRule *rules, unsigned int num_rules, const uint32_t *tokens, const uint8_t *records, size_t count, seccomplite_Profile *profile);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PROFILE_H */
@@ -0,0 +1,254 @@
+/*
+ * Author: Michael Witt <m.witt@htw-berlin.de>
+ */
+
+/*
+ * File:   program.h
+ * Author: michael
+ *
+ * Compiled BPF programs that can be loaded without libseccomp
+ */
+
+#ifndef PROGRAM_H
+#define PROGRAM_H
+
+#include <Python.h>
+#include "structmember.h"
+#include <stdint.h>
+#include <seccomp.h>
+#include <linux/filter.h>
+#include "config.h"
+#include "bpf.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+  /**
+   * Program type internals
+   */
+  typedef struct {
+    PyObject_HEAD
+    struct sock_filter *_insns;
+    unsigned int _len;
+    uint32_t _flags;
+    int _nnp;
+    PyObject *_weakreflist;
+    void *_map;
+    size_t _map_len;
+  } seccomplite_ProgramObject;
+
+  /**
+   * Type object builder
+   * @return Set up new python type
+   */
+  extern PyTypeObject * Program_build(void);
+
+  /**
+   * Object destructor
+   */
+  extern void Program_dealloc(seccomplite_ProgramObject *self);
+
+  /**
+   * Object allocator
+   */
+  extern PyObject * Program_new(PyTypeObject *type, PyObject *args, PyObject *kwds);
+
+  /**
+   * Object initializer
+   * @arguments
+        data - bytes-like object holding struct sock_filter instructions
+        nnp - set no_new_privs before loading (default True)
+        tsync - synchronize all threads on load (default False)
+   */
+  extern int Program_init(seccomplite_ProgramObject *self, PyObject *args, PyObject *kwds);
+
+  /**
+   * Vectorcall constructor, takes the arguments of the initializer without
+   * packing them into a tuple and dict
+   */
+  extern PyObject * Program_vectorcall(PyObject *type, PyObject *const *args, size_t nargsf, PyObject *kwnames);
+
+  /**
+   * __len__ method, number of BPF instructions
+   */
+  extern Py_ssize_t Program_length(seccomplite_ProgramObject *self);
+
+  /**
+   * __getitem__ method, returns the instruction as (code, jt, jf, k)
+   */
+  extern PyObject * Program_item(seccomplite_ProgramObject *self, Py_ssize_t index);
+
+  /**
+   * Load the program into the Linux Kernel.
+   *
+   * Description:
+        Install the compiled program as a new seccomp filter of the
+        calling thread.  No libseccomp code is involved.  Programs with
+        NOTIFY actions are loaded with a new listener, its descriptor is
+        returned, otherwise None.
+   */
+  extern PyObject * Program_load(seccomplite_ProgramObject *self);
+
+  /**
+   * Export the program in BPF format.
+   * @arguments
+        file - the output file
+   */
+  extern PyObject * Program_export_bpf(seccomplite_ProgramObject *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames);
+
+  /**
+   * Store the program in a sealed memfd.
+   * @arguments
+        inheritable - do not set close-on-exec on the descriptor
+   *
+   * Description:
+        Write the BPF program into a new memfd and seal it against any
+        further modification.  The descriptor can be inherited by child
+        processes or passed with SCM_RIGHTS, see from_fd().
+   */
+  extern PyObject * Program_to_memfd(seccomplite_ProgramObject *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames);
+
+  /**
+   * Map a program from a file descriptor.
+   * @arguments
+        fd - descriptor holding a BPF program, e.g. from to_memfd()
+        nnp - set no_new_privs before loading (default True)
+        tsync - synchronize all threads on load (default False)
+   *
+   * Description:
+        Sealed memfds are mapped read-only and used in place, anything
+        else is copied since it could change after the call.
+   */
+  extern PyObject * Program_from_fd(PyTypeObject *type, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames);
+
+  /**
+   * Create a program object from a descriptor, sealed memfds are mapped
+   * in place like from_fd() does
+   * @param fd Descriptor holding the instructions, stays open
+   * @param flags SECCOMP_FILTER_FLAG_* passed to seccomp(2) on load
+   * @param nnp Set no_new_privs before loading
+   * @return New reference or NULL with exception set
+   */
+  extern PyObject * Program_from_memfd(int fd, uint32_t flags, int nnp);
+
+  /**
+   * Evaluate the program for a syscall.
+   * @arguments
+        syscall - the syscall name or number
+        arch - the architecture, default native
+        args - up to six argument values
+        instruction_pointer - the instruction pointer
+   *
+   * Description:
+        Run the program the way the kernel does and return a tuple of the
+        resulting action and the number of executed instructions.
+   */
+  extern PyObject * Program_evaluate(seccomplite_ProgramObject *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames);
+
+  /**
+   * Return a peephole optimised copy of the program.
+   * @arguments
+        verify - compare both programs on generated inputs (default True)
+        report - also return a dict with statistics (default False)
+        share_blocks - keep identical instruction tails, e.g. argument
+                       checks repeated for several syscalls, only once
+                       (default False)
+   *
+   * Description:
+        Thread jumps, remove redundant loads, merge identical returns and
+        drop dead code.  If verification finds a difference the program is
+        returned unchanged and the report says verified=-1.
+   */
+  extern PyObject * Program_optimize(seccomplite_ProgramObject *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames);
+
+  /**
+   * Return the raw struct sock_filter array as bytes
+   */
+  extern PyObject * Program_tobytes(seccomplite_ProgramObject *self);
+
+  /**
+   * Create a new program object holding a copy of the given instructions
+   * @param insns Instructions to copy
+   * @param len Number of instructions
+   * @param flags SECCOMP_FILTER_FLAG_* passed to seccomp(2) on load
+   * @param nnp Set no_new_privs before loading
+   * @return New reference or NULL with exception set
+   */
+  extern PyObject * Program_create(const struct sock_filter *insns, unsigned int len, uint32_t flags, int nnp);
+
+  /**
+   * Create an optimised copy of a program, see seccomplite_bpf_optimize
+   * @param program Program to optimise
+   * @param flags SECCOMPLITE_BPF_* flags
+   * @param report Receives the statistics of the run
+   * @return New reference or NULL with exception set
+   */
+  extern PyObject * Program_optimized(seccomplite_ProgramObject *program, int flags, seccomplite_BpfReport *report);
+
+  /**
+   * Generate the BPF program of a libseccomp context into memory, does
+   * not need the GIL
+   * @param ctx Filter context to export
+   * @param insns Receives a malloc'ed instruction array
+   * @param len Receives the number of instructions
+   * @return 0 on success, negative errno on failure
+   */
+  extern int seccomplite_ctx_export(scmp_filter_ctx ctx, struct sock_filter **insns, unsigned int *len);
+
+  /**
+   * Same as seccomplite_ctx_export but raises a python exception on failure
+   * @return 0 on success, -1 with exception set
+   */
+  extern int seccomplite_ctx_compile(scmp_filter_ctx ctx, struct sock_filter **insns, unsigned int *len);
+
+  /**
+   * Read the load flags (no_new_privs, tsync, ...) from a libseccomp context
+   * @param ctx Filter context
+   * @param flags Receives SECCOMP_FILTER_FLAG_* bits
+   * @param nnp Receives the no_new_privs setting
+   */
+  extern void seccomplite_ctx_load_flags(scmp_filter_ctx ctx, uint32_t *flags, int *nnp);
+
+  /**
+   * Compile the given context into a new program object
+   * @param ctx Filter context to compile
+   * @return New reference or NULL with exception set
+   */
+  extern PyObject * Program_from_ctx(scmp_filter_ctx ctx);
+
+  /**
+   * Write the whole buffer to the given descriptor
+   * @return 0 on success, -1 with errno set
+   */
+  extern int seccomplite_write_all(int fd, const char *data, size_t remaining);
+
+  /**
+   * Check whether a BPF program can return SECCOMP_RET_USER_NOTIF
+   */
+  extern int seccomplite_program_notifies(const struct sock_filter *insns, unsigned int len);
+
+  /**
+   * Install a BPF program as seccomp filter of the calling thread
+   * @param listener If not NULL and the program can notify, a listener is
+   *                 requested and its descriptor stored here, otherwise -1
+   * @return 0 on success, -1 with errno set
+   */
+  extern int seccomplite_program_install(const struct sock_filter *insns, unsigned int len, uint32_t flags, int nnp, int *listener);
+
+  /**
+   * Check if the given object is a seccomplite.Program instance
+   */
+  extern int PyObject_IsProgram(PyObject *o);
+
+  /**
+   * Type export
+   */
+  extern PyType_Spec seccomplite_ProgramTypeSpec;
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PROGRAM_H */
+
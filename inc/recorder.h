@@ -0,0 +1,84 @@
+/*
+ * Author: Michael Witt <m.witt@htw-berlin.de>
+ */
+
+/*
+ * File:   recorder.h
+ * Author: michael
+ *
+ * Binary syscall traces of a command.  A trace file is an array of
+ * seccomplite_TraceRecord slots, so it can be mapped and handed to
+ * Filter.profile() as is.  Every recording appends one segment:
+ *
+ *   header, block of records, index, block of records, index, ...
+ *
+ * Blocks hold index_interval records except the last one of a segment,
+ * so the index of block k sits (k + 1) * (interval + 1) slots after the
+ * header.  Both meta records carry SECCOMPLITE_TRACE_MAGIC as
+ * instruction pointer and -1 as syscall, their flags tell them apart:
+ *
+ *   header  args: version, interval, CLOCK_REALTIME and CLOCK_MONOTONIC
+ *                 at the start in nanoseconds
+ *           pid: the command, timestamp: the start
+ *   index   args: records in the block, first and last timestamp, records
+ *                 and slots since the header
+ *           timestamp: the last timestamp
+ */
+
+#ifndef RECORDER_H
+#define RECORDER_H
+
+#include <Python.h>
+#include <stdint.h>
+#include "profile.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+  /**
+   * "SCLTRACE" in native byte order of a little endian machine
+   */
+#define SECCOMPLITE_TRACE_MAGIC 0x45434152544c4353ULL
+#define SECCOMPLITE_TRACE_VERSION 1
+#define SECCOMPLITE_TRACE_INTERVAL 1024
+
+  /**
+   * Record a syscall trace of a command
+   * @arguments
+        file - file object or descriptor opened for appending
+        argv - the command and its arguments, looked up in PATH
+        filter - Filter or Program deciding which syscalls are recorded,
+                 NOTIFY actions are served by a listener, TRACE() actions
+                 by ptrace, default every syscall through a listener
+        index_interval - records per block, default 1024
+   *
+   * Description:
+        Run the command under the filter and append one segment of
+        records to the file, including the syscalls of every child.
+        Recorded syscalls continue unchanged.  A helper process does the
+        recording so the tracer never reaps children of the caller.
+        Return a dict with the returncode of the command, negative for a
+        signal like subprocess, and the number of records and blocks
+        written.
+   */
+  extern PyObject * seccomplite_record_trace(PyObject *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames);
+
+  /**
+   * Read the index of a trace
+   * @arguments
+        trace - buffer holding a trace file
+   *
+   * Description:
+        Return a list of dicts, one per block, with the slot of its first
+        record, the number of records and the first and last timestamp.
+        A block cut short by a killed recorder has no index record, its
+        numbers are taken from the records.
+   */
+  extern PyObject * seccomplite_trace_index(PyObject *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* RECORDER_H */
@@ -0,0 +1,57 @@
+/*
+ * Author: Michael Witt <m.witt@htw-berlin.de>
+ */
+
+/*
+ * File:   registry.h
+ * Author: michael
+ *
+ * Process wide interning of compiled programs
+ */
+
+#ifndef REGISTRY_H
+#define REGISTRY_H
+
+#include <Python.h>
+#include "filter.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+  /**
+   * Return the shared program for the given filter
+   * @param filter Filter to look up or compile
+   * @return New reference to the shared program or NULL with exception set
+   */
+  extern PyObject * seccomplite_registry_intern(seccomplite_FilterObject *filter);
+
+  /**
+   * Get registry counters
+   * @arguments
+        reset - reset the hit, miss and eviction counters afterwards
+   * 
+   * Description:
+        Return a dict with the number of hits, misses, evictions and the
+        current number of entries of the interning registry.
+   */
+  extern PyObject * seccomplite_intern_stats(PyObject *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames);
+
+  /**
+   * Drop all entries of the interning registry
+   */
+  extern PyObject * seccomplite_intern_clear(PyObject *self);
+
+  /**
+   * Configure how the registry holds its programs
+   * @arguments
+        weak - keep only weak references so unused programs are evicted
+   */
+  extern PyObject * seccomplite_intern_mode(PyObject *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* REGISTRY_H */
+
@@ -0,0 +1,131 @@
+/*
+ * Author: Michael Witt <m.witt@htw-berlin.de>
+ */
+
+/*
+ * File:   ruleset.h
+ * Author: michael
+ *
+ * Column store of rules for bulk insertion, the columns are either owned
+ * arrays or views of buffer-protocol objects such as numpy arrays
+ */
+
+#ifndef RULESET_H
+#define RULESET_H
+
+#include <Python.h>
+#include "structmember.h"
+#include <stdint.h>
+#include <seccomp.h>
+#include "config.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+  /**
+   * Number of columns that can be backed by a buffer view
+   */
+#define SECCOMPLITE_RULESET_COLUMNS 4
+
+  /**
+   * RuleSet type internals, rule i has argc[i] comparisons starting at
+   * args[i * width]
+   */
+  typedef struct {
+    PyObject_HEAD
+    uint32_t *_actions;
+    int32_t *_syscalls;
+    uint8_t *_argc;
+    struct scmp_arg_cmp *_args;
+    unsigned int _width;
+    Py_ssize_t _len;
+    Py_ssize_t _cap;
+    Py_buffer _views[SECCOMPLITE_RULESET_COLUMNS];
+    int _num_views;
+  } seccomplite_RuleSetObject;
+
+  /**
+   * Type object builder
+   * @return Set up new python type
+   */
+  extern PyTypeObject * RuleSet_build(void);
+
+  /**
+   * Object destructor
+   */
+  extern void RuleSet_dealloc(seccomplite_RuleSetObject *self);
+
+  /**
+   * Object allocator
+   */
+  extern PyObject * RuleSet_new(PyTypeObject *type, PyObject *args, PyObject *kwds);
+
+  /**
+   * Object initializer
+   * @arguments
+        actions - buffer of uint32 actions, one per rule
+        syscalls - buffer of int32 syscall numbers
+        args - buffer of struct scmp_arg_cmp records (uint32 arg, int32 op,
+               uint64 datum_a, uint64 datum_b), the same number for every
+               rule, e.g. a numpy structured array of shape (rules, width)
+        argc - buffer of uint8 comparison counts, default all of them
+   *
+   * Description:
+        The buffers are used in place, nothing is copied until the set is
+        extended with append().  Without arguments an empty set is created.
+   */
+  extern int RuleSet_init(seccomplite_RuleSetObject *self, PyObject *args, PyObject *kwds);
+
+  /**
+   * Vectorcall constructor, takes the arguments of the initializer without
+   * packing them into a tuple and dict
+   */
+  extern PyObject * RuleSet_vectorcall(PyObject *type, PyObject *const *args, size_t nargsf, PyObject *kwnames);
+
+  /**
+   * __len__ method, number of rules
+   */
+  extern Py_ssize_t RuleSet_length(seccomplite_RuleSetObject *self);
+
+  /**
+   * __getitem__ method, returns the rule as
+   * (action, syscall, ((arg, op, datum_a, datum_b), ...))
+   */
+  extern PyObject * RuleSet_item(seccomplite_RuleSetObject *self, Py_ssize_t index);
+
+  /**
+   * Add a rule to the set.
+   * @arguments
+        action - the rule action
+        syscall - the syscall name or number
+        args - variable number of Arg objects
+   */
+  extern PyObject * RuleSet_append(seccomplite_RuleSetObject *self, PyObject *const *args, Py_ssize_t nargs);
+
+  /**
+   * Fetch and validate one rule
+   * @param self RuleSet object
+   * @param index Rule index
+   * @param action Receives the action
+   * @param syscall Receives the syscall number
+   * @param args Receives up to six comparisons
+   * @return Number of comparisons, -1 with ValueError set for invalid rules
+   */
+  extern int seccomplite_ruleset_get(seccomplite_RuleSetObject *self, Py_ssize_t index, uint32_t *action, int *syscall, struct scmp_arg_cmp *args);
+
+  /**
+   * Check if the given object is a seccomplite.RuleSet instance
+   */
+  extern int PyObject_IsRuleSet(PyObject *o);
+
+  /**
+   * Type export
+   */
+  extern PyType_Spec seccomplite_RuleSetTypeSpec;
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* RULESET_H */
@@ -25,9 +25,28 @@ extern "C" {
 
   extern PyObject * seccomplite_system_arch(PyObject *self);
 
-  extern PyObject * seccomplite_resolve_syscall(PyObject *self, PyObject *args, PyObject *kwds);
-  extern PyObject * seccomplite_act_errno(PyObject *self, PyObject *args, PyObject *kwds);
-  extern PyObject * seccomplite_act_trace(PyObject *self, PyObject *args, PyObject *kwds);
+  extern PyObject * seccomplite_resolve_syscall(PyObject *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames);
+  extern PyObject * seccomplite_act_errno(PyObject *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames);
+  extern PyObject * seccomplite_act_trace(PyObject *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames);
+
+  /**
+   * Maximum number of parameters seccomplite_parse_vector handles
+   */
+#define SECCOMPLITE_VECTOR_MAX 8
+
+  /**
+   * PyArg_ParseTupleAndKeywords for the vectorcall and METH_FASTCALL
+   * conventions, no argument tuple or keyword dict is built
+   * @param args Positional arguments followed by the keyword values
+   * @param nargs Number of positional arguments
+   * @param kwnames Keyword names or NULL
+   * @param format Format of PyArg_ParseTupleAndKeywords, only single
+   *               object units are supported (O U i I K p y*), the
+   *               function name follows a colon
+   * @param kwlist Parameter names
+   * @return True on success, false with exception set
+   */
+  extern int seccomplite_parse_vector(PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames, const char *format, char **kwlist, ...);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,224 @@
+/*
+ * Author: Michael Witt <m.witt@htw-berlin.de>
+ */
+
+/*
+ * File:   server.h
+ * Author: michael
+ *
+ * Compile server shared by the processes of a host.  Clients send the
+ * policy record of a filter over a Unix stream socket, the server compiles
+ * it once, keeps the program in a sealed memfd and passes the descriptor
+ * back with SCM_RIGHTS.  Every process maps the same pages.
+ *
+ * One request per connection, all integers in native byte order:
+ *
+ *   request  seccomplite_ServerRequest, then length bytes of record
+ *   reply    seccomplite_ServerReply, with the memfd as SCM_RIGHTS
+ *            when error is 0, echoing the digest of the record and the
+ *            options so the client can check what it got
+ */
+
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <Python.h>
+#include "structmember.h"
+#include <pthread.h>
+#include <stdint.h>
+#include <sys/un.h>
+#include <linux/filter.h>
+#include "config.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+  /**
+   * "SCLC" in native byte order of a little endian machine
+   */
+#define SECCOMPLITE_SERVER_MAGIC 0x434c4353U
+#define SECCOMPLITE_SERVER_VERSION 2
+
+  /**
+   * Largest record accepted, larger policies are compiled locally
+   */
+#define SECCOMPLITE_SERVER_MAX_RECORD (16U << 20)
+
+  /**
+   * Milliseconds a connection may take, the server side only waits for
+   * the request, the client also for the compilation
+   */
+#define SECCOMPLITE_SERVER_TIMEOUT 1000
+#define SECCOMPLITE_CLIENT_TIMEOUT 10000
+
+  /**
+   * Default number of cached programs
+   */
+#define SECCOMPLITE_SERVER_ENTRIES 256
+
+  /**
+   * Connections served at the same time, further clients wait in the
+   * listen backlog
+   */
+#define SECCOMPLITE_SERVER_WORKERS 16
+
+  typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t options;
+    uint32_t length;
+  } seccomplite_ServerRequest;
+
+  typedef struct {
+    uint32_t magic;
+    int32_t error;
+    uint32_t flags;
+    uint32_t nnp;
+    uint32_t len;
+    uint32_t options;
+    uint64_t digest;
+  } seccomplite_ServerReply;
+
+  /**
+   * Cached program, the record is kept to rule out digest collisions
+   */
+  typedef struct seccomplite_ServerEntry {
+    uint64_t digest;
+    int options;
+    uint8_t *record;
+    size_t record_len;
+    int fd;
+    uint32_t flags;
+    int nnp;
+    unsigned int len;
+    struct seccomplite_ServerEntry *next;
+  } seccomplite_ServerEntry;
+
+  /**
+   * CompileServer type internals, the cache is shared by the workers and
+   * prewarm() and guarded by the mutex, as is the number of workers
+   */
+  typedef struct {
+    PyObject_HEAD
+    PyObject *_path;
+    int _mode;
+    unsigned int _max_entries;
+    int _socket;
+    int _wakeup;
+    int _running;
+    pthread_t _thread;
+    pthread_mutex_t _lock;
+    pthread_cond_t _idle;
+    unsigned int _workers;
+    seccomplite_ServerEntry *_entries;
+    unsigned int _count;
+    unsigned long long _requests;
+    unsigned long long _hits;
+    unsigned long long _misses;
+    unsigned long long _errors;
+  } seccomplite_CompileServerObject;
+
+  /**
+   * Type object builder
+   * @return Set up new python type
+   */
+  extern PyTypeObject * CompileServer_build(void);
+
+  /**
+   * Object destructor, stops the server and drops the cache
+   */
+  extern void CompileServer_dealloc(seccomplite_CompileServerObject *self);
+
+  /**
+   * Object allocator
+   */
+  extern PyObject * CompileServer_new(PyTypeObject *type, PyObject *args, PyObject *kwds);
+
+  /**
+   * Object constructor
+   * @arguments
+        path - path of the Unix socket
+        mode - permissions of the socket, default 0o600
+        max_entries - number of cached programs, default 256
+   */
+  extern int CompileServer_init(seccomplite_CompileServerObject *self, PyObject *args, PyObject *kwds);
+
+  /**
+   * Vectorcall constructor, builds the object without an argument tuple
+   */
+  extern PyObject * CompileServer_vectorcall(PyObject *type, PyObject *const *args, size_t nargsf, PyObject *kwnames);
+
+  /**
+   * Start serving.
+   *
+   * Description:
+        Bind the socket and start the server thread.  Every connection is
+        served by a worker thread of its own, up to
+        SECCOMPLITE_SERVER_WORKERS at a time, so a stalled client does not
+        hold up the others.  A stale socket left by a dead server is
+        replaced, a live one raises OSError.
+   */
+  extern PyObject * CompileServer_start(seccomplite_CompileServerObject *self);
+
+  /**
+   * Stop the server thread, wait for the workers and remove the socket,
+   * the cache is kept
+   */
+  extern PyObject * CompileServer_stop(seccomplite_CompileServerObject *self);
+
+  /**
+   * Compile filters into the cache.
+   * @arguments
+        filters - Filter objects
+   *
+   * Description:
+        Compile every filter the way a request would and keep the program,
+        e.g. for the policies of a host at boot.  Return the number of
+        programs that were not cached yet.
+   */
+  extern PyObject * CompileServer_prewarm(seccomplite_CompileServerObject *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames);
+
+  /**
+   * Drop all cached programs
+   */
+  extern PyObject * CompileServer_clear(seccomplite_CompileServerObject *self);
+
+  /**
+   * __repr__ method
+   */
+  extern PyObject * CompileServer_repr(seccomplite_CompileServerObject *self);
+
+  /**
+   * Check if the given object is a seccomplite.CompileServer instance
+   */
+  extern int PyObject_IsCompileServer(PyObject *o);
+
+  /**
+   * Fetch a program from a compile server, does not need the GIL
+   * @param address Socket of the server, from seccomplite_server_address()
+   * @param options SECCOMPLITE_BPF_* flags the program is optimised with
+   * @param fd Receives the memfd holding the program
+   * @return 0 on success, negative errno if the server can not be used or
+   *         the reply does not match the request
+   */
+  extern int seccomplite_server_fetch(const struct sockaddr_un *address, const uint8_t *record, size_t len, int options, int *fd, uint32_t *flags, int *nnp);
+
+  /**
+   * Convert the path of a compile server socket
+   * @param path str, bytes or os.PathLike object
+   * @param address Receives the socket address
+   * @return 0 on success, -1 with exception set
+   */
+  extern int seccomplite_server_address(PyObject *path, struct sockaddr_un *address);
+
+  /**
+   * Type export
+   */
+  extern PyType_Spec seccomplite_CompileServerTypeSpec;
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SERVER_H */
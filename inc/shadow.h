@@ -0,0 +1,79 @@
+/*
+ * Author: Michael Witt <m.witt@htw-berlin.de>
+ */
+
+/*
+ * File:   shadow.h
+ * Author: michael
+ *
+ * Shadow mode, filters whose verdicts are only counted.  Every action
+ * other than ALLOW and LOG is rewritten to a notification, a listener
+ * thread lets the syscall continue and counts it by architecture, syscall
+ * and the action the filter would have taken, together with the most
+ * frequent values of every argument.
+ */
+
+#ifndef SHADOW_H
+#define SHADOW_H
+
+#include <Python.h>
+#include <stdint.h>
+#include <linux/filter.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+  /**
+   * Distinct syscalls and argument values counted, further ones only
+   * count as dropped or other values
+   */
+#define SECCOMPLITE_SHADOW_SYSCALLS 256
+#define SECCOMPLITE_SHADOW_VALUES 8
+
+  /**
+   * Counters and listener thread of one shadow load, shared by the
+   * filter and the thread, which keeps running after the filter is gone
+   * as long as any task uses the shadowed filter
+   */
+  typedef struct seccomplite_Shadow seccomplite_Shadow;
+
+  /**
+   * Copy a program with every action but ALLOW and LOG replaced
+   * @param action Replacement, SECCOMP_RET_USER_NOTIF or SECCOMP_RET_LOG
+   * @return The malloc'ed copy, NULL if out of memory
+   */
+  extern struct sock_filter * seccomplite_shadow_rewrite(const struct sock_filter *insns, unsigned int len, uint32_t action);
+
+  /**
+   * Start the listener thread of a shadow load.  It must be started
+   * before the filter is installed, otherwise it would be subject to the
+   * filter it serves.
+   * @param insns The original program, used to tell the would-be action
+   * @return Shadow with a reference for the caller, NULL with errno set
+   */
+  extern seccomplite_Shadow * seccomplite_shadow_start(const struct sock_filter *insns, unsigned int len);
+
+  /**
+   * Hand the listener of the installed filter to the thread, -1 if
+   * installing failed, which ends the thread
+   */
+  extern void seccomplite_shadow_attach(seccomplite_Shadow *shadow, int listener);
+
+  /**
+   * Drop the caller's reference
+   */
+  extern void seccomplite_shadow_release(seccomplite_Shadow *shadow);
+
+  /**
+   * Build the report of a shadow load
+   * @param reset Clear the counters afterwards
+   * @return New reference to a dict, NULL with exception set
+   */
+  extern PyObject * seccomplite_shadow_report(seccomplite_Shadow *shadow, int reset);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SHADOW_H */
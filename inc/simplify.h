@@ -0,0 +1,115 @@
+/*
+ * Author: Michael Witt <m.witt@htw-berlin.de>
+ */
+
+/*
+ * File:   simplify.h
+ * Author: michael
+ *
+ * Detection of rules that can never decide a syscall
+ */
+
+#ifndef SIMPLIFY_H
+#define SIMPLIFY_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "policy.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+  /**
+   * Maximum number of architecture instances of a record
+   */
+#define SECCOMPLITE_SIMPLIFY_MAX_INSTANCES 64
+
+  /**
+   * Reasons for a rule to be redundant
+   */
+  enum seccomplite_simplify_kind {
+    SECCOMPLITE_SIMPLIFY_DUPLICATE = 1,
+    SECCOMPLITE_SIMPLIFY_SUBSUMED = 2,
+    SECCOMPLITE_SIMPLIFY_SHADOWED = 3,
+    SECCOMPLITE_SIMPLIFY_COLLAPSED = 4,
+    SECCOMPLITE_SIMPLIFY_WIDENED = 5
+  };
+
+  /**
+   * One redundant rule, rules are numbered in the order they were added
+   * with the rules of merged filters in place of the merge.  A widened rule
+   * takes over the collapsed ones, comparison replace becomes cmp.
+   */
+  typedef struct {
+    int kind;
+    unsigned int rule;
+    unsigned int cause;
+    int syscall;
+    uint32_t action;
+    unsigned int replace;
+    struct scmp_arg_cmp cmp;
+    int verified;
+  } seccomplite_SimplifyFinding;
+
+  /**
+   * One rule of the record, instances has a bit for every architecture
+   * instance the rule applies to
+   */
+  typedef struct {
+    uint32_t action;
+    int syscall;
+    unsigned int argc;
+    struct scmp_arg_cmp args[6];
+    uint64_t instances;
+  } seccomplite_SimplifyRule;
+
+  /**
+   * Collect the rules of a record in the order they were added, numbered
+   * the same way as the findings.  Does not need the GIL.
+   * @param data Record data
+   * @param len Record length
+   * @param rules Receives a malloc'ed array of rules
+   * @param tokens Receives SECCOMPLITE_SIMPLIFY_MAX_INSTANCES architecture
+   *               tokens indexed by instance, 0 for unused or removed ones
+   * @return Number of rules, negative errno on failure
+   */
+  extern int seccomplite_simplify_rules(const uint8_t *data, size_t len, seccomplite_SimplifyRule **rules, uint32_t *tokens);
+
+  /**
+   * Find duplicate, subsumed and shadowed rules.  A rule is subsumed if a
+   * rule with the same action matches a superset of its arguments and no
+   * other action competes for the syscall, it is shadowed by an
+   * unconditional rule which always takes precedence in libseccomp.
+   * Rules that only differ in an EQ comparison whose values enumerate all
+   * combinations of some flag bits are collapsed into the first one, which
+   * is widened to a single MASKED_EQ comparison.  Does not need the GIL.
+   * @param data Record data
+   * @param len Record length
+   * @param findings Receives a malloc'ed array ordered by rule, the cause is
+   *                 always a rule that is kept
+   * @return Number of findings, negative errno on failure
+   */
+  extern int seccomplite_simplify_analyze(const uint8_t *data, size_t len, seccomplite_SimplifyFinding **findings);
+
+  /**
+   * Check which findings can be dropped without changing the compiled
+   * program.  libseccomp builds one decision tree per syscall, a rule that
+   * is logically redundant can still change which branch a later rule ends
+   * up in, so the findings of a syscall are tried together first and one
+   * by one if that changes the program.  Does not need the GIL.
+   * @param data Record data
+   * @param len Record length
+   * @param findings Findings of seccomplite_simplify_analyze, the verified
+   *                 field is set for every finding that can be dropped
+   * @param count Number of findings
+   * @param out Receives the record without the verified findings
+   * @return 0 on success, negative errno on failure
+   */
+  extern int seccomplite_simplify_verify(const uint8_t *data, size_t len, seccomplite_SimplifyFinding *findings, unsigned int count, seccomplite_Policy *out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SIMPLIFY_H */
@@ -0,0 +1,56 @@
+/*
+ * Author: Michael Witt <m.witt@htw-berlin.de>
+ */
+
+/*
+ * File:   split.h
+ * Author: michael
+ *
+ * Splitting of oversized policies into a stack of filters
+ */
+
+#ifndef SPLIT_H
+#define SPLIT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <linux/filter.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+  /**
+   * One program of a split policy
+   */
+  typedef struct {
+    struct sock_filter *insns;
+    unsigned int len;
+  } seccomplite_SplitProgram;
+
+  /**
+   * Partition the rules of a record by syscall into programs of at most
+   * limit instructions.  Every program keeps the default action and allows
+   * the syscalls decided by the other programs, the kernel runs all of
+   * them and the most restrictive result wins.  Syscalls are assigned in
+   * order of their priority, so the first program holds the hottest ones.
+   * Does not need the GIL.
+   * @param data Record data
+   * @param len Record length
+   * @param limit Maximum number of instructions per program
+   * @param programs Receives a malloc'ed array of programs
+   * @return Number of programs, negative errno on failure
+   */
+  extern int seccomplite_split_compile(const uint8_t *data, size_t len, unsigned int limit, seccomplite_SplitProgram **programs);
+
+  /**
+   * Release the programs returned by seccomplite_split_compile
+   */
+  extern void seccomplite_split_free(seccomplite_SplitProgram *programs, unsigned int count);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SPLIT_H */
+
@@ -0,0 +1,71 @@
+/*
+ * Author: Michael Witt <m.witt@htw-berlin.de>
+ */
+
+/*
+ * File:   stack.h
+ * Author: michael
+ *
+ * Inspection and planning of stacked kernel filters
+ */
+
+#ifndef STACK_H
+#define STACK_H
+
+#include <Python.h>
+#include <linux/filter.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+  /**
+   * Compose several programs into one that decides like the stack, does
+   * not need the GIL
+   * @param programs Programs in evaluation order, most recently loaded first
+   * @param count Number of programs
+   * @param insns Receives a malloc'ed instruction array
+   * @param len Receives the number of instructions
+   * @return 0 on success, negative errno on failure
+   */
+  extern int seccomplite_stack_compose(const struct sock_fprog *programs, unsigned int count, struct sock_filter **insns, unsigned int *len);
+
+  /**
+   * Get the filters loaded into a process
+   * @arguments
+        pid - process to inspect, default the calling process
+   *
+   * Description:
+        Read the number of stacked filters from /proc/<pid>/status and
+        fetch every filter with PTRACE_SECCOMP_GET_FILTER.  The list is in
+        load order like the input of plan_stack(), the kernel runs the last
+        filter first.  Filters that can not be read are None, the kernel only
+        hands them out to callers with CAP_SYS_ADMIN which are not
+        filtered themselves.  The filters of the calling process can never
+        be read that way, only their number is reported and no child is
+        forked, so the call is safe under filters that kill clone.
+        Returns None if the kernel reports neither.
+   */
+  extern PyObject * seccomplite_loaded_filters(PyObject *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames);
+
+  /**
+   * Plan a stack of filters
+   * @arguments
+        filters - Filter or Program objects in load order
+   *
+   * Description:
+        Combine the filters into one program that returns exactly what
+        the kernel would return after loading them one after another: the
+        most restrictive action wins, on equal actions the filter loaded
+        last.  Every return of a program is replaced by a jump into a copy
+        of the next program specialised for the result so far.  Raises
+        ValueError if the combined program exceeds BPF_MAXINSNS.
+   */
+  extern PyObject * seccomplite_plan_stack(PyObject *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* STACK_H */
+
@@ -0,0 +1,149 @@
+/*
+ * Author: Michael Witt <m.witt@htw-berlin.de>
+ */
+
+/*
+ * File:   stats.h
+ * Author: michael
+ *
+ * Call counters, latency histograms and USDT probes around the expensive
+ * libseccomp calls.  Timing is off until enabled at run time, building
+ * with -DSECCOMPLITE_NO_STATS removes it completely.  The probes are
+ * compiled in whenever <sys/sdt.h> is available and cost a nop each until
+ * a tracer attaches, -DSECCOMPLITE_NO_USDT removes them.
+ */
+
+#ifndef STATS_H
+#define STATS_H
+
+#include <Python.h>
+#include <stdint.h>
+#include <time.h>
+
+#if !defined(SECCOMPLITE_NO_USDT) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define SECCOMPLITE_USDT 1
+#endif
+#endif
+
+#ifdef SECCOMPLITE_USDT
+#define SECCOMPLITE_PROBE_ENTRY(op) DTRACE_PROBE2(seccomplite, call__entry, op, seccomplite_stats_names[op])
+#define SECCOMPLITE_PROBE_RETURN(op, rc, ns) DTRACE_PROBE4(seccomplite, call__return, op, seccomplite_stats_names[op], rc, ns)
+#else
+#define SECCOMPLITE_PROBE_ENTRY(op) do { } while (0)
+#define SECCOMPLITE_PROBE_RETURN(op, rc, ns) do { } while (0)
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+  /**
+   * Instrumented operations
+   */
+  enum seccomplite_stats_op {
+    SECCOMPLITE_STATS_INIT = 0,
+    SECCOMPLITE_STATS_RULE_ADD = 1,
+    SECCOMPLITE_STATS_MERGE = 2,
+    SECCOMPLITE_STATS_LOAD = 3,
+    SECCOMPLITE_STATS_EXPORT_PFC = 4,
+    SECCOMPLITE_STATS_EXPORT_BPF = 5,
+    SECCOMPLITE_STATS_OPS = 6
+  };
+
+  /**
+   * Number of histogram buckets, bucket i counts latencies below 2^(i+1)
+   * nanoseconds, the last one everything above
+   */
+#define SECCOMPLITE_STATS_BUCKETS 40
+
+  /**
+   * Operation names, also passed to the probes
+   */
+  extern const char *seccomplite_stats_names[SECCOMPLITE_STATS_OPS];
+
+  /**
+   * Timing switch, read without the GIL
+   */
+  extern int seccomplite_stats_enabled;
+
+  /**
+   * Add one call to the counters, safe without the GIL
+   * @param op Operation
+   * @param ns Elapsed time in nanoseconds
+   * @param rc Return code of the call, nonzero counts as error
+   */
+  extern void seccomplite_stats_record(int op, uint64_t ns, int rc);
+
+#ifndef SECCOMPLITE_NO_STATS
+  static inline uint64_t seccomplite_stats_now(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000000000ULL + now.tv_nsec;
+  }
+
+  /**
+   * Start timing a call
+   * @return Start time, 0 if timing is disabled
+   */
+  static inline uint64_t seccomplite_stats_begin(int op) {
+    SECCOMPLITE_PROBE_ENTRY(op);
+    return __atomic_load_n(&seccomplite_stats_enabled, __ATOMIC_RELAXED) ? seccomplite_stats_now() : 0;
+  }
+
+  /**
+   * Finish timing a call started with seccomplite_stats_begin()
+   */
+  static inline void seccomplite_stats_end(int op, uint64_t started, int rc) {
+    uint64_t ns = started ? seccomplite_stats_now() - started : 0;
+    SECCOMPLITE_PROBE_RETURN(op, rc, ns);
+    if (started) {
+      seccomplite_stats_record(op, ns, rc);
+    }
+  }
+#else
+  static inline uint64_t seccomplite_stats_begin(int op) {
+    SECCOMPLITE_PROBE_ENTRY(op);
+    return 0;
+  }
+
+  static inline void seccomplite_stats_end(int op, uint64_t started, int rc) {
+    SECCOMPLITE_PROBE_RETURN(op, rc, 0);
+  }
+#endif
+
+  /**
+   * Get the call statistics
+   * @arguments
+        reset - reset the counters afterwards
+   *
+   * Description:
+        Return a dict mapping every operation that was called while timing
+        was enabled to a dict with the number of calls and errors, the
+        total, minimum and maximum latency in nanoseconds and a histogram
+        mapping power of two upper bounds in nanoseconds to call counts.
+   */
+  extern PyObject * seccomplite_stats(PyObject *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames);
+
+  /**
+   * Switch timing on or off
+   * @arguments
+        enabled - new state, default True
+   *
+   * Description:
+        Return the previous state.  Timing can also be enabled for the
+        whole process with the SECCOMPLITE_STATS environment variable.
+   */
+  extern PyObject * seccomplite_stats_enable(PyObject *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames);
+
+  /**
+   * Apply the SECCOMPLITE_STATS environment variable, called on import
+   */
+  extern void seccomplite_stats_setup(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* STATS_H */
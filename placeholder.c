@@ -0,0 +1,125 @@
+/*
+ * Placeholder submodule in seccomplite library
+ * Author: Michael Witt <m.witt@htw-berlin.de>
+ */
+
+#include <Python.h>
+#include "inc/config.h"
+#include "inc/placeholder.h"
+#include "inc/seccomplite.h"
+
+/**
+ * Placeholder type member and methods definitions
+ */
+static PyMemberDef Placeholder_members[] = {
+  {"name", T_OBJECT, offsetof(seccomplite_PlaceholderObject, _name), READONLY, "Placeholder name"},
+  { NULL } /* Sentinel */
+};
+
+static PyMethodDef Placeholder_methods[] = {
+  { "__reduce__", (PyCFunction)Placeholder_reduce, METH_NOARGS, "Pickle support" },
+  { NULL } /* Sentinel */
+};
+
+/**
+ * Placeholder type slots definitions
+ */
+static PyType_Slot seccomplite_PlaceholderTypeSlots[] = {
+  { Py_tp_methods, Placeholder_methods },
+  { Py_tp_members, Placeholder_members },
+  { Py_tp_init, Placeholder_init },
+  { Py_tp_new, Placeholder_new },
+  { Py_tp_dealloc, Placeholder_dealloc },
+  { Py_tp_repr, Placeholder_repr },
+  { 0, NULL }
+};
+
+/**
+ * Placeholder type specs
+ */
+PyType_Spec seccomplite_PlaceholderTypeSpec = {
+  MODULE_NAME "." PLACEHOLDER_TYPE_NAME,
+  sizeof (seccomplite_PlaceholderObject),
+  0,
+  Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE,
+  seccomplite_PlaceholderTypeSlots
+};
+
+/// Placeholder type methods
+
+void Placeholder_dealloc(seccomplite_PlaceholderObject *self) {
+  Py_XDECREF(self->_name);
+  Py_TYPE(self)->tp_free((PyObject*) self);
+}
+
+PyObject * Placeholder_new(PyTypeObject *type, PyObject *args, PyObject *kwds) {
+  seccomplite_PlaceholderObject *self;
+
+  self = (seccomplite_PlaceholderObject *) type->tp_alloc(type, 0);
+  if (self != NULL) {
+    self->_name = NULL;
+  }
+
+  return (PyObject *) self;
+}
+
+/**
+ * Constructor parameters
+ */
+static char *Placeholder_kwlist[] = {"name", NULL};
+
+int Placeholder_init(seccomplite_PlaceholderObject *self, PyObject *args, PyObject *kwds) {
+  PyObject *name = NULL;
+  if (!PyArg_ParseTupleAndKeywords(args, kwds, "U", Placeholder_kwlist, &name)) {
+    return -1;
+  }
+
+  Py_INCREF(name);
+  Py_XSETREF(self->_name, name);
+  return 0;
+}
+
+PyObject * Placeholder_vectorcall(PyObject *type, PyObject *const *args, size_t nargsf, PyObject *kwnames) {
+  PyObject *name = NULL;
+  if (!seccomplite_parse_vector(args, PyVectorcall_NARGS(nargsf), kwnames, "U:" PLACEHOLDER_TYPE_NAME, Placeholder_kwlist, &name)) {
+    return NULL;
+  }
+
+  seccomplite_PlaceholderObject *self = (seccomplite_PlaceholderObject *) Placeholder_new((PyTypeObject *) type, NULL, NULL);
+  if (self) {
+    Py_INCREF(name);
+    self->_name = name;
+  }
+  return (PyObject *) self;
+}
+
+PyObject * Placeholder_repr(seccomplite_PlaceholderObject *self) {
+  return PyUnicode_FromFormat("%s(%R)", PLACEHOLDER_TYPE_NAME, self->_name ? self->_name : Py_None);
+}
+
+PyObject * Placeholder_reduce(seccomplite_PlaceholderObject *self) {
+  return Py_BuildValue("O(O)", Py_TYPE(self), self->_name ? self->_name : Py_None);
+}
+
+PyTypeObject * Placeholder_build(void) {
+  // Ready the type
+  PyObject *type = PyType_FromSpec(&seccomplite_PlaceholderTypeSpec);
+  PyTypeObject *result = (PyTypeObject *) type;
+
+  if (!type || PyType_Ready(result) < 0) {
+    Py_XDECREF(type);
+    return NULL;
+  }
+
+#if PY_VERSION_HEX >= 0x03090000
+  // Calling the type skips the argument tuple of tp_new and tp_init
+  result->tp_vectorcall = (vectorcallfunc) Placeholder_vectorcall;
+#endif
+  return result;
+}
+
+int PyObject_IsPlaceholder(PyObject *o) {
+  PyObject *seccomplite = PyState_FindModule(&SeccompLiteModule);
+  PyObject *type = PyDict_GetItemString(PyModule_GetDict(seccomplite), PLACEHOLDER_TYPE_NAME);
+  return PyObject_IsInstance(o, type) == 1;
+}
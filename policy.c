@@ -0,0 +1,786 @@
+/*
+ * Policy record in seccomplite library
+ * Author: Michael Witt <m.witt@htw-berlin.de>
+ *
+ * All integers are stored as LEB128 varints, syscall numbers are zigzag
+ * encoded since libseccomp uses negative pseudo syscall numbers.  The
+ * record does not depend on the GIL, it uses the plain C allocator.
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include "inc/policy.h"
+
+/**
+ * Make room for at least the given number of bytes
+ */
+static int policy_reserve(seccomplite_Policy *policy, size_t extra) {
+  if (policy->len + extra <= policy->cap) {
+    return 0;
+  }
+
+  size_t cap = policy->cap ? policy->cap : 64;
+  while (cap < policy->len + extra) {
+    cap *= 2;
+  }
+
+  uint8_t *data = realloc(policy->data, cap);
+  if (!data) {
+    return -1;
+  }
+
+  policy->data = data;
+  policy->cap = cap;
+  return 0;
+}
+
+static void policy_put_byte(seccomplite_Policy *policy, uint8_t value) {
+  policy->data[policy->len++] = value;
+}
+
+static void policy_put_varint(seccomplite_Policy *policy, uint64_t value) {
+  while (value >= 0x80) {
+    policy->data[policy->len++] = (uint8_t) (value | 0x80);
+    value >>= 7;
+  }
+  policy->data[policy->len++] = (uint8_t) value;
+}
+
+static uint64_t policy_zigzag(int value) {
+  return ((uint64_t) (int64_t) value << 1) ^ (uint64_t) ((int64_t) value >> 63);
+}
+
+static int policy_unzigzag(uint64_t value) {
+  return (int) ((int64_t) (value >> 1) ^ -(int64_t) (value & 1));
+}
+
+static int policy_get_varint(const uint8_t *data, size_t len, size_t *offset, uint64_t *value) {
+  uint64_t result = 0;
+  unsigned int shift = 0;
+  while (*offset < len && shift < 64) {
+    uint8_t byte = data[(*offset)++];
+    result |= (uint64_t) (byte & 0x7F) << shift;
+    if (!(byte & 0x80)) {
+      *value = result;
+      return 0;
+    }
+    shift += 7;
+  }
+
+  return -1;
+}
+
+void seccomplite_policy_free(seccomplite_Policy *policy) {
+  free(policy->data);
+  policy->data = NULL;
+  policy->len = 0;
+  policy->cap = 0;
+}
+
+int seccomplite_policy_reset(seccomplite_Policy *policy, uint32_t def_action) {
+  policy->len = 0;
+  if (policy_reserve(policy, 11) != 0) {
+    return -1;
+  }
+
+  policy_put_byte(policy, SECCOMPLITE_POLICY_INIT);
+  policy_put_varint(policy, def_action);
+  return 0;
+}
+
+int seccomplite_policy_attr(seccomplite_Policy *policy, uint32_t attr, uint32_t value) {
+  if (policy_reserve(policy, 11) != 0) {
+    return -1;
+  }
+
+  policy_put_byte(policy, SECCOMPLITE_POLICY_ATTR);
+  policy_put_varint(policy, attr);
+  policy_put_varint(policy, value);
+  return 0;
+}
+
+int seccomplite_policy_arch(seccomplite_Policy *policy, uint8_t op, uint32_t arch) {
+  if (policy_reserve(policy, 6) != 0) {
+    return -1;
+  }
+
+  policy_put_byte(policy, op);
+  policy_put_varint(policy, arch);
+  return 0;
+}
+
+int seccomplite_policy_priority(seccomplite_Policy *policy, int syscall, uint8_t priority) {
+  if (policy_reserve(policy, 12) != 0) {
+    return -1;
+  }
+
+  policy_put_byte(policy, SECCOMPLITE_POLICY_PRIORITY);
+  policy_put_varint(policy, policy_zigzag(syscall));
+  policy_put_byte(policy, priority);
+  return 0;
+}
+
+int seccomplite_policy_rule(seccomplite_Policy *policy, int exact, uint32_t action, int syscall, unsigned int argc, const struct scmp_arg_cmp *args) {
+  if (argc > 6 || policy_reserve(policy, 18 + argc * 21) != 0) {
+    return -1;
+  }
+
+  policy_put_byte(policy, exact ? SECCOMPLITE_POLICY_RULE_EXACT : SECCOMPLITE_POLICY_RULE);
+  policy_put_varint(policy, action);
+  policy_put_varint(policy, policy_zigzag(syscall));
+  policy_put_byte(policy, argc);
+
+  unsigned int index = 0;
+  for (index = 0; index < argc; index++) {
+    // Argument index and operator share one byte
+    policy_put_byte(policy, (uint8_t) ((args[index].arg & 0x7) | ((args[index].op & 0x1F) << 3)));
+    policy_put_varint(policy, args[index].datum_a);
+    policy_put_varint(policy, args[index].datum_b);
+  }
+
+  return 0;
+}
+
+int seccomplite_policy_merge(seccomplite_Policy *policy, const seccomplite_Policy *other) {
+  if (policy_reserve(policy, 11 + other->len) != 0) {
+    return -1;
+  }
+
+  policy_put_byte(policy, SECCOMPLITE_POLICY_MERGE);
+  policy_put_varint(policy, other->len);
+  memcpy(policy->data + policy->len, other->data, other->len);
+  policy->len += other->len;
+  return 0;
+}
+
+int seccomplite_policy_fanout(seccomplite_Policy *policy) {
+  if (policy_reserve(policy, 1) != 0) {
+    return -1;
+  }
+
+  policy_put_byte(policy, SECCOMPLITE_POLICY_FANOUT);
+  return 0;
+}
+
+int seccomplite_policy_put_varint(seccomplite_Policy *buffer, uint64_t value) {
+  if (policy_reserve(buffer, 10) != 0) {
+    return -1;
+  }
+
+  policy_put_varint(buffer, value);
+  return 0;
+}
+
+int seccomplite_policy_put_bytes(seccomplite_Policy *buffer, const void *data, size_t len) {
+  if (policy_reserve(buffer, len) != 0) {
+    return -1;
+  }
+
+  memcpy(buffer->data + buffer->len, data, len);
+  buffer->len += len;
+  return 0;
+}
+
+int seccomplite_policy_get_varint(const uint8_t *data, size_t len, size_t *offset, uint64_t *value) {
+  return policy_get_varint(data, len, offset, value);
+}
+
+int seccomplite_policy_next(const uint8_t *data, size_t len, size_t *offset, seccomplite_PolicyEntry *entry) {
+  if (*offset >= len) {
+    return 0;
+  }
+
+  uint64_t a = 0;
+  uint64_t b = 0;
+  memset(entry, 0, sizeof(seccomplite_PolicyEntry));
+  entry->op = data[(*offset)++];
+  switch (entry->op) {
+    case SECCOMPLITE_POLICY_INIT:
+      if (policy_get_varint(data, len, offset, &a) != 0) {
+        return -1;
+      }
+      entry->action = (uint32_t) a;
+      return 1;
+
+    case SECCOMPLITE_POLICY_ATTR:
+      if (policy_get_varint(data, len, offset, &a) != 0 || policy_get_varint(data, len, offset, &b) != 0) {
+        return -1;
+      }
+      entry->attr = (uint32_t) a;
+      entry->value = (uint32_t) b;
+      return 1;
+
+    case SECCOMPLITE_POLICY_ARCH_ADD:
+    case SECCOMPLITE_POLICY_ARCH_REMOVE:
+      if (policy_get_varint(data, len, offset, &a) != 0) {
+        return -1;
+      }
+      entry->arch = (uint32_t) a;
+      return 1;
+
+    case SECCOMPLITE_POLICY_PRIORITY:
+      if (policy_get_varint(data, len, offset, &a) != 0 || *offset >= len) {
+        return -1;
+      }
+      entry->syscall = policy_unzigzag(a);
+      entry->priority = data[(*offset)++];
+      return 1;
+
+    case SECCOMPLITE_POLICY_RULE:
+    case SECCOMPLITE_POLICY_RULE_EXACT:
+      if (policy_get_varint(data, len, offset, &a) != 0 || policy_get_varint(data, len, offset, &b) != 0 || *offset >= len) {
+        return -1;
+      }
+      entry->action = (uint32_t) a;
+      entry->syscall = policy_unzigzag(b);
+      entry->argc = data[(*offset)++];
+      if (entry->argc > 6) {
+        return -1;
+      }
+
+      unsigned int index = 0;
+      for (index = 0; index < entry->argc; index++) {
+        if (*offset >= len) {
+          return -1;
+        }
+        uint8_t packed = data[(*offset)++];
+        entry->args[index].arg = packed & 0x7;
+        entry->args[index].op = (enum scmp_compare) (packed >> 3);
+        if (policy_get_varint(data, len, offset, &entry->args[index].datum_a) != 0 ||
+            policy_get_varint(data, len, offset, &entry->args[index].datum_b) != 0) {
+          return -1;
+        }
+      }
+      return 1;
+
+    case SECCOMPLITE_POLICY_FANOUT:
+      return 1;
+
+    case SECCOMPLITE_POLICY_MERGE:
+      if (policy_get_varint(data, len, offset, &a) != 0 || a > len - *offset) {
+        return -1;
+      }
+      entry->nested = data + *offset;
+      entry->nested_len = (size_t) a;
+      *offset += (size_t) a;
+      return 1;
+
+    default:
+      return -1;
+  }
+}
+
+int seccomplite_policy_replay(const uint8_t *data, size_t len, scmp_filter_ctx *ctx) {
+  scmp_filter_ctx result = NULL;
+  scmp_filter_ctx other = NULL;
+  seccomplite_PolicyEntry entry;
+  size_t offset = 0;
+  int rc = 0;
+
+  *ctx = NULL;
+  if (seccomplite_policy_is_fanout(data, len)) {
+    uint32_t arches[SECCOMPLITE_POLICY_MAX_ARCHES];
+    int count = seccomplite_policy_arches(data, len, arches);
+    if (count < 0) {
+      return count;
+    }
+    return seccomplite_policy_replay_arches(data, len, arches, count, ctx);
+  }
+
+  while (rc == 0 && (rc = seccomplite_policy_next(data, len, &offset, &entry)) == 1) {
+    rc = 0;
+    if (entry.op == SECCOMPLITE_POLICY_INIT) {
+      if (result) {
+        rc = seccomp_reset(result, entry.action);
+      }
+      else if (!(result = seccomp_init(entry.action))) {
+        rc = -EINVAL;
+      }
+      continue;
+    }
+    else if (!result) {
+      // Every record starts with the default action
+      rc = -EINVAL;
+      break;
+    }
+
+    switch (entry.op) {
+      case SECCOMPLITE_POLICY_ATTR:
+        rc = seccomp_attr_set(result, entry.attr, entry.value);
+        break;
+      case SECCOMPLITE_POLICY_ARCH_ADD:
+        rc = seccomp_arch_add(result, entry.arch);
+        break;
+      case SECCOMPLITE_POLICY_ARCH_REMOVE:
+        rc = seccomp_arch_remove(result, entry.arch);
+        break;
+      case SECCOMPLITE_POLICY_PRIORITY:
+        rc = seccomp_syscall_priority(result, entry.syscall, entry.priority);
+        break;
+      case SECCOMPLITE_POLICY_RULE:
+        rc = seccomp_rule_add_array(result, entry.action, entry.syscall, entry.argc, entry.args);
+        break;
+      case SECCOMPLITE_POLICY_RULE_EXACT:
+        rc = seccomp_rule_add_exact_array(result, entry.action, entry.syscall, entry.argc, entry.args);
+        break;
+      case SECCOMPLITE_POLICY_FANOUT:
+        break;
+      case SECCOMPLITE_POLICY_MERGE:
+        rc = seccomplite_policy_replay(entry.nested, entry.nested_len, &other);
+        if (rc == 0) {
+          rc = seccomp_merge(result, other);
+          if (rc != 0) {
+            seccomp_release(other);
+          }
+        }
+        break;
+    }
+  }
+
+  if (rc != 0) {
+    if (result) {
+      seccomp_release(result);
+    }
+    return rc < 0 && rc != -1 ? rc : -EINVAL;
+  }
+
+  *ctx = result;
+  return result ? 0 : -EINVAL;
+}
+
+int seccomplite_policy_map_datums(const uint8_t *data, size_t len, seccomplite_PolicyDatumMap map, void *arg, seccomplite_Policy *out) {
+  seccomplite_PolicyEntry entry;
+  size_t offset = 0;
+  size_t start = 0;
+  int rc = 0;
+
+  out->len = 0;
+  while ((rc = seccomplite_policy_next(data, len, &offset, &entry)) == 1) {
+    if (entry.op != SECCOMPLITE_POLICY_RULE && entry.op != SECCOMPLITE_POLICY_RULE_EXACT) {
+      // Everything else is copied as encoded
+      if (seccomplite_policy_put_bytes(out, data + start, offset - start) != 0) {
+        return -ENOMEM;
+      }
+      start = offset;
+      continue;
+    }
+
+    unsigned int index = 0;
+    for (index = 0; index < entry.argc; index++) {
+      struct scmp_arg_cmp cmp = entry.args[index];
+      entry.args[index].datum_a = map(&cmp, 0, arg);
+      entry.args[index].datum_b = map(&cmp, 1, arg);
+    }
+
+    if (seccomplite_policy_rule(out, entry.op == SECCOMPLITE_POLICY_RULE_EXACT, entry.action, entry.syscall, entry.argc, entry.args) != 0) {
+      return -ENOMEM;
+    }
+    start = offset;
+  }
+
+  return rc == 0 ? 0 : -EINVAL;
+}
+
+int seccomplite_policy_is_fanout(const uint8_t *data, size_t len) {
+  seccomplite_PolicyEntry entry;
+  size_t offset = 0;
+
+  // The marker directly follows the default action
+  return seccomplite_policy_next(data, len, &offset, &entry) == 1 && entry.op == SECCOMPLITE_POLICY_INIT &&
+    seccomplite_policy_next(data, len, &offset, &entry) == 1 && entry.op == SECCOMPLITE_POLICY_FANOUT;
+}
+
+int seccomplite_policy_arches(const uint8_t *data, size_t len, uint32_t *arches) {
+  seccomplite_PolicyEntry entry;
+  size_t offset = 0;
+  int count = 0;
+  int rc = 0;
+
+  while ((rc = seccomplite_policy_next(data, len, &offset, &entry)) == 1) {
+    uint32_t arch = entry.arch == SCMP_ARCH_NATIVE ? seccomp_arch_native() : entry.arch;
+    int index = 0;
+    switch (entry.op) {
+      case SECCOMPLITE_POLICY_INIT:
+        // A fresh context only holds the native architecture
+        arches[0] = seccomp_arch_native();
+        count = 1;
+        break;
+      case SECCOMPLITE_POLICY_ARCH_ADD:
+        for (index = 0; index < count && arches[index] != arch; index++);
+        if (index == count) {
+          if (count == SECCOMPLITE_POLICY_MAX_ARCHES) {
+            return -E2BIG;
+          }
+          arches[count++] = arch;
+        }
+        break;
+      case SECCOMPLITE_POLICY_ARCH_REMOVE:
+        for (index = 0; index < count && arches[index] != arch; index++);
+        if (index < count) {
+          memmove(&arches[index], &arches[index + 1], sizeof(uint32_t) * (count - index - 1));
+          count--;
+        }
+        break;
+      case SECCOMPLITE_POLICY_MERGE:
+        // Nested records bring architectures of their own
+        return -EINVAL;
+    }
+  }
+
+  return rc == 0 ? count : -EINVAL;
+}
+
+int seccomplite_policy_replay_arches(const uint8_t *data, size_t len, const uint32_t *arches, unsigned int num_arches, scmp_filter_ctx *ctx) {
+  seccomplite_PolicyEntry entry;
+  size_t offset = 0;
+  int rc = 0;
+
+  *ctx = NULL;
+  if (num_arches == 0 || seccomplite_policy_next(data, len, &offset, &entry) != 1 || entry.op != SECCOMPLITE_POLICY_INIT) {
+    return -EINVAL;
+  }
+
+  scmp_filter_ctx result = seccomp_init(entry.action);
+  if (!result) {
+    return -EINVAL;
+  }
+
+  // Set up the architectures first so every rule reaches all of them
+  uint32_t native = seccomp_arch_native();
+  int keep_native = 0;
+  unsigned int index = 0;
+  for (index = 0; rc == 0 && index < num_arches; index++) {
+    if (arches[index] == native || arches[index] == SCMP_ARCH_NATIVE) {
+      keep_native = 1;
+    }
+    else {
+      rc = seccomp_arch_add(result, arches[index]);
+    }
+  }
+  if (rc == 0 && !keep_native) {
+    rc = seccomp_arch_remove(result, native);
+  }
+
+  while (rc == 0 && (rc = seccomplite_policy_next(data, len, &offset, &entry)) == 1) {
+    rc = 0;
+    switch (entry.op) {
+      case SECCOMPLITE_POLICY_ATTR:
+        rc = seccomp_attr_set(result, entry.attr, entry.value);
+        break;
+      case SECCOMPLITE_POLICY_PRIORITY:
+        rc = seccomp_syscall_priority(result, entry.syscall, entry.priority);
+        break;
+      case SECCOMPLITE_POLICY_RULE:
+        rc = seccomp_rule_add_array(result, entry.action, entry.syscall, entry.argc, entry.args);
+        break;
+      case SECCOMPLITE_POLICY_RULE_EXACT:
+        rc = seccomp_rule_add_exact_array(result, entry.action, entry.syscall, entry.argc, entry.args);
+        break;
+      case SECCOMPLITE_POLICY_INIT:
+      case SECCOMPLITE_POLICY_MERGE:
+        rc = -EINVAL;
+        break;
+    }
+  }
+
+  if (rc != 0) {
+    seccomp_release(result);
+    return rc < 0 && rc != -1 ? rc : -EINVAL;
+  }
+
+  *ctx = result;
+  return 0;
+}
+
+/**
+ * Rule or priority of the canonical form, instances has a bit for every
+ * architecture instance the entry applies to
+ */
+typedef struct {
+  seccomplite_PolicyEntry entry;
+  uint64_t instances;
+} policy_canonical_entry;
+
+/**
+ * Walk state shared by nested records
+ */
+typedef struct {
+  policy_canonical_entry *entries;
+  unsigned int count;
+  unsigned int cap;
+  unsigned int instances;
+  uint64_t alive;
+  uint32_t tokens[64];
+  uint32_t attrs[32];
+  uint32_t values[32];
+  unsigned int num_attrs;
+} policy_canonical_state;
+
+/**
+ * Architectures of one record level
+ */
+typedef struct {
+  uint32_t tokens[SECCOMPLITE_POLICY_MAX_ARCHES];
+  unsigned int ids[SECCOMPLITE_POLICY_MAX_ARCHES];
+  unsigned int count;
+} policy_canonical_arches;
+
+static uint64_t policy_canonical_mask(const policy_canonical_arches *arches) {
+  uint64_t mask = 0;
+  unsigned int index = 0;
+  for (index = 0; index < arches->count; index++) {
+    mask |= 1ULL << arches->ids[index];
+  }
+  return mask;
+}
+
+static int policy_canonical_add_arch(policy_canonical_state *state, policy_canonical_arches *arches, uint32_t token) {
+  if (state->instances >= 64 || arches->count >= SECCOMPLITE_POLICY_MAX_ARCHES) {
+    return -E2BIG;
+  }
+
+  arches->tokens[arches->count] = token == SCMP_ARCH_NATIVE ? seccomp_arch_native() : token;
+  state->tokens[state->instances] = arches->tokens[arches->count];
+  arches->ids[arches->count++] = state->instances;
+  state->alive |= 1ULL << state->instances++;
+  return 0;
+}
+
+static int policy_canonical_walk(policy_canonical_state *state, const uint8_t *data, size_t len, policy_canonical_arches *arches, int nested) {
+  seccomplite_PolicyEntry entry;
+  size_t offset = 0;
+  unsigned int first = state->count;
+  unsigned int index = 0;
+  int rc = 0;
+
+  while ((rc = seccomplite_policy_next(data, len, &offset, &entry)) == 1) {
+    rc = 0;
+    switch (entry.op) {
+      case SECCOMPLITE_POLICY_INIT:
+        arches->count = 0;
+        rc = policy_canonical_add_arch(state, arches, SCMP_ARCH_NATIVE);
+        break;
+
+      case SECCOMPLITE_POLICY_ATTR:
+        // seccomp_merge() requires equal attributes, the outer ones count
+        if (nested) {
+          break;
+        }
+        for (index = 0; index < state->num_attrs && state->attrs[index] != entry.attr; index++);
+        if (index == state->num_attrs) {
+          if (index == 32) {
+            return -E2BIG;
+          }
+          state->attrs[state->num_attrs++] = entry.attr;
+        }
+        state->values[index] = entry.value;
+        break;
+
+      case SECCOMPLITE_POLICY_ARCH_ADD:
+        rc = policy_canonical_add_arch(state, arches, entry.arch);
+        break;
+
+      case SECCOMPLITE_POLICY_ARCH_REMOVE: {
+        uint32_t token = entry.arch == SCMP_ARCH_NATIVE ? seccomp_arch_native() : entry.arch;
+        for (index = 0; index < arches->count && arches->tokens[index] != token; index++);
+        if (index < arches->count) {
+          state->alive &= ~(1ULL << arches->ids[index]);
+          arches->tokens[index] = arches->tokens[arches->count - 1];
+          arches->ids[index] = arches->ids[arches->count - 1];
+          arches->count--;
+        }
+        break;
+      }
+
+      case SECCOMPLITE_POLICY_PRIORITY:
+      case SECCOMPLITE_POLICY_RULE:
+      case SECCOMPLITE_POLICY_RULE_EXACT:
+        if (state->count == state->cap) {
+          unsigned int cap = state->cap ? 2 * state->cap : 64;
+          policy_canonical_entry *entries = realloc(state->entries, cap * sizeof(policy_canonical_entry));
+          if (!entries) {
+            return -ENOMEM;
+          }
+          state->entries = entries;
+          state->cap = cap;
+        }
+
+        state->entries[state->count].entry = entry;
+        state->entries[state->count++].instances = policy_canonical_mask(arches);
+        break;
+
+      case SECCOMPLITE_POLICY_MERGE: {
+        policy_canonical_arches other = { .count = 0 };
+        rc = policy_canonical_walk(state, entry.nested, entry.nested_len, &other, 1);
+        for (index = 0; rc == 0 && index < other.count; index++) {
+          if (arches->count >= SECCOMPLITE_POLICY_MAX_ARCHES) {
+            rc = -E2BIG;
+            break;
+          }
+          arches->tokens[arches->count] = other.tokens[index];
+          arches->ids[arches->count++] = other.ids[index];
+        }
+        break;
+      }
+    }
+
+    if (rc != 0) {
+      return rc;
+    }
+  }
+
+  if (rc < 0) {
+    return -EINVAL;
+  }
+
+  // Fan-out rules end up on every architecture of the record
+  if (seccomplite_policy_is_fanout(data, len)) {
+    for (index = first; index < state->count; index++) {
+      state->entries[index].instances = policy_canonical_mask(arches);
+    }
+  }
+
+  // The last priority of a syscall wins
+  for (index = first; index < state->count; index++) {
+    if (state->entries[index].entry.op == SECCOMPLITE_POLICY_PRIORITY) {
+      unsigned int later = 0;
+      for (later = index + 1; later < state->count; later++) {
+        if (state->entries[later].entry.op == SECCOMPLITE_POLICY_PRIORITY && state->entries[later].entry.syscall == state->entries[index].entry.syscall) {
+          state->entries[index].instances &= ~state->entries[later].instances;
+        }
+      }
+    }
+  }
+
+  return 0;
+}
+
+static int policy_canonical_compare(const void *a, const void *b) {
+  const seccomplite_PolicyEntry *x = &((const policy_canonical_entry *) a)->entry;
+  const seccomplite_PolicyEntry *y = &((const policy_canonical_entry *) b)->entry;
+  if (x->op != y->op) {
+    return x->op < y->op ? -1 : 1;
+  }
+  else if (x->syscall != y->syscall) {
+    return x->syscall < y->syscall ? -1 : 1;
+  }
+  else if (x->op == SECCOMPLITE_POLICY_PRIORITY) {
+    return (int) x->priority - (int) y->priority;
+  }
+  else if (x->action != y->action) {
+    return x->action < y->action ? -1 : 1;
+  }
+  else if (x->argc != y->argc) {
+    return x->argc < y->argc ? -1 : 1;
+  }
+
+  unsigned int index = 0;
+  for (index = 0; index < x->argc; index++) {
+    const struct scmp_arg_cmp *p = &x->args[index];
+    const struct scmp_arg_cmp *q = &y->args[index];
+    if (p->arg != q->arg) {
+      return p->arg < q->arg ? -1 : 1;
+    }
+    else if (p->op != q->op) {
+      return p->op < q->op ? -1 : 1;
+    }
+    else if (p->datum_a != q->datum_a) {
+      return p->datum_a < q->datum_a ? -1 : 1;
+    }
+    else if (p->datum_b != q->datum_b) {
+      return p->datum_b < q->datum_b ? -1 : 1;
+    }
+  }
+
+  return 0;
+}
+
+static int policy_canonical_by_token(const void *a, const void *b) {
+  uint32_t x = ((const uint32_t *) a)[0];
+  uint32_t y = ((const uint32_t *) b)[0];
+  return x < y ? -1 : x > y;
+}
+
+int seccomplite_policy_canonical(const uint8_t *data, size_t len, seccomplite_Policy *out) {
+  policy_canonical_state state;
+  policy_canonical_arches arches = { .count = 0 };
+  seccomplite_PolicyEntry entry;
+  size_t offset = 0;
+
+  memset(&state, 0, sizeof(state));
+  out->len = 0;
+  int rc = seccomplite_policy_next(data, len, &offset, &entry) == 1 && entry.op == SECCOMPLITE_POLICY_INIT ? 0 : -EINVAL;
+  rc = rc ? rc : policy_canonical_walk(&state, data, len, &arches, 0);
+  if (rc == -E2BIG || rc == -EINVAL) {
+    // Too many architectures to track, only identical records match.  The
+    // leading zero is no operation code, it keeps both forms apart.
+    free(state.entries);
+    return seccomplite_policy_put_varint(out, 0) || seccomplite_policy_put_bytes(out, data, len) ? -ENOMEM : 0;
+  }
+  else if (rc != 0) {
+    free(state.entries);
+    return rc;
+  }
+
+  qsort(state.entries, state.count, sizeof(policy_canonical_entry), policy_canonical_compare);
+
+  // Live architectures in token order, each instance with its own entries
+  uint32_t live[64][2];
+  unsigned int num_live = 0;
+  unsigned int index = 0;
+  for (index = 0; index < state.instances; index++) {
+    if (state.alive & (1ULL << index)) {
+      live[num_live][0] = state.tokens[index];
+      live[num_live++][1] = index;
+    }
+  }
+  qsort(live, num_live, sizeof(live[0]), policy_canonical_by_token);
+
+  uint32_t attrs[32][2];
+  for (index = 0; index < state.num_attrs; index++) {
+    attrs[index][0] = state.attrs[index];
+    attrs[index][1] = state.values[index];
+  }
+  qsort(attrs, state.num_attrs, sizeof(attrs[0]), policy_canonical_by_token);
+
+  rc = seccomplite_policy_reset(out, entry.action);
+  for (index = 0; rc == 0 && index < state.num_attrs; index++) {
+    rc = seccomplite_policy_attr(out, attrs[index][0], attrs[index][1]);
+  }
+
+  unsigned int arch = 0;
+  for (arch = 0; rc == 0 && arch < num_live; arch++) {
+    uint64_t bit = 1ULL << live[arch][1];
+    const policy_canonical_entry *previous = NULL;
+    rc = seccomplite_policy_arch(out, SECCOMPLITE_POLICY_ARCH_ADD, live[arch][0]);
+    for (index = 0; rc == 0 && index < state.count; index++) {
+      const policy_canonical_entry *current = &state.entries[index];
+      if (!(current->instances & bit) || (previous && policy_canonical_compare(previous, current) == 0)) {
+        continue;
+      }
+
+      previous = current;
+      if (current->entry.op == SECCOMPLITE_POLICY_PRIORITY) {
+        rc = seccomplite_policy_priority(out, current->entry.syscall, current->entry.priority);
+      }
+      else {
+        rc = seccomplite_policy_rule(out, current->entry.op == SECCOMPLITE_POLICY_RULE_EXACT, current->entry.action, current->entry.syscall, current->entry.argc, current->entry.args);
+      }
+    }
+  }
+
+  free(state.entries);
+  return rc == 0 ? 0 : -ENOMEM;
+}
+
+uint64_t seccomplite_policy_digest(const uint8_t *data, size_t len) {
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  size_t index = 0;
+  for (index = 0; index < len; index++) {
+    hash ^= data[index];
+    hash *= 0x100000001b3ULL;
+  }
+
+  return hash;
+}
@@ -0,0 +1,206 @@
+/*
+ * Trace replay profiling in seccomplite library
+ * Author: Michael Witt <m.witt@htw-berlin.de>
+ *
+ * Every record runs through the compiled program for the instruction
+ * counters and through the rules of the policy record for the rule
+ * counters.  Rules hold native syscall numbers, libseccomp translates them
+ * by name for the other architectures, so records of a foreign
+ * architecture are translated back the same way.  The translations are
+ * cached since resolving a number walks the syscall tables.
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <seccomp.h>
+#include "inc/bpf.h"
+#include "inc/profile.h"
+
+#define PROFILE_CACHE_SIZE 1024
+#define PROFILE_X32_SYSCALL_BIT 0x40000000
+
+_Static_assert(sizeof(seccomplite_TraceRecord) == SECCOMPLITE_TRACE_RECORD_SIZE, "Trace record layout changed");
+
+/**
+ * Cached translation of a foreign syscall number
+ */
+typedef struct {
+  uint32_t arch;
+  int nr;
+  int native;
+  int used;
+} profile_slot;
+
+/**
+ * Rule order sorted by syscall, rules of one syscall stay in add order
+ */
+typedef struct {
+  int syscall;
+  unsigned int rule;
+} profile_index;
+
+static int profile_by_syscall(const void *a, const void *b) {
+  const profile_index *left = a;
+  const profile_index *right = b;
+  if (left->syscall != right->syscall) {
+    return left->syscall < right->syscall ? -1 : 1;
+  }
+  return left->rule < right->rule ? -1 : left->rule > right->rule;
+}
+
+/**
+ * Native number of a syscall of the given architecture
+ * @return The native number, __NR_SCMP_ERROR if there is none
+ */
+static int profile_native(profile_slot *cache, uint32_t arch, int nr) {
+  if (arch == seccomp_arch_native()) {
+    return nr;
+  }
+
+  unsigned int slot = ((arch * 31u) ^ (uint32_t) nr) % PROFILE_CACHE_SIZE;
+  unsigned int probe = 0;
+  for (probe = 0; probe < PROFILE_CACHE_SIZE && cache[slot].used; probe++) {
+    if (cache[slot].arch == arch && cache[slot].nr == nr) {
+      return cache[slot].native;
+    }
+    slot = (slot + 1) % PROFILE_CACHE_SIZE;
+  }
+
+  char *name = seccomp_syscall_resolve_num_arch(arch, nr);
+  int native = name ? seccomp_syscall_resolve_name(name) : __NR_SCMP_ERROR;
+  free(name);
+  if (probe < PROFILE_CACHE_SIZE) {
+    cache[slot].arch = arch;
+    cache[slot].nr = nr;
+    cache[slot].native = native;
+    cache[slot].used = 1;
+  }
+  return native;
+}
+
+/**
+ * Evaluate one comparison the way the generated code does, 32-bit
+ * architectures only see the low half of arguments and datums
+ */
+static int profile_compare(const struct scmp_arg_cmp *cmp, const __u64 *args, uint64_t width) {
+  if (cmp->arg >= 6) {
+    return 0;
+  }
+
+  uint64_t value = args[cmp->arg] & width;
+  uint64_t datum_a = cmp->datum_a & width;
+  uint64_t datum_b = cmp->datum_b & width;
+  switch (cmp->op) {
+    case SCMP_CMP_NE: return value != datum_a;
+    case SCMP_CMP_LT: return value < datum_a;
+    case SCMP_CMP_LE: return value <= datum_a;
+    case SCMP_CMP_EQ: return value == datum_a;
+    case SCMP_CMP_GE: return value >= datum_a;
+    case SCMP_CMP_GT: return value > datum_a;
+    case SCMP_CMP_MASKED_EQ: return (value & datum_a) == datum_b;
+    default: return 0;
+  }
+}
+
+int seccomplite_profile_run(const struct sock_filter *insns, unsigned int len, const seccomplite_SimplifyRule *rules, unsigned int num_rules, const uint32_t *tokens, const uint8_t *records, size_t count, seccomplite_Profile *profile) {
+  profile_slot *cache = calloc(PROFILE_CACHE_SIZE, sizeof(profile_slot));
+  profile_index *order = malloc((num_rules ? num_rules : 1) * sizeof(profile_index));
+  if (!cache || !order) {
+    free(cache);
+    free(order);
+    return -ENOMEM;
+  }
+
+  unsigned int index = 0;
+  for (index = 0; index < num_rules; index++) {
+    order[index].syscall = rules[index].syscall;
+    order[index].rule = index;
+  }
+  qsort(order, num_rules, sizeof(profile_index), profile_by_syscall);
+
+  size_t position = 0;
+  for (position = 0; position < count; position++) {
+    seccomplite_TraceRecord record;
+    memcpy(&record, records + position * sizeof(record), sizeof(record));
+    if (record.flags & SECCOMPLITE_TRACE_META) {
+      continue;
+    }
+    profile->records++;
+
+    uint32_t action = 0;
+    if (seccomplite_bpf_profile(insns, len, &record.data, &action, NULL, profile->hits) != 0) {
+      profile->undecided++;
+      continue;
+    }
+
+    // x32 shares AUDIT_ARCH_X86_64 and sets a bit in the syscall number
+    uint32_t arch = record.data.arch;
+    if (arch == SCMP_ARCH_X86_64 && (record.data.nr & PROFILE_X32_SYSCALL_BIT)) {
+      arch = SCMP_ARCH_X32;
+    }
+
+    uint64_t instances = 0;
+    for (index = 0; index < SECCOMPLITE_SIMPLIFY_MAX_INSTANCES; index++) {
+      if (tokens[index] == arch) {
+        instances |= 1ULL << index;
+      }
+    }
+
+    int native = instances ? profile_native(cache, arch, record.data.nr) : __NR_SCMP_ERROR;
+    uint64_t width = arch & __AUDIT_ARCH_64BIT ? UINT64_MAX : UINT32_MAX;
+
+    // Binary search for the first rule of the syscall
+    unsigned int low = 0;
+    unsigned int high = native == __NR_SCMP_ERROR ? 0 : num_rules;
+    while (low < high) {
+      unsigned int middle = low + (high - low) / 2;
+      if (order[middle].syscall < native) {
+        low = middle + 1;
+      }
+      else {
+        high = middle;
+      }
+    }
+
+    unsigned int decided = num_rules;
+    unsigned int conditional = num_rules;
+    for (index = low; native != __NR_SCMP_ERROR && index < num_rules && order[index].syscall == native; index++) {
+      const seccomplite_SimplifyRule *rule = &rules[order[index].rule];
+      if (!(rule->instances & instances)) {
+        continue;
+      }
+
+      profile->reached[order[index].rule]++;
+      unsigned int arg = 0;
+      for (arg = 0; arg < rule->argc && profile_compare(&rule->args[arg], record.data.args, width); arg++);
+      if (arg < rule->argc) {
+        continue;
+      }
+
+      profile->matched[order[index].rule]++;
+      if (rule->action == action) {
+        if (rule->argc == 0 && decided == num_rules) {
+          decided = order[index].rule;
+        }
+        else if (rule->argc > 0 && conditional == num_rules) {
+          conditional = order[index].rule;
+        }
+      }
+    }
+
+    if (decided == num_rules) {
+      decided = conditional;
+    }
+    if (decided < num_rules) {
+      profile->decided[decided]++;
+    }
+    else {
+      profile->undecided++;
+    }
+  }
+
+  free(cache);
+  free(order);
+  return 0;
+}
@@ -0,0 +1,687 @@
+/*
+ * Program submodule in seccomplite library
+ * Author: Michael Witt <m.witt@htw-berlin.de>
+ */
+
+#include <Python.h>
+#include <seccomp.h>
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/prctl.h>
+#include <sys/syscall.h>
+#include <linux/seccomp.h>
+#include "inc/config.h"
+#include "inc/program.h"
+#include "inc/seccomplite.h"
+#include "inc/arch.h"
+#include "inc/bpf.h"
+#include "inc/stats.h"
+
+#ifndef SECCOMP_FILTER_FLAG_TSYNC_ESRCH
+#define SECCOMP_FILTER_FLAG_TSYNC_ESRCH (1UL << 4)
+#endif
+
+static PyObject * Program_map(PyTypeObject *type, int fd, uint32_t flags, int nnp);
+
+/**
+ * Program type member and methods definitions
+ */
+static PyMemberDef Program_members[] = {
+  {"flags", T_UINT, offsetof(seccomplite_ProgramObject, _flags), READONLY, "SECCOMP_FILTER_FLAG_* used on load"},
+  {"nnp", T_BOOL, offsetof(seccomplite_ProgramObject, _nnp), READONLY, "Set no_new_privs before loading"},
+  {"__weaklistoffset__", T_PYSSIZET, offsetof(seccomplite_ProgramObject, _weakreflist), READONLY},
+  { NULL } /* Sentinel */
+};
+
+static PyMethodDef Program_methods[] = {
+  { "load", (PyCFunction)Program_load, METH_NOARGS, "Load the program into the Linux Kernel \nDescription:\n Install the compiled program as a new seccomp filter of the calling thread No libseccomp code is involved Programs with NOTIFY actions return the descriptor of their listener otherwise None" },
+  { "export_bpf", (PyCFunction)Program_export_bpf, METH_FASTCALL | METH_KEYWORDS, "Export the program in BPF format \nArguments:\n file the output file \nDescription:\n Output the program in Berkley Packet Filter BPF to the given file" },
+  { "tobytes", (PyCFunction)Program_tobytes, METH_NOARGS, "Return the raw struct sock_filter array as bytes" },
+  { "evaluate", (PyCFunction)Program_evaluate, METH_FASTCALL | METH_KEYWORDS, "Evaluate the program for a syscall \nArguments:\n syscall the syscall name or number arch the architecture default native args up to six argument values instruction_pointer the instruction pointer \nDescription:\n Run the program the way the kernel does and return a tuple of the resulting action and the number of executed instructions" },
+  { "optimize", (PyCFunction)Program_optimize, METH_FASTCALL | METH_KEYWORDS, "Return a peephole optimised copy of the program \nArguments:\n verify compare both programs on generated inputs default True report also return a dict with statistics share_blocks keep identical instruction tails such as argument checks repeated for several syscalls only once \nDescription:\n Thread jumps remove redundant loads merge identical returns and drop dead code If verification finds a difference the program is returned unchanged" },
+  { "to_memfd", (PyCFunction)Program_to_memfd, METH_FASTCALL | METH_KEYWORDS, "Store the program in a sealed memfd \nArguments:\n inheritable do not set close-on-exec on the descriptor \nDescription:\n Write the BPF program into a new memfd and seal it against any further modification The descriptor can be inherited by child processes or passed with SCM_RIGHTS see from_fd" },
+  { "from_fd", (PyCFunction)Program_from_fd, METH_FASTCALL | METH_KEYWORDS | METH_CLASS, "Map a program from a file descriptor \nArguments:\n fd descriptor holding a BPF program e.g from to_memfd nnp set no_new_privs before loading tsync synchronize all threads on load \nDescription:\n Sealed memfds are mapped read-only and used in place anything else is copied since it could change after the call" },
+  { NULL } /* Sentinel */
+};
+
+/**
+ * Program type slots definitions
+ */
+static PyType_Slot seccomplite_ProgramTypeSlots[] = {
+  { Py_tp_methods, Program_methods },
+  { Py_tp_members, Program_members },
+  { Py_tp_init, Program_init },
+  { Py_tp_new, Program_new },
+  { Py_tp_dealloc, Program_dealloc },
+  { Py_sq_length, Program_length },
+  { Py_sq_item, Program_item },
+  { 0, NULL }
+};
+
+/**
+ * Program type specs
+ */
+PyType_Spec seccomplite_ProgramTypeSpec = {
+  MODULE_NAME "." PROGRAM_TYPE_NAME,
+  sizeof (seccomplite_ProgramObject),
+  0,
+  Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE,
+  seccomplite_ProgramTypeSlots
+};
+
+/// Program type methods
+
+int seccomplite_write_all(int fd, const char *data, size_t remaining) {
+  while (remaining > 0) {
+    ssize_t written = write(fd, data, remaining);
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return -1;
+    }
+
+    data += written;
+    remaining -= written;
+  }
+
+  return 0;
+}
+
+void Program_dealloc(seccomplite_ProgramObject *self) {
+  if (self->_weakreflist) {
+    PyObject_ClearWeakRefs((PyObject *) self);
+  }
+
+  if (self->_map) {
+    munmap(self->_map, self->_map_len);
+  }
+  else {
+    PyMem_Free(self->_insns);
+  }
+  Py_TYPE(self)->tp_free((PyObject*) self);
+}
+
+PyObject * Program_new(PyTypeObject *type, PyObject *args, PyObject *kwds) {
+  seccomplite_ProgramObject *self;
+
+  self = (seccomplite_ProgramObject *) type->tp_alloc(type, 0);
+  if (self != NULL) {
+    self->_insns = NULL;
+    self->_len = 0;
+    self->_flags = 0;
+    self->_nnp = 1;
+  }
+
+  return (PyObject *) self;
+}
+
+/**
+ * Constructor parameters
+ */
+static char *Program_kwlist[] = {"data", "nnp", "tsync", NULL};
+
+/**
+ * Copy the instructions into the program, releases the buffer
+ * @param self Type self reference
+ * @param data Buffer holding struct sock_filter instructions
+ * @param nnp Set no_new_privs before loading
+ * @param tsync Synchronize all threads on load
+ * @return 0 on success, -1 with exception set
+ */
+static int Program_setup(seccomplite_ProgramObject *self, Py_buffer *data, int nnp, int tsync) {
+  if (data->len == 0 || data->len % sizeof(struct sock_filter) != 0) {
+    PyBuffer_Release(data);
+    PyErr_SetString(PyExc_ValueError, "Program data must be a non-empty array of struct sock_filter");
+    return -1;
+  }
+
+  struct sock_filter *insns = PyMem_Malloc(data->len);
+  if (!insns) {
+    PyBuffer_Release(data);
+    PyErr_NoMemory();
+    return -1;
+  }
+  memcpy(insns, data->buf, data->len);
+
+  if (self->_map) {
+    munmap(self->_map, self->_map_len);
+    self->_map = NULL;
+    self->_map_len = 0;
+  }
+  else {
+    PyMem_Free(self->_insns);
+  }
+  self->_insns = insns;
+  self->_len = data->len / sizeof(struct sock_filter);
+  self->_nnp = nnp;
+  self->_flags = tsync ? SECCOMP_FILTER_FLAG_TSYNC : 0;
+  PyBuffer_Release(data);
+
+  return 0;
+}
+
+int Program_init(seccomplite_ProgramObject *self, PyObject *args, PyObject *kwds) {
+  Py_buffer data;
+  int nnp = 1;
+  int tsync = 0;
+  if (!PyArg_ParseTupleAndKeywords(args, kwds, "y*|pp", Program_kwlist, &data, &nnp, &tsync)) {
+    return -1;
+  }
+
+  return Program_setup(self, &data, nnp, tsync);
+}
+
+PyObject * Program_vectorcall(PyObject *type, PyObject *const *args, size_t nargsf, PyObject *kwnames) {
+  Py_buffer data;
+  int nnp = 1;
+  int tsync = 0;
+  if (!seccomplite_parse_vector(args, PyVectorcall_NARGS(nargsf), kwnames, "y*|pp:" PROGRAM_TYPE_NAME, Program_kwlist, &data, &nnp, &tsync)) {
+    return NULL;
+  }
+
+  PyObject *self = Program_new((PyTypeObject *) type, NULL, NULL);
+  if (!self) {
+    PyBuffer_Release(&data);
+    return NULL;
+  }
+  if (Program_setup((seccomplite_ProgramObject *) self, &data, nnp, tsync) != 0) {
+    Py_CLEAR(self);
+  }
+  return self;
+}
+
+Py_ssize_t Program_length(seccomplite_ProgramObject *self) {
+  return self->_len;
+}
+
+PyObject * Program_item(seccomplite_ProgramObject *self, Py_ssize_t index) {
+  if (index < 0 || index >= self->_len) {
+    PyErr_SetString(PyExc_IndexError, "Program index out of range");
+    return NULL;
+  }
+
+  struct sock_filter *insn = &self->_insns[index];
+  return Py_BuildValue("(HBBI)", insn->code, insn->jt, insn->jf, insn->k);
+}
+
+PyObject * Program_load(seccomplite_ProgramObject *self) {
+  int listener = -1;
+  uint64_t started = seccomplite_stats_begin(SECCOMPLITE_STATS_LOAD);
+  int rc = seccomplite_program_install(self->_insns, self->_len, self->_flags, self->_nnp, &listener);
+  seccomplite_stats_end(SECCOMPLITE_STATS_LOAD, started, rc);
+  if (rc != 0) {
+    PyErr_SetFromErrno(PyExc_OSError);
+    return NULL;
+  }
+
+  if (listener >= 0) {
+    return PyLong_FromLong(listener);
+  }
+  Py_RETURN_NONE;
+}
+
+PyObject * Program_export_bpf(seccomplite_ProgramObject *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames) {
+  PyObject *file;
+  static char *kwlist[] = {"file", NULL};
+  if (!seccomplite_parse_vector(args, nargs, kwnames, "O:export_bpf", kwlist, &file)) {
+    return NULL;
+  }
+
+  int fd = PyObject_AsFileDescriptor(file);
+  if (fd < 0) {
+    PyErr_SetString(PyExc_AttributeError, "Given file descriptor appears to be invalid");
+    return NULL;
+  }
+
+  if (seccomplite_write_all(fd, (const char *) self->_insns, self->_len * sizeof(struct sock_filter)) != 0) {
+    return PyErr_SetFromErrno(PyExc_OSError);
+  }
+
+  Py_RETURN_NONE;
+}
+
+PyObject * Program_tobytes(seccomplite_ProgramObject *self) {
+  return PyBytes_FromStringAndSize((const char *) self->_insns, self->_len * sizeof(struct sock_filter));
+}
+
+PyObject * Program_evaluate(seccomplite_ProgramObject *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames) {
+  PyObject *syscall = NULL;
+  PyObject *arch = NULL;
+  PyObject *values = NULL;
+  unsigned long long ip = 0;
+  static char *kwlist[] = {"syscall", "arch", "args", "instruction_pointer", NULL};
+  if (!seccomplite_parse_vector(args, nargs, kwnames, "O|OOK:evaluate", kwlist, &syscall, &arch, &values, &ip)) {
+    return NULL;
+  }
+
+  uint32_t arch_token = PyObject_AsArchToken(arch);
+  if (arch_token == UINT32_MAX) {
+    PyErr_SetString(PyExc_AttributeError, "Given architecture is invalid.");
+    return NULL;
+  }
+  else if (arch_token == SCMP_ARCH_NATIVE) {
+    arch_token = seccomp_arch_native();
+  }
+
+  struct seccomp_data data;
+  memset(&data, 0, sizeof(data));
+  data.arch = seccomplite_arch_kernel_token(arch_token);
+  data.instruction_pointer = ip;
+  if (PyUnicode_Check(syscall)) {
+    data.nr = seccomp_syscall_resolve_name_arch(arch_token, PyUnicode_AsUTF8(syscall));
+    if (data.nr == __NR_SCMP_ERROR) {
+      PyErr_SetString(PyExc_ValueError, "Unknown syscall");
+      return NULL;
+    }
+  }
+  else if (!PyArg_Parse(syscall, "i", &data.nr)) {
+    return NULL;
+  }
+
+  if (values && values != Py_None) {
+    PyObject *sequence = PySequence_Fast(values, "args must be a sequence");
+    if (!sequence) {
+      return NULL;
+    }
+
+    Py_ssize_t count = PySequence_Fast_GET_SIZE(sequence);
+    Py_ssize_t index = 0;
+    if (count > 6) {
+      Py_DECREF(sequence);
+      PyErr_SetString(PyExc_ValueError, "A syscall has at most six arguments");
+      return NULL;
+    }
+    for (index = 0; index < count; index++) {
+      data.args[index] = PyLong_AsUnsignedLongLongMask(PySequence_Fast_GET_ITEM(sequence, index));
+    }
+    Py_DECREF(sequence);
+    if (PyErr_Occurred()) {
+      return NULL;
+    }
+  }
+
+  uint32_t action = 0;
+  unsigned int executed = 0;
+  if (seccomplite_bpf_run(self->_insns, self->_len, &data, &action, &executed) != 0) {
+    PyErr_SetString(PyExc_ValueError, "Program is malformed");
+    return NULL;
+  }
+
+  return Py_BuildValue("(kI)", (unsigned long) action, executed);
+}
+
+PyObject * Program_optimized(seccomplite_ProgramObject *program, int flags, seccomplite_BpfReport *report) {
+  // The instructions may live in a shared mapping, work on a private copy
+  struct sock_filter *insns = malloc(program->_len * sizeof(struct sock_filter));
+  if (!insns) {
+    return PyErr_NoMemory();
+  }
+  memcpy(insns, program->_insns, program->_len * sizeof(struct sock_filter));
+
+  struct sock_filter *optimized = NULL;
+  unsigned int len = 0;
+  int rc = 0;
+  Py_BEGIN_ALLOW_THREADS
+  rc = seccomplite_bpf_optimize(insns, program->_len, flags, &optimized, &len, report);
+  Py_END_ALLOW_THREADS
+  free(insns);
+  if (rc == -ENOMEM) {
+    return PyErr_NoMemory();
+  }
+  else if (rc != 0) {
+    PyErr_SetString(PyExc_ValueError, "Program is malformed");
+    return NULL;
+  }
+
+  PyObject *result = Program_create(optimized, len, program->_flags, program->_nnp);
+  free(optimized);
+  return result;
+}
+
+PyObject * Program_optimize(seccomplite_ProgramObject *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames) {
+  int verify = 1;
+  int report = 0;
+  int share_blocks = 0;
+  static char *kwlist[] = {"verify", "report", "share_blocks", NULL};
+  if (!seccomplite_parse_vector(args, nargs, kwnames, "|ppp:optimize", kwlist, &verify, &report, &share_blocks)) {
+    return NULL;
+  }
+
+  seccomplite_BpfReport stats;
+  int flags = (verify ? SECCOMPLITE_BPF_VERIFY : 0) | (share_blocks ? SECCOMPLITE_BPF_SHARE_BLOCKS : 0);
+  PyObject *program = Program_optimized(self, flags, &stats);
+  if (!program || !report) {
+    return program;
+  }
+
+  return Py_BuildValue("(N{sIsIsIsIsIsIsIsksksksi})", program,
+                       "before", stats.before, "after", stats.after,
+                       "threaded", stats.threaded, "loads", stats.loads,
+                       "returns", stats.returns, "dead", stats.dead,
+                       "shared", stats.shared,
+                       "witnesses", stats.witnesses,
+                       "executed_before", stats.executed_before,
+                       "executed_after", stats.executed_after,
+                       "verified", stats.verified);
+}
+
+PyObject * Program_to_memfd(seccomplite_ProgramObject *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames) {
+  int inheritable = 0;
+  static char *kwlist[] = {"inheritable", NULL};
+  if (!seccomplite_parse_vector(args, nargs, kwnames, "|p:to_memfd", kwlist, &inheritable)) {
+    return NULL;
+  }
+
+  int fd = memfd_create("seccomplite-program", MFD_ALLOW_SEALING | (inheritable ? 0 : MFD_CLOEXEC));
+  if (fd < 0) {
+    return PyErr_SetFromErrno(PyExc_OSError);
+  }
+
+  if (seccomplite_write_all(fd, (const char *) self->_insns, self->_len * sizeof(struct sock_filter)) != 0 ||
+      fcntl(fd, F_ADD_SEALS, F_SEAL_WRITE | F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) != 0) {
+    PyErr_SetFromErrno(PyExc_OSError);
+    close(fd);
+    return NULL;
+  }
+
+  return PyLong_FromLong(fd);
+}
+
+PyObject * Program_from_fd(PyTypeObject *type, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames) {
+  static char *kwlist[] = {"fd", "nnp", "tsync", NULL};
+
+  PyObject *file = NULL;
+  int nnp = 1;
+  int tsync = 0;
+  if (!seccomplite_parse_vector(args, nargs, kwnames, "O|pp:from_fd", kwlist, &file, &nnp, &tsync)) {
+    return NULL;
+  }
+
+  int fd = PyObject_AsFileDescriptor(file);
+  if (fd < 0) {
+    return NULL;
+  }
+
+  return Program_map(type, fd, tsync ? SECCOMP_FILTER_FLAG_TSYNC : 0, nnp);
+}
+
+PyObject * Program_from_memfd(int fd, uint32_t flags, int nnp) {
+  PyObject *seccomplite = PyState_FindModule(&SeccompLiteModule);
+  PyTypeObject *type = (PyTypeObject *) PyDict_GetItemString(PyModule_GetDict(seccomplite), PROGRAM_TYPE_NAME);
+  return Program_map(type, fd, flags, nnp);
+}
+
+static PyObject * Program_map(PyTypeObject *type, int fd, uint32_t flags, int nnp) {
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    return PyErr_SetFromErrno(PyExc_OSError);
+  }
+
+  if (st.st_size == 0 || st.st_size % sizeof(struct sock_filter) != 0) {
+    PyErr_SetString(PyExc_ValueError, "File does not contain an array of struct sock_filter");
+    return NULL;
+  }
+
+  seccomplite_ProgramObject *self = (seccomplite_ProgramObject *) Program_new(type, NULL, NULL);
+  if (!self) {
+    return NULL;
+  }
+  self->_len = st.st_size / sizeof(struct sock_filter);
+  self->_nnp = nnp;
+  self->_flags = flags;
+
+  // Only content that can not change anymore is used in place
+  int seals = fcntl(fd, F_GET_SEALS);
+  int sealed = seals >= 0 && (seals & (F_SEAL_WRITE | F_SEAL_SHRINK)) == (F_SEAL_WRITE | F_SEAL_SHRINK);
+  if (sealed) {
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+      Py_DECREF(self);
+      return PyErr_SetFromErrno(PyExc_OSError);
+    }
+
+    self->_map = map;
+    self->_map_len = st.st_size;
+    self->_insns = (struct sock_filter *) map;
+    return (PyObject *) self;
+  }
+
+  self->_insns = PyMem_Malloc(st.st_size);
+  if (!self->_insns) {
+    Py_DECREF(self);
+    return PyErr_NoMemory();
+  }
+
+  off_t offset = 0;
+  while (offset < st.st_size) {
+    ssize_t got = pread(fd, (char *) self->_insns + offset, st.st_size - offset, offset);
+    if (got < 0 && errno == EINTR) {
+      continue;
+    }
+    else if (got <= 0) {
+      Py_DECREF(self);
+      if (got == 0) {
+        PyErr_SetString(PyExc_ValueError, "File was truncated while reading");
+        return NULL;
+      }
+      return PyErr_SetFromErrno(PyExc_OSError);
+    }
+    offset += got;
+  }
+
+  return (PyObject *) self;
+}
+
+PyTypeObject * Program_build(void) {
+  // Ready the type
+  PyObject *type = PyType_FromSpec(&seccomplite_ProgramTypeSpec);
+  PyTypeObject *result = (PyTypeObject *) type;
+
+  if (!type || PyType_Ready(result) < 0) {
+    Py_XDECREF(type);
+    return NULL;
+  }
+
+#if PY_VERSION_HEX >= 0x03090000
+  // Calling the type skips the argument tuple of tp_new and tp_init
+  result->tp_vectorcall = (vectorcallfunc) Program_vectorcall;
+#endif
+  return result;
+}
+
+PyObject * Program_create(const struct sock_filter *insns, unsigned int len, uint32_t flags, int nnp) {
+  PyObject *seccomplite = PyState_FindModule(&SeccompLiteModule);
+  PyTypeObject *type = (PyTypeObject *) PyDict_GetItemString(PyModule_GetDict(seccomplite), PROGRAM_TYPE_NAME);
+
+  seccomplite_ProgramObject *self = (seccomplite_ProgramObject *) Program_new(type, NULL, NULL);
+  if (!self) {
+    return NULL;
+  }
+
+  self->_insns = PyMem_Malloc(len * sizeof(struct sock_filter));
+  if (!self->_insns) {
+    Py_DECREF(self);
+    return PyErr_NoMemory();
+  }
+
+  memcpy(self->_insns, insns, len * sizeof(struct sock_filter));
+  self->_len = len;
+  self->_flags = flags;
+  self->_nnp = nnp;
+  return (PyObject *) self;
+}
+
+int seccomplite_ctx_export(scmp_filter_ctx ctx, struct sock_filter **insns, unsigned int *len) {
+  // libseccomp can only export into a file descriptor, use an anonymous one
+  int fd = memfd_create("seccomplite-bpf", MFD_CLOEXEC);
+  if (fd < 0) {
+    return -errno;
+  }
+
+  uint64_t started = seccomplite_stats_begin(SECCOMPLITE_STATS_EXPORT_BPF);
+  int rc = seccomp_export_bpf(ctx, fd);
+  seccomplite_stats_end(SECCOMPLITE_STATS_EXPORT_BPF, started, rc);
+  if (rc != 0) {
+    close(fd);
+    return rc < 0 ? rc : -EINVAL;
+  }
+
+  off_t size = lseek(fd, 0, SEEK_END);
+  if (size <= 0 || size % sizeof(struct sock_filter) != 0) {
+    close(fd);
+    return -ENOEXEC;
+  }
+
+  struct sock_filter *result = malloc(size);
+  if (!result) {
+    close(fd);
+    return -ENOMEM;
+  }
+
+  off_t offset = 0;
+  while (offset < size) {
+    ssize_t got = pread(fd, (char *) result + offset, size - offset, offset);
+    if (got <= 0) {
+      if (got < 0 && errno == EINTR) {
+        continue;
+      }
+      rc = got < 0 ? -errno : -EIO;
+      free(result);
+      close(fd);
+      return rc;
+    }
+    offset += got;
+  }
+
+  close(fd);
+  *insns = result;
+  *len = size / sizeof(struct sock_filter);
+  return 0;
+}
+
+int seccomplite_ctx_compile(scmp_filter_ctx ctx, struct sock_filter **insns, unsigned int *len) {
+  int rc = seccomplite_ctx_export(ctx, insns, len);
+  if (rc == -ENOMEM) {
+    PyErr_NoMemory();
+  }
+  else if (rc == -ENOEXEC) {
+    PyErr_SetString(PyExc_RuntimeError, "Library error (invalid BPF program)");
+  }
+  else if (rc != 0) {
+    PyErr_SetString(PyExc_RuntimeError, "Library error (errno != 0)");
+  }
+
+  return rc == 0 ? 0 : -1;
+}
+
+void seccomplite_ctx_load_flags(scmp_filter_ctx ctx, uint32_t *flags, int *nnp) {
+  uint32_t value = 0;
+
+  *nnp = 1;
+  if (seccomp_attr_get(ctx, SCMP_FLTATR_CTL_NNP, &value) == 0) {
+    *nnp = value != 0;
+  }
+
+  *flags = 0;
+  value = 0;
+  if (seccomp_attr_get(ctx, SCMP_FLTATR_CTL_TSYNC, &value) == 0 && value) {
+    *flags |= SECCOMP_FILTER_FLAG_TSYNC;
+  }
+#if SCMP_VER_MAJOR > 2 || (SCMP_VER_MAJOR == 2 && SCMP_VER_MINOR >= 4)
+  value = 0;
+  if (seccomp_attr_get(ctx, SCMP_FLTATR_CTL_LOG, &value) == 0 && value) {
+    *flags |= SECCOMP_FILTER_FLAG_LOG;
+  }
+#endif
+#if (SCMP_VER_MAJOR > 2 || (SCMP_VER_MAJOR == 2 && SCMP_VER_MINOR >= 5)) && defined(SECCOMP_FILTER_FLAG_SPEC_ALLOW)
+  value = 0;
+  if (seccomp_attr_get(ctx, SCMP_FLTATR_CTL_SSB, &value) == 0 && value) {
+    *flags |= SECCOMP_FILTER_FLAG_SPEC_ALLOW;
+  }
+#endif
+}
+
+PyObject * Program_from_ctx(scmp_filter_ctx ctx) {
+  struct sock_filter *insns = NULL;
+  unsigned int len = 0;
+  if (seccomplite_ctx_compile(ctx, &insns, &len) != 0) {
+    return NULL;
+  }
+
+  uint32_t flags = 0;
+  int nnp = 1;
+  seccomplite_ctx_load_flags(ctx, &flags, &nnp);
+
+  PyObject *result = Program_create(insns, len, flags, nnp);
+  free(insns);
+  return result;
+}
+
+int seccomplite_program_notifies(const struct sock_filter *insns, unsigned int len) {
+  unsigned int pc = 0;
+  for (pc = 0; pc < len; pc++) {
+    if (insns[pc].code == (BPF_RET | BPF_K) && (insns[pc].k & SECCOMP_RET_ACTION_FULL) == SECCOMP_RET_USER_NOTIF) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+int seccomplite_program_install(const struct sock_filter *insns, unsigned int len, uint32_t flags, int nnp, int *listener) {
+  struct sock_fprog prog = {
+    .len = (unsigned short) len,
+    .filter = (struct sock_filter *) insns
+  };
+
+  if (len == 0 || len > BPF_MAXINSNS) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  if (nnp && prctl(PR_SET_NO_NEW_PRIVS, 1, 0, 0, 0) != 0) {
+    return -1;
+  }
+
+  if (listener) {
+    *listener = -1;
+    if (seccomplite_program_notifies(insns, len)) {
+      flags |= SECCOMP_FILTER_FLAG_NEW_LISTENER;
+    }
+  }
+
+  // The return value can not be both the listener and the thread id,
+  // the kernel only accepts the pair when TSYNC fails with ESRCH
+  if ((flags & SECCOMP_FILTER_FLAG_TSYNC) && (flags & SECCOMP_FILTER_FLAG_NEW_LISTENER)) {
+    flags |= SECCOMP_FILTER_FLAG_TSYNC_ESRCH;
+  }
+
+  // Prefer seccomp(2), it is the only way to pass filter flags
+  int rc = syscall(__NR_seccomp, SECCOMP_SET_MODE_FILTER, flags, &prog);
+  if (rc != 0 && errno == ENOSYS && flags == 0) {
+    rc = prctl(PR_SET_SECCOMP, SECCOMP_MODE_FILTER, &prog);
+  }
+
+  if (rc >= 0 && (flags & SECCOMP_FILTER_FLAG_NEW_LISTENER)) {
+    // The new listener is returned instead of 0
+    *listener = rc;
+    return 0;
+  }
+  else if (rc > 0) {
+    // TSYNC reports the thread that could not be synchronized
+    errno = ESRCH;
+    return -1;
+  }
+
+  return rc;
+}
+
+int PyObject_IsProgram(PyObject *o) {
+  PyObject *seccomplite = PyState_FindModule(&SeccompLiteModule);
+  PyObject *type = PyDict_GetItemString(PyModule_GetDict(seccomplite), PROGRAM_TYPE_NAME);
+  return PyObject_IsInstance(o, type) == 1;
+}
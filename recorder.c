@@ -0,0 +1,605 @@
+/*
+ * Trace recorder in seccomplite library
+ * Author: Michael Witt <m.witt@htw-berlin.de>
+ *
+ * Recording runs in a helper process forked off the caller.  The helper
+ * starts the command with the filter loaded and collects the syscalls
+ * either from a notify listener or as ptrace seccomp stops.  A tracer has
+ * to wait for any child to see the tracees, in the caller that would reap
+ * children it does not own.  The helper does not allocate, everything it
+ * needs is set up before the fork.
+ */
+
+#include <Python.h>
+#include <errno.h>
+#include <poll.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/ptrace.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <seccomp.h>
+#include <linux/seccomp.h>
+#include "inc/config.h"
+#include "inc/filter.h"
+#include "inc/program.h"
+#include "inc/recorder.h"
+#include "inc/seccomplite.h"
+
+#define RECORDER_MAX_INTERVAL 65536
+
+/**
+ * State shared by the caller, the helper and the command
+ */
+typedef struct {
+  int error;
+  int listener;
+  int status;
+  int exited;
+  uint64_t records;
+  uint64_t blocks;
+} recorder_shared;
+
+/**
+ * Block buffer of a segment, one slot more for the index record
+ */
+typedef struct {
+  int fd;
+  unsigned int interval;
+  seccomplite_TraceRecord *block;
+  unsigned int count;
+  uint64_t records;
+  uint64_t slots;
+  uint64_t blocks;
+} recorder_writer;
+
+static uint64_t recorder_now(clockid_t clock) {
+  struct timespec now;
+  clock_gettime(clock, &now);
+  return (uint64_t) now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+/**
+ * Check whether a BPF program can return SECCOMP_RET_TRACE
+ */
+static int recorder_traces(const struct sock_filter *insns, unsigned int len) {
+  unsigned int pc = 0;
+  for (pc = 0; pc < len; pc++) {
+    if (insns[pc].code == (BPF_RET | BPF_K) && (insns[pc].k & SECCOMP_RET_ACTION_FULL) == SECCOMP_RET_TRACE) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/// Writer
+
+static void recorder_meta(seccomplite_TraceRecord *record, uint32_t arch, uint32_t flags) {
+  memset(record, 0, sizeof(*record));
+  record->data.nr = -1;
+  record->data.arch = arch;
+  record->data.instruction_pointer = SECCOMPLITE_TRACE_MAGIC;
+  record->flags = flags;
+}
+
+static int recorder_header(recorder_writer *writer, pid_t pid) {
+  seccomplite_TraceRecord header;
+  recorder_meta(&header, seccomp_arch_native(), SECCOMPLITE_TRACE_HEADER);
+  header.data.args[0] = SECCOMPLITE_TRACE_VERSION;
+  header.data.args[1] = writer->interval;
+  header.data.args[2] = recorder_now(CLOCK_REALTIME);
+  header.data.args[3] = recorder_now(CLOCK_MONOTONIC);
+  header.pid = (uint32_t) pid;
+  header.timestamp = header.data.args[3];
+  return seccomplite_write_all(writer->fd, (const char *) &header, sizeof(header));
+}
+
+/**
+ * Write the buffered records followed by their index
+ * @return 0 on success, -1 with errno set
+ */
+static int recorder_flush(recorder_writer *writer) {
+  if (writer->count == 0) {
+    return 0;
+  }
+
+  seccomplite_TraceRecord *index = &writer->block[writer->count];
+  recorder_meta(index, 0, SECCOMPLITE_TRACE_INDEX);
+  index->data.args[0] = writer->count;
+  index->data.args[1] = writer->block[0].timestamp;
+  index->data.args[2] = writer->block[writer->count - 1].timestamp;
+  index->data.args[3] = writer->records + writer->count;
+  index->data.args[4] = writer->slots + writer->count + 1;
+  index->timestamp = index->data.args[2];
+
+  if (seccomplite_write_all(writer->fd, (const char *) writer->block, (writer->count + 1) * sizeof(seccomplite_TraceRecord)) != 0) {
+    return -1;
+  }
+
+  writer->records += writer->count;
+  writer->slots += writer->count + 1;
+  writer->blocks++;
+  writer->count = 0;
+  return 0;
+}
+
+static int recorder_add(recorder_writer *writer, const struct seccomp_data *data, uint32_t pid) {
+  seccomplite_TraceRecord *record = &writer->block[writer->count++];
+  memcpy(&record->data, data, sizeof(record->data));
+  record->pid = pid;
+  record->flags = 0;
+  record->timestamp = recorder_now(CLOCK_MONOTONIC);
+  return writer->count == writer->interval ? recorder_flush(writer) : 0;
+}
+
+/// Helper process
+
+/**
+ * Command side, load the filter and run the command
+ */
+static void recorder_command(const seccomplite_ProgramObject *program, char **argv, recorder_shared *shared, int notify) {
+  prctl(PR_SET_PDEATHSIG, SIGKILL);
+  if (!notify && (ptrace(PTRACE_TRACEME, 0, 0, 0) != 0 || kill(getpid(), SIGSTOP) != 0)) {
+    shared->error = errno;
+    _exit(127);
+  }
+
+  // The command is single threaded, TSYNC would only conflict with the listener
+  int listener = -1;
+  uint32_t flags = program->_flags & ~SECCOMP_FILTER_FLAG_TSYNC;
+  if (seccomplite_program_install(program->_insns, program->_len, flags, program->_nnp, notify ? &listener : NULL) != 0) {
+    shared->error = errno;
+    _exit(127);
+  }
+
+  __atomic_store_n(&shared->listener, listener, __ATOMIC_RELEASE);
+  execvp(argv[0], argv);
+  shared->error = errno;
+  _exit(127);
+}
+
+static void recorder_reaped(recorder_shared *shared, int status) {
+  shared->status = status;
+  shared->exited = 1;
+}
+
+/**
+ * Serve the listener the command creates until no task uses the filter
+ * @return 0 on success, an errno value otherwise
+ */
+static int recorder_notify(recorder_writer *writer, recorder_shared *shared, pid_t pid, struct seccomp_notif *req, struct seccomp_notif_resp *resp) {
+  int status = 0;
+  int listener = -1;
+  while ((listener = __atomic_load_n(&shared->listener, __ATOMIC_ACQUIRE)) < 0) {
+    if (waitpid(pid, &status, WNOHANG) == pid) {
+      recorder_reaped(shared, status);
+      return shared->error ? shared->error : ECHILD;
+    }
+
+    struct timespec pause = { 0, 100000 };
+    nanosleep(&pause, NULL);
+  }
+
+  // The listener is in the shared descriptor table, exec unshared it
+  int rc = 0;
+  struct pollfd fds = { .fd = listener, .events = POLLIN };
+  for (;;) {
+    int ready = poll(&fds, 1, 100);
+    if (ready < 0 && errno != EINTR) {
+      rc = errno;
+      break;
+    }
+
+    // Reaping releases the filter of the command, only then the listener hangs up
+    if (!shared->exited && waitpid(pid, &status, WNOHANG) == pid) {
+      recorder_reaped(shared, status);
+    }
+    if (ready <= 0) {
+      continue;
+    }
+    else if (!(fds.revents & POLLIN)) {
+      break;
+    }
+
+    memset(req, 0, sizeof(*req));
+    if (seccomp_notify_receive(listener, req) != 0) {
+      continue;
+    }
+
+    resp->id = req->id;
+    resp->val = 0;
+    resp->error = 0;
+    resp->flags = SECCOMP_USER_NOTIF_FLAG_CONTINUE;
+    seccomp_notify_respond(listener, resp);
+    if (recorder_add(writer, &req->data, req->pid) != 0) {
+      rc = errno;
+      break;
+    }
+  }
+
+  close(listener);
+  if (!shared->exited) {
+    if (rc != 0) {
+      kill(pid, SIGKILL);
+    }
+    while (waitpid(pid, &status, 0) < 0 && errno == EINTR);
+    recorder_reaped(shared, status);
+  }
+  return rc;
+}
+
+/**
+ * Trace the command and all its children until they are gone
+ * @return 0 on success, an errno value otherwise
+ */
+static int recorder_ptrace(recorder_writer *writer, recorder_shared *shared, pid_t pid) {
+#ifdef PTRACE_GET_SYSCALL_INFO
+  int status = 0;
+  if (waitpid(pid, &status, __WALL) != pid || !WIFSTOPPED(status)) {
+    recorder_reaped(shared, status);
+    return shared->error ? shared->error : ECHILD;
+  }
+
+  long options = PTRACE_O_TRACESECCOMP | PTRACE_O_EXITKILL | PTRACE_O_TRACEEXEC
+    | PTRACE_O_TRACEFORK | PTRACE_O_TRACEVFORK | PTRACE_O_TRACECLONE;
+  if (ptrace(PTRACE_SETOPTIONS, pid, 0, options) != 0 || ptrace(PTRACE_CONT, pid, 0, 0) != 0) {
+    int rc = errno;
+    kill(pid, SIGKILL);
+    while (waitpid(pid, &status, 0) < 0 && errno == EINTR);
+    recorder_reaped(shared, status);
+    return rc;
+  }
+
+  int rc = 0;
+  for (;;) {
+    pid_t tid = waitpid(-1, &status, __WALL);
+    if (tid < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      break;
+    }
+    else if (WIFEXITED(status) || WIFSIGNALED(status)) {
+      if (tid == pid) {
+        recorder_reaped(shared, status);
+      }
+      continue;
+    }
+    else if (!WIFSTOPPED(status)) {
+      continue;
+    }
+
+    int sig = WSTOPSIG(status);
+    int event = status >> 16;
+    if (sig == SIGTRAP && event == PTRACE_EVENT_SECCOMP) {
+      struct __ptrace_syscall_info info;
+      if (rc == 0 && ptrace(PTRACE_GET_SYSCALL_INFO, tid, sizeof(info), &info) > 0 && info.op == PTRACE_SYSCALL_INFO_SECCOMP) {
+        struct seccomp_data data;
+        data.nr = (int) info.seccomp.nr;
+        data.arch = info.arch;
+        data.instruction_pointer = info.instruction_pointer;
+        memcpy(data.args, info.seccomp.args, sizeof(data.args));
+        if (recorder_add(writer, &data, (uint32_t) tid) != 0) {
+          // Keep the tracees running, EXITKILL would take them down
+          rc = errno;
+        }
+      }
+      sig = 0;
+    }
+    else if (sig == SIGTRAP && event) {
+      sig = 0;
+    }
+    else {
+      // Group-stops have no siginfo, everything else is a signal to pass on
+      siginfo_t info;
+      if (ptrace(PTRACE_GETSIGINFO, tid, 0, &info) != 0) {
+        sig = 0;
+      }
+    }
+    ptrace(PTRACE_CONT, tid, 0, sig);
+  }
+  return rc;
+#else
+  kill(pid, SIGKILL);
+  return ENOSYS;
+#endif
+}
+
+static void recorder_helper(recorder_writer *writer, recorder_shared *shared, const seccomplite_ProgramObject *program, char **argv, int notify, struct seccomp_notif *req, struct seccomp_notif_resp *resp) {
+  prctl(PR_SET_PDEATHSIG, SIGKILL);
+
+  // The notify command shares the descriptor table to hand over its listener
+  pid_t pid = (pid_t) syscall(SYS_clone, (notify ? CLONE_FILES : 0) | SIGCHLD, 0, NULL, NULL, 0);
+  if (pid < 0) {
+    shared->error = errno;
+    _exit(1);
+  }
+  else if (pid == 0) {
+    recorder_command(program, argv, shared, notify);
+  }
+
+  if (recorder_header(writer, pid) != 0) {
+    int status = 0;
+    shared->error = errno;
+    kill(pid, SIGKILL);
+    while (waitpid(pid, &status, __WALL) < 0 && errno == EINTR);
+    _exit(1);
+  }
+
+  int rc = notify ? recorder_notify(writer, shared, pid, req, resp) : recorder_ptrace(writer, shared, pid);
+  if (recorder_flush(writer) != 0 && rc == 0) {
+    rc = errno;
+  }
+
+  if (!shared->error) {
+    shared->error = rc;
+  }
+  shared->records = writer->records;
+  shared->blocks = writer->blocks;
+  _exit(0);
+}
+
+/// Module functions
+
+/**
+ * Compile the filter to record with, the default notifies every syscall
+ * @return New reference to a Program, NULL with exception set
+ */
+static PyObject * recorder_program(PyObject *filter) {
+  PyObject *seccomplite = PyState_FindModule(&SeccompLiteModule);
+  PyObject *type = PyDict_GetItemString(PyModule_GetDict(seccomplite), FILTER_TYPE_NAME);
+  if (!filter || filter == Py_None) {
+    PyObject *all = PyObject_CallFunction(type, "I", SCMP_ACT_NOTIFY);
+    PyObject *program = all ? Filter_compile((seccomplite_FilterObject *) all) : NULL;
+    Py_XDECREF(all);
+    return program;
+  }
+  else if (PyObject_IsProgram(filter)) {
+    Py_INCREF(filter);
+    return filter;
+  }
+  else if (PyObject_IsInstance(filter, type) == 1) {
+    return Filter_compile((seccomplite_FilterObject *) filter);
+  }
+
+  PyErr_SetString(PyExc_TypeError, "Traces are recorded under a " FILTER_TYPE_NAME " or " PROGRAM_TYPE_NAME);
+  return NULL;
+}
+
+/**
+ * Wait for the helper, a pending signal handler that raises kills it
+ * @return 0 on success, -1 with exception set
+ */
+static int recorder_wait(pid_t helper) {
+  int status = 0;
+  for (;;) {
+    pid_t rc;
+    Py_BEGIN_ALLOW_THREADS
+    rc = waitpid(helper, &status, 0);
+    Py_END_ALLOW_THREADS
+    if (rc == helper) {
+      return 0;
+    }
+    else if (errno != EINTR) {
+      PyErr_SetFromErrno(PyExc_OSError);
+      return -1;
+    }
+    else if (PyErr_CheckSignals() != 0) {
+      kill(helper, SIGKILL);
+      while (waitpid(helper, &status, 0) < 0 && errno == EINTR);
+      return -1;
+    }
+  }
+}
+
+PyObject * seccomplite_record_trace(PyObject *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames) {
+  PyObject *file = NULL;
+  PyObject *command = NULL;
+  PyObject *filter = NULL;
+  unsigned int interval = SECCOMPLITE_TRACE_INTERVAL;
+  static char *kwlist[] = {"file", "argv", "filter", "index_interval", NULL};
+  if (!seccomplite_parse_vector(args, nargs, kwnames, "OO|OI:record_trace", kwlist, &file, &command, &filter, &interval)) {
+    return NULL;
+  }
+
+  if (interval == 0 || interval > RECORDER_MAX_INTERVAL) {
+    PyErr_Format(PyExc_ValueError, "Index interval must be between 1 and %d", RECORDER_MAX_INTERVAL);
+    return NULL;
+  }
+
+  int fd = PyObject_AsFileDescriptor(file);
+  if (fd < 0) {
+    PyErr_SetString(PyExc_AttributeError, "Given file descriptor appears to be invalid");
+    return NULL;
+  }
+
+  PyObject *sequence = PySequence_Fast(command, "The command must be a sequence of arguments");
+  if (!sequence) {
+    return NULL;
+  }
+  else if (PySequence_Fast_GET_SIZE(sequence) == 0) {
+    Py_DECREF(sequence);
+    PyErr_SetString(PyExc_ValueError, "The command must not be empty");
+    return NULL;
+  }
+
+  // Everything the helper touches is allocated up front
+  Py_ssize_t count = PySequence_Fast_GET_SIZE(sequence);
+  PyObject *encoded = PyTuple_New(count);
+  char **argv = PyMem_Calloc(count + 1, sizeof(char *));
+  PyObject *program = encoded && argv ? recorder_program(filter) : NULL;
+  Py_ssize_t index = 0;
+  for (index = 0; program && index < count; index++) {
+    PyObject *argument = NULL;
+    if (!PyUnicode_FSConverter(PySequence_Fast_GET_ITEM(sequence, index), &argument)) {
+      Py_CLEAR(program);
+      break;
+    }
+    PyTuple_SET_ITEM(encoded, index, argument);
+    argv[index] = PyBytes_AS_STRING(argument);
+  }
+  Py_DECREF(sequence);
+
+  recorder_writer writer = { fd, interval, NULL, 0, 0, 0, 0 };
+  struct seccomp_notif *req = NULL;
+  struct seccomp_notif_resp *resp = NULL;
+  recorder_shared *shared = MAP_FAILED;
+  PyObject *result = NULL;
+  if (!program) {
+    goto error;
+  }
+
+  seccomplite_ProgramObject *compiled = (seccomplite_ProgramObject *) program;
+  int notify = seccomplite_program_notifies(compiled->_insns, compiled->_len);
+  if (!notify && !recorder_traces(compiled->_insns, compiled->_len)) {
+    PyErr_SetString(PyExc_ValueError, "The filter has neither NOTIFY nor TRACE() actions");
+    goto error;
+  }
+
+  writer.block = PyMem_Malloc((interval + 1) * sizeof(seccomplite_TraceRecord));
+  shared = mmap(NULL, sizeof(recorder_shared), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (!writer.block || shared == MAP_FAILED) {
+    PyErr_NoMemory();
+    goto error;
+  }
+  else if (notify && seccomp_notify_alloc(&req, &resp) != 0) {
+    PyErr_SetString(PyExc_RuntimeError, "Library error (errno != 0)");
+    goto error;
+  }
+
+  memset(shared, 0, sizeof(recorder_shared));
+  shared->listener = -1;
+  pid_t helper = fork();
+  if (helper < 0) {
+    PyErr_SetFromErrno(PyExc_OSError);
+    goto error;
+  }
+  else if (helper == 0) {
+    recorder_helper(&writer, shared, compiled, argv, notify, req, resp);
+  }
+
+  if (recorder_wait(helper) != 0) {
+    goto error;
+  }
+  else if (shared->error != 0) {
+    errno = shared->error;
+    PyErr_SetFromErrno(PyExc_OSError);
+    goto error;
+  }
+
+  int status = shared->status;
+  result = Py_BuildValue("{s:i,s:K,s:K}",
+    "returncode", WIFSIGNALED(status) ? -WTERMSIG(status) : WEXITSTATUS(status),
+    "records", (unsigned long long) shared->records,
+    "blocks", (unsigned long long) shared->blocks);
+
+error:
+  if (req) {
+    seccomp_notify_free(req, resp);
+  }
+  if (shared != MAP_FAILED) {
+    munmap(shared, sizeof(recorder_shared));
+  }
+  PyMem_Free(writer.block);
+  PyMem_Free(argv);
+  Py_XDECREF(encoded);
+  Py_XDECREF(program);
+  return result;
+}
+
+/**
+ * Add one block to the index
+ * @return 0 on success, -1 with exception set
+ */
+static int recorder_index_block(PyObject *blocks, size_t slot, uint64_t records, uint64_t first, uint64_t last) {
+  if (records == 0) {
+    return 0;
+  }
+
+  PyObject *block = Py_BuildValue("{s:n,s:K,s:K,s:K}", "offset", (Py_ssize_t) slot,
+    "records", (unsigned long long) records, "first", (unsigned long long) first, "last", (unsigned long long) last);
+  int rc = block ? PyList_Append(blocks, block) : -1;
+  Py_XDECREF(block);
+  return rc;
+}
+
+PyObject * seccomplite_trace_index(PyObject *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames) {
+  Py_buffer view;
+  static char *kwlist[] = {"trace", NULL};
+  if (!seccomplite_parse_vector(args, nargs, kwnames, "y*:trace_index", kwlist, &view)) {
+    return NULL;
+  }
+
+  if (view.len % SECCOMPLITE_TRACE_RECORD_SIZE != 0) {
+    PyBuffer_Release(&view);
+    PyErr_Format(PyExc_ValueError, "Trace length is not a multiple of the record size %d", SECCOMPLITE_TRACE_RECORD_SIZE);
+    return NULL;
+  }
+
+  const uint8_t *data = view.buf;
+  size_t count = view.len / SECCOMPLITE_TRACE_RECORD_SIZE;
+  size_t slot = 0;
+  seccomplite_TraceRecord record;
+  PyObject *blocks = PyList_New(0);
+#define RECORDER_SLOT(at) memcpy(&record, data + (at) * SECCOMPLITE_TRACE_RECORD_SIZE, SECCOMPLITE_TRACE_RECORD_SIZE)
+
+  while (blocks && slot < count) {
+    RECORDER_SLOT(slot);
+    if (!(record.flags & SECCOMPLITE_TRACE_HEADER) || record.data.args[1] == 0) {
+      PyErr_Format(PyExc_ValueError, "No trace header at record %zu", slot);
+      Py_CLEAR(blocks);
+      break;
+    }
+
+    uint64_t interval = record.data.args[1];
+    slot++;
+    while (blocks && slot < count) {
+      // Full blocks end in an index exactly one interval later
+      size_t end = slot + interval;
+      if (end < count) {
+        RECORDER_SLOT(end);
+      }
+      if (end >= count || !(record.flags & SECCOMPLITE_TRACE_INDEX) || record.data.args[0] != interval) {
+        for (end = slot; end < count; end++) {
+          RECORDER_SLOT(end);
+          if (record.flags & SECCOMPLITE_TRACE_META) {
+            break;
+          }
+        }
+      }
+
+      if (end < count && (record.flags & SECCOMPLITE_TRACE_INDEX)) {
+        if (recorder_index_block(blocks, slot, record.data.args[0], record.data.args[1], record.data.args[2]) != 0) {
+          Py_CLEAR(blocks);
+        }
+        slot = end + 1;
+        continue;
+      }
+
+      // Records of a killed recorder up to the next segment or the end
+      uint64_t first = 0;
+      uint64_t last = 0;
+      if (end > slot) {
+        RECORDER_SLOT(slot);
+        first = record.timestamp;
+        RECORDER_SLOT(end - 1);
+        last = record.timestamp;
+      }
+      if (recorder_index_block(blocks, slot, end - slot, first, last) != 0) {
+        Py_CLEAR(blocks);
+      }
+      slot = end;
+      break;
+    }
+  }
+
+#undef RECORDER_SLOT
+  PyBuffer_Release(&view);
+  return blocks;
+}
@@ -0,0 +1,184 @@
+/*
+ * Program interning registry in seccomplite library
+ * Author: Michael Witt <m.witt@htw-berlin.de>
+ *
+ * Filters with an identical policy share one compiled program.  The
+ * registry is keyed by the digest of the canonical form of the record, so
+ * the order rules were added in or whether they came from a merge does not
+ * matter, and by the optimiser options the program is compiled with.  The
+ * canonical form itself is kept to rule out digest collisions.
+ */
+
+#include <Python.h>
+#include "inc/config.h"
+#include "inc/registry.h"
+#include "inc/program.h"
+#include "inc/policy.h"
+#include "inc/seccomplite.h"
+
+/**
+ * (digest, options) -> (canonical record, options, program or weakref to program)
+ */
+static PyObject *registry = NULL;
+static int registry_weak = 0;
+static unsigned long long registry_hits = 0;
+static unsigned long long registry_misses = 0;
+static unsigned long long registry_evictions = 0;
+
+/**
+ * Weak reference callback removing the entry of a dead program
+ */
+static PyObject * registry_evict(PyObject *key, PyObject *ref) {
+  PyObject *entry = registry ? PyDict_GetItemWithError(registry, key) : NULL;
+  if (entry && PyTuple_GET_ITEM(entry, 2) == ref) {
+    if (PyDict_DelItem(registry, key) != 0) {
+      return NULL;
+    }
+    registry_evictions++;
+  }
+  else if (PyErr_Occurred()) {
+    return NULL;
+  }
+
+  Py_RETURN_NONE;
+}
+
+static PyMethodDef registry_evict_def = {
+  "_evict", (PyCFunction)registry_evict, METH_O, "Remove a dead program from the registry"
+};
+
+PyObject * seccomplite_registry_intern(seccomplite_FilterObject *filter) {
+  if (filter->_frozen) {
+    Py_INCREF(filter->_program);
+    return filter->_program;
+  }
+
+  if (!registry) {
+    registry = PyDict_New();
+    if (!registry) {
+      return NULL;
+    }
+  }
+
+  seccomplite_Policy canonical = { NULL, 0, 0 };
+  if (seccomplite_policy_canonical(filter->_policy.data, filter->_policy.len, &canonical) != 0) {
+    seccomplite_policy_free(&canonical);
+    return PyErr_NoMemory();
+  }
+
+  uint64_t digest = seccomplite_policy_digest(canonical.data, canonical.len);
+  int options = Filter_program_options(filter);
+  PyObject *key = Py_BuildValue("(Ki)", (unsigned long long) digest, options);
+  if (!key) {
+    seccomplite_policy_free(&canonical);
+    return NULL;
+  }
+
+  PyObject *entry = PyDict_GetItemWithError(registry, key);
+  if (!entry && PyErr_Occurred()) {
+    seccomplite_policy_free(&canonical);
+    Py_DECREF(key);
+    return NULL;
+  }
+
+  int collision = 0;
+  if (entry) {
+    PyObject *record = PyTuple_GET_ITEM(entry, 0);
+    PyObject *program = PyTuple_GET_ITEM(entry, 2);
+    if (PyWeakref_CheckRef(program)) {
+      program = PyWeakref_GetObject(program);
+    }
+
+    collision = PyLong_AsLong(PyTuple_GET_ITEM(entry, 1)) != options ||
+      (size_t) PyBytes_GET_SIZE(record) != canonical.len ||
+      memcmp(PyBytes_AS_STRING(record), canonical.data, canonical.len) != 0;
+    if (!collision && program != Py_None) {
+      registry_hits++;
+      seccomplite_policy_free(&canonical);
+      Py_DECREF(key);
+      Py_INCREF(program);
+      return program;
+    }
+  }
+
+  registry_misses++;
+  PyObject *program = Filter_compile(filter);
+  if (!program || collision) {
+    // Digest collisions are never cached, the first entry stays
+    seccomplite_policy_free(&canonical);
+    Py_DECREF(key);
+    return program;
+  }
+
+  PyObject *holder = program;
+  Py_INCREF(holder);
+  if (registry_weak) {
+    PyObject *callback = PyCFunction_New(&registry_evict_def, key);
+    Py_DECREF(holder);
+    holder = callback ? PyWeakref_NewRef(program, callback) : NULL;
+    Py_XDECREF(callback);
+  }
+
+  PyObject *record = PyBytes_FromStringAndSize((const char *) canonical.data, canonical.len);
+  seccomplite_policy_free(&canonical);
+  PyObject *value = (holder && record) ? Py_BuildValue("(OiO)", record, options, holder) : NULL;
+  Py_XDECREF(holder);
+  Py_XDECREF(record);
+  if (!value || PyDict_SetItem(registry, key, value) != 0) {
+    Py_XDECREF(value);
+    Py_DECREF(key);
+    Py_DECREF(program);
+    return NULL;
+  }
+
+  Py_DECREF(value);
+  Py_DECREF(key);
+  return program;
+}
+
+PyObject * seccomplite_intern_stats(PyObject *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames) {
+  int reset = 0;
+  static char *kwlist[] = {"reset", NULL};
+  if (!seccomplite_parse_vector(args, nargs, kwnames, "|p:intern_stats", kwlist, &reset)) {
+    return NULL;
+  }
+
+  PyObject *result = Py_BuildValue("{s:K,s:K,s:K,s:n,s:O}",
+    "hits", registry_hits,
+    "misses", registry_misses,
+    "evictions", registry_evictions,
+    "entries", registry ? PyDict_Size(registry) : (Py_ssize_t) 0,
+    "weak", registry_weak ? Py_True : Py_False);
+
+  if (result && reset) {
+    registry_hits = 0;
+    registry_misses = 0;
+    registry_evictions = 0;
+  }
+
+  return result;
+}
+
+PyObject * seccomplite_intern_clear(PyObject *self) {
+  if (registry) {
+    PyDict_Clear(registry);
+  }
+
+  Py_RETURN_NONE;
+}
+
+PyObject * seccomplite_intern_mode(PyObject *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames) {
+  int weak = 0;
+  static char *kwlist[] = {"weak", NULL};
+  if (!seccomplite_parse_vector(args, nargs, kwnames, "p:intern_mode", kwlist, &weak)) {
+    return NULL;
+  }
+
+  // Existing entries keep their mode, start over to avoid mixing both
+  if (weak != registry_weak && registry) {
+    PyDict_Clear(registry);
+  }
+  registry_weak = weak;
+
+  Py_RETURN_NONE;
+}
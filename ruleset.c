@@ -0,0 +1,452 @@
+/*
+ * RuleSet submodule in seccomplite library
+ * Author: Michael Witt <m.witt@htw-berlin.de>
+ */
+
+#include <Python.h>
+#include <seccomp.h>
+#include <stdint.h>
+#include <string.h>
+#include "inc/config.h"
+#include "inc/ruleset.h"
+#include "inc/seccomplite.h"
+#include "inc/arg.h"
+#include "inc/filter.h"
+
+/**
+ * Comparisons per rule of an owned set
+ */
+#define RULESET_WIDTH 6
+
+static PyObject * RuleSet_get_zero_copy(seccomplite_RuleSetObject *self, void *closure);
+
+/**
+ * RuleSet type member and methods definitions
+ */
+static PyMemberDef RuleSet_members[] = {
+  {"width", T_UINT, offsetof(seccomplite_RuleSetObject, _width), READONLY, "Argument comparisons stored per rule"},
+  { NULL } /* Sentinel */
+};
+
+static PyGetSetDef RuleSet_getset[] = {
+  {"zero_copy", (getter) RuleSet_get_zero_copy, NULL, "True while the rules are read from the buffers passed to the constructor", NULL},
+  { NULL } /* Sentinel */
+};
+
+static PyMethodDef RuleSet_methods[] = {
+  { "append", (PyCFunction)RuleSet_append, METH_FASTCALL, "Add a rule to the set \nArguments:\n action the rule action syscall the syscall name or number args variable number of Arg objects \nDescription:\n A set created from buffers is copied into owned arrays first" },
+  { NULL } /* Sentinel */
+};
+
+/**
+ * RuleSet type slots definitions
+ */
+static PyType_Slot seccomplite_RuleSetTypeSlots[] = {
+  { Py_tp_methods, RuleSet_methods },
+  { Py_tp_members, RuleSet_members },
+  { Py_tp_getset, RuleSet_getset },
+  { Py_tp_init, RuleSet_init },
+  { Py_tp_new, RuleSet_new },
+  { Py_tp_dealloc, RuleSet_dealloc },
+  { Py_sq_length, RuleSet_length },
+  { Py_sq_item, RuleSet_item },
+  { 0, NULL }
+};
+
+/**
+ * RuleSet type specs
+ */
+PyType_Spec seccomplite_RuleSetTypeSpec = {
+  MODULE_NAME "." RULESET_TYPE_NAME,
+  sizeof (seccomplite_RuleSetObject),
+  0,
+  Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE,
+  seccomplite_RuleSetTypeSlots
+};
+
+/// RuleSet type methods
+
+/**
+ * Drop all rules and release the buffer views
+ * @param self Type self reference
+ */
+static void RuleSet_clear(seccomplite_RuleSetObject *self) {
+  if (self->_num_views > 0) {
+    int index;
+    for (index = 0; index < self->_num_views; index++) {
+      PyBuffer_Release(&self->_views[index]);
+    }
+    self->_num_views = 0;
+  }
+  else {
+    PyMem_Free(self->_actions);
+    PyMem_Free(self->_syscalls);
+    PyMem_Free(self->_argc);
+    PyMem_Free(self->_args);
+  }
+
+  self->_actions = NULL;
+  self->_syscalls = NULL;
+  self->_argc = NULL;
+  self->_args = NULL;
+  self->_width = RULESET_WIDTH;
+  self->_len = 0;
+  self->_cap = 0;
+}
+
+/**
+ * Grow the owned arrays, buffer backed columns are copied on the first call
+ * @param self Type self reference
+ * @param cap Minimum capacity
+ * @return 0 on success, -1 with exception set
+ */
+static int RuleSet_reserve(seccomplite_RuleSetObject *self, Py_ssize_t cap) {
+  if (self->_num_views == 0 && cap <= self->_cap) {
+    return 0;
+  }
+  if (cap < 2 * self->_cap) {
+    cap = 2 * self->_cap;
+  }
+  if (cap < 16) {
+    cap = 16;
+  }
+
+  uint32_t *actions = PyMem_Malloc(cap * sizeof (*actions));
+  int32_t *syscalls = PyMem_Malloc(cap * sizeof (*syscalls));
+  uint8_t *argc = PyMem_Malloc(cap * sizeof (*argc));
+  struct scmp_arg_cmp *args = PyMem_Calloc(cap * RULESET_WIDTH, sizeof (*args));
+  if (!actions || !syscalls || !argc || !args) {
+    PyMem_Free(actions);
+    PyMem_Free(syscalls);
+    PyMem_Free(argc);
+    PyMem_Free(args);
+    PyErr_NoMemory();
+    return -1;
+  }
+
+  Py_ssize_t len = self->_len;
+  Py_ssize_t index;
+  if (len > 0) {
+    memcpy(actions, self->_actions, len * sizeof (*actions));
+    memcpy(syscalls, self->_syscalls, len * sizeof (*syscalls));
+    for (index = 0; index < len; index++) {
+      argc[index] = self->_argc ? self->_argc[index] : self->_width;
+      if (argc[index] > self->_width) {
+        argc[index] = self->_width;
+      }
+      if (self->_width > 0) {
+        memcpy(&args[index * RULESET_WIDTH], &self->_args[index * self->_width], self->_width * sizeof (*args));
+      }
+    }
+  }
+
+  RuleSet_clear(self);
+  self->_actions = actions;
+  self->_syscalls = syscalls;
+  self->_argc = argc;
+  self->_args = args;
+  self->_len = len;
+  self->_cap = cap;
+  return 0;
+}
+
+/**
+ * Acquire a buffer view as column of fixed size items
+ * @param self Type self reference
+ * @param o Buffer object
+ * @param name Argument name for error messages
+ * @param itemsize Size of one item
+ * @param alignment Required alignment of the data
+ * @param data Receives the data pointer
+ * @param count Receives the number of items
+ * @return 0 on success, -1 with exception set
+ */
+static int RuleSet_column(seccomplite_RuleSetObject *self, PyObject *o, const char *name, Py_ssize_t itemsize, size_t alignment, void **data, Py_ssize_t *count) {
+  Py_buffer *view = &self->_views[self->_num_views];
+  if (PyObject_GetBuffer(o, view, PyBUF_C_CONTIGUOUS) != 0) {
+    return -1;
+  }
+  self->_num_views++;
+
+  if ((view->itemsize != 1 && view->itemsize != itemsize) || view->len % itemsize != 0) {
+    PyErr_Format(PyExc_ValueError, "%s must be a buffer of %zd byte items", name, itemsize);
+    return -1;
+  }
+  if ((uintptr_t) view->buf % alignment != 0) {
+    PyErr_Format(PyExc_ValueError, "%s buffer is not aligned", name);
+    return -1;
+  }
+
+  *data = view->buf;
+  *count = view->len / itemsize;
+  return 0;
+}
+
+void RuleSet_dealloc(seccomplite_RuleSetObject *self) {
+  RuleSet_clear(self);
+  Py_TYPE(self)->tp_free((PyObject*) self);
+}
+
+PyObject * RuleSet_new(PyTypeObject *type, PyObject *args, PyObject *kwds) {
+  seccomplite_RuleSetObject *self;
+
+  self = (seccomplite_RuleSetObject *) type->tp_alloc(type, 0);
+  if (self != NULL) {
+    self->_actions = NULL;
+    self->_syscalls = NULL;
+    self->_argc = NULL;
+    self->_args = NULL;
+    self->_width = RULESET_WIDTH;
+    self->_len = 0;
+    self->_cap = 0;
+    self->_num_views = 0;
+  }
+
+  return (PyObject *) self;
+}
+
+/**
+ * Constructor parameters
+ */
+static char *RuleSet_kwlist[] = {"actions", "syscalls", "args", "argc", NULL};
+
+/**
+ * Replace the rules by views of the given buffers
+ * @param self Type self reference
+ * @return 0 on success, -1 with exception set
+ */
+static int RuleSet_setup(seccomplite_RuleSetObject *self, PyObject *actions, PyObject *syscalls, PyObject *arguments, PyObject *argc) {
+  RuleSet_clear(self);
+  if ((!actions || actions == Py_None) && (!syscalls || syscalls == Py_None)) {
+    if ((arguments && arguments != Py_None) || (argc && argc != Py_None)) {
+      PyErr_SetString(PyExc_ValueError, "args and argc require actions and syscalls");
+      return -1;
+    }
+    return 0;
+  }
+  if (!actions || actions == Py_None || !syscalls || syscalls == Py_None) {
+    PyErr_SetString(PyExc_ValueError, "actions and syscalls must be given together");
+    return -1;
+  }
+
+  void *data = NULL;
+  Py_ssize_t len = 0;
+  Py_ssize_t count = 0;
+  if (RuleSet_column(self, actions, "actions", sizeof (uint32_t), sizeof (uint32_t), &data, &len) != 0) {
+    goto error;
+  }
+  self->_actions = data;
+
+  if (RuleSet_column(self, syscalls, "syscalls", sizeof (int32_t), sizeof (int32_t), &data, &count) != 0) {
+    goto error;
+  }
+  self->_syscalls = data;
+  if (count != len) {
+    PyErr_SetString(PyExc_ValueError, "actions and syscalls differ in length");
+    goto error;
+  }
+
+  self->_width = 0;
+  if (arguments && arguments != Py_None) {
+    if (RuleSet_column(self, arguments, "args", sizeof (struct scmp_arg_cmp), sizeof (uint64_t), &data, &count) != 0) {
+      goto error;
+    }
+    self->_args = data;
+    if ((len == 0 && count != 0) || (len > 0 && (count % len != 0 || count / len > RULESET_WIDTH))) {
+      PyErr_SetString(PyExc_ValueError, "args must hold up to six comparisons for every rule");
+      goto error;
+    }
+    self->_width = len > 0 ? count / len : 0;
+  }
+
+  if (argc && argc != Py_None) {
+    if (RuleSet_column(self, argc, "argc", sizeof (uint8_t), sizeof (uint8_t), &data, &count) != 0) {
+      goto error;
+    }
+    self->_argc = data;
+    if (count != len) {
+      PyErr_SetString(PyExc_ValueError, "actions and argc differ in length");
+      goto error;
+    }
+  }
+
+  self->_len = len;
+  self->_cap = len;
+  return 0;
+
+error:
+  RuleSet_clear(self);
+  return -1;
+}
+
+int RuleSet_init(seccomplite_RuleSetObject *self, PyObject *args, PyObject *kwds) {
+  PyObject *actions = NULL;
+  PyObject *syscalls = NULL;
+  PyObject *arguments = NULL;
+  PyObject *argc = NULL;
+  if (!PyArg_ParseTupleAndKeywords(args, kwds, "|OOOO", RuleSet_kwlist, &actions, &syscalls, &arguments, &argc)) {
+    return -1;
+  }
+
+  return RuleSet_setup(self, actions, syscalls, arguments, argc);
+}
+
+PyObject * RuleSet_vectorcall(PyObject *type, PyObject *const *args, size_t nargsf, PyObject *kwnames) {
+  PyObject *actions = NULL;
+  PyObject *syscalls = NULL;
+  PyObject *arguments = NULL;
+  PyObject *argc = NULL;
+  if (!seccomplite_parse_vector(args, PyVectorcall_NARGS(nargsf), kwnames, "|OOOO:" RULESET_TYPE_NAME, RuleSet_kwlist, &actions, &syscalls, &arguments, &argc)) {
+    return NULL;
+  }
+
+  PyObject *self = RuleSet_new((PyTypeObject *) type, NULL, NULL);
+  if (self && RuleSet_setup((seccomplite_RuleSetObject *) self, actions, syscalls, arguments, argc) != 0) {
+    Py_CLEAR(self);
+  }
+  return self;
+}
+
+Py_ssize_t RuleSet_length(seccomplite_RuleSetObject *self) {
+  return self->_len;
+}
+
+PyObject * RuleSet_item(seccomplite_RuleSetObject *self, Py_ssize_t index) {
+  if (index < 0 || index >= self->_len) {
+    PyErr_SetString(PyExc_IndexError, "RuleSet index out of range");
+    return NULL;
+  }
+
+  uint32_t action = 0;
+  int syscall = 0;
+  struct scmp_arg_cmp arguments[RULESET_WIDTH];
+  int num_args = seccomplite_ruleset_get(self, index, &action, &syscall, arguments);
+  if (num_args < 0) {
+    return NULL;
+  }
+
+  PyObject *comparisons = PyTuple_New(num_args);
+  if (!comparisons) {
+    return NULL;
+  }
+
+  int arg;
+  for (arg = 0; arg < num_args; arg++) {
+    PyObject *item = Py_BuildValue("(IiKK)", arguments[arg].arg, (int) arguments[arg].op,
+      (unsigned long long) arguments[arg].datum_a, (unsigned long long) arguments[arg].datum_b);
+    if (!item) {
+      Py_DECREF(comparisons);
+      return NULL;
+    }
+    PyTuple_SET_ITEM(comparisons, arg, item);
+  }
+
+  return Py_BuildValue("(IiN)", action, syscall, comparisons);
+}
+
+PyObject * RuleSet_append(seccomplite_RuleSetObject *self, PyObject *const *args, Py_ssize_t nargs) {
+  Py_ssize_t num_args = nargs - 2;
+  if (num_args < 0) {
+    PyErr_SetString(PyExc_AttributeError, "append requires at least 2 arguments");
+    return NULL;
+  }
+  if (num_args > RULESET_WIDTH) {
+    PyErr_SetString(PyExc_RuntimeError, "Maximum number of arguments exceeded");
+    return NULL;
+  }
+
+  uint32_t action = 0;
+  if (PyArg_Parse(args[0], "I", &action) == 0) {
+    PyErr_SetString(PyExc_AttributeError, "action must be an integer");
+    return NULL;
+  }
+
+  int syscall = PyObject_AsSyscallNumber(args[1]);
+  if (syscall == -1) {
+    return NULL;
+  }
+
+  struct scmp_arg_cmp arguments[RULESET_WIDTH];
+  memset(arguments, 0, sizeof (arguments));
+  PyObject *seccomplite = PyState_FindModule(&SeccompLiteModule);
+  PyObject *type = PyDict_GetItemString(PyModule_GetDict(seccomplite), ARG_TYPE_NAME);
+  Py_ssize_t index;
+  for (index = 0; index < num_args; index++) {
+    PyObject *o = args[index + 2];
+    if (!PyObject_IsInstance(o, type)) {
+      PyErr_SetString(PyExc_AttributeError, "argument must be of type " ARG_TYPE_NAME);
+      return NULL;
+    }
+
+    seccomplite_ArgObject *arg = (seccomplite_ArgObject *) o;
+    if (arg->_placeholder_a || arg->_placeholder_b) {
+      PyErr_SetString(PyExc_ValueError, "Placeholders can not be stored in a " RULESET_TYPE_NAME);
+      return NULL;
+    }
+    arguments[index] = arg->_arg;
+  }
+
+  if (RuleSet_reserve(self, self->_len + 1) != 0) {
+    return NULL;
+  }
+
+  index = self->_len++;
+  self->_actions[index] = action;
+  self->_syscalls[index] = syscall;
+  self->_argc[index] = (uint8_t) num_args;
+  memcpy(&self->_args[index * RULESET_WIDTH], arguments, sizeof (arguments));
+  Py_RETURN_NONE;
+}
+
+static PyObject * RuleSet_get_zero_copy(seccomplite_RuleSetObject *self, void *closure) {
+  return PyBool_FromLong(self->_num_views > 0);
+}
+
+PyTypeObject * RuleSet_build(void) {
+  // Ready the type
+  PyObject *type = PyType_FromSpec(&seccomplite_RuleSetTypeSpec);
+  PyTypeObject *result = (PyTypeObject *) type;
+
+  if (!type || PyType_Ready(result) < 0) {
+    Py_XDECREF(type);
+    return NULL;
+  }
+
+#if PY_VERSION_HEX >= 0x03090000
+  // Calling the type skips the argument tuple of tp_new and tp_init
+  result->tp_vectorcall = (vectorcallfunc) RuleSet_vectorcall;
+#endif
+  return result;
+}
+
+int seccomplite_ruleset_get(seccomplite_RuleSetObject *self, Py_ssize_t index, uint32_t *action, int *syscall, struct scmp_arg_cmp *args) {
+  unsigned int num_args = self->_argc ? self->_argc[index] : self->_width;
+  if (num_args > self->_width) {
+    PyErr_Format(PyExc_ValueError, "Rule %zd has more comparisons than stored", index);
+    return -1;
+  }
+
+  unsigned int arg;
+  const struct scmp_arg_cmp *source = &self->_args[index * self->_width];
+  for (arg = 0; arg < num_args; arg++) {
+    if (source[arg].arg > 5) {
+      PyErr_Format(PyExc_ValueError, "Rule %zd compares invalid argument %u", index, source[arg].arg);
+      return -1;
+    }
+    if (source[arg].op < SCMP_CMP_NE || source[arg].op > SCMP_CMP_MASKED_EQ) {
+      PyErr_Format(PyExc_ValueError, "Rule %zd has invalid comparison operator %d", index, (int) source[arg].op);
+      return -1;
+    }
+    args[arg] = source[arg];
+  }
+
+  *action = self->_actions[index];
+  *syscall = self->_syscalls[index];
+  return (int) num_args;
+}
+
+int PyObject_IsRuleSet(PyObject *o) {
+  PyObject *seccomplite = PyState_FindModule(&SeccompLiteModule);
+  PyObject *type = PyDict_GetItemString(PyModule_GetDict(seccomplite), RULESET_TYPE_NAME);
+  return PyObject_IsInstance(o, type) == 1;
+}
@@ -6,6 +6,9 @@
 
 #include <Python.h>
 #include <seccomp.h>
+#include <limits.h>
+#include <stdarg.h>
+#include <string.h>
 #include "structmember.h"
 #include "inc/config.h"
 #include "inc/seccomplite.h"
@@ -14,6 +17,16 @@
 #include "inc/attr.h"
 #include "inc/arg.h"
 #include "inc/filter.h"
+#include "inc/program.h"
+#include "inc/placeholder.h"
+#include "inc/registry.h"
+#include "inc/stack.h"
+#include "inc/ruleset.h"
+#include "inc/broker.h"
+#include "inc/recorder.h"
+#include "inc/server.h"
+#include "inc/builtin.h"
+#include "inc/stats.h"
 
 /**
  * All exported methods
@@ -21,9 +34,19 @@
 static PyMethodDef SeccompLiteMethods[] = {
   // { "Name", function, METH_KEYWORDS or METH_VARARGS or METH_NOARGS, "description" }
   { "system_arch", (PyCFunction)seccomplite_system_arch, METH_NOARGS, "Get the native system architecture"},
-  { "resolve_syscall", (PyCFunction)seccomplite_resolve_syscall, METH_KEYWORDS | METH_VARARGS, "Return the syscall number for the given syscall name"},
-  { "ERRNO", (PyCFunction)seccomplite_act_errno, METH_KEYWORDS | METH_VARARGS, "Configure a seccomp action to return the specified error code"},
-  { "TRACE", (PyCFunction)seccomplite_act_trace, METH_KEYWORDS | METH_VARARGS, "Configure a seccomp action to notify a tracing process with the specified value"},
+  { "resolve_syscall", (PyCFunction)seccomplite_resolve_syscall, METH_FASTCALL | METH_KEYWORDS, "Return the syscall number for the given syscall name"},
+  { "ERRNO", (PyCFunction)seccomplite_act_errno, METH_FASTCALL | METH_KEYWORDS, "Configure a seccomp action to return the specified error code"},
+  { "TRACE", (PyCFunction)seccomplite_act_trace, METH_FASTCALL | METH_KEYWORDS, "Configure a seccomp action to notify a tracing process with the specified value"},
+  { "intern_stats", (PyCFunction)seccomplite_intern_stats, METH_FASTCALL | METH_KEYWORDS, "Get the hit, miss and eviction counters of the program interning registry"},
+  { "intern_clear", (PyCFunction)seccomplite_intern_clear, METH_NOARGS, "Drop all entries of the program interning registry"},
+  { "loaded_filters", (PyCFunction)seccomplite_loaded_filters, METH_FASTCALL | METH_KEYWORDS, "Get the filters loaded into a process \nArguments:\n pid process to inspect default the calling process \nDescription:\n Read the number of stacked filters from /proc and fetch every filter with PTRACE_SECCOMP_GET_FILTER The list is in load order the kernel runs the last filter first Filters that can not be read are None the kernel only hands them out to callers with CAP_SYS_ADMIN which are not filtered themselves The filters of the calling process can never be read that way only their number is reported and no child is forked so the call is safe under filters that kill clone"},
+  { "plan_stack", (PyCFunction)seccomplite_plan_stack, METH_FASTCALL | METH_KEYWORDS, "Plan a stack of filters \nArguments:\n filters Filter or Program objects in load order \nDescription:\n Combine the filters into one program that returns exactly what the kernel would return after loading them one after another The most restrictive action wins on equal actions the filter loaded last Raises ValueError if the combined program exceeds the kernel limit"},
+  { "intern_mode", (PyCFunction)seccomplite_intern_mode, METH_FASTCALL | METH_KEYWORDS, "Configure the program interning registry to hold weak (evicting) or strong references"},
+  { "stats", (PyCFunction)seccomplite_stats, METH_FASTCALL | METH_KEYWORDS, "Get the call statistics \nArguments:\n reset reset the counters afterwards \nDescription:\n Return a dict mapping every libseccomp operation init rule_add merge load export_pfc and export_bpf that was called while timing was enabled to a dict with the number of calls and errors the total minimum and maximum latency in nanoseconds and a histogram mapping power of two upper bounds in nanoseconds to call counts"},
+  { "stats_enable", (PyCFunction)seccomplite_stats_enable, METH_FASTCALL | METH_KEYWORDS, "Switch call timing on or off \nArguments:\n enabled new state default True \nDescription:\n Return the previous state Timing is off by default unless the SECCOMPLITE_STATS environment variable is set to a value other than 0 Builds with SECCOMPLITE_NO_STATS can not enable it"},
+  { "record_trace", (PyCFunction)seccomplite_record_trace, METH_FASTCALL | METH_KEYWORDS, "Record a syscall trace of a command \nArguments:\n file file object or descriptor opened for appending argv the command and its arguments looked up in PATH filter Filter or Program deciding which syscalls are recorded NOTIFY actions are served by a listener TRACE actions by ptrace default every syscall through a listener index_interval records per block default 1024 \nDescription:\n Run the command under the filter and append one segment of TRACE_RECORD_SIZE byte records to the file including the syscalls of every child Recorded syscalls continue unchanged A header record starts the segment and an index record follows every block both are skipped by Filter.profile Return a dict with the returncode of the command negative for a signal and the number of records and blocks written"},
+  { "trace_index", (PyCFunction)seccomplite_trace_index, METH_FASTCALL | METH_KEYWORDS, "Read the index of a trace \nArguments:\n trace buffer holding a trace file e.g a mmap \nDescription:\n Return a list of dicts one per block with the slot of its first record the number of records and the first and last timestamp Blocks of a killed recorder have no index record their numbers are taken from the records"},
+  { "translate_syscalls", (PyCFunction)seccomplite_translate_syscalls, METH_FASTCALL | METH_KEYWORDS, "Translate syscall numbers between architectures \nArguments:\n numbers buffer of 4 byte syscall numbers e.g array('i') from_arch architecture the numbers belong to to_arch architecture to translate to missing number for syscalls the target does not have or the source does not know default -1 \nDescription:\n Map every number to the number of the syscall with the same name on the target and return the result as bytes of the same layout The mapping tables are built from libseccomp once per pair of architectures large inputs are translated without the GIL"},
   {NULL, NULL, 0, NULL} /* Closing sentinal */
 };
 
@@ -51,6 +74,7 @@ PyInit_seccomplite(void) {
 
   // Add all exported constants
   seccomplite_export_constants(seccomplite);
+  seccomplite_stats_setup();
 
   // Ready the Arch type
   PyTypeObject *arch_type = Arch_build();
@@ -88,6 +112,61 @@ PyInit_seccomplite(void) {
   Py_INCREF(filter_type);
   PyModule_AddObject(seccomplite, FILTER_TYPE_NAME, (PyObject *) filter_type);
 
+  // Ready the Program type
+  PyTypeObject *program_type = Program_build();
+  if (!program_type) {
+    return NULL;
+  }
+
+  Py_INCREF(program_type);
+  PyModule_AddObject(seccomplite, PROGRAM_TYPE_NAME, (PyObject *) program_type);
+
+  // Policies embedded at build time, read-only
+  PyObject *builtins = seccomplite_builtin_policies(program_type);
+  PyObject *proxy = builtins ? PyDictProxy_New(builtins) : NULL;
+  Py_XDECREF(builtins);
+  if (!proxy) {
+    return NULL;
+  }
+
+  PyModule_AddObject(seccomplite, "builtin_policies", proxy);
+
+  // Ready the Placeholder type
+  PyTypeObject *placeholder_type = Placeholder_build();
+  if (!placeholder_type) {
+    return NULL;
+  }
+
+  Py_INCREF(placeholder_type);
+  PyModule_AddObject(seccomplite, PLACEHOLDER_TYPE_NAME, (PyObject *) placeholder_type);
+
+  // Ready the RuleSet type
+  PyTypeObject *ruleset_type = RuleSet_build();
+  if (!ruleset_type) {
+    return NULL;
+  }
+
+  Py_INCREF(ruleset_type);
+  PyModule_AddObject(seccomplite, RULESET_TYPE_NAME, (PyObject *) ruleset_type);
+
+  // Ready the Broker type
+  PyTypeObject *broker_type = Broker_build();
+  if (!broker_type) {
+    return NULL;
+  }
+
+  Py_INCREF(broker_type);
+  PyModule_AddObject(seccomplite, BROKER_TYPE_NAME, (PyObject *) broker_type);
+
+  // Ready the CompileServer type
+  PyTypeObject *server_type = CompileServer_build();
+  if (!server_type) {
+    return NULL;
+  }
+
+  Py_INCREF(server_type);
+  PyModule_AddObject(seccomplite, COMPILE_SERVER_TYPE_NAME, (PyObject *) server_type);
+
   return seccomplite;
 }
 
@@ -95,31 +174,31 @@ PyObject * seccomplite_system_arch(PyObject *self) {
   return Py_BuildValue("I", seccomp_arch_native());
 }
 
-PyObject * seccomplite_act_errno(PyObject *self, PyObject *args, PyObject *kwds) {
+PyObject * seccomplite_act_errno(PyObject *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames) {
   uint32_t syscall = 0;
   static char *kwlist[] = {"code", NULL};
-  if (!PyArg_ParseTupleAndKeywords(args, kwds, "I", kwlist, &syscall)) {
+  if (!seccomplite_parse_vector(args, nargs, kwnames, "I:ERRNO", kwlist, &syscall)) {
     return NULL;
   }
   
   return Py_BuildValue("I", SCMP_ACT_ERRNO(syscall));
 }
 
-PyObject * seccomplite_act_trace(PyObject *self, PyObject *args, PyObject *kwds) {
+PyObject * seccomplite_act_trace(PyObject *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames) {
   uint32_t syscall = 0;
   static char *kwlist[] = {"signal", NULL};
-  if (!PyArg_ParseTupleAndKeywords(args, kwds, "I", kwlist, &syscall)) {
+  if (!seccomplite_parse_vector(args, nargs, kwnames, "I:TRACE", kwlist, &syscall)) {
     return NULL;
   }
   
   return Py_BuildValue("I", SCMP_ACT_TRACE(syscall));
 }
 
-PyObject * seccomplite_resolve_syscall(PyObject *self, PyObject *args, PyObject *kwds) {
+PyObject * seccomplite_resolve_syscall(PyObject *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames) {
   PyObject *syscall = NULL;
   PyObject *arch = NULL;
   static char *kwlist[] = {"arch", "syscall", NULL};
-  if (!PyArg_ParseTupleAndKeywords(args, kwds, "OO", kwlist, &arch, &syscall)) {
+  if (!seccomplite_parse_vector(args, nargs, kwnames, "OO:resolve_syscall", kwlist, &arch, &syscall)) {
     return NULL;
   }
 
@@ -157,4 +236,132 @@ PyObject * seccomplite_resolve_syscall(PyObject *self, PyObject *args, PyObject
   else {
     return Py_BuildValue("i", result);
   }
-}
\ No newline at end of file
+}
+
+/**
+ * Convert a single argument, plain objects and exact ints are handled
+ * inline, everything else goes through PyArg_Parse for identical results
+ * @return True on success, false with exception set
+ */
+static int seccomplite_convert_unit(PyObject *value, const char *unit, void *target) {
+  if (unit[0] == 'O') {
+    *(PyObject **) target = value;
+    return 1;
+  }
+  else if (unit[0] == 'p') {
+    int truth = PyObject_IsTrue(value);
+    if (truth < 0) {
+      return 0;
+    }
+    *(int *) target = truth;
+    return 1;
+  }
+  else if (PyLong_CheckExact(value) && unit[0] == 'I') {
+    *(unsigned int *) target = (unsigned int) PyLong_AsUnsignedLongMask(value);
+    return !PyErr_Occurred();
+  }
+  else if (PyLong_CheckExact(value) && unit[0] == 'K') {
+    *(unsigned long long *) target = PyLong_AsUnsignedLongLongMask(value);
+    return !PyErr_Occurred();
+  }
+  else if (PyLong_CheckExact(value) && unit[0] == 'i') {
+    long number = PyLong_AsLong(value);
+    if (number >= INT_MIN && number <= INT_MAX && !(number == -1 && PyErr_Occurred())) {
+      *(int *) target = (int) number;
+      return 1;
+    }
+    PyErr_Clear();
+  }
+
+  return PyArg_Parse(value, unit, target);
+}
+
+int seccomplite_parse_vector(PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames, const char *format, char **kwlist, ...) {
+  // Split the format into conversion units
+  char units[SECCOMPLITE_VECTOR_MAX][3];
+  Py_ssize_t count = 0;
+  Py_ssize_t required = -1;
+  const char *name = "function";
+  const char *cursor = NULL;
+  for (cursor = format; *cursor; cursor++) {
+    if (*cursor == '|') {
+      required = count;
+      continue;
+    }
+    if (*cursor == ':') {
+      name = cursor + 1;
+      break;
+    }
+
+    units[count][0] = *cursor;
+    units[count][1] = cursor[1] == '*' ? *++cursor : '\0';
+    units[count][2] = '\0';
+    count++;
+  }
+  if (required < 0) {
+    required = count;
+  }
+
+  if (nargs > count) {
+    PyErr_Format(PyExc_TypeError, "%s() takes at most %zd arguments (%zd given)", name, count, nargs);
+    return 0;
+  }
+
+  // Positional arguments first, keywords fill the remaining slots
+  PyObject *values[SECCOMPLITE_VECTOR_MAX] = { NULL };
+  Py_ssize_t index = 0;
+  for (index = 0; index < nargs; index++) {
+    values[index] = args[index];
+  }
+
+  Py_ssize_t keywords = kwnames ? PyTuple_GET_SIZE(kwnames) : 0;
+  for (index = 0; index < keywords; index++) {
+    PyObject *key = PyTuple_GET_ITEM(kwnames, index);
+    Py_ssize_t slot = 0;
+    while (slot < count && PyUnicode_CompareWithASCIIString(key, kwlist[slot]) != 0) {
+      slot++;
+    }
+
+    if (slot == count) {
+      PyErr_Format(PyExc_TypeError, "'%U' is an invalid keyword argument for %s()", key, name);
+      return 0;
+    }
+    if (values[slot]) {
+      PyErr_Format(PyExc_TypeError, "argument for %s() given by name ('%s') and position (%zd)", name, kwlist[slot], slot + 1);
+      return 0;
+    }
+    values[slot] = args[nargs + index];
+  }
+
+  // Convert every given value with the single unit parser
+  Py_buffer *buffers[SECCOMPLITE_VECTOR_MAX];
+  int num_buffers = 0;
+  va_list targets;
+  va_start(targets, kwlist);
+  for (index = 0; index < count; index++) {
+    void *target = va_arg(targets, void *);
+    if (!values[index]) {
+      if (index < required) {
+        PyErr_Format(PyExc_TypeError, "%s() missing required argument '%s' (pos %zd)", name, kwlist[index], index + 1);
+        goto error;
+      }
+      continue;
+    }
+
+    if (!seccomplite_convert_unit(values[index], units[index], target)) {
+      goto error;
+    }
+    if (units[index][1] == '*') {
+      buffers[num_buffers++] = target;
+    }
+  }
+  va_end(targets);
+  return 1;
+
+error:
+  va_end(targets);
+  while (num_buffers > 0) {
+    PyBuffer_Release(buffers[--num_buffers]);
+  }
+  return 0;
+}
@@ -0,0 +1,970 @@
+/*
+ * Compile server submodule in seccomplite library
+ * Author: Michael Witt <m.witt@htw-berlin.de>
+ *
+ * The server thread runs without the GIL and hands every connection to a
+ * detached worker, which replays the policy record of the request into a
+ * fresh libseccomp context and compiles it exactly like Filter.compile()
+ * does.  Programs are cached by the digest of the record
+ * and the optimiser options, every reply passes a duplicate of the cached
+ * memfd so an eviction never closes a descriptor still being sent.
+ */
+
+#include <Python.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <seccomp.h>
+#include "inc/config.h"
+#include "inc/server.h"
+#include "inc/seccomplite.h"
+#include "inc/filter.h"
+#include "inc/program.h"
+#include "inc/policy.h"
+#include "inc/fanout.h"
+#include "inc/bpf.h"
+
+/**
+ * Options a request may ask for
+ */
+#define SERVER_OPTIONS (SECCOMPLITE_BPF_VERIFY | SECCOMPLITE_BPF_SHARE_BLOCKS)
+
+static PyObject * CompileServer_get_path(seccomplite_CompileServerObject *self, void *closure);
+static PyObject * CompileServer_get_running(seccomplite_CompileServerObject *self, void *closure);
+static PyObject * CompileServer_get_entries(seccomplite_CompileServerObject *self, void *closure);
+static PyObject * CompileServer_get_counter(seccomplite_CompileServerObject *self, void *closure);
+
+/**
+ * CompileServer type member and methods definitions
+ */
+static PyGetSetDef CompileServer_getset[] = {
+  {"path", (getter) CompileServer_get_path, NULL, "Path of the Unix socket", NULL},
+  {"running", (getter) CompileServer_get_running, NULL, "True between start and stop", NULL},
+  {"entries", (getter) CompileServer_get_entries, NULL, "Number of cached programs", NULL},
+  {"requests", (getter) CompileServer_get_counter, NULL, "Requests received", (void *) offsetof(seccomplite_CompileServerObject, _requests)},
+  {"hits", (getter) CompileServer_get_counter, NULL, "Requests and prewarmed filters found in the cache", (void *) offsetof(seccomplite_CompileServerObject, _hits)},
+  {"misses", (getter) CompileServer_get_counter, NULL, "Requests and prewarmed filters that were compiled", (void *) offsetof(seccomplite_CompileServerObject, _misses)},
+  {"errors", (getter) CompileServer_get_counter, NULL, "Malformed requests and policies that failed to compile", (void *) offsetof(seccomplite_CompileServerObject, _errors)},
+  { NULL } /* Sentinel */
+};
+
+static PyMethodDef CompileServer_methods[] = {
+  { "start", (PyCFunction)CompileServer_start, METH_NOARGS, "Start serving \nDescription:\n Bind the socket and start the server thread Every connection is served by a worker thread of its own so a stalled client does not hold up the others A stale socket left by a dead server is replaced a live one raises OSError" },
+  { "stop", (PyCFunction)CompileServer_stop, METH_NOARGS, "Stop the server thread wait for the workers and remove the socket the cache is kept" },
+  { "prewarm", (PyCFunction)CompileServer_prewarm, METH_FASTCALL | METH_KEYWORDS, "Compile filters into the cache \nArguments:\n filters Filter objects \nDescription:\n Compile every filter the way a request would and keep the program e.g for the policies of a host at boot Return the number of programs that were not cached yet" },
+  { "clear", (PyCFunction)CompileServer_clear, METH_NOARGS, "Drop all cached programs" },
+  { NULL } /* Sentinel */
+};
+
+/**
+ * CompileServer type slots definitions
+ */
+static PyType_Slot seccomplite_CompileServerTypeSlots[] = {
+  { Py_tp_methods, CompileServer_methods },
+  { Py_tp_getset, CompileServer_getset },
+  { Py_tp_init, CompileServer_init },
+  { Py_tp_new, CompileServer_new },
+  { Py_tp_dealloc, CompileServer_dealloc },
+  { Py_tp_repr, CompileServer_repr },
+  { 0, NULL }
+};
+
+/**
+ * CompileServer type specs
+ */
+PyType_Spec seccomplite_CompileServerTypeSpec = {
+  MODULE_NAME "." COMPILE_SERVER_TYPE_NAME,
+  sizeof (seccomplite_CompileServerObject),
+  0,
+  Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE,
+  seccomplite_CompileServerTypeSlots
+};
+
+/// Compilation and cache
+
+/**
+ * Compile a policy record the way Filter.compile() does
+ * @return 0 on success, negative errno on failure
+ */
+static int server_compile(const uint8_t *record, size_t len, int options, struct sock_filter **insns, unsigned int *num_insns, uint32_t *flags, int *nnp) {
+  scmp_filter_ctx ctx = NULL;
+  int rc = seccomplite_policy_replay(record, len, &ctx);
+  if (rc != 0) {
+    return rc < 0 ? rc : -EINVAL;
+  }
+
+  seccomplite_ctx_load_flags(ctx, flags, nnp);
+  if (seccomplite_policy_is_fanout(record, len) && seccomplite_fanout_groups(record, len) > 1) {
+    uint32_t badarch = SCMP_ACT_KILL;
+    seccomp_attr_get(ctx, SCMP_FLTATR_ACT_BADARCH, &badarch);
+    rc = seccomplite_fanout_compile(record, len, badarch, insns, num_insns);
+  }
+  else {
+    rc = seccomplite_ctx_export(ctx, insns, num_insns);
+  }
+  seccomp_release(ctx);
+
+  if (rc == 0 && options) {
+    struct sock_filter *optimized = NULL;
+    unsigned int optimized_len = 0;
+    seccomplite_BpfReport report;
+    int bpf_flags = SECCOMPLITE_BPF_VERIFY | (options & SECCOMPLITE_BPF_SHARE_BLOCKS);
+    rc = seccomplite_bpf_optimize(*insns, *num_insns, bpf_flags, &optimized, &optimized_len, &report);
+    free(*insns);
+    *insns = optimized;
+    *num_insns = optimized_len;
+  }
+
+  return rc < 0 ? rc : (rc > 0 ? -EINVAL : 0);
+}
+
+/**
+ * Store a program in a sealed memfd, see Program.to_memfd()
+ * @return The descriptor, negative errno on failure
+ */
+static int server_memfd(const struct sock_filter *insns, unsigned int len) {
+  int fd = memfd_create("seccomplite-program", MFD_ALLOW_SEALING | MFD_CLOEXEC);
+  if (fd < 0) {
+    return -errno;
+  }
+
+  if (seccomplite_write_all(fd, (const char *) insns, len * sizeof(struct sock_filter)) != 0 ||
+      fcntl(fd, F_ADD_SEALS, F_SEAL_WRITE | F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) != 0) {
+    int rc = -errno;
+    close(fd);
+    return rc;
+  }
+  return fd;
+}
+
+static void server_entry_free(seccomplite_ServerEntry *entry) {
+  close(entry->fd);
+  free(entry->record);
+  free(entry);
+}
+
+/**
+ * Find an entry and move it to the front, called with the lock held
+ */
+static seccomplite_ServerEntry * server_lookup(seccomplite_CompileServerObject *self, uint64_t digest, int options, const uint8_t *record, size_t len) {
+  seccomplite_ServerEntry **link = &self->_entries;
+  for (; *link; link = &(*link)->next) {
+    seccomplite_ServerEntry *entry = *link;
+    if (entry->digest == digest && entry->options == options &&
+        entry->record_len == len && memcmp(entry->record, record, len) == 0) {
+      *link = entry->next;
+      entry->next = self->_entries;
+      self->_entries = entry;
+      return entry;
+    }
+  }
+  return NULL;
+}
+
+/**
+ * Insert a new entry at the front and evict the least recently used ones,
+ * called with the lock held
+ */
+static void server_insert(seccomplite_CompileServerObject *self, seccomplite_ServerEntry *entry) {
+  entry->next = self->_entries;
+  self->_entries = entry;
+  self->_count++;
+
+  seccomplite_ServerEntry **link = &self->_entries;
+  unsigned int kept = 0;
+  while (*link && kept < self->_max_entries) {
+    link = &(*link)->next;
+    kept++;
+  }
+  while (*link) {
+    seccomplite_ServerEntry *evicted = *link;
+    *link = evicted->next;
+    server_entry_free(evicted);
+    self->_count--;
+  }
+}
+
+static void server_drop(seccomplite_CompileServerObject *self) {
+  pthread_mutex_lock(&self->_lock);
+  while (self->_entries) {
+    seccomplite_ServerEntry *entry = self->_entries;
+    self->_entries = entry->next;
+    server_entry_free(entry);
+  }
+  self->_count = 0;
+  pthread_mutex_unlock(&self->_lock);
+}
+
+/**
+ * Look up or compile the program of a record, does not need the GIL
+ * @param fd Receives a duplicate of the cached memfd
+ * @param compiled Set to 1 if the program was not cached yet
+ * @return 0 on success, negative errno on failure
+ */
+static int server_obtain(seccomplite_CompileServerObject *self, const uint8_t *record, size_t len, int options, int *fd, uint32_t *flags, int *nnp, int *compiled) {
+  uint64_t digest = seccomplite_policy_digest(record, len);
+  *compiled = 0;
+
+  pthread_mutex_lock(&self->_lock);
+  seccomplite_ServerEntry *entry = server_lookup(self, digest, options, record, len);
+  if (entry) {
+    __atomic_fetch_add(&self->_hits, 1, __ATOMIC_RELAXED);
+    *fd = fcntl(entry->fd, F_DUPFD_CLOEXEC, 0);
+    *flags = entry->flags;
+    *nnp = entry->nnp;
+    pthread_mutex_unlock(&self->_lock);
+    return *fd < 0 ? -errno : 0;
+  }
+  pthread_mutex_unlock(&self->_lock);
+
+  // Compiled without the lock, hits on other policies are not held up
+  __atomic_fetch_add(&self->_misses, 1, __ATOMIC_RELAXED);
+  entry = calloc(1, sizeof(seccomplite_ServerEntry));
+  if (!entry || !(entry->record = malloc(len ? len : 1))) {
+    free(entry);
+    return -ENOMEM;
+  }
+  memcpy(entry->record, record, len);
+  entry->record_len = len;
+  entry->digest = digest;
+  entry->options = options;
+
+  struct sock_filter *insns = NULL;
+  int rc = server_compile(record, len, options, &insns, &entry->len, &entry->flags, &entry->nnp);
+  entry->fd = rc == 0 ? server_memfd(insns, entry->len) : rc;
+  free(insns);
+  if (entry->fd < 0) {
+    rc = entry->fd;
+    free(entry->record);
+    free(entry);
+    return rc;
+  }
+
+  pthread_mutex_lock(&self->_lock);
+  seccomplite_ServerEntry *raced = server_lookup(self, digest, options, record, len);
+  if (raced) {
+    // Compiled twice at the same time, keep the first one
+    server_entry_free(entry);
+    entry = raced;
+  }
+  else {
+    server_insert(self, entry);
+    *compiled = 1;
+  }
+  *fd = fcntl(entry->fd, F_DUPFD_CLOEXEC, 0);
+  *flags = entry->flags;
+  *nnp = entry->nnp;
+  pthread_mutex_unlock(&self->_lock);
+  return *fd < 0 ? -errno : 0;
+}
+
+/// Wire protocol
+
+static int64_t server_now(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (int64_t) now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+/**
+ * Receive exactly size bytes before the deadline, a client trickling in
+ * its request can not keep a worker busy for longer
+ * @param wakeup Eventfd signalled on shutdown, cuts the request short
+ * @param deadline server_now() value the request must be complete by
+ * @return 0 on success, negative errno on failure, timeout, shutdown or
+ *         early end of stream
+ */
+static int server_recv(int fd, void *buffer, size_t size, int wakeup, int64_t deadline) {
+  char *data = buffer;
+  while (size > 0) {
+    struct pollfd fds[2] = {
+      { .fd = fd, .events = POLLIN },
+      { .fd = wakeup, .events = POLLIN }
+    };
+    int64_t left = deadline - server_now();
+    int ready = left > 0 ? poll(fds, 2, (int) left) : 0;
+    if (ready < 0 && errno == EINTR) {
+      continue;
+    }
+    else if (ready <= 0 || fds[1].revents) {
+      return ready < 0 ? -errno : -EAGAIN;
+    }
+
+    ssize_t got = recv(fd, data, size, MSG_DONTWAIT);
+    if (got < 0 && (errno == EINTR || errno == EAGAIN)) {
+      continue;
+    }
+    else if (got <= 0) {
+      return got < 0 ? -errno : -EPIPE;
+    }
+    data += got;
+    size -= got;
+  }
+  return 0;
+}
+
+/**
+ * Send exactly size bytes, a peer that went away does not raise SIGPIPE
+ * @return 0 on success, negative errno on failure
+ */
+static int server_send(int fd, const void *buffer, size_t size) {
+  const char *data = buffer;
+  while (size > 0) {
+    ssize_t sent = send(fd, data, size, MSG_NOSIGNAL);
+    if (sent < 0 && errno == EINTR) {
+      continue;
+    }
+    else if (sent < 0) {
+      return -errno;
+    }
+    data += sent;
+    size -= sent;
+  }
+  return 0;
+}
+
+static void server_timeout(int fd, int milliseconds) {
+  struct timeval timeout = { milliseconds / 1000, (milliseconds % 1000) * 1000 };
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+  setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+}
+
+/**
+ * Send a reply, the descriptor is passed along if not negative
+ */
+static int server_reply(int conn, const seccomplite_ServerReply *reply, int fd) {
+  struct iovec iov = { (void *) reply, sizeof(*reply) };
+  union {
+    char buffer[CMSG_SPACE(sizeof(int))];
+    struct cmsghdr align;
+  } control;
+  struct msghdr msg = { 0 };
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+
+  if (fd >= 0) {
+    memset(&control, 0, sizeof(control));
+    msg.msg_control = control.buffer;
+    msg.msg_controllen = sizeof(control.buffer);
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+  }
+
+  ssize_t sent = 0;
+  do {
+    sent = sendmsg(conn, &msg, MSG_NOSIGNAL);
+  } while (sent < 0 && errno == EINTR);
+  return sent == sizeof(*reply) ? 0 : -EPIPE;
+}
+
+/**
+ * Serve the single request of a connection
+ */
+static void server_handle(seccomplite_CompileServerObject *self, int conn) {
+  seccomplite_ServerRequest request;
+  seccomplite_ServerReply reply = { SECCOMPLITE_SERVER_MAGIC, 0, 0, 0, 0, 0, 0 };
+  uint8_t *record = NULL;
+  int fd = -1;
+
+  int64_t deadline = server_now() + SECCOMPLITE_SERVER_TIMEOUT;
+  server_timeout(conn, SECCOMPLITE_SERVER_TIMEOUT);
+  int rc = server_recv(conn, &request, sizeof(request), self->_wakeup, deadline);
+  if (rc == 0 && (request.magic != SECCOMPLITE_SERVER_MAGIC || request.version != SECCOMPLITE_SERVER_VERSION ||
+                  request.length > SECCOMPLITE_SERVER_MAX_RECORD || (request.options & ~SERVER_OPTIONS))) {
+    rc = -EPROTO;
+  }
+  else if (rc == 0 && !(record = malloc(request.length ? request.length : 1))) {
+    rc = -ENOMEM;
+  }
+  else if (rc == 0) {
+    rc = server_recv(conn, record, request.length, self->_wakeup, deadline);
+  }
+
+  if (rc == 0) {
+    __atomic_fetch_add(&self->_requests, 1, __ATOMIC_RELAXED);
+    reply.digest = seccomplite_policy_digest(record, request.length);
+    reply.options = request.options;
+    int compiled = 0;
+    int nnp = 0;
+    rc = server_obtain(self, record, request.length, request.options, &fd, &reply.flags, &nnp, &compiled);
+    reply.nnp = nnp;
+  }
+  free(record);
+
+  if (rc == 0) {
+    struct stat st;
+    reply.len = fstat(fd, &st) == 0 ? st.st_size / sizeof(struct sock_filter) : 0;
+  }
+  else {
+    __atomic_fetch_add(&self->_errors, 1, __ATOMIC_RELAXED);
+  }
+
+  // Requests cut short get no answer, the client falls back anyway
+  if (rc != -EPIPE && rc != -EAGAIN) {
+    reply.error = -rc;
+    server_reply(conn, &reply, fd);
+  }
+  if (fd >= 0) {
+    close(fd);
+  }
+}
+
+/**
+ * Connection handed to a worker
+ */
+typedef struct {
+  seccomplite_CompileServerObject *server;
+  int conn;
+} server_job;
+
+static void server_finish(seccomplite_CompileServerObject *self) {
+  pthread_mutex_lock(&self->_lock);
+  self->_workers--;
+  pthread_cond_broadcast(&self->_idle);
+  pthread_mutex_unlock(&self->_lock);
+}
+
+static void * server_worker(void *arg) {
+  server_job *job = arg;
+  server_handle(job->server, job->conn);
+  close(job->conn);
+  server_finish(job->server);
+  free(job);
+  return NULL;
+}
+
+/**
+ * Serve a connection on a detached worker, waits for a free slot first
+ */
+static void server_dispatch(seccomplite_CompileServerObject *self, int conn) {
+  pthread_mutex_lock(&self->_lock);
+  while (self->_workers >= SECCOMPLITE_SERVER_WORKERS) {
+    pthread_cond_wait(&self->_idle, &self->_lock);
+  }
+  self->_workers++;
+  pthread_mutex_unlock(&self->_lock);
+
+  pthread_attr_t attr;
+  pthread_t thread;
+  server_job *job = malloc(sizeof(server_job));
+  int started = 0;
+  if (job) {
+    job->server = self;
+    job->conn = conn;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    started = pthread_create(&thread, &attr, server_worker, job) == 0;
+    pthread_attr_destroy(&attr);
+  }
+
+  // Out of threads, serve the connection here
+  if (!started) {
+    free(job);
+    server_handle(self, conn);
+    close(conn);
+    server_finish(self);
+  }
+}
+
+static void * server_thread(void *arg) {
+  seccomplite_CompileServerObject *self = arg;
+  struct pollfd fds[2] = {
+    { .fd = self->_socket, .events = POLLIN },
+    { .fd = self->_wakeup, .events = POLLIN }
+  };
+
+  for (;;) {
+    if (poll(fds, 2, -1) < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      break;
+    }
+    else if (fds[1].revents) {
+      break;
+    }
+    else if (!(fds[0].revents & POLLIN)) {
+      continue;
+    }
+
+    int conn = accept4(self->_socket, NULL, NULL, SOCK_CLOEXEC);
+    if (conn >= 0) {
+      server_dispatch(self, conn);
+    }
+  }
+  return NULL;
+}
+
+/// Client side
+
+int seccomplite_server_address(PyObject *path, struct sockaddr_un *address) {
+  PyObject *encoded = NULL;
+  if (!PyUnicode_FSConverter(path, &encoded)) {
+    return -1;
+  }
+
+  memset(address, 0, sizeof(*address));
+  address->sun_family = AF_UNIX;
+  int valid = PyBytes_GET_SIZE(encoded) > 0 && (size_t) PyBytes_GET_SIZE(encoded) < sizeof(address->sun_path);
+  if (valid) {
+    memcpy(address->sun_path, PyBytes_AS_STRING(encoded), PyBytes_GET_SIZE(encoded));
+  }
+  Py_DECREF(encoded);
+  if (!valid) {
+    PyErr_SetString(PyExc_ValueError, "Socket path is empty or too long");
+    return -1;
+  }
+  return 0;
+}
+
+int seccomplite_server_fetch(const struct sockaddr_un *address, const uint8_t *record, size_t len, int options, int *fd, uint32_t *flags, int *nnp) {
+  if (len > SECCOMPLITE_SERVER_MAX_RECORD) {
+    return -E2BIG;
+  }
+
+  int conn = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (conn < 0) {
+    return -errno;
+  }
+  server_timeout(conn, SECCOMPLITE_CLIENT_TIMEOUT);
+
+  // Whoever serves the socket decides the policy, only trust root or ourselves
+  struct ucred peer;
+  socklen_t peer_len = sizeof(peer);
+  int rc = connect(conn, (const struct sockaddr *) address, sizeof(*address)) == 0 ? 0 : -errno;
+  if (rc == 0 && getsockopt(conn, SOL_SOCKET, SO_PEERCRED, &peer, &peer_len) != 0) {
+    rc = -errno;
+  }
+  else if (rc == 0 && peer.uid != 0 && peer.uid != geteuid()) {
+    rc = -EPERM;
+  }
+
+  seccomplite_ServerRequest request = { SECCOMPLITE_SERVER_MAGIC, SECCOMPLITE_SERVER_VERSION, (uint16_t) options, (uint32_t) len };
+  rc = rc ? rc : server_send(conn, &request, sizeof(request));
+  rc = rc ? rc : server_send(conn, record, len);
+
+  seccomplite_ServerReply reply;
+  struct iovec iov = { &reply, sizeof(reply) };
+  union {
+    char buffer[CMSG_SPACE(sizeof(int))];
+    struct cmsghdr align;
+  } control;
+  struct msghdr msg = { 0 };
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control.buffer;
+  msg.msg_controllen = sizeof(control.buffer);
+
+  ssize_t got = -1;
+  if (rc == 0) {
+    do {
+      got = recvmsg(conn, &msg, MSG_CMSG_CLOEXEC | MSG_WAITALL);
+    } while (got < 0 && errno == EINTR);
+    rc = got < 0 ? -errno : 0;
+  }
+  close(conn);
+
+  *fd = -1;
+  struct cmsghdr *cmsg = rc == 0 ? CMSG_FIRSTHDR(&msg) : NULL;
+  if (cmsg && cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS && cmsg->cmsg_len == CMSG_LEN(sizeof(int))) {
+    memcpy(fd, CMSG_DATA(cmsg), sizeof(int));
+  }
+
+  if (rc == 0 && (got != sizeof(reply) || reply.magic != SECCOMPLITE_SERVER_MAGIC || (msg.msg_flags & MSG_CTRUNC))) {
+    rc = -EPROTO;
+  }
+  else if (rc == 0 && reply.error != 0) {
+    rc = -reply.error;
+  }
+  else if (rc == 0 && (reply.digest != seccomplite_policy_digest(record, len) || reply.options != (uint32_t) options)) {
+    // Not the program of this request
+    rc = -EPROTO;
+  }
+  else if (rc == 0) {
+    struct stat st;
+    if (*fd < 0 || reply.len == 0 || fstat(*fd, &st) != 0 || st.st_size != (off_t) reply.len * (off_t) sizeof(struct sock_filter)) {
+      rc = -EPROTO;
+    }
+  }
+
+  if (rc != 0) {
+    if (*fd >= 0) {
+      close(*fd);
+    }
+    *fd = -1;
+    return rc;
+  }
+
+  *flags = reply.flags;
+  *nnp = reply.nnp != 0;
+  return 0;
+}
+
+/// CompileServer type methods
+
+/**
+ * Stop the server thread and remove the socket
+ */
+static void server_shutdown(seccomplite_CompileServerObject *self) {
+  if (!self->_running) {
+    return;
+  }
+
+  uint64_t one = 1;
+  if (write(self->_wakeup, &one, sizeof(one)) != sizeof(one)) {
+    // The eventfd can only overflow, the thread is woken up anyway
+  }
+  // Workers still use the object, the wakeup cuts their requests short
+  Py_BEGIN_ALLOW_THREADS
+  pthread_join(self->_thread, NULL);
+  pthread_mutex_lock(&self->_lock);
+  while (self->_workers > 0) {
+    pthread_cond_wait(&self->_idle, &self->_lock);
+  }
+  pthread_mutex_unlock(&self->_lock);
+  Py_END_ALLOW_THREADS
+
+  struct sockaddr_un address;
+  socklen_t address_len = sizeof(address);
+  if (getsockname(self->_socket, (struct sockaddr *) &address, &address_len) == 0 && address.sun_path[0]) {
+    unlink(address.sun_path);
+  }
+  close(self->_socket);
+  close(self->_wakeup);
+  self->_socket = -1;
+  self->_wakeup = -1;
+  self->_running = 0;
+}
+
+void CompileServer_dealloc(seccomplite_CompileServerObject *self) {
+  server_shutdown(self);
+  server_drop(self);
+  pthread_cond_destroy(&self->_idle);
+  pthread_mutex_destroy(&self->_lock);
+  Py_XDECREF(self->_path);
+  Py_TYPE(self)->tp_free((PyObject*) self);
+}
+
+PyObject * CompileServer_new(PyTypeObject *type, PyObject *args, PyObject *kwds) {
+  seccomplite_CompileServerObject *self;
+
+  self = (seccomplite_CompileServerObject *) type->tp_alloc(type, 0);
+  if (self != NULL) {
+    self->_path = NULL;
+    self->_mode = 0600;
+    self->_max_entries = SECCOMPLITE_SERVER_ENTRIES;
+    self->_socket = -1;
+    self->_wakeup = -1;
+    self->_running = 0;
+    pthread_mutex_init(&self->_lock, NULL);
+    pthread_cond_init(&self->_idle, NULL);
+    self->_workers = 0;
+    self->_entries = NULL;
+    self->_count = 0;
+    self->_requests = 0;
+    self->_hits = 0;
+    self->_misses = 0;
+    self->_errors = 0;
+  }
+
+  return (PyObject *) self;
+}
+
+/**
+ * Take over the constructor arguments
+ * @return 0 on success, -1 with exception set
+ */
+static int CompileServer_setup(seccomplite_CompileServerObject *self, PyObject *path, int mode, int max_entries) {
+  if (self->_running) {
+    PyErr_SetString(PyExc_ValueError, "Compile server is already running");
+    return -1;
+  }
+  else if (mode < 0 || mode > 07777) {
+    PyErr_SetString(PyExc_ValueError, "Mode must be a permission bit mask");
+    return -1;
+  }
+  else if (max_entries < 1) {
+    PyErr_SetString(PyExc_ValueError, "At least one program must be cached");
+    return -1;
+  }
+
+  PyObject *encoded = NULL;
+  if (!PyUnicode_FSConverter(path, &encoded)) {
+    return -1;
+  }
+
+  struct sockaddr_un address;
+  Py_ssize_t size = PyBytes_GET_SIZE(encoded);
+  Py_DECREF(encoded);
+  if (size == 0 || (size_t) size >= sizeof(address.sun_path)) {
+    PyErr_SetString(PyExc_ValueError, "Socket path is empty or too long");
+    return -1;
+  }
+
+  Py_INCREF(path);
+  Py_XSETREF(self->_path, path);
+  self->_mode = mode;
+  self->_max_entries = max_entries;
+  return 0;
+}
+
+/**
+ * Constructor parameters
+ */
+static char *CompileServer_kwlist[] = {"path", "mode", "max_entries", NULL};
+
+int CompileServer_init(seccomplite_CompileServerObject *self, PyObject *args, PyObject *kwds) {
+  PyObject *path = NULL;
+  int mode = 0600;
+  int max_entries = SECCOMPLITE_SERVER_ENTRIES;
+  if (!PyArg_ParseTupleAndKeywords(args, kwds, "O|ii", CompileServer_kwlist, &path, &mode, &max_entries)) {
+    return -1;
+  }
+
+  return CompileServer_setup(self, path, mode, max_entries);
+}
+
+PyObject * CompileServer_vectorcall(PyObject *type, PyObject *const *args, size_t nargsf, PyObject *kwnames) {
+  PyObject *path = NULL;
+  int mode = 0600;
+  int max_entries = SECCOMPLITE_SERVER_ENTRIES;
+  if (!seccomplite_parse_vector(args, PyVectorcall_NARGS(nargsf), kwnames, "O|ii:" COMPILE_SERVER_TYPE_NAME, CompileServer_kwlist, &path, &mode, &max_entries)) {
+    return NULL;
+  }
+
+  seccomplite_CompileServerObject *self = (seccomplite_CompileServerObject *) CompileServer_new((PyTypeObject *) type, NULL, NULL);
+  if (self && CompileServer_setup(self, path, mode, max_entries) != 0) {
+    Py_CLEAR(self);
+  }
+  return (PyObject *) self;
+}
+
+/**
+ * Bind the socket, a socket file nobody listens on any more is replaced
+ * @return The listening socket, -1 with errno set
+ */
+static int server_bind(const struct sockaddr_un *address, int mode) {
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0) {
+    return -1;
+  }
+
+  int rc = bind(fd, (const struct sockaddr *) address, sizeof(*address));
+  if (rc != 0 && errno == EADDRINUSE) {
+    int probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    int stale = probe >= 0 && connect(probe, (const struct sockaddr *) address, sizeof(*address)) != 0 && errno == ECONNREFUSED;
+    if (probe >= 0) {
+      close(probe);
+    }
+    errno = EADDRINUSE;
+    if (stale && unlink(address->sun_path) == 0) {
+      rc = bind(fd, (const struct sockaddr *) address, sizeof(*address));
+    }
+  }
+
+  if (rc != 0 || chmod(address->sun_path, mode) != 0 || listen(fd, SOMAXCONN) != 0) {
+    int error = errno;
+    if (rc == 0) {
+      unlink(address->sun_path);
+    }
+    close(fd);
+    errno = error;
+    return -1;
+  }
+  return fd;
+}
+
+PyObject * CompileServer_start(seccomplite_CompileServerObject *self) {
+  if (self->_running) {
+    PyErr_SetString(PyExc_ValueError, "Compile server is already running");
+    return NULL;
+  }
+  else if (!self->_path) {
+    PyErr_SetString(PyExc_RuntimeError, "Compile server is not initialized");
+    return NULL;
+  }
+
+  PyObject *encoded = NULL;
+  if (!PyUnicode_FSConverter(self->_path, &encoded)) {
+    return NULL;
+  }
+
+  struct sockaddr_un address;
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  strncpy(address.sun_path, PyBytes_AS_STRING(encoded), sizeof(address.sun_path) - 1);
+  Py_DECREF(encoded);
+
+  self->_socket = server_bind(&address, self->_mode);
+  self->_wakeup = self->_socket < 0 ? -1 : eventfd(0, EFD_CLOEXEC);
+  if (self->_wakeup < 0) {
+    PyErr_SetFromErrnoWithFilenameObject(PyExc_OSError, self->_path);
+    if (self->_socket >= 0) {
+      unlink(address.sun_path);
+      close(self->_socket);
+    }
+    self->_socket = -1;
+    return NULL;
+  }
+
+  int rc = pthread_create(&self->_thread, NULL, server_thread, self);
+  if (rc != 0) {
+    unlink(address.sun_path);
+    close(self->_socket);
+    close(self->_wakeup);
+    self->_socket = -1;
+    self->_wakeup = -1;
+    errno = rc;
+    return PyErr_SetFromErrno(PyExc_OSError);
+  }
+
+  self->_running = 1;
+  Py_RETURN_NONE;
+}
+
+PyObject * CompileServer_stop(seccomplite_CompileServerObject *self) {
+  server_shutdown(self);
+  Py_RETURN_NONE;
+}
+
+PyObject * CompileServer_prewarm(seccomplite_CompileServerObject *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames) {
+  PyObject *filters = NULL;
+  static char *kwlist[] = {"filters", NULL};
+  if (!seccomplite_parse_vector(args, nargs, kwnames, "O:prewarm", kwlist, &filters)) {
+    return NULL;
+  }
+
+  PyObject *sequence = PySequence_Fast(filters, "Filters must be a sequence of " FILTER_TYPE_NAME " objects");
+  if (!sequence) {
+    return NULL;
+  }
+
+  PyObject *seccomplite = PyState_FindModule(&SeccompLiteModule);
+  PyObject *type = PyDict_GetItemString(PyModule_GetDict(seccomplite), FILTER_TYPE_NAME);
+  Py_ssize_t count = PySequence_Fast_GET_SIZE(sequence);
+  Py_ssize_t index = 0;
+  long compiled_total = 0;
+  for (index = 0; index < count; index++) {
+    PyObject *item = PySequence_Fast_GET_ITEM(sequence, index);
+    if (PyObject_IsInstance(item, type) != 1) {
+      PyErr_SetString(PyExc_TypeError, "Filters must be a sequence of " FILTER_TYPE_NAME " objects");
+      break;
+    }
+
+    seccomplite_FilterObject *filter = (seccomplite_FilterObject *) item;
+    if (filter->_frozen || !filter->_ctx) {
+      PyErr_SetString(PyExc_ValueError, "Frozen filters can not be prewarmed");
+      break;
+    }
+    else if (filter->_placeholders && PyList_GET_SIZE(filter->_placeholders) > 0) {
+      PyErr_SetString(PyExc_ValueError, "Filter contains placeholders, use instantiate()");
+      break;
+    }
+
+    // The record may change while the GIL is released
+    size_t len = filter->_policy.len;
+    uint8_t *record = malloc(len ? len : 1);
+    if (!record) {
+      PyErr_NoMemory();
+      break;
+    }
+    memcpy(record, filter->_policy.data, len);
+
+    int options = Filter_program_options(filter);
+    int fd = -1;
+    uint32_t flags = 0;
+    int nnp = 0;
+    int compiled = 0;
+    int rc = 0;
+    Py_BEGIN_ALLOW_THREADS
+    rc = server_obtain(self, record, len, options, &fd, &flags, &nnp, &compiled);
+    Py_END_ALLOW_THREADS
+    free(record);
+
+    if (rc == -ENOMEM) {
+      PyErr_NoMemory();
+      break;
+    }
+    else if (rc != 0) {
+      PyErr_SetString(PyExc_RuntimeError, "Library error (errno != 0)");
+      break;
+    }
+    close(fd);
+    compiled_total += compiled;
+  }
+
+  Py_DECREF(sequence);
+  if (index < count) {
+    return NULL;
+  }
+  return PyLong_FromLong(compiled_total);
+}
+
+PyObject * CompileServer_clear(seccomplite_CompileServerObject *self) {
+  Py_BEGIN_ALLOW_THREADS
+  server_drop(self);
+  Py_END_ALLOW_THREADS
+  Py_RETURN_NONE;
+}
+
+static PyObject * CompileServer_get_path(seccomplite_CompileServerObject *self, void *closure) {
+  PyObject *path = self->_path ? self->_path : Py_None;
+  Py_INCREF(path);
+  return path;
+}
+
+static PyObject * CompileServer_get_running(seccomplite_CompileServerObject *self, void *closure) {
+  return PyBool_FromLong(self->_running);
+}
+
+static PyObject * CompileServer_get_entries(seccomplite_CompileServerObject *self, void *closure) {
+  pthread_mutex_lock(&self->_lock);
+  unsigned int count = self->_count;
+  pthread_mutex_unlock(&self->_lock);
+  return PyLong_FromUnsignedLong(count);
+}
+
+static PyObject * CompileServer_get_counter(seccomplite_CompileServerObject *self, void *closure) {
+  unsigned long long *counter = (unsigned long long *) ((char *) self + (size_t) closure);
+  return PyLong_FromUnsignedLongLong(__atomic_load_n(counter, __ATOMIC_RELAXED));
+}
+
+PyObject * CompileServer_repr(seccomplite_CompileServerObject *self) {
+  return PyUnicode_FromFormat("%s(%R)", COMPILE_SERVER_TYPE_NAME, self->_path ? self->_path : Py_None);
+}
+
+PyTypeObject * CompileServer_build(void) {
+  // Ready the type
+  PyObject *type = PyType_FromSpec(&seccomplite_CompileServerTypeSpec);
+  PyTypeObject *result = (PyTypeObject *) type;
+
+  if (!type || PyType_Ready(result) < 0) {
+    Py_XDECREF(type);
+    return NULL;
+  }
+
+#if PY_VERSION_HEX >= 0x03090000
+  // Calling the type skips the argument tuple of tp_new and tp_init
+  result->tp_vectorcall = (vectorcallfunc) CompileServer_vectorcall;
+#endif
+  return result;
+}
+
+int PyObject_IsCompileServer(PyObject *o) {
+  PyObject *seccomplite = PyState_FindModule(&SeccompLiteModule);
+  PyObject *type = PyDict_GetItemString(PyModule_GetDict(seccomplite), COMPILE_SERVER_TYPE_NAME);
+  return PyObject_IsInstance(o, type) == 1;
+}
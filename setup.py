@@ -5,10 +5,18 @@
 # Author: Michael Witt <m.witt@htw-berlin.de>
 # 
 from distutils.core import setup, Extension
+from distutils.command.build_ext import build_ext
+from distutils.errors import DistutilsExecError, DistutilsOptionError
 
 # To use a consistent encoding
 from codecs import open
 from os import path
+import json
+import os
+import re
+import struct
+import subprocess
+import sys
 
 pwd = path.abspath(path.dirname(__file__))
 
@@ -34,7 +42,104 @@ seccomp_lite_module = Extension(
         ('DEVELOP_VERSION', '"{}"'.format(DEVELOP_VERSION)),
         ('MODULE_DESCRIPTION', '"{}"'.format(MODULE_DESCRIPTION))],
     libraries=['seccomp'],
-    sources=['filter.c', 'arch.c', 'attr.c', 'arg.c', 'exported_symbols.c', 'seccomplite.c'])
+    sources=['filter.c', 'arch.c', 'attr.c', 'arg.c', 'program.c', 'placeholder.c', 'policy.c', 'registry.c', 'fanout.c', 'split.c', 'bpf.c', 'stack.c', 'simplify.c', 'ruleset.c', 'builtin.c', 'profile.c', 'stats.c', 'diff.c', 'broker.c', 'recorder.c', 'shadow.c', 'server.c', 'exported_symbols.c', 'seccomplite.c'])
+
+# Compiles the policy files with the freshly built extension, this runs in
+# a child process so the extension can be rebuilt afterwards.  A policy file
+# is a python script that assigns a Filter or Program to `policy`.
+POLICY_COMPILER = """
+import json, runpy, sys
+import seccomplite
+result = []
+for name, file in json.loads(sys.argv[1]):
+    policy = runpy.run_path(file, init_globals={'seccomplite': seccomplite}).get('policy')
+    if isinstance(policy, seccomplite.Filter):
+        policy = policy.compile()
+    if not isinstance(policy, seccomplite.Program):
+        sys.exit('{}: policy must be a seccomplite.Filter or Program'.format(file))
+    result.append([name, policy.tobytes().hex(), policy.flags, policy.nnp])
+json.dump(result, sys.stdout)
+"""
+
+
+# Instructions as written by Program.tobytes()
+struct_sock_filter = struct.Struct('=HBBI')
+
+
+class build_ext_policies(build_ext):
+    """
+    build_ext that embeds fixed policies into the extension.  The policies
+    are compiled by a first build of the extension, exactly as
+    Filter.compile() does at runtime, and the generated BPF is compiled in
+    as static data exposed through seccomplite.builtin_policies.
+    """
+
+    user_options = build_ext.user_options + [
+        ('policies=', None,
+         'comma separated name=file list of policies to embed '
+         '[default: $SECCOMPLITE_POLICIES]'),
+    ]
+
+    def initialize_options(self):
+        build_ext.initialize_options(self)
+        self.policies = None
+
+    def finalize_options(self):
+        build_ext.finalize_options(self)
+        if self.policies is None:
+            self.policies = os.environ.get('SECCOMPLITE_POLICIES', '')
+
+        policies = []
+        for entry in filter(None, (item.strip() for item in self.policies.split(','))):
+            name, _, file = entry.partition('=')
+            if not re.match(r'^[A-Za-z_][A-Za-z0-9_.-]*$', name) or not file:
+                raise DistutilsOptionError("invalid policy '{}', expected name=file".format(entry))
+            if not path.isfile(file):
+                raise DistutilsOptionError("policy file '{}' does not exist".format(file))
+            policies.append((name, path.abspath(file)))
+        self.policies = policies
+
+    def run(self):
+        build_ext.run(self)
+        if not self.policies:
+            return
+
+        # Compile the policies with the extension we just built
+        env = dict(os.environ)
+        env['PYTHONPATH'] = os.pathsep.join(
+            filter(None, [path.dirname(path.abspath(self.get_ext_fullpath(MODULE_NAME))), env.get('PYTHONPATH')]))
+        child = subprocess.run([sys.executable, '-c', POLICY_COMPILER, json.dumps(self.policies)],
+                               env=env, stdout=subprocess.PIPE)
+        if child.returncode != 0:
+            raise DistutilsExecError('compiling the builtin policies failed')
+
+        # Generate the policy table included by builtin.c
+        lines = ['/* Generated by setup.py build_ext from the given policies, do not edit */', '']
+        table = []
+        for index, (name, program, flags, nnp) in enumerate(json.loads(child.stdout)):
+            data = bytes.fromhex(program)
+            lines.append('static const struct sock_filter builtin_policy_{}[] = {{'.format(index))
+            for offset in range(0, len(data), 8):
+                code, jt, jf, k = struct_sock_filter.unpack_from(data, offset)
+                lines.append('  {{ 0x{:04x}, {}, {}, 0x{:08x} }},'.format(code, jt, jf, k))
+            lines.extend(['};', ''])
+            table.append('  {{ "{}", builtin_policy_{}, {}, 0x{:x}, {} }},'.format(
+                name, index, len(data) // 8, flags, int(nnp)))
+        lines.append('static const seccomplite_BuiltinPolicy builtin_policies[] = {')
+        lines.extend(table)
+        lines.extend(['  { NULL, NULL, 0, 0, 0 }', '};', ''])
+
+        self.mkpath(self.build_temp)
+        generated = path.abspath(path.join(self.build_temp, 'seccomplite_policies.h'))
+        with open(generated, 'w', encoding='utf-8') as f:
+            f.write('\n'.join(lines))
+
+        # Rebuild with the table compiled in
+        for extension in self.extensions:
+            extension.define_macros.append(('SECCOMPLITE_BUILTIN_POLICIES', '"{}"'.format(generated)))
+        self.force = True
+        self.build_extensions()
+
 
 setup(
     name=MODULE_NAME,
@@ -81,6 +186,9 @@ setup(
     # Exported modules
     ext_modules=[seccomp_lite_module],
 
+    # Policies given with build_ext --policies are embedded
+    cmdclass={'build_ext': build_ext_policies},
+
     # If there are data files included in your packages that need to be
     # installed, specify them here.  If using Python 2.6 or less, then these
     # have to be included in MANIFEST.in as well.
@@ -0,0 +1,332 @@
+/*
+ * Shadow mode in seccomplite library
+ * Author: Michael Witt <m.witt@htw-berlin.de>
+ *
+ * Only would-be violations reach the listener, allowed syscalls never
+ * leave the kernel.  A violation costs the target one round trip to the
+ * listener plus a run of the original program to tell the action.  The
+ * counters are guarded by a mutex the report takes only briefly.
+ */
+
+#include <Python.h>
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <seccomp.h>
+#include <linux/seccomp.h>
+#include "inc/bpf.h"
+#include "inc/shadow.h"
+
+/**
+ * Most frequent values of one argument, further values count as other
+ */
+typedef struct {
+  uint64_t values[SECCOMPLITE_SHADOW_VALUES];
+  uint64_t counts[SECCOMPLITE_SHADOW_VALUES];
+  uint64_t other;
+} shadow_arg;
+
+typedef struct {
+  int used;
+  uint32_t arch;
+  int nr;
+  uint32_t action;
+  uint64_t count;
+  shadow_arg args[6];
+} shadow_entry;
+
+struct seccomplite_Shadow {
+  int refs;
+  pthread_mutex_t lock;
+  pthread_cond_t ready;
+  int attached;
+  int listener;
+  struct sock_filter *insns;
+  unsigned int len;
+  uint64_t violations;
+  uint64_t dropped;
+  shadow_entry entries[SECCOMPLITE_SHADOW_SYSCALLS];
+};
+
+struct sock_filter * seccomplite_shadow_rewrite(const struct sock_filter *insns, unsigned int len, uint32_t action) {
+  struct sock_filter *copy = malloc((len ? len : 1) * sizeof(struct sock_filter));
+  if (!copy) {
+    return NULL;
+  }
+
+  unsigned int pc = 0;
+  memcpy(copy, insns, len * sizeof(struct sock_filter));
+  for (pc = 0; pc < len; pc++) {
+    uint32_t verdict = copy[pc].k & SECCOMP_RET_ACTION_FULL;
+    if (copy[pc].code == (BPF_RET | BPF_K) && verdict != SECCOMP_RET_ALLOW && verdict != SECCOMP_RET_LOG) {
+      copy[pc].k = action;
+    }
+  }
+  return copy;
+}
+
+void seccomplite_shadow_release(seccomplite_Shadow *shadow) {
+  if (__atomic_sub_fetch(&shadow->refs, 1, __ATOMIC_ACQ_REL) == 0) {
+    pthread_mutex_destroy(&shadow->lock);
+    pthread_cond_destroy(&shadow->ready);
+    free(shadow->insns);
+    free(shadow);
+  }
+}
+
+/**
+ * Count one violation, called with the lock held
+ */
+static void shadow_count(seccomplite_Shadow *shadow, const struct seccomp_data *data, uint32_t action) {
+  unsigned int slot = ((data->arch * 31u) ^ ((uint32_t) data->nr * 131u) ^ action) % SECCOMPLITE_SHADOW_SYSCALLS;
+  unsigned int probe = 0;
+  shadow_entry *entry = NULL;
+  shadow->violations++;
+  for (probe = 0; probe < SECCOMPLITE_SHADOW_SYSCALLS; probe++) {
+    entry = &shadow->entries[(slot + probe) % SECCOMPLITE_SHADOW_SYSCALLS];
+    if (!entry->used || (entry->arch == data->arch && entry->nr == data->nr && entry->action == action)) {
+      break;
+    }
+  }
+
+  if (probe == SECCOMPLITE_SHADOW_SYSCALLS) {
+    shadow->dropped++;
+    return;
+  }
+  else if (!entry->used) {
+    entry->used = 1;
+    entry->arch = data->arch;
+    entry->nr = data->nr;
+    entry->action = action;
+  }
+
+  entry->count++;
+  unsigned int arg = 0;
+  for (arg = 0; arg < 6; arg++) {
+    shadow_arg *counter = &entry->args[arg];
+    unsigned int index = 0;
+    for (index = 0; index < SECCOMPLITE_SHADOW_VALUES; index++) {
+      if (counter->counts[index] == 0) {
+        counter->values[index] = data->args[arg];
+      }
+      if (counter->values[index] == data->args[arg]) {
+        counter->counts[index]++;
+        break;
+      }
+    }
+    if (index == SECCOMPLITE_SHADOW_VALUES) {
+      counter->other++;
+    }
+  }
+}
+
+static void * shadow_thread(void *arg) {
+  seccomplite_Shadow *shadow = arg;
+  struct seccomp_notif *req = NULL;
+  struct seccomp_notif_resp *resp = NULL;
+
+  // Signals are for the threads running Python
+  sigset_t all;
+  sigfillset(&all);
+  pthread_sigmask(SIG_BLOCK, &all, NULL);
+
+  pthread_mutex_lock(&shadow->lock);
+  while (!shadow->attached) {
+    pthread_cond_wait(&shadow->ready, &shadow->lock);
+  }
+  int listener = shadow->listener;
+  pthread_mutex_unlock(&shadow->lock);
+
+  if (listener >= 0 && seccomp_notify_alloc(&req, &resp) == 0) {
+    struct pollfd fds = { .fd = listener, .events = POLLIN };
+    for (;;) {
+      if (poll(&fds, 1, -1) < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        break;
+      }
+      else if (!(fds.revents & POLLIN)) {
+        // No task uses the filter any more
+        break;
+      }
+
+      memset(req, 0, sizeof(*req));
+      if (seccomp_notify_receive(listener, req) != 0) {
+        continue;
+      }
+
+      // Counted before the answer, a report after the syscall includes it
+      uint32_t action = SECCOMP_RET_KILL_PROCESS;
+      seccomplite_bpf_run(shadow->insns, shadow->len, &req->data, &action, NULL);
+      pthread_mutex_lock(&shadow->lock);
+      shadow_count(shadow, &req->data, action);
+      pthread_mutex_unlock(&shadow->lock);
+
+      resp->id = req->id;
+      resp->val = 0;
+      resp->error = 0;
+      resp->flags = SECCOMP_USER_NOTIF_FLAG_CONTINUE;
+      seccomp_notify_respond(listener, resp);
+    }
+    seccomp_notify_free(req, resp);
+  }
+
+  if (listener >= 0) {
+    close(listener);
+  }
+  seccomplite_shadow_release(shadow);
+  return NULL;
+}
+
+seccomplite_Shadow * seccomplite_shadow_start(const struct sock_filter *insns, unsigned int len) {
+  seccomplite_Shadow *shadow = calloc(1, sizeof(seccomplite_Shadow));
+  if (!shadow || !(shadow->insns = malloc((len ? len : 1) * sizeof(struct sock_filter)))) {
+    free(shadow);
+    errno = ENOMEM;
+    return NULL;
+  }
+
+  memcpy(shadow->insns, insns, len * sizeof(struct sock_filter));
+  shadow->len = len;
+  shadow->listener = -1;
+  shadow->refs = 2;
+  pthread_mutex_init(&shadow->lock, NULL);
+  pthread_cond_init(&shadow->ready, NULL);
+
+  pthread_t thread;
+  pthread_attr_t attr;
+  pthread_attr_init(&attr);
+  pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+  int rc = pthread_create(&thread, &attr, shadow_thread, shadow);
+  pthread_attr_destroy(&attr);
+  if (rc != 0) {
+    shadow->refs = 1;
+    seccomplite_shadow_release(shadow);
+    errno = rc;
+    return NULL;
+  }
+
+  return shadow;
+}
+
+void seccomplite_shadow_attach(seccomplite_Shadow *shadow, int listener) {
+  pthread_mutex_lock(&shadow->lock);
+  shadow->listener = listener;
+  shadow->attached = 1;
+  pthread_cond_signal(&shadow->ready);
+  pthread_mutex_unlock(&shadow->lock);
+}
+
+/**
+ * Build the dict of one argument, values beyond the tracked ones are
+ * counted under None
+ * @return New reference, NULL on error
+ */
+static PyObject * shadow_arg_values(const shadow_arg *counter) {
+  PyObject *values = PyDict_New();
+  unsigned int index = 0;
+  for (index = 0; values && index < SECCOMPLITE_SHADOW_VALUES && counter->counts[index]; index++) {
+    PyObject *key = PyLong_FromUnsignedLongLong(counter->values[index]);
+    PyObject *count = PyLong_FromUnsignedLongLong(counter->counts[index]);
+    if (!key || !count || PyDict_SetItem(values, key, count) != 0) {
+      Py_CLEAR(values);
+    }
+    Py_XDECREF(key);
+    Py_XDECREF(count);
+  }
+
+  if (values && counter->other) {
+    PyObject *count = PyLong_FromUnsignedLongLong(counter->other);
+    if (!count || PyDict_SetItem(values, Py_None, count) != 0) {
+      Py_CLEAR(values);
+    }
+    Py_XDECREF(count);
+  }
+  return values;
+}
+
+static PyObject * shadow_entry_dict(const shadow_entry *entry) {
+  PyObject *syscall = NULL;
+  char *name = seccomp_syscall_resolve_num_arch(entry->arch, entry->nr);
+  if (name) {
+    syscall = PyUnicode_FromString(name);
+    free(name);
+  }
+  else {
+    syscall = PyLong_FromLong(entry->nr);
+  }
+
+  PyObject *args = PyTuple_New(6);
+  unsigned int arg = 0;
+  for (arg = 0; args && arg < 6; arg++) {
+    PyObject *values = shadow_arg_values(&entry->args[arg]);
+    if (!values) {
+      Py_CLEAR(args);
+      break;
+    }
+    PyTuple_SET_ITEM(args, arg, values);
+  }
+
+  if (!syscall || !args) {
+    Py_XDECREF(syscall);
+    Py_XDECREF(args);
+    return NULL;
+  }
+
+  return Py_BuildValue("{s:I,s:N,s:I,s:K,s:N}", "arch", entry->arch, "syscall", syscall,
+    "action", entry->action, "count", (unsigned long long) entry->count, "args", args);
+}
+
+static int shadow_by_count(const void *a, const void *b) {
+  const shadow_entry *left = a;
+  const shadow_entry *right = b;
+  return left->count < right->count ? 1 : left->count > right->count ? -1 : 0;
+}
+
+PyObject * seccomplite_shadow_report(seccomplite_Shadow *shadow, int reset) {
+  // Copy under the lock, the dicts are built without it
+  shadow_entry *entries = PyMem_Malloc(sizeof(shadow->entries));
+  if (!entries) {
+    return PyErr_NoMemory();
+  }
+
+  unsigned int used = 0;
+  unsigned int index = 0;
+  pthread_mutex_lock(&shadow->lock);
+  for (index = 0; index < SECCOMPLITE_SHADOW_SYSCALLS; index++) {
+    if (shadow->entries[index].used) {
+      entries[used++] = shadow->entries[index];
+    }
+  }
+  uint64_t violations = shadow->violations;
+  uint64_t dropped = shadow->dropped;
+  if (reset) {
+    memset(shadow->entries, 0, sizeof(shadow->entries));
+    shadow->violations = 0;
+    shadow->dropped = 0;
+  }
+  pthread_mutex_unlock(&shadow->lock);
+
+  qsort(entries, used, sizeof(shadow_entry), shadow_by_count);
+  PyObject *syscalls = PyList_New(used);
+  for (index = 0; syscalls && index < used; index++) {
+    PyObject *entry = shadow_entry_dict(&entries[index]);
+    if (!entry) {
+      Py_CLEAR(syscalls);
+      break;
+    }
+    PyList_SET_ITEM(syscalls, index, entry);
+  }
+  PyMem_Free(entries);
+
+  if (!syscalls) {
+    return NULL;
+  }
+  return Py_BuildValue("{s:K,s:K,s:N}", "violations", (unsigned long long) violations,
+    "dropped", (unsigned long long) dropped, "syscalls", syscalls);
+}
@@ -0,0 +1,718 @@
+/*
+ * Rule simplification in seccomplite library
+ * Author: Michael Witt <m.witt@htw-berlin.de>
+ *
+ * Every architecture instance of a record (the native one of the first
+ * init, every add_arch) gets a bit, a rule applies to the instances present
+ * when it was added.  Removed instances take their rules with them, fan-out
+ * records apply every rule to all instances.  A rule can only make another
+ * one redundant if it covers all of its instances.
+ */
+
+#include <Python.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <seccomp.h>
+#include "inc/policy.h"
+#include "inc/program.h"
+#include "inc/bpf.h"
+#include "inc/simplify.h"
+
+#define SIMPLIFY_MAX_INSTANCES SECCOMPLITE_SIMPLIFY_MAX_INSTANCES
+
+/**
+ * One rule of the record
+ */
+typedef struct {
+  uint32_t action;
+  int syscall;
+  unsigned int argc;
+  struct scmp_arg_cmp args[6];
+  uint64_t instances;
+  int kind;
+  unsigned int cause;
+  unsigned int replace;
+  struct scmp_arg_cmp cmp;
+} simplify_rule;
+
+/**
+ * Walk state shared by nested records
+ */
+typedef struct {
+  simplify_rule *rules;
+  unsigned int count;
+  unsigned int cap;
+  unsigned int instances;
+  uint64_t alive;
+  uint32_t tokens[SIMPLIFY_MAX_INSTANCES];
+} simplify_state;
+
+/**
+ * Architectures of one record level
+ */
+typedef struct {
+  uint32_t tokens[SECCOMPLITE_POLICY_MAX_ARCHES];
+  unsigned int ids[SECCOMPLITE_POLICY_MAX_ARCHES];
+  unsigned int count;
+} simplify_arches;
+
+static uint64_t simplify_mask(const simplify_arches *arches) {
+  uint64_t mask = 0;
+  unsigned int index = 0;
+  for (index = 0; index < arches->count; index++) {
+    mask |= 1ULL << arches->ids[index];
+  }
+  return mask;
+}
+
+static int simplify_add_arch(simplify_state *state, simplify_arches *arches, uint32_t token) {
+  if (state->instances >= SIMPLIFY_MAX_INSTANCES || arches->count >= SECCOMPLITE_POLICY_MAX_ARCHES) {
+    return -E2BIG;
+  }
+
+  arches->tokens[arches->count] = token == SCMP_ARCH_NATIVE ? seccomp_arch_native() : token;
+  state->tokens[state->instances] = arches->tokens[arches->count];
+  arches->ids[arches->count++] = state->instances;
+  state->alive |= 1ULL << state->instances++;
+  return 0;
+}
+
+static int simplify_walk(simplify_state *state, const uint8_t *data, size_t len, simplify_arches *arches) {
+  seccomplite_PolicyEntry entry;
+  size_t offset = 0;
+  unsigned int first = state->count;
+  int rc = 0;
+  while ((rc = seccomplite_policy_next(data, len, &offset, &entry)) == 1) {
+    unsigned int index = 0;
+    rc = 0;
+    switch (entry.op) {
+      case SECCOMPLITE_POLICY_INIT:
+        arches->count = 0;
+        rc = simplify_add_arch(state, arches, SCMP_ARCH_NATIVE);
+        break;
+
+      case SECCOMPLITE_POLICY_ARCH_ADD:
+        rc = simplify_add_arch(state, arches, entry.arch);
+        break;
+
+      case SECCOMPLITE_POLICY_ARCH_REMOVE: {
+        uint32_t token = entry.arch == SCMP_ARCH_NATIVE ? seccomp_arch_native() : entry.arch;
+        for (index = 0; index < arches->count && arches->tokens[index] != token; index++);
+        if (index < arches->count) {
+          state->alive &= ~(1ULL << arches->ids[index]);
+          arches->tokens[index] = arches->tokens[arches->count - 1];
+          arches->ids[index] = arches->ids[arches->count - 1];
+          arches->count--;
+        }
+        break;
+      }
+
+      case SECCOMPLITE_POLICY_RULE:
+      case SECCOMPLITE_POLICY_RULE_EXACT:
+        if (state->count == state->cap) {
+          unsigned int cap = state->cap ? 2 * state->cap : 64;
+          simplify_rule *rules = realloc(state->rules, cap * sizeof(simplify_rule));
+          if (!rules) {
+            return -ENOMEM;
+          }
+          state->rules = rules;
+          state->cap = cap;
+        }
+
+        simplify_rule *rule = &state->rules[state->count++];
+        memset(rule, 0, sizeof(simplify_rule));
+        rule->action = entry.action;
+        rule->syscall = entry.syscall;
+        rule->argc = entry.argc;
+        memcpy(rule->args, entry.args, sizeof(rule->args));
+        rule->instances = simplify_mask(arches);
+        break;
+
+      case SECCOMPLITE_POLICY_MERGE: {
+        simplify_arches nested = { .count = 0 };
+        rc = simplify_walk(state, entry.nested, entry.nested_len, &nested);
+        for (index = 0; rc == 0 && index < nested.count; index++) {
+          if (arches->count >= SECCOMPLITE_POLICY_MAX_ARCHES) {
+            rc = -E2BIG;
+            break;
+          }
+          arches->tokens[arches->count] = nested.tokens[index];
+          arches->ids[arches->count++] = nested.ids[index];
+        }
+        break;
+      }
+    }
+
+    if (rc != 0) {
+      return rc;
+    }
+  }
+
+  if (rc < 0) {
+    return -EINVAL;
+  }
+
+  // Fan-out rules end up on every architecture of the record
+  if (seccomplite_policy_is_fanout(data, len)) {
+    unsigned int index = 0;
+    for (index = first; index < state->count; index++) {
+      state->rules[index].instances = simplify_mask(arches);
+    }
+  }
+
+  return 0;
+}
+
+/**
+ * Value range of an ordered comparison
+ * @return 1 for ordered comparisons, 0 otherwise
+ */
+static int simplify_interval(const struct scmp_arg_cmp *cmp, uint64_t *lo, uint64_t *hi) {
+  *lo = 0;
+  *hi = UINT64_MAX;
+  switch (cmp->op) {
+    case SCMP_CMP_LT:
+      if (cmp->datum_a == 0) {
+        *lo = 1;
+        *hi = 0;
+      }
+      else {
+        *hi = cmp->datum_a - 1;
+      }
+      return 1;
+    case SCMP_CMP_LE:
+      *hi = cmp->datum_a;
+      return 1;
+    case SCMP_CMP_EQ:
+      *lo = *hi = cmp->datum_a;
+      return 1;
+    case SCMP_CMP_GE:
+      *lo = cmp->datum_a;
+      return 1;
+    case SCMP_CMP_GT:
+      if (cmp->datum_a == UINT64_MAX) {
+        *lo = 1;
+        *hi = 0;
+      }
+      else {
+        *lo = cmp->datum_a + 1;
+      }
+      return 1;
+    default:
+      return 0;
+  }
+}
+
+static int simplify_never(const struct scmp_arg_cmp *cmp) {
+  uint64_t lo = 0;
+  uint64_t hi = 0;
+  if (simplify_interval(cmp, &lo, &hi)) {
+    return lo > hi;
+  }
+  return 0;
+}
+
+static int simplify_always(const struct scmp_arg_cmp *cmp) {
+  uint64_t lo = 0;
+  uint64_t hi = 0;
+  if (simplify_interval(cmp, &lo, &hi)) {
+    return lo == 0 && hi == UINT64_MAX;
+  }
+  return cmp->op == SCMP_CMP_MASKED_EQ && cmp->datum_a == 0;
+}
+
+/**
+ * Check if every value matching a also matches b, both on the same argument
+ */
+static int simplify_cmp_implies(const struct scmp_arg_cmp *a, const struct scmp_arg_cmp *b) {
+  uint64_t a_lo = 0;
+  uint64_t a_hi = 0;
+  uint64_t b_lo = 0;
+  uint64_t b_hi = 0;
+  int a_range = simplify_interval(a, &a_lo, &a_hi);
+  int b_range = simplify_interval(b, &b_lo, &b_hi);
+  if (simplify_never(a) || simplify_always(b)) {
+    return 1;
+  }
+
+  // libseccomp only compares the masked bits of the datum
+  uint64_t a_datum = a->datum_b & a->datum_a;
+  uint64_t b_datum = b->datum_b & b->datum_a;
+  if (a_range) {
+    if (b_range) {
+      return b_lo <= a_lo && a_hi <= b_hi;
+    }
+    else if (b->op == SCMP_CMP_NE) {
+      return b->datum_a < a_lo || b->datum_a > a_hi;
+    }
+    return a_lo == a_hi && (a_lo & b->datum_a) == b_datum;
+  }
+  else if (a->op == SCMP_CMP_NE) {
+    if (b->op == SCMP_CMP_NE) {
+      return a->datum_a == b->datum_a;
+    }
+    else if (b_range) {
+      return b_lo <= (a->datum_a == 0 ? 1 : 0) && b_hi >= (a->datum_a == UINT64_MAX ? UINT64_MAX - 1 : UINT64_MAX);
+    }
+    return 0;
+  }
+
+  // Masked comparison, the matching values lie between datum and datum | ~mask
+  if (b_range) {
+    return b_lo <= a_datum && (a_datum | ~a->datum_a) <= b_hi;
+  }
+  else if (b->op == SCMP_CMP_NE) {
+    return (b->datum_a & a->datum_a) != a_datum;
+  }
+  return (b->datum_a & ~a->datum_a) == 0 && (a_datum & b->datum_a) == b_datum;
+}
+
+/**
+ * Check if every syscall matching rule a also matches rule b
+ */
+static int simplify_rule_implies(const simplify_rule *a, const simplify_rule *b) {
+  unsigned int index = 0;
+  for (index = 0; index < a->argc; index++) {
+    if (simplify_never(&a->args[index])) {
+      return 1;
+    }
+  }
+
+  for (index = 0; index < b->argc; index++) {
+    unsigned int other = 0;
+    for (other = 0; other < a->argc; other++) {
+      if (a->args[other].arg == b->args[index].arg && simplify_cmp_implies(&a->args[other], &b->args[index])) {
+        break;
+      }
+    }
+
+    if (other == a->argc && !simplify_always(&b->args[index])) {
+      return 0;
+    }
+  }
+
+  return 1;
+}
+
+static int simplify_by_syscall(const void *a, const void *b) {
+  const simplify_rule *left = *(const simplify_rule * const *) a;
+  const simplify_rule *right = *(const simplify_rule * const *) b;
+  if (left->syscall != right->syscall) {
+    return left->syscall < right->syscall ? -1 : 1;
+  }
+  return left < right ? -1 : left > right;
+}
+
+/**
+ * Classify the rules of one syscall, given in record order
+ */
+static void simplify_group(simplify_rule *rules, simplify_rule **group, unsigned int count) {
+  unsigned int j = 0;
+  unsigned int i = 0;
+
+  // Unconditional rules decide the syscall whatever else was added
+  for (j = 0; j < count; j++) {
+    simplify_rule *rule = group[j];
+    for (i = 0; i < count && rule->instances && !rule->kind; i++) {
+      const simplify_rule *other = group[i];
+      if (i == j || other->argc != 0 || (rule->instances & ~other->instances)) {
+        continue;
+      }
+      if (rule->argc != 0 || (i < j && other->action != rule->action)) {
+        rule->kind = SECCOMPLITE_SIMPLIFY_SHADOWED;
+        rule->cause = other - rules;
+      }
+    }
+  }
+
+  for (j = 0; j < count; j++) {
+    simplify_rule *rule = group[j];
+    int conflict = 0;
+    if (!rule->instances || rule->kind) {
+      continue;
+    }
+
+    for (i = 0; i < count; i++) {
+      if (group[i]->action != rule->action && (group[i]->instances & rule->instances)) {
+        conflict = 1;
+      }
+    }
+
+    for (i = 0; i < count && !rule->kind; i++) {
+      const simplify_rule *other = group[i];
+      if (i == j || other->kind == SECCOMPLITE_SIMPLIFY_SHADOWED || other->action != rule->action ||
+          (rule->instances & ~other->instances) || !simplify_rule_implies(rule, other)) {
+        continue;
+      }
+
+      if (simplify_rule_implies(other, rule)) {
+        if (i < j) {
+          rule->kind = SECCOMPLITE_SIMPLIFY_DUPLICATE;
+          rule->cause = other - rules;
+        }
+      }
+      else if (!conflict) {
+        rule->kind = SECCOMPLITE_SIMPLIFY_SUBSUMED;
+        rule->cause = other - rules;
+      }
+    }
+  }
+}
+
+/**
+ * Find the only comparison of a rule on the given argument
+ * @return Index of the comparison, -1 if there is none or several
+ */
+static int simplify_only_cmp(const simplify_rule *rule, unsigned int arg) {
+  int found = -1;
+  unsigned int index = 0;
+  for (index = 0; index < rule->argc; index++) {
+    if (rule->args[index].arg == arg) {
+      if (found >= 0) {
+        return -1;
+      }
+      found = index;
+    }
+  }
+  return found;
+}
+
+/**
+ * Check if b equals a except for an EQ comparison on the argument of
+ * comparison skip of a
+ * @return Index of that comparison in b, -1 if the rules differ otherwise
+ */
+static int simplify_same_except(const simplify_rule *a, const simplify_rule *b, unsigned int skip) {
+  if (a->action != b->action || a->instances != b->instances || a->argc != b->argc) {
+    return -1;
+  }
+
+  int other = simplify_only_cmp(b, a->args[skip].arg);
+  if (other < 0 || b->args[other].op != SCMP_CMP_EQ) {
+    return -1;
+  }
+
+  unsigned int index = 0;
+  for (index = 0; index < a->argc; index++) {
+    unsigned int match = 0;
+    if (index == skip) {
+      continue;
+    }
+    for (match = 0; match < b->argc; match++) {
+      if ((int) match != other && b->args[match].arg == a->args[index].arg && b->args[match].op == a->args[index].op &&
+          b->args[match].datum_a == a->args[index].datum_a && b->args[match].datum_b == a->args[index].datum_b) {
+        break;
+      }
+    }
+    if (match == b->argc) {
+      return -1;
+    }
+  }
+
+  return other;
+}
+
+/**
+ * Collapse enumerated flag combinations of one syscall.  The EQ values of
+ * a set are base plus every subset of the bits that vary, which is exactly
+ * what (value & ~varying) == base matches.
+ */
+static int simplify_collapse(simplify_rule *rules, simplify_rule **group, unsigned int count) {
+  unsigned int *members = malloc((count ? count : 1) * sizeof(unsigned int));
+  if (!members) {
+    return -ENOMEM;
+  }
+
+  unsigned int j = 0;
+  for (j = 0; j < count; j++) {
+    simplify_rule *rule = group[j];
+    unsigned int skip = 0;
+    for (skip = 0; skip < rule->argc && !rule->kind; skip++) {
+      if (rule->args[skip].op != SCMP_CMP_EQ || simplify_only_cmp(rule, rule->args[skip].arg) < 0) {
+        continue;
+      }
+
+      uint64_t all = UINT64_MAX;
+      uint64_t any = 0;
+      unsigned int num_members = 0;
+      unsigned int i = 0;
+      for (i = j; i < count; i++) {
+        int other = group[i]->kind ? -1 : simplify_same_except(rule, group[i], skip);
+        if (other >= 0) {
+          all &= group[i]->args[other].datum_a;
+          any |= group[i]->args[other].datum_a;
+          members[num_members++] = i;
+        }
+      }
+
+      // Values are distinct, duplicates were found before
+      uint64_t varying = any & ~all;
+      if (num_members < 2 || !varying || __builtin_popcountll(varying) > 31 ||
+          num_members != 1U << __builtin_popcountll(varying)) {
+        continue;
+      }
+
+      rule->kind = SECCOMPLITE_SIMPLIFY_WIDENED;
+      rule->cause = rule - rules;
+      rule->replace = skip;
+      rule->cmp.arg = rule->args[skip].arg;
+      rule->cmp.op = SCMP_CMP_MASKED_EQ;
+      rule->cmp.datum_a = ~varying;
+      rule->cmp.datum_b = all;
+      for (i = 1; i < num_members; i++) {
+        group[members[i]]->kind = SECCOMPLITE_SIMPLIFY_COLLAPSED;
+        group[members[i]]->cause = rule - rules;
+      }
+    }
+  }
+
+  free(members);
+  return 0;
+}
+
+int seccomplite_simplify_rules(const uint8_t *data, size_t len, seccomplite_SimplifyRule **rules, uint32_t *tokens) {
+  simplify_state state = { NULL, 0, 0, 0, 0 };
+  simplify_arches arches = { .count = 0 };
+  int rc = simplify_walk(&state, data, len, &arches);
+  if (rc != 0) {
+    free(state.rules);
+    return rc;
+  }
+
+  *rules = malloc((state.count ? state.count : 1) * sizeof(seccomplite_SimplifyRule));
+  if (!*rules) {
+    free(state.rules);
+    return -ENOMEM;
+  }
+
+  unsigned int index = 0;
+  for (index = 0; index < state.count; index++) {
+    seccomplite_SimplifyRule *rule = &(*rules)[index];
+    rule->action = state.rules[index].action;
+    rule->syscall = state.rules[index].syscall;
+    rule->argc = state.rules[index].argc;
+    memcpy(rule->args, state.rules[index].args, sizeof(rule->args));
+    rule->instances = state.rules[index].instances & state.alive;
+  }
+  for (index = 0; index < SIMPLIFY_MAX_INSTANCES; index++) {
+    tokens[index] = index < state.instances && (state.alive & (1ULL << index)) ? state.tokens[index] : 0;
+  }
+
+  free(state.rules);
+  return state.count;
+}
+
+int seccomplite_simplify_analyze(const uint8_t *data, size_t len, seccomplite_SimplifyFinding **findings) {
+  simplify_state state = { NULL, 0, 0, 0, 0 };
+  simplify_arches arches = { .count = 0 };
+  int rc = simplify_walk(&state, data, len, &arches);
+  if (rc != 0) {
+    free(state.rules);
+    return rc;
+  }
+
+  unsigned int index = 0;
+  simplify_rule **sorted = malloc((state.count ? state.count : 1) * sizeof(simplify_rule *));
+  if (!sorted) {
+    free(state.rules);
+    return -ENOMEM;
+  }
+  for (index = 0; index < state.count; index++) {
+    state.rules[index].instances &= state.alive;
+    sorted[index] = &state.rules[index];
+  }
+  qsort(sorted, state.count, sizeof(simplify_rule *), simplify_by_syscall);
+
+  unsigned int first = 0;
+  for (index = 1; index <= state.count; index++) {
+    if (index == state.count || sorted[index]->syscall != sorted[first]->syscall) {
+      simplify_group(state.rules, sorted + first, index - first);
+      if (simplify_collapse(state.rules, sorted + first, index - first) != 0) {
+        free(sorted);
+        free(state.rules);
+        return -ENOMEM;
+      }
+      first = index;
+    }
+  }
+  free(sorted);
+
+  unsigned int count = 0;
+  for (index = 0; index < state.count; index++) {
+    count += state.rules[index].kind != 0;
+  }
+
+  *findings = malloc((count ? count : 1) * sizeof(seccomplite_SimplifyFinding));
+  if (!*findings) {
+    free(state.rules);
+    return -ENOMEM;
+  }
+
+  count = 0;
+  for (index = 0; index < state.count; index++) {
+    const simplify_rule *rule = &state.rules[index];
+    if (!rule->kind) {
+      continue;
+    }
+
+    // Redundancy is transitive, point at the rule that stays
+    unsigned int cause = rule->cause;
+    unsigned int steps = 0;
+    while (state.rules[cause].kind && state.rules[cause].kind != SECCOMPLITE_SIMPLIFY_WIDENED && steps++ < state.count) {
+      cause = state.rules[cause].cause;
+    }
+
+    seccomplite_SimplifyFinding *finding = &(*findings)[count++];
+    finding->kind = rule->kind;
+    finding->rule = index;
+    finding->cause = cause;
+    finding->syscall = rule->syscall;
+    finding->action = rule->action;
+    finding->replace = rule->replace;
+    finding->cmp = rule->cmp;
+  }
+
+  free(state.rules);
+  return (int) count;
+}
+
+static int simplify_copy(const uint8_t *data, size_t len, const seccomplite_SimplifyFinding *findings, unsigned int count, unsigned int *rule, unsigned int *next, seccomplite_Policy *out) {
+  seccomplite_PolicyEntry entry;
+  size_t offset = 0;
+  size_t start = 0;
+  int rc = 0;
+  while ((rc = seccomplite_policy_next(data, len, &offset, &entry)) == 1) {
+    if (entry.op == SECCOMPLITE_POLICY_MERGE) {
+      seccomplite_Policy nested = { NULL, 0, 0 };
+      rc = simplify_copy(entry.nested, entry.nested_len, findings, count, rule, next, &nested);
+      if (rc == 0 && seccomplite_policy_merge(out, &nested) != 0) {
+        rc = -ENOMEM;
+      }
+      seccomplite_policy_free(&nested);
+      if (rc != 0) {
+        return rc;
+      }
+    }
+    else if (entry.op == SECCOMPLITE_POLICY_RULE || entry.op == SECCOMPLITE_POLICY_RULE_EXACT) {
+      const seccomplite_SimplifyFinding *finding = *next < count && findings[*next].rule == *rule ? &findings[(*next)++] : NULL;
+      (*rule)++;
+      if (finding && finding->verified && finding->kind == SECCOMPLITE_SIMPLIFY_WIDENED) {
+        entry.args[finding->replace] = finding->cmp;
+        if (seccomplite_policy_rule(out, entry.op == SECCOMPLITE_POLICY_RULE_EXACT, entry.action, entry.syscall, entry.argc, entry.args) != 0) {
+          return -ENOMEM;
+        }
+      }
+      else if (!(finding && finding->verified) && seccomplite_policy_put_bytes(out, data + start, offset - start) != 0) {
+        return -ENOMEM;
+      }
+    }
+    else if (seccomplite_policy_put_bytes(out, data + start, offset - start) != 0) {
+      return -ENOMEM;
+    }
+    start = offset;
+  }
+
+  return rc < 0 ? -EINVAL : 0;
+}
+
+static int simplify_export(const uint8_t *data, size_t len, struct sock_filter **insns, unsigned int *num_insns) {
+  scmp_filter_ctx ctx = NULL;
+  int rc = seccomplite_policy_replay(data, len, &ctx);
+  if (rc == 0) {
+    rc = seccomplite_ctx_export(ctx, insns, num_insns);
+    seccomp_release(ctx);
+  }
+  return rc;
+}
+
+/**
+ * Drop the verified findings and compare with the original program
+ * @return 0 and the new record in out if the program did not change, 1 if
+ *         it did, negative errno on failure
+ */
+static int simplify_try(const uint8_t *data, size_t len, const seccomplite_SimplifyFinding *findings, unsigned int count, const struct sock_filter *original, unsigned int original_len, seccomplite_Policy *out) {
+  seccomplite_Policy record = { NULL, 0, 0 };
+  struct sock_filter *insns = NULL;
+  unsigned int num_insns = 0;
+  unsigned int rule = 0;
+  unsigned int next = 0;
+  int rc = simplify_copy(data, len, findings, count, &rule, &next, &record);
+  rc = rc ? rc : simplify_export(record.data, record.len, &insns, &num_insns);
+  if (rc == 0) {
+    rc = seccomplite_bpf_compare(original, original_len, insns, num_insns, NULL) != 0;
+  }
+  free(insns);
+
+  if (rc == 0) {
+    seccomplite_policy_free(out);
+    *out = record;
+  }
+  else {
+    seccomplite_policy_free(&record);
+  }
+  return rc;
+}
+
+int seccomplite_simplify_verify(const uint8_t *data, size_t len, seccomplite_SimplifyFinding *findings, unsigned int count, seccomplite_Policy *out) {
+  struct sock_filter *original = NULL;
+  unsigned int original_len = 0;
+  unsigned int index = 0;
+  uint8_t *tried = calloc(count ? count : 1, 1);
+  int rc = tried ? simplify_export(data, len, &original, &original_len) : -ENOMEM;
+  if (rc == 0 && seccomplite_policy_put_bytes(out, data, len) != 0) {
+    rc = -ENOMEM;
+  }
+
+  for (index = 0; index < count; index++) {
+    findings[index].verified = 1;
+  }
+  rc = rc ? rc : simplify_try(data, len, findings, count, original, original_len, out);
+
+  // Syscalls have trees of their own, retry them one at a time
+  unsigned int first = 0;
+  for (index = 0; rc == 1 && index < count; index++) {
+    findings[index].verified = 0;
+  }
+  for (first = 0; rc == 1 && first < count; first++) {
+    if (tried[first]) {
+      continue;
+    }
+
+    for (index = first; index < count; index++) {
+      if (findings[index].syscall == findings[first].syscall) {
+        findings[index].verified = 1;
+        tried[index] = 1;
+      }
+    }
+
+    int group = simplify_try(data, len, findings, count, original, original_len, out);
+    for (index = first; group == 1 && index < count; index++) {
+      if (findings[index].syscall == findings[first].syscall) {
+        findings[index].verified = 0;
+      }
+    }
+    for (index = first; group == 1 && index < count; index++) {
+      if (findings[index].syscall != findings[first].syscall) {
+        continue;
+      }
+
+      findings[index].verified = 1;
+      int single = simplify_try(data, len, findings, count, original, original_len, out);
+      if (single < 0) {
+        group = single;
+        break;
+      }
+      findings[index].verified = single == 0;
+    }
+    rc = group < 0 ? group : 1;
+  }
+
+  free(tried);
+  free(original);
+  if (rc < 0) {
+    seccomplite_policy_free(out);
+    return rc;
+  }
+  return 0;
+}
@@ -0,0 +1,280 @@
+/*
+ * Policy splitting in seccomplite library
+ * Author: Michael Witt <m.witt@htw-berlin.de>
+ *
+ * The kernel rejects programs with more than BPF_MAXINSNS instructions.
+ * Oversized policies are split by syscall into several records which are
+ * compiled on their own.  Each group is grown as far as it still fits,
+ * the size is found by interpolating the program lengths of the probes.
+ */
+
+#include <Python.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <seccomp.h>
+#include "inc/policy.h"
+#include "inc/program.h"
+#include "inc/split.h"
+
+/**
+ * One syscall of the policy
+ */
+typedef struct {
+  int syscall;
+  int priority;
+  unsigned int order;
+  unsigned int position;
+  int has_rules;
+} split_syscall;
+
+/**
+ * Split state shared by all groups
+ */
+typedef struct {
+  const uint8_t *data;
+  size_t len;
+  uint32_t def_action;
+  split_syscall *syscalls;
+  split_syscall *by_number;
+  unsigned int count;
+} split_plan;
+
+static int split_by_number(const void *a, const void *b) {
+  int left = ((const split_syscall *) a)->syscall;
+  int right = ((const split_syscall *) b)->syscall;
+  return (left > right) - (left < right);
+}
+
+static int split_by_priority(const void *a, const void *b) {
+  const split_syscall *left = a;
+  const split_syscall *right = b;
+  if (left->priority != right->priority) {
+    return right->priority - left->priority;
+  }
+
+  return (left->order > right->order) - (left->order < right->order);
+}
+
+/**
+ * Position of a syscall in priority order
+ * @return Position or -1 if the policy has no rule for the syscall
+ */
+static int split_position(const split_plan *plan, int syscall) {
+  split_syscall key = { .syscall = syscall };
+  const split_syscall *found = bsearch(&key, plan->by_number, plan->count, sizeof(split_syscall), split_by_number);
+  return found ? (int) found->position : -1;
+}
+
+/**
+ * Collect all syscalls with rules in priority order
+ * @return 0 on success, negative errno on failure
+ */
+static int split_collect(split_plan *plan) {
+  seccomplite_PolicyEntry entry;
+  size_t offset = 0;
+  unsigned int cap = 0;
+  int rc = 0;
+
+  while ((rc = seccomplite_policy_next(plan->data, plan->len, &offset, &entry)) == 1) {
+    if (entry.op == SECCOMPLITE_POLICY_INIT) {
+      plan->def_action = entry.action;
+      continue;
+    }
+    else if (entry.op == SECCOMPLITE_POLICY_MERGE) {
+      return -EINVAL;
+    }
+    else if (entry.op != SECCOMPLITE_POLICY_PRIORITY && entry.op != SECCOMPLITE_POLICY_RULE &&
+             entry.op != SECCOMPLITE_POLICY_RULE_EXACT) {
+      continue;
+    }
+
+    unsigned int index = 0;
+    for (index = 0; index < plan->count && plan->syscalls[index].syscall != entry.syscall; index++);
+    if (index == plan->count) {
+      if (plan->count == cap) {
+        cap = cap ? cap * 2 : 64;
+        split_syscall *syscalls = realloc(plan->syscalls, cap * sizeof(split_syscall));
+        if (!syscalls) {
+          return -ENOMEM;
+        }
+        plan->syscalls = syscalls;
+      }
+      memset(&plan->syscalls[index], 0, sizeof(split_syscall));
+      plan->syscalls[index].syscall = entry.syscall;
+      plan->syscalls[index].order = index;
+      plan->count++;
+    }
+
+    if (entry.op == SECCOMPLITE_POLICY_PRIORITY) {
+      plan->syscalls[index].priority = entry.priority;
+    }
+    else {
+      plan->syscalls[index].has_rules = 1;
+    }
+  }
+
+  if (rc != 0) {
+    return -EINVAL;
+  }
+
+  // Priorities alone do not make a syscall part of the policy
+  unsigned int kept = 0;
+  unsigned int index = 0;
+  for (index = 0; index < plan->count; index++) {
+    if (plan->syscalls[index].has_rules) {
+      plan->syscalls[kept++] = plan->syscalls[index];
+    }
+  }
+  plan->count = kept;
+
+  qsort(plan->syscalls, plan->count, sizeof(split_syscall), split_by_priority);
+  for (index = 0; index < plan->count; index++) {
+    plan->syscalls[index].position = index;
+  }
+
+  plan->by_number = malloc((plan->count ? plan->count : 1) * sizeof(split_syscall));
+  if (!plan->by_number) {
+    return -ENOMEM;
+  }
+  memcpy(plan->by_number, plan->syscalls, plan->count * sizeof(split_syscall));
+  qsort(plan->by_number, plan->count, sizeof(split_syscall), split_by_number);
+  return 0;
+}
+
+/**
+ * Compile the group of syscalls at positions [first, last)
+ * @return 0 on success, negative errno on failure
+ */
+static int split_group(const split_plan *plan, unsigned int first, unsigned int last, seccomplite_SplitProgram *program) {
+  seccomplite_Policy record = { NULL, 0, 0 };
+  seccomplite_PolicyEntry entry;
+  size_t offset = 0;
+  size_t start = 0;
+  int rc = 0;
+
+  // Keep everything except the rules of other groups
+  while (rc == 0 && (rc = seccomplite_policy_next(plan->data, plan->len, &offset, &entry)) == 1) {
+    rc = 0;
+    if (entry.op == SECCOMPLITE_POLICY_RULE || entry.op == SECCOMPLITE_POLICY_RULE_EXACT) {
+      int position = split_position(plan, entry.syscall);
+      if (position < (int) first || position >= (int) last) {
+        start = offset;
+        continue;
+      }
+    }
+
+    rc = seccomplite_policy_put_bytes(&record, plan->data + start, offset - start) ? -ENOMEM : 0;
+    start = offset;
+  }
+
+  // Syscalls of the other groups are decided there
+  unsigned int index = 0;
+  for (index = 0; rc == 0 && plan->def_action != SCMP_ACT_ALLOW && index < plan->count; index++) {
+    if (index < first || index >= last) {
+      rc = seccomplite_policy_rule(&record, 0, SCMP_ACT_ALLOW, plan->syscalls[index].syscall, 0, NULL) ? -ENOMEM : 0;
+    }
+  }
+
+  scmp_filter_ctx ctx = NULL;
+  if (rc == 0) {
+    rc = seccomplite_policy_replay(record.data, record.len, &ctx);
+  }
+  seccomplite_policy_free(&record);
+
+  if (rc == 0) {
+    rc = seccomplite_ctx_export(ctx, &program->insns, &program->len);
+    seccomp_release(ctx);
+  }
+
+  return rc;
+}
+
+void seccomplite_split_free(seccomplite_SplitProgram *programs, unsigned int count) {
+  unsigned int index = 0;
+  for (index = 0; programs && index < count; index++) {
+    free(programs[index].insns);
+  }
+  free(programs);
+}
+
+int seccomplite_split_compile(const uint8_t *data, size_t len, unsigned int limit, seccomplite_SplitProgram **programs) {
+  split_plan plan = { data, len, SCMP_ACT_KILL, NULL, NULL, 0 };
+  seccomplite_SplitProgram *result = NULL;
+  unsigned int groups = 0;
+  int rc = split_collect(&plan);
+
+  unsigned int first = 0;
+  while (rc == 0 && (first < plan.count || groups == 0)) {
+    seccomplite_SplitProgram best = { NULL, 0 };
+    seccomplite_SplitProgram probe = { NULL, 0 };
+    unsigned int fits = first;
+    unsigned int fits_len = 0;
+    unsigned int fails = plan.count + 1;
+    unsigned int fails_len = 0;
+    unsigned int last = plan.count;
+
+    // Interpolate between the largest group that fits and the smallest
+    // one that overflows, moving at least an eighth of the interval
+    while (fails - fits > 1) {
+      rc = split_group(&plan, first, last, &probe);
+      if (rc != 0) {
+        break;
+      }
+
+      if (probe.len <= limit) {
+        free(best.insns);
+        best = probe;
+        fits = last;
+        fits_len = probe.len;
+      }
+      else {
+        free(probe.insns);
+        fails = last;
+        fails_len = probe.len;
+      }
+      probe.insns = NULL;
+
+      if (fails > plan.count || fails - fits <= 1) {
+        break;
+      }
+
+      unsigned int span = fails - fits;
+      unsigned int step = (unsigned int) ((uint64_t) span * (limit - fits_len) / (fails_len - fits_len));
+      unsigned int margin = span / 8;
+      step = step < margin ? margin : step;
+      step = step > span - margin ? span - margin : step;
+      step = step < 1 ? 1 : step;
+      last = fits + (step < span ? step : span - 1);
+    }
+
+    if (rc == 0 && !best.insns) {
+      // Not even a single syscall fits
+      rc = -E2BIG;
+    }
+    if (rc != 0) {
+      free(best.insns);
+      break;
+    }
+
+    seccomplite_SplitProgram *grown = realloc(result, (groups + 1) * sizeof(seccomplite_SplitProgram));
+    if (!grown) {
+      free(best.insns);
+      rc = -ENOMEM;
+      break;
+    }
+    result = grown;
+    result[groups++] = best;
+    first = fits;
+  }
+
+  free(plan.syscalls);
+  free(plan.by_number);
+  if (rc != 0) {
+    seccomplite_split_free(result, groups);
+    return rc;
+  }
+
+  *programs = result;
+  return groups;
+}
@@ -0,0 +1,487 @@
+/*
+ * Filter stack inspection and planning in seccomplite library
+ * Author: Michael Witt <m.witt@htw-berlin.de>
+ *
+ * The kernel runs every filter of a stack on every syscall, starting with
+ * the most recently loaded one, and keeps the most restrictive result.
+ * A planned stack is a single program with the same result: each return
+ * of a program becomes a jump into a copy of the next program whose
+ * returns are resolved against the result so far.  Copies only depend on
+ * that result, so there are never more copies of a program than distinct
+ * return values in the stack.
+ */
+
+#include <Python.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ptrace.h>
+#include <sys/wait.h>
+#include <linux/seccomp.h>
+#include <linux/capability.h>
+#include "inc/config.h"
+#include "inc/filter.h"
+#include "inc/program.h"
+#include "inc/seccomplite.h"
+#include "inc/stack.h"
+
+/**
+ * Copies of one program, keyed by the result of the filters before
+ */
+typedef struct {
+  uint32_t *values;
+  unsigned int *positions;
+  unsigned int count;
+  unsigned int cap;
+  unsigned int prefix;
+} stack_stage;
+
+/**
+ * Precedence of a return value, lower is more restrictive
+ */
+static int32_t stack_action(uint32_t value) {
+  return (int32_t) (value & SECCOMP_RET_ACTION_FULL);
+}
+
+/**
+ * The earlier evaluated (later loaded) filter wins on equal actions
+ */
+static uint32_t stack_combine(uint32_t current, uint32_t next) {
+  return stack_action(next) < stack_action(current) ? next : current;
+}
+
+static int stack_stage_add(stack_stage *stage, uint32_t value) {
+  unsigned int index = 0;
+  for (index = 0; index < stage->count; index++) {
+    if (stage->values[index] == value) {
+      return 0;
+    }
+  }
+
+  if (stage->count == stage->cap) {
+    unsigned int cap = stage->cap ? stage->cap * 2 : 4;
+    uint32_t *values = realloc(stage->values, cap * sizeof(uint32_t));
+    if (!values) {
+      return -ENOMEM;
+    }
+    stage->values = values;
+
+    unsigned int *positions = realloc(stage->positions, cap * sizeof(unsigned int));
+    if (!positions) {
+      return -ENOMEM;
+    }
+    stage->positions = positions;
+    stage->cap = cap;
+  }
+
+  stage->values[stage->count++] = value;
+  return 0;
+}
+
+static unsigned int stack_stage_position(const stack_stage *stage, uint32_t value) {
+  unsigned int index = 0;
+  for (index = 0; index < stage->count && stage->values[index] != value; index++);
+  return stage->positions[index];
+}
+
+/**
+ * Number of instructions needed to clear A and X before a copy, the kernel
+ * starts every filter with both set to zero
+ */
+static unsigned int stack_prefix(const struct sock_fprog *program, struct sock_filter *prefix) {
+  unsigned int count = 0;
+  unsigned int index = 0;
+  int reads_x = 0;
+
+  for (index = 0; index < program->len; index++) {
+    const struct sock_filter *insn = &program->filter[index];
+    uint16_t class = BPF_CLASS(insn->code);
+    if (((class == BPF_ALU || class == BPF_JMP) && BPF_SRC(insn->code) == BPF_X) || class == BPF_STX ||
+        (class == BPF_MISC && BPF_MISCOP(insn->code) == BPF_TXA)) {
+      reads_x = 1;
+      break;
+    }
+  }
+
+  if (BPF_CLASS(program->filter[0].code) != BPF_LD) {
+    prefix[count++] = (struct sock_filter) BPF_STMT(BPF_LD | BPF_W | BPF_IMM, 0);
+  }
+  if (reads_x) {
+    prefix[count++] = (struct sock_filter) BPF_STMT(BPF_LDX | BPF_W | BPF_IMM, 0);
+  }
+
+  return count;
+}
+
+int seccomplite_stack_compose(const struct sock_fprog *programs, unsigned int count, struct sock_filter **insns, unsigned int *len) {
+  if (count == 0) {
+    return -EINVAL;
+  }
+
+  stack_stage *stages = calloc(count, sizeof(stack_stage));
+  int32_t *strictest = malloc(sizeof(int32_t) * (count + 1));
+  struct sock_filter *result = NULL;
+  int rc = stages && strictest ? 0 : -ENOMEM;
+
+  // Most restrictive action any later program can still return
+  unsigned int stage = count;
+  if (rc == 0) {
+    strictest[count] = INT32_MAX;
+  }
+  while (rc == 0 && stage-- > 0) {
+    const struct sock_fprog *program = &programs[stage];
+    strictest[stage] = strictest[stage + 1];
+    unsigned int index = 0;
+    for (index = 0; rc == 0 && index < program->len; index++) {
+      const struct sock_filter *insn = &program->filter[index];
+      if (BPF_CLASS(insn->code) != BPF_RET) {
+        continue;
+      }
+      else if (BPF_RVAL(insn->code) != BPF_K) {
+        // Results computed at runtime can not be resolved ahead of time
+        rc = -EINVAL;
+      }
+      else if (stack_action(insn->k) < strictest[stage]) {
+        strictest[stage] = stack_action(insn->k);
+      }
+    }
+
+    if (program->len == 0) {
+      rc = -EINVAL;
+    }
+  }
+
+  // Collect the copies every program needs
+  size_t total = 0;
+  if (rc == 0) {
+    rc = stack_stage_add(&stages[0], 0);
+  }
+  for (stage = 0; rc == 0 && stage < count; stage++) {
+    const struct sock_fprog *program = &programs[stage];
+    struct sock_filter prefix[2];
+    stages[stage].prefix = stage > 0 ? stack_prefix(program, prefix) : 0;
+
+    unsigned int copy = 0;
+    for (copy = 0; rc == 0 && copy < stages[stage].count; copy++) {
+      stages[stage].positions[copy] = (unsigned int) total;
+      total += stages[stage].prefix + program->len;
+
+      unsigned int index = 0;
+      for (index = 0; rc == 0 && index < program->len; index++) {
+        const struct sock_filter *insn = &program->filter[index];
+        if (BPF_CLASS(insn->code) != BPF_RET) {
+          continue;
+        }
+
+        uint32_t value = stage > 0 ? stack_combine(stages[stage].values[copy], insn->k) : insn->k;
+        if (stage + 1 < count && stack_action(value) > strictest[stage + 1]) {
+          rc = stack_stage_add(&stages[stage + 1], value);
+        }
+      }
+    }
+  }
+
+  if (rc == 0 && total > UINT32_MAX / sizeof(struct sock_filter)) {
+    rc = -E2BIG;
+  }
+  if (rc == 0 && !(result = malloc(total * sizeof(struct sock_filter)))) {
+    rc = -ENOMEM;
+  }
+
+  // Emit every copy, returns become jumps into the next program
+  unsigned int pos = 0;
+  for (stage = 0; rc == 0 && stage < count; stage++) {
+    const struct sock_fprog *program = &programs[stage];
+    struct sock_filter prefix[2];
+    stack_prefix(program, prefix);
+
+    unsigned int copy = 0;
+    for (copy = 0; copy < stages[stage].count; copy++) {
+      memcpy(&result[pos], prefix, stages[stage].prefix * sizeof(struct sock_filter));
+      pos += stages[stage].prefix;
+
+      unsigned int index = 0;
+      for (index = 0; index < program->len; index++, pos++) {
+        const struct sock_filter *insn = &program->filter[index];
+        result[pos] = *insn;
+        if (BPF_CLASS(insn->code) != BPF_RET) {
+          continue;
+        }
+
+        uint32_t value = stage > 0 ? stack_combine(stages[stage].values[copy], insn->k) : insn->k;
+        if (stage + 1 < count && stack_action(value) > strictest[stage + 1]) {
+          unsigned int target = stack_stage_position(&stages[stage + 1], value);
+          result[pos] = (struct sock_filter) BPF_STMT(BPF_JMP | BPF_JA, target - (pos + 1));
+        }
+        else {
+          result[pos] = (struct sock_filter) BPF_STMT(BPF_RET | BPF_K, value);
+        }
+      }
+    }
+  }
+
+  for (stage = 0; stages && stage < count; stage++) {
+    free(stages[stage].values);
+    free(stages[stage].positions);
+  }
+  free(stages);
+  free(strictest);
+
+  if (rc != 0) {
+    free(result);
+    return rc;
+  }
+
+  *insns = result;
+  *len = pos;
+  return 0;
+}
+
+/**
+ * Read Seccomp_filters from the status file of a process
+ * @return Number of filters or -1 if the kernel does not report it
+ */
+static int stack_status_filters(pid_t pid) {
+  char path[64];
+  if (pid) {
+    snprintf(path, sizeof(path), "/proc/%d/status", (int) pid);
+  }
+  else {
+    snprintf(path, sizeof(path), "/proc/self/status");
+  }
+
+  FILE *status = fopen(path, "re");
+  if (!status) {
+    return -1;
+  }
+
+  char line[256];
+  int result = -1;
+  int mode = -1;
+  while (fgets(line, sizeof(line), status)) {
+    if (sscanf(line, "Seccomp_filters: %d", &result) == 1) {
+      break;
+    }
+    sscanf(line, "Seccomp: %d", &mode);
+  }
+  fclose(status);
+
+  // Kernels without the counter still report the mode
+  return result < 0 && mode >= 0 && mode != SECCOMP_MODE_FILTER ? 0 : result;
+}
+
+/**
+ * Check if PTRACE_SECCOMP_GET_FILTER can succeed, the kernel requires
+ * CAP_SYS_ADMIN and a caller without filters of its own
+ */
+static int stack_can_fetch(void) {
+  FILE *status = fopen("/proc/self/status", "re");
+  if (!status) {
+    return 0;
+  }
+
+  char line[256];
+  unsigned long long caps = 0;
+  int mode = -1;
+  while (fgets(line, sizeof(line), status)) {
+    sscanf(line, "CapEff: %llx", &caps);
+    sscanf(line, "Seccomp: %d", &mode);
+  }
+  fclose(status);
+
+  return mode == SECCOMP_MODE_DISABLED && (caps & (1ULL << CAP_SYS_ADMIN)) != 0;
+}
+
+/**
+ * Stop a process with PTRACE_SEIZE and PTRACE_INTERRUPT
+ * @return 0 on success, -1 with errno set
+ */
+static int stack_attach(pid_t pid, long options) {
+  int status = 0;
+  if (ptrace(PTRACE_SEIZE, pid, NULL, (void *) options) != 0) {
+    return -1;
+  }
+
+  if (ptrace(PTRACE_INTERRUPT, pid, NULL, NULL) != 0) {
+    int error = errno;
+    ptrace(PTRACE_DETACH, pid, NULL, NULL);
+    errno = error;
+    return -1;
+  }
+
+  while (waitpid(pid, &status, __WALL) < 0) {
+    if (errno != EINTR) {
+      return -1;
+    }
+  }
+
+  return WIFSTOPPED(status) ? 0 : -1;
+}
+
+/**
+ * Fetch the filters of a stopped tracee into the given list
+ * @return Number of filters read
+ */
+static int stack_fetch(pid_t pid, PyObject *filters) {
+  Py_ssize_t index = 0;
+  for (index = 0; index < PyList_GET_SIZE(filters); index++) {
+    long count = ptrace(PTRACE_SECCOMP_GET_FILTER, pid, (void *) index, NULL);
+    if (count <= 0) {
+      break;
+    }
+
+    struct sock_filter *insns = malloc(count * sizeof(struct sock_filter));
+    if (!insns) {
+      break;
+    }
+
+    if (ptrace(PTRACE_SECCOMP_GET_FILTER, pid, (void *) index, insns) == count) {
+      // The load flags are not reported, use the defaults
+      PyObject *program = Program_create(insns, count, 0, 1);
+      if (program) {
+        PyList_SetItem(filters, index, program);
+      }
+      else {
+        PyErr_Clear();
+      }
+    }
+    free(insns);
+  }
+
+  return (int) index;
+}
+
+PyObject * seccomplite_loaded_filters(PyObject *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames) {
+  int pid = 0;
+  static char *kwlist[] = {"pid", NULL};
+  if (!seccomplite_parse_vector(args, nargs, kwnames, "|i:loaded_filters", kwlist, &pid)) {
+    return NULL;
+  }
+
+  int count = stack_status_filters(pid);
+  if (count < 0) {
+    Py_RETURN_NONE;
+  }
+
+  PyObject *filters = PyList_New(count);
+  if (!filters) {
+    return NULL;
+  }
+
+  Py_ssize_t index = 0;
+  for (index = 0; index < count; index++) {
+    Py_INCREF(Py_None);
+    PyList_SET_ITEM(filters, index, Py_None);
+  }
+
+  // A filtered caller, e.g. with its own filters, can never read any.  No
+  // child is forked since the filters may not allow clone.
+  if (count == 0 || !pid || pid == getpid() || !stack_can_fetch()) {
+    return filters;
+  }
+
+  if (stack_attach(pid, 0) == 0) {
+    stack_fetch(pid, filters);
+    ptrace(PTRACE_DETACH, pid, NULL, NULL);
+  }
+  return filters;
+}
+
+PyObject * seccomplite_plan_stack(PyObject *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames) {
+  PyObject *filters = NULL;
+  static char *kwlist[] = {"filters", NULL};
+  if (!seccomplite_parse_vector(args, nargs, kwnames, "O:plan_stack", kwlist, &filters)) {
+    return NULL;
+  }
+
+  PyObject *sequence = PySequence_Fast(filters, "filters must be a sequence");
+  if (!sequence) {
+    return NULL;
+  }
+
+  Py_ssize_t count = PySequence_Fast_GET_SIZE(sequence);
+  if (count == 0) {
+    Py_DECREF(sequence);
+    PyErr_SetString(PyExc_ValueError, "At least one filter is required");
+    return NULL;
+  }
+
+  PyObject *programs = PyTuple_New(count);
+  struct sock_fprog *fprogs = PyMem_Malloc(count * sizeof(struct sock_fprog));
+  if (!programs || !fprogs) {
+    Py_DECREF(sequence);
+    Py_XDECREF(programs);
+    PyMem_Free(fprogs);
+    return PyErr_NoMemory();
+  }
+
+  // The kernel evaluates the most recently loaded filter first
+  PyObject *seccomplite = PyState_FindModule(&SeccompLiteModule);
+  PyObject *type = PyDict_GetItemString(PyModule_GetDict(seccomplite), FILTER_TYPE_NAME);
+  uint32_t flags = 0;
+  int nnp = 0;
+  Py_ssize_t index = 0;
+  for (index = 0; index < count; index++) {
+    PyObject *item = PySequence_Fast_GET_ITEM(sequence, index);
+    PyObject *program = NULL;
+    if (PyObject_IsProgram(item)) {
+      Py_INCREF(item);
+      program = item;
+    }
+    else if (PyObject_IsInstance(item, type) == 1) {
+      program = Filter_compile((seccomplite_FilterObject *) item);
+    }
+    else {
+      PyErr_SetString(PyExc_TypeError, "Stacks are made of " FILTER_TYPE_NAME " or " PROGRAM_TYPE_NAME " objects");
+    }
+
+    if (program && ((seccomplite_ProgramObject *) program)->_len > BPF_MAXINSNS) {
+      Py_CLEAR(program);
+      PyErr_SetString(PyExc_ValueError, "Program exceeds the kernel limit, see Filter.split()");
+    }
+
+    if (!program) {
+      Py_DECREF(sequence);
+      Py_DECREF(programs);
+      PyMem_Free(fprogs);
+      return NULL;
+    }
+
+    seccomplite_ProgramObject *compiled = (seccomplite_ProgramObject *) program;
+    PyTuple_SET_ITEM(programs, index, program);
+    fprogs[count - 1 - index].len = (unsigned short) compiled->_len;
+    fprogs[count - 1 - index].filter = compiled->_insns;
+    flags |= compiled->_flags;
+    nnp |= compiled->_nnp;
+  }
+  Py_DECREF(sequence);
+
+  struct sock_filter *insns = NULL;
+  unsigned int len = 0;
+  int rc = 0;
+  Py_BEGIN_ALLOW_THREADS
+  rc = seccomplite_stack_compose(fprogs, count, &insns, &len);
+  Py_END_ALLOW_THREADS
+  PyMem_Free(fprogs);
+  Py_DECREF(programs);
+
+  if (rc == -EINVAL) {
+    PyErr_SetString(PyExc_ValueError, "Programs returning computed values can not be planned");
+    return NULL;
+  }
+  else if (rc != 0) {
+    return PyErr_NoMemory();
+  }
+  else if (len > BPF_MAXINSNS) {
+    // Every distinct return value adds a copy of the programs after it
+    free(insns);
+    PyErr_SetString(PyExc_ValueError, "Planned stack exceeds the kernel limit, see Filter.split()");
+    return NULL;
+  }
+
+  PyObject *result = Program_create(insns, len, flags, nnp);
+  free(insns);
+  return result;
+}
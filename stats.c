@@ -0,0 +1,143 @@
+/*
+ * Call statistics in seccomplite library
+ * Author: Michael Witt <m.witt@htw-berlin.de>
+ *
+ * The counters are updated with relaxed atomics, the libseccomp calls
+ * also run on fan-out worker threads without the GIL.  A snapshot taken
+ * while calls are in flight can be off by those calls.
+ */
+
+#include <Python.h>
+#include <stdlib.h>
+#include <string.h>
+#include "inc/seccomplite.h"
+#include "inc/stats.h"
+
+/**
+ * Counters of one operation
+ */
+typedef struct {
+  uint64_t calls;
+  uint64_t errors;
+  uint64_t total;
+  uint64_t min;
+  uint64_t max;
+  uint64_t buckets[SECCOMPLITE_STATS_BUCKETS];
+} stats_counter;
+
+const char *seccomplite_stats_names[SECCOMPLITE_STATS_OPS] = {
+  "init", "rule_add", "merge", "load", "export_pfc", "export_bpf"
+};
+
+int seccomplite_stats_enabled = 0;
+
+static stats_counter stats_counters[SECCOMPLITE_STATS_OPS];
+
+void seccomplite_stats_record(int op, uint64_t ns, int rc) {
+  stats_counter *counter = &stats_counters[op];
+  unsigned int bucket = ns > 1 ? 63 - __builtin_clzll(ns) : 0;
+  if (bucket >= SECCOMPLITE_STATS_BUCKETS) {
+    bucket = SECCOMPLITE_STATS_BUCKETS - 1;
+  }
+
+  __atomic_fetch_add(&counter->calls, 1, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&counter->total, ns, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&counter->buckets[bucket], 1, __ATOMIC_RELAXED);
+  if (rc != 0) {
+    __atomic_fetch_add(&counter->errors, 1, __ATOMIC_RELAXED);
+  }
+
+  // The minimum starts at 0 for an empty counter
+  uint64_t seen = __atomic_load_n(&counter->min, __ATOMIC_RELAXED);
+  while ((seen == 0 || ns < seen) && !__atomic_compare_exchange_n(&counter->min, &seen, ns ? ns : 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+  seen = __atomic_load_n(&counter->max, __ATOMIC_RELAXED);
+  while (ns > seen && !__atomic_compare_exchange_n(&counter->max, &seen, ns, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
+
+void seccomplite_stats_setup(void) {
+#ifndef SECCOMPLITE_NO_STATS
+  const char *value = getenv("SECCOMPLITE_STATS");
+  seccomplite_stats_enabled = value && *value && strcmp(value, "0") != 0;
+#endif
+}
+
+/**
+ * Build the dict of one operation
+ * @return New reference, NULL on error
+ */
+static PyObject * stats_entry(const stats_counter *counter) {
+  PyObject *histogram = PyDict_New();
+  unsigned int bucket = 0;
+  for (bucket = 0; histogram && bucket < SECCOMPLITE_STATS_BUCKETS; bucket++) {
+    uint64_t count = __atomic_load_n(&counter->buckets[bucket], __ATOMIC_RELAXED);
+    if (count == 0) {
+      continue;
+    }
+
+    PyObject *key = PyLong_FromUnsignedLongLong(2ULL << bucket);
+    PyObject *value = PyLong_FromUnsignedLongLong(count);
+    if (!key || !value || PyDict_SetItem(histogram, key, value) != 0) {
+      Py_CLEAR(histogram);
+    }
+    Py_XDECREF(key);
+    Py_XDECREF(value);
+  }
+
+  if (!histogram) {
+    return NULL;
+  }
+
+  return Py_BuildValue("{s:K,s:K,s:K,s:K,s:K,s:N}",
+    "calls", (unsigned long long) __atomic_load_n(&counter->calls, __ATOMIC_RELAXED),
+    "errors", (unsigned long long) __atomic_load_n(&counter->errors, __ATOMIC_RELAXED),
+    "total_ns", (unsigned long long) __atomic_load_n(&counter->total, __ATOMIC_RELAXED),
+    "min_ns", (unsigned long long) __atomic_load_n(&counter->min, __ATOMIC_RELAXED),
+    "max_ns", (unsigned long long) __atomic_load_n(&counter->max, __ATOMIC_RELAXED),
+    "histogram", histogram);
+}
+
+PyObject * seccomplite_stats(PyObject *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames) {
+  int reset = 0;
+  static char *kwlist[] = {"reset", NULL};
+  if (!seccomplite_parse_vector(args, nargs, kwnames, "|p:stats", kwlist, &reset)) {
+    return NULL;
+  }
+
+  PyObject *result = PyDict_New();
+  int op = 0;
+  for (op = 0; result && op < SECCOMPLITE_STATS_OPS; op++) {
+    if (__atomic_load_n(&stats_counters[op].calls, __ATOMIC_RELAXED) == 0) {
+      continue;
+    }
+
+    PyObject *entry = stats_entry(&stats_counters[op]);
+    if (!entry || PyDict_SetItemString(result, seccomplite_stats_names[op], entry) != 0) {
+      Py_CLEAR(result);
+    }
+    Py_XDECREF(entry);
+  }
+
+  if (result && reset) {
+    memset(stats_counters, 0, sizeof(stats_counters));
+  }
+
+  return result;
+}
+
+PyObject * seccomplite_stats_enable(PyObject *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames) {
+  int enabled = 1;
+  static char *kwlist[] = {"enabled", NULL};
+  if (!seccomplite_parse_vector(args, nargs, kwnames, "|p:stats_enable", kwlist, &enabled)) {
+    return NULL;
+  }
+
+#ifdef SECCOMPLITE_NO_STATS
+  if (enabled) {
+    PyErr_SetString(PyExc_RuntimeError, "Statistics are compiled out (SECCOMPLITE_NO_STATS)");
+    return NULL;
+  }
+#endif
+
+  int previous = __atomic_exchange_n(&seccomplite_stats_enabled, enabled, __ATOMIC_RELAXED);
+  return PyBool_FromLong(previous);
+}
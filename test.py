@@ -1,5 +1,6 @@
 #!/usr/bin/python3
 import seccomplite
+import pickle
 
 print("Show contents of seccomplite")
 print(dir(seccomplite))
@@ -34,3 +35,327 @@ print("-- arg: {}, op: {}, datum_a: {}, datum_b: {}".format(arg.arg, arg.op, arg
 print("Another New object for Arg")
 arg = seccomplite.Arg(4, seccomplite.NE, datum_b=100, datum_a=400)
 print("-- arg: {}, op: {}, datum_a: {}, datum_b: {}".format(arg.arg, arg.op, arg.datum_a, arg.datum_b))
+
+print("Filter template:")
+template = seccomplite.Filter(seccomplite.KILL)
+template.add_rule(seccomplite.ALLOW, "read", seccomplite.Arg(0, seccomplite.EQ, seccomplite.Placeholder("fd")))
+template.add_rule(seccomplite.ALLOW, "exit_group")
+print("  placeholders: {}".format(template.placeholders))
+program = template.instantiate(fd=7)
+print("  instructions: {}, first: {}".format(len(program), program[0]))
+masked = seccomplite.Filter(seccomplite.KILL)
+masked.add_rule(seccomplite.ALLOW, "mmap", seccomplite.Arg(2, seccomplite.MASKED_EQ, seccomplite.Placeholder("mask"), seccomplite.Placeholder("value")))
+direct = seccomplite.Filter(seccomplite.KILL)
+direct.add_rule(seccomplite.ALLOW, "mmap", seccomplite.Arg(2, seccomplite.MASKED_EQ, 0xff, 0x12))
+print("  masked_eq: {}".format(masked.instantiate(mask=0xff, value=0x12).tobytes() == direct.compile().tobytes()))
+print("  masked_eq pickled: {}".format(pickle.loads(pickle.dumps(masked)).instantiate(mask=0xff, value=0x12).tobytes() == direct.compile().tobytes()))
+x86 = seccomplite.Filter(seccomplite.KILL)
+x86.add_arch(seccomplite.Arch.X86)
+x86.remove_arch(seccomplite.Arch.NATIVE)
+x86.add_rule(seccomplite.ALLOW, "read", seccomplite.Arg(0, seccomplite.EQ, seccomplite.Placeholder("fd")))
+direct = seccomplite.Filter(seccomplite.KILL)
+direct.add_arch(seccomplite.Arch.X86)
+direct.remove_arch(seccomplite.Arch.NATIVE)
+direct.add_rule(seccomplite.ALLOW, "read", seccomplite.Arg(0, seccomplite.EQ, 7))
+print("  x86: {}".format(x86.instantiate(fd=7).tobytes() == direct.compile().tobytes()))
+ordered = seccomplite.Filter(seccomplite.KILL)
+ordered.add_rule(seccomplite.ALLOW, "close", seccomplite.Arg(0, seccomplite.GE, seccomplite.Placeholder("a")))
+ordered.add_rule(seccomplite.ERRNO(5), "close", seccomplite.Arg(0, seccomplite.LE, seccomplite.Placeholder("b")))
+direct = seccomplite.Filter(seccomplite.KILL)
+direct.add_rule(seccomplite.ALLOW, "close", seccomplite.Arg(0, seccomplite.GE, 10))
+direct.add_rule(seccomplite.ERRNO(5), "close", seccomplite.Arg(0, seccomplite.LE, 1))
+verdict = ordered.instantiate(a=10, b=1).evaluate("close", args=(4,))[0]
+print("  ordered: {:#x}, direct: {:#x}".format(verdict, direct.compile().evaluate("close", args=(4,))[0]))
+rejected = seccomplite.Filter(seccomplite.KILL)
+try:
+    rejected.add_rule(seccomplite.KILL, "close", seccomplite.Arg(0, seccomplite.EQ, seccomplite.Placeholder("x")))
+except RuntimeError:
+    pass
+print("  rejected rule placeholders: {}".format(rejected.placeholders))
+arg = seccomplite.Arg(0, seccomplite.EQ, seccomplite.Placeholder("fd"))
+arg.datum_a = 5
+print("  datum_a: {}, placeholder_a: {}".format(arg.datum_a, arg.placeholder_a))
+
+print("Frozen filter:")
+frozen = seccomplite.Filter(seccomplite.KILL)
+frozen.add_rule(seccomplite.ALLOW, "exit_group")
+frozen.freeze()
+print("  frozen: {}, digest: {:#x}, instructions: {}".format(frozen.frozen, frozen.digest, len(frozen.compile())))
+
+print("Interning registry:")
+first = seccomplite.Filter(seccomplite.KILL)
+first.add_rule(seccomplite.ALLOW, "exit_group")
+second = seccomplite.Filter(seccomplite.KILL)
+second.add_rule(seccomplite.ALLOW, "exit_group")
+print("  shared: {}, stats: {}".format(first.intern() is second.intern(), seccomplite.intern_stats()))
+reordered = seccomplite.Filter(seccomplite.KILL)
+reordered.add_rule(seccomplite.ALLOW, "write")
+reordered.add_rule(seccomplite.ALLOW, "exit_group")
+duplicated = seccomplite.Filter(seccomplite.KILL)
+duplicated.add_rule(seccomplite.ALLOW, "exit_group")
+duplicated.add_rule(seccomplite.ALLOW, "write")
+duplicated.add_rule(seccomplite.ALLOW, "exit_group")
+print("  order independent: {}".format(reordered.digest == duplicated.digest and reordered.intern() is duplicated.intern()))
+
+print("Program in memfd:")
+memfd = frozen.compile().to_memfd()
+print("  mapped program equal: {}".format(seccomplite.Program.from_fd(memfd).tobytes() == frozen.compile().tobytes()))
+
+print("Pickled filter:")
+restored = pickle.loads(pickle.dumps(template))
+print("  state bytes: {}, placeholders: {}".format(len(pickle.dumps(template)), restored.placeholders))
+
+print("Fan-out filter:")
+fanout = seccomplite.Filter(seccomplite.KILL, fanout=True)
+fanout.add_rule(seccomplite.ALLOW, "exit_group")
+fanout.add_arch(seccomplite.Arch.X86)
+fanout.add_arch(seccomplite.Arch.AARCH64)
+print("  fanout: {}, instructions: {}".format(fanout.fanout, len(fanout.compile())))
+
+print("Split filter:")
+large = seccomplite.Filter(seccomplite.KILL)
+for offset, syscall in enumerate(("read", "write", "close", "fstat", "lseek")):
+  for fd in range(8):
+    large.add_rule(seccomplite.ALLOW, syscall, seccomplite.Arg(0, seccomplite.EQ, fd * 1000 + offset))
+programs, cost = large.split(limit=64, report=True)
+print("  filters: {}, cost of read: {}".format(len(programs), cost["read"]))
+print("  read(3): {:#x}".format(programs[-1].evaluate("read", args=(3000,))[0]))
+
+print("Filter stack:")
+outer = seccomplite.Filter(seccomplite.ALLOW)
+outer.add_rule(seccomplite.ERRNO(1), "getuid")
+inner = seccomplite.Filter(seccomplite.ALLOW)
+inner.add_rule(seccomplite.ERRNO(2), "getuid")
+planned = seccomplite.plan_stack([outer, inner])
+print("  loaded filters: {}, planned getuid: {:#x}".format(seccomplite.loaded_filters(), planned.evaluate("getuid")[0]))
+stack = []
+for layers in range(6):
+  layer = seccomplite.Filter(seccomplite.ALLOW)
+  for fd in range(120):
+    layer.add_rule(seccomplite.ERRNO(fd % 7 + 1), "write", seccomplite.Arg(0, seccomplite.EQ, fd))
+  stack.append(layer)
+try:
+  seccomplite.plan_stack(stack)
+  print("  oversized plan: accepted")
+except ValueError as error:
+  print("  oversized plan: {}".format(error))
+
+print("Peephole optimiser:")
+optimized, stats = large.compile().optimize(report=True)
+print("  instructions: {} -> {}, verified: {}".format(stats["before"], stats["after"], stats["verified"]))
+fanout.add_rule(seccomplite.ALLOW, "close", seccomplite.Arg(0, seccomplite.LT, 1024))
+shared, stats = fanout.compile().optimize(report=True, share_blocks=True)
+print("  shared blocks: {} -> {}, verified: {}".format(stats["before"], stats["after"], stats["verified"]))
+plain = fanout.intern()
+fanout.share_blocks = True
+print("  interned with share_blocks: {} -> {}".format(len(plain), len(fanout.intern())))
+fanout.share_blocks = False
+
+print("Rule simplification:")
+redundant = seccomplite.Filter(seccomplite.KILL)
+redundant.add_rule(seccomplite.ALLOW, "write", seccomplite.Arg(0, seccomplite.EQ, 1))
+redundant.add_rule(seccomplite.ALLOW, "write")
+redundant.add_rule(seccomplite.ALLOW, "read", seccomplite.Arg(0, seccomplite.LT, 10))
+redundant.add_rule(seccomplite.ALLOW, "read", seccomplite.Arg(0, seccomplite.LT, 5))
+findings = redundant.simplify(rewrite=True)
+print("  findings: {}, left: {}".format([(finding["kind"], finding["rule"]) for finding in findings], len(redundant.simplify())))
+
+import os
+print("Flag masks:")
+flags = seccomplite.Filter(seccomplite.KILL)
+for value in (0, os.O_CLOEXEC, os.O_NONBLOCK, os.O_CLOEXEC | os.O_NONBLOCK):
+  flags.add_rule(seccomplite.ALLOW, "openat", seccomplite.Arg(2, seccomplite.EQ, value))
+print("  collapsed: {}".format([finding["kind"] for finding in flags.simplify(rewrite=True)]))
+subset = seccomplite.Arg.flags_subset(2, os.O_CLOEXEC | os.O_NONBLOCK)
+print("  flags_subset: op {}, mask {:#x}".format(subset.op, subset.datum_a))
+
+import array
+import struct
+print("Rule set:")
+bulk = seccomplite.RuleSet()
+bulk.append(seccomplite.ALLOW, "read", seccomplite.Arg(0, seccomplite.EQ, 0))
+bulk.append(seccomplite.ALLOW, "write")
+actions = array.array('I', [rule[0] for rule in bulk])
+syscalls = array.array('i', [rule[1] for rule in bulk])
+comparisons = struct.pack('=IiQQ', 0, seccomplite.EQ, 0, 0) + struct.pack('=IiQQ', 0, 0, 0, 0)
+columns = seccomplite.RuleSet(actions, syscalls, comparisons, bytes([1, 0]))
+appended = seccomplite.Filter(seccomplite.KILL)
+appended.add_rules(bulk)
+viewed = seccomplite.Filter(seccomplite.KILL)
+viewed.add_rules(columns)
+print("  rules: {}, zero copy: {}, same program: {}".format(len(columns), columns.zero_copy, appended.compile().tobytes() == viewed.compile().tobytes()))
+
+print("Builtin policies:")
+print("  embedded: {}".format(sorted(seccomplite.builtin_policies)))
+
+print("Trace profile:")
+profiled = seccomplite.Filter(seccomplite.KILL)
+profiled.add_rule(seccomplite.ALLOW, "read", seccomplite.Arg(0, seccomplite.EQ, 0))
+profiled.add_rule(seccomplite.ALLOW, "write")
+profiled.add_rule(seccomplite.ALLOW, "close")
+native = seccomplite.system_arch()
+def record(name, *args):
+  return struct.pack('=iIQ6QIIQ', seccomplite.resolve_syscall(native, name), native, 0, *(args + (0,) * (6 - len(args))), os.getpid(), 0, 0)
+profile = profiled.profile(record("read", 0) * 2 + record("write", 1) + record("getpid"))
+print("  records: {}, undecided: {}, decided: {}, unused: {}".format(profile["records"], profile["undecided"], [rule["decided"] for rule in profile["rules"]], profile["unused"]))
+
+print("Call statistics:")
+previous = seccomplite.stats_enable()
+timed = seccomplite.Filter(seccomplite.KILL)
+timed.add_rule(seccomplite.ALLOW, "read")
+timed.compile()
+calls = seccomplite.stats(reset=True)
+seccomplite.stats_enable(previous)
+print("  operations: {}, rule_add calls: {}".format(sorted(calls), calls["rule_add"]["calls"]))
+
+print("Filter diff:")
+before = seccomplite.Filter(seccomplite.KILL)
+before.add_rule(seccomplite.ALLOW, "read", seccomplite.Arg(0, seccomplite.LT, 10))
+before.add_rule(seccomplite.ALLOW, "write")
+after = seccomplite.Filter(seccomplite.KILL)
+after.add_rule(seccomplite.ALLOW, "write")
+after.add_rule(seccomplite.ALLOW, "read", seccomplite.Arg(0, seccomplite.LE, 10))
+print("  equal: {}, changed: {}".format(before.diff(before), [(change["syscall"], change["args"]) for change in before.diff(after)]))
+commands = seccomplite.Filter(seccomplite.KILL)
+for command in range(200):
+  commands.add_rule(seccomplite.ALLOW, "ioctl", seccomplite.Arg(1, seccomplite.EQ, command))
+pairs = seccomplite.Filter(seccomplite.KILL)
+for fd in range(300):
+  pairs.add_rule(seccomplite.ALLOW, "ioctl", seccomplite.Arg(0, seccomplite.EQ, fd), seccomplite.Arg(1, seccomplite.EQ, fd * 3))
+print("  large filters equal: {}, {}".format(commands.diff(commands), pairs.diff(pairs)))
+
+print("Cached program:")
+cached = seccomplite.Filter(seccomplite.KILL)
+cached.add_rule(seccomplite.ALLOW, "read")
+generation = cached.generation
+first_program = cached.compile()
+cached.export_bpf(open(os.devnull, "w"))
+reused = cached.compile() is first_program
+cached.add_rule(seccomplite.ALLOW, "write")
+print("  reused: {}, modifications: {}, recompiled: {}".format(reused, cached.generation - generation, cached.compile() is not first_program))
+
+import socket
+import tempfile
+print("File-open broker:")
+shared_dir = tempfile.mkdtemp()
+with open(os.path.join(shared_dir, "data"), "w") as handle:
+  handle.write("brokered")
+parent, child = socket.socketpair()
+pid = os.fork()
+if pid == 0:
+  brokered = seccomplite.Filter(seccomplite.ALLOW)
+  brokered.add_rule(seccomplite.NOTIFY, "openat")
+  socket.send_fds(child, [b"l"], [brokered.load()])
+  results = []
+  for path in (os.path.join(shared_dir, "data"), "/etc/passwd"):
+    try:
+      with open(path) as handle:
+        results.append(handle.read())
+    except PermissionError:
+      results.append("denied")
+  child.send(",".join(results).encode())
+  os._exit(0)
+_, listeners, _, _ = socket.recv_fds(parent, 1, 1)
+broker = seccomplite.Broker({shared_dir: "r"})
+broker.start(listeners[0])
+os.close(listeners[0])
+answers = parent.recv(64).decode()
+os.waitpid(pid, 0)
+broker.stop()
+print("  child: {}, served: {}, denied: {}".format(answers, broker.served, broker.denied))
+synced_read, synced_write = os.pipe()
+pid = os.fork()
+if pid == 0:
+  synced = seccomplite.Filter(seccomplite.ALLOW)
+  synced.set_attr(seccomplite.Attr.CTL_TSYNC, 1)
+  synced.add_rule(seccomplite.NOTIFY, "getppid")
+  os.write(synced_write, b"1" if synced.load() >= 0 else b"0")
+  os._exit(0)
+os.waitpid(pid, 0)
+print("  listener with TSYNC: {}".format(os.read(synced_read, 1) == b"1"))
+os.close(synced_read)
+pid = os.fork()
+if pid == 0:
+  sandboxed = seccomplite.Filter(seccomplite.ALLOW)
+  sandboxed.add_rule(seccomplite.KILL, "clone")
+  sandboxed.add_rule(seccomplite.KILL, "clone3")
+  sandboxed.load()
+  os._exit(0 if seccomplite.loaded_filters() == [None] else 1)
+print("  loaded filters without clone: {}".format(os.waitpid(pid, 0)[1]))
+os.close(synced_write)
+
+print("Trace recorder:")
+with tempfile.TemporaryFile() as trace_file:
+  recorded = seccomplite.record_trace(trace_file, ["sh", "-c", "exit 3"], index_interval=16)
+  trace_file.seek(0)
+  trace = trace_file.read()
+blocks = seccomplite.trace_index(trace)
+replayed = seccomplite.Filter(seccomplite.ALLOW).profile(trace)
+print("  returncode: {}, indexed: {}, replayed: {}".format(recorded["returncode"], sum(block["records"] for block in blocks) == recorded["records"], replayed["records"] == recorded["records"]))
+
+import threading
+print("Shadow mode:")
+shadowed = seccomplite.Filter(seccomplite.ALLOW)
+shadowed.add_rule(seccomplite.ERRNO(1), "getppid")
+outcome = []
+def canary():
+  shadowed.load(shadow=True)
+  outcome.append(os.getppid() == os.getppid())
+worker = threading.Thread(target=canary)
+worker.start()
+worker.join()
+report = shadowed.shadow_report()
+print("  allowed: {}, violations: {}".format(outcome[0], [(entry["syscall"], entry["count"]) for entry in report["syscalls"]]))
+restored = seccomplite.Filter(seccomplite.ALLOW)
+restored.add_rule(seccomplite.ERRNO(1), "getppid")
+def restore():
+  restored.load(shadow=True)
+  restored.__setstate__(seccomplite.Filter(seccomplite.ALLOW).__reduce__()[2])
+  os.getppid()
+worker = threading.Thread(target=restore)
+worker.start()
+worker.join()
+print("  counted after __setstate__: {}".format(restored.shadow_report()["violations"]))
+del restored
+
+print("Compile server:")
+server = seccomplite.CompileServer(os.path.join(tempfile.mkdtemp(), "compile.sock"))
+served_filter = seccomplite.Filter(seccomplite.ALLOW)
+served_filter.add_rule(seccomplite.ERRNO(1), "getppid")
+server.prewarm([served_filter])
+server.start()
+stalled = socket.socket(socket.AF_UNIX)
+stalled.connect(server.path)
+fetched = seccomplite.Filter(seccomplite.ALLOW)
+fetched.add_rule(seccomplite.ERRNO(1), "getppid")
+fetched.compile_server = server.path
+same = fetched.compile().tobytes() == served_filter.compile().tobytes()
+server.stop()
+stalled.close()
+print("  same program: {}, requests: {}, hits: {}".format(same, server.requests, server.hits))
+forger = socket.socket(socket.AF_UNIX)
+forger.bind(os.path.join(tempfile.mkdtemp(), "forged.sock"))
+forger.listen(1)
+def forge():
+  conn, _ = forger.accept()
+  magic, version, options, length = struct.unpack("=IHHI", conn.recv(12, socket.MSG_WAITALL))
+  conn.recv(length, socket.MSG_WAITALL)
+  allow_all = os.memfd_create("forged")
+  os.write(allow_all, struct.pack("=HBBI", 0x06, 0, 0, seccomplite.ALLOW))
+  socket.send_fds(conn, [struct.pack("=IiIIIIQ", magic, 0, 0, 1, 1, options, 0)], [allow_all])
+  os.close(allow_all)
+  conn.close()
+worker = threading.Thread(target=forge)
+worker.start()
+forged = seccomplite.Filter(seccomplite.ALLOW)
+forged.add_rule(seccomplite.ERRNO(1), "getppid")
+forged.compile_server = forger.getsockname()
+program = forged.compile()
+worker.join()
+forger.close()
+print("  forged reply rejected: {}".format(program.tobytes() == served_filter.compile().tobytes()))
+
+print("Syscall translation:")
+numbers = array.array("i", [seccomplite.resolve_syscall("x86", "read"), seccomplite.resolve_syscall("x86", "socketcall")])
+translated = array.array("i", seccomplite.translate_syscalls(numbers, "x86", "x86_64"))
+print("  read: {}, socketcall: {}".format(translated[0] == seccomplite.resolve_syscall("x86_64", "read"), translated[1]))